@@ -0,0 +1,127 @@
+#include <examples/ace/logging/shipper.h>
+
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using logging::LogShipper;
+
+// Many senders ship lines to ace_logging_server as fast as they can, each
+// with a connection and a loop of its own, as many processes would.
+//
+//   ace_logging_server 50000 4 &
+//   ace_logging_bench 127.0.0.1 50000 16 256
+
+const char kLine[] = "20261019 05:00:00.123456Z  4242 INFO  "
+                     "Hello 0123456789 abcdefghijklmnopqrstuvwxyz - bench.cc:42\n";
+const int kLineLength = sizeof kLine - 1;
+const int kBatchSize = 1024*1024 / kLineLength * kLineLength;
+
+void send(LogShipper* shipper, const string* batch, int batches)
+{
+  for (int i = 0; i < batches; ++i)
+  {
+    shipper->write(batch->data(), static_cast<int>(batch->size()));
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    printf("usage: %s server_ip server_port [senders] [megabytes_each] [compress]\n", argv[0]);
+    return 0;
+  }
+
+  uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+  InetAddress serverAddr(argv[1], port);
+  int senders = argc > 3 ? atoi(argv[3]) : 8;
+  int batches = argc > 4 ? atoi(argv[4]) : 128;
+  bool compress = argc > 5 && atoi(argv[5]) != 0;
+
+  string batch;
+  while (batch.size() < static_cast<size_t>(kBatchSize))
+  {
+    batch.append(kLine, kLineLength);
+  }
+
+  boost::ptr_vector<EventLoopThread> loops;
+  boost::ptr_vector<LogShipper> shippers;
+  for (int i = 0; i < senders; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "ace_logging_bench.%d", i);
+    loops.push_back(new EventLoopThread);
+    shippers.push_back(new LogShipper(loops.back().startLoop(), serverAddr, name));
+    shippers.back().setBlockSeconds(10.0);
+    shippers.back().setCompression(compress);
+    shippers.back().start();
+  }
+
+  for (int i = 0; i < senders; ++i)
+  {
+    for (int n = 0; n < 300 && !shippers[i].stats().connected; ++n)
+    {
+      CurrentThread::sleepUsec(10*1000);
+    }
+    if (!shippers[i].stats().connected)
+    {
+      printf("sender %d not connected, lines go to its spill file\n", i);
+    }
+  }
+
+  Timestamp start(Timestamp::now());
+  boost::ptr_vector<Thread> threads;
+  for (int i = 0; i < senders; ++i)
+  {
+    threads.push_back(new Thread(boost::bind(send, &shippers[i], &batch, batches)));
+    threads.back().start();
+  }
+  for (int i = 0; i < senders; ++i)
+  {
+    threads[i].join();
+  }
+  // until all are written to the sockets
+  for (int i = 0; i < senders; ++i)
+  {
+    while (shippers[i].stats().connected && shippers[i].stats().pendingBytes > 0)
+    {
+      CurrentThread::sleepUsec(1000);
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+
+  int64_t shipped = 0;
+  int64_t spilled = 0;
+  int64_t dropped = 0;
+  for (int i = 0; i < senders; ++i)
+  {
+    LogShipper::Stats stats = shippers[i].stats();
+    shipped += stats.shippedBytes;
+    spilled += stats.spilledBytes;
+    dropped += stats.droppedBytes;
+  }
+  double mbytes = static_cast<double>(shipped) / 1024 / 1024;
+  printf("%d senders, %.1f MiB in %.3f seconds, %.1f MiB/s, %.0f lines/s\n",
+         senders, mbytes, seconds, mbytes / seconds,
+         static_cast<double>(shipped / kLineLength) / seconds);
+  printf("spilled %lld bytes, dropped %lld bytes\n",
+         static_cast<long long>(spilled), static_cast<long long>(dropped));
+
+  for (int i = 0; i < senders; ++i)
+  {
+    shippers[i].stop();
+  }
+  CurrentThread::sleepUsec(1000*1000);  // wait for disconnect, then safe to destruct LogShipper (esp. TcpClient).
+  shippers.clear();
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -1,12 +1,10 @@
-#include <examples/ace/logging/logrecord.pb.h>
+#include <examples/ace/logging/shipper.h>
 
-#include <muduo/base/Mutex.h>
+#include <muduo/base/AsyncLogging.h>
 #include <muduo/base/Logging.h>
 #include <muduo/base/ProcessInfo.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/EventLoopThread.h>
-#include <muduo/net/TcpClient.h>
-#include <muduo/net/protobuf/ProtobufCodecLite.h>
 
 #include <boost/bind.hpp>
 
@@ -16,105 +14,18 @@
 using namespace muduo;
 using namespace muduo::net;
 
-// just to verify the protocol, not for practical usage.
+// Lines typed are logged with LOG_INFO, and shipped to ace_logging_server.
 
-namespace logging
-{
-extern const char logtag[] = "LOG0";
-typedef ProtobufCodecLiteT<LogRecord, logtag> Codec;
+muduo::AsyncLogging* g_asyncLog = NULL;
 
-// same as asio/char/client.cc
-class LogClient : boost::noncopyable
+void asyncOutput(const char* msg, int len)
 {
- public:
-  LogClient(EventLoop* loop, const InetAddress& serverAddr)
-    : client_(loop, serverAddr, "LogClient"),
-      codec_(boost::bind(&LogClient::onMessage, this, _1, _2, _3))
-  {
-    client_.setConnectionCallback(
-        boost::bind(&LogClient::onConnection, this, _1));
-    client_.setMessageCallback(
-        boost::bind(&Codec::onMessage, &codec_, _1, _2, _3));
-    client_.enableRetry();
-  }
-
-  void connect()
-  {
-    client_.connect();
-  }
-
-  void disconnect()
-  {
-    client_.disconnect();
-  }
-
-  void write(const StringPiece& message)
-  {
-    MutexLockGuard lock(mutex_);
-    updateLogRecord(message);
-    if (connection_)
-    {
-      codec_.send(connection_, logRecord_);
-    }
-    else
-    {
-      LOG_WARN << "NOT CONNECTED";
-    }
-  }
-
- private:
-  void onConnection(const TcpConnectionPtr& conn)
-  {
-    LOG_INFO << conn->localAddress().toIpPort() << " -> "
-             << conn->peerAddress().toIpPort() << " is "
-             << (conn->connected() ? "UP" : "DOWN");
-
-    MutexLockGuard lock(mutex_);
-    if (conn->connected())
-    {
-      connection_ = conn;
-      LogRecord_Heartbeat* hb = logRecord_.mutable_heartbeat();
-      hb->set_hostname(ProcessInfo::hostname().c_str());
-      hb->set_process_name(ProcessInfo::procname().c_str());
-      hb->set_process_id(ProcessInfo::pid());
-      hb->set_process_start_time(ProcessInfo::startTime().microSecondsSinceEpoch());
-      hb->set_username(ProcessInfo::username().c_str());
-      updateLogRecord("Heartbeat");
-      codec_.send(connection_, logRecord_);
-      logRecord_.clear_heartbeat();
-      LOG_INFO << "Type message below:";
-    }
-    else
-    {
-      connection_.reset();
-    }
-  }
-
-  void onMessage(const TcpConnectionPtr&,
-                 const MessagePtr& message,
-                 Timestamp)
-  {
-    // SHOULD NOT HAPPEN
-    LogRecord* logRecord = muduo::down_cast<LogRecord*>(message.get());
-    LOG_WARN << logRecord->DebugString();
-  }
-
-  void updateLogRecord(const StringPiece& message)
-  {
-    mutex_.assertLocked();
-    logRecord_.set_level(1);
-    logRecord_.set_thread_id(CurrentThread::tid());
-    logRecord_.set_timestamp(Timestamp::now().microSecondsSinceEpoch());
-    logRecord_.set_message(message.data(), message.size());
-  }
-
-  TcpClient client_;
-  Codec codec_;
-  MutexLock mutex_;
-  LogRecord logRecord_;
-  TcpConnectionPtr connection_;
-};
+  g_asyncLog->append(msg, len);
+}
 
+void stdoutOutput(const char* msg, int len)
+{
+  fwrite(msg, 1, len, stdout);
 }
 
 int main(int argc, char* argv[])
@@ -129,15 +40,30 @@ int main(int argc, char* argv[])
     uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
     InetAddress serverAddr(argv[1], port);
 
-    logging::LogClient client(loopThread.startLoop(), serverAddr);
-    client.connect();
-    std::string line;
-    while (std::getline(std::cin, line))
+    string name = ProcessInfo::procname();
+    logging::LogShipper shipper(loopThread.startLoop(), serverAddr, name);
+    shipper.setCompression(true);
+    shipper.start();
+
     {
-      client.write(line);
+      muduo::AsyncLogging log(name, 0, 1);
+      log.setWriteCallback(boost::bind(&logging::LogShipper::write, &shipper, _1, _2));
+      log.start();
+      g_asyncLog = &log;
+      Logger::setOutput(asyncOutput);
+
+      printf("Type message below:\n");
+      std::string line;
+      while (std::getline(std::cin, line))
+      {
+        LOG_INFO << line;
+      }
+
+      log.stop();
+      Logger::setOutput(stdoutOutput);
     }
-    client.disconnect();
-    CurrentThread::sleepUsec(1000*1000);  // wait for disconnect, then safe to destruct LogClient (esp. TcpClient). Otherwise mutex_ is used after dtor.
+    shipper.stop();
+    CurrentThread::sleepUsec(1000*1000);  // wait for disconnect, then safe to destruct LogShipper (esp. TcpClient).
   }
   google::protobuf::ShutdownProtobufLibrary();
 }
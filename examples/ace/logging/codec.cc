@@ -0,0 +1,6 @@
+#include <examples/ace/logging/codec.h>
+
+namespace logging
+{
+const char logtag[] = "LOG1";
+}
@@ -0,0 +1,14 @@
+#ifndef MUDUO_EXAMPLES_ACE_LOGGING_CODEC_H
+#define MUDUO_EXAMPLES_ACE_LOGGING_CODEC_H
+
+#include <examples/ace/logging/logrecord.pb.h>
+
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+
+namespace logging
+{
+extern const char logtag[];
+typedef muduo::net::ProtobufCodecLiteT<LogBatch, logtag> Codec;
+}
+
+#endif  // MUDUO_EXAMPLES_ACE_LOGGING_CODEC_H
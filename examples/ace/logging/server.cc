@@ -1,14 +1,15 @@
-#include <examples/ace/logging/logrecord.pb.h>
+#include <examples/ace/logging/codec.h>
 
 #include <muduo/base/Atomic.h>
-#include <muduo/base/FileUtil.h>
+#include <muduo/base/LogFile.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Mutex.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
-#include <muduo/net/protobuf/ProtobufCodecLite.h>
 
 #include <boost/bind.hpp>
 
+#include <map>
 #include <stdio.h>
 
 using namespace muduo;
@@ -16,75 +17,139 @@ using namespace muduo::net;
 
 namespace logging
 {
-extern const char logtag[] = "LOG0";
-typedef ProtobufCodecLiteT<LogRecord, logtag> Codec;
+
+typedef boost::shared_ptr<LogFile> LogFilePtr;
+
+// Rolling files of each source, process_name.hostname, shared by sessions
+// of it, eg. one reconnecting before the old one is closed.
+class Sources : boost::noncopyable
+{
+ public:
+  explicit Sources(off_t rollSize)
+    : rollSize_(rollSize)
+  {
+  }
+
+  // Thread safe.
+  LogFilePtr get(const string& source)
+  {
+    MutexLockGuard lock(mutex_);
+    LogFilePtr& file = files_[source];
+    if (!file)
+    {
+      LOG_INFO << "Sources new " << source;
+      // A batch of lines in one append, so the roll is checked every time.
+      // Preallocated files are written in large chunks with pwrite(2).
+      file.reset(new LogFile(source, rollSize_, true, 3, 1, true));
+    }
+    return file;
+  }
+
+  // Flushes the files, LogFile flushes only when appended to, and closes
+  // those of sources without a session.
+  void flush()
+  {
+    std::vector<LogFilePtr> files;
+    {
+      MutexLockGuard lock(mutex_);
+      for (FileMap::iterator it = files_.begin(); it != files_.end(); )
+      {
+        if (it->second.unique())
+        {
+          LOG_INFO << "Sources close " << it->first;
+          files.push_back(it->second);
+          files_.erase(it++);
+        }
+        else
+        {
+          files.push_back(it->second);
+          ++it;
+        }
+      }
+    }
+    // out of the lock, with that of each file
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+      files[i]->flush();
+    }
+  }
+
+ private:
+  typedef std::map<string, LogFilePtr> FileMap;
+
+  const off_t rollSize_;
+  MutexLock mutex_;
+  FileMap files_;
+};
 
 class Session : boost::noncopyable
 {
  public:
-  explicit Session(const TcpConnectionPtr& conn)
+  Session(const TcpConnectionPtr& conn, Sources* sources, AtomicInt64* receivedBytes)
     : codec_(boost::bind(&Session::onMessage, this, _1, _2, _3)),
-      file_(getFileName(conn))
+      sources_(sources),
+      receivedBytes_(receivedBytes)
   {
     conn->setMessageCallback(
         boost::bind(&Codec::onMessage, &codec_, _1, _2, _3));
   }
 
  private:
-
-  // FIXME: duplicate code LogFile
-  // or use LogFile instead
-  string getFileName(const TcpConnectionPtr& conn)
+  static string sourceName(const LogRecord::Heartbeat& hb)
   {
-    string filename;
-    filename += conn->peerAddress().toIp();
-
-    char timebuf[32];
-    struct tm tm;
-    time_t now = time(NULL);
-    gmtime_r(&now, &tm); // FIXME: localtime_r ?
-    strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm);
-    filename += timebuf;
-
-    char buf[32];
-    snprintf(buf, sizeof buf, "%d", globalCount_.incrementAndGet());
-    filename += buf;
-
-    filename += ".log";
-    LOG_INFO << "Session of " << conn->name() << " file " << filename;
-    return filename;
+    string name = hb.process_name().c_str();
+    name += '.';
+    name += hb.hostname().c_str();
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+      if (name[i] == '/')
+      {
+        name[i] = '_';
+      }
+    }
+    return name;
   }
 
   void onMessage(const TcpConnectionPtr& conn,
-                 const MessagePtr& message,
-                 Timestamp time)
+                 const boost::shared_ptr<LogBatch>& batch,
+                 Timestamp)
   {
-    LogRecord* logRecord = muduo::down_cast<LogRecord*>(message.get());
-    if (logRecord->has_heartbeat())
+    if (batch->has_heartbeat())
+    {
+      const LogRecord::Heartbeat& hb = batch->heartbeat();
+      LOG_INFO << conn->name() << " is " << hb.process_name() << " pid " << hb.process_id()
+               << " of " << hb.username() << "@" << hb.hostname();
+      file_ = sources_->get(sourceName(hb));
+    }
+    if (batch->has_lines())
     {
-      // FIXME ?
+      if (!file_)
+      {
+        LOG_WARN << conn->name() << " sends lines before a heartbeat";
+        file_ = sources_->get("unknown." + conn->peerAddress().toIp());
+      }
+      const std::string& lines = batch->lines();
+      file_->append(lines.data(), static_cast<int>(lines.size()));
+      receivedBytes_->add(static_cast<int64_t>(lines.size()));
     }
-    const char* sep = "==========\n";
-    std::string str = logRecord->DebugString();
-    file_.append(str.c_str(), str.size());
-    file_.append(sep, strlen(sep));
-    LOG_DEBUG << str;
   }
 
   Codec codec_;
-  FileUtil::AppendFile file_;
-  static AtomicInt32 globalCount_;
+  Sources* sources_;
+  AtomicInt64* receivedBytes_;
+  LogFilePtr file_;
 };
 typedef boost::shared_ptr<Session> SessionPtr;
 
-AtomicInt32 Session::globalCount_;
-
 class LogServer : boost::noncopyable
 {
  public:
   LogServer(EventLoop* loop, const InetAddress& listenAddr, int numThreads)
     : loop_(loop),
-      server_(loop_, listenAddr, "AceLoggingServer")
+      server_(loop_, listenAddr, "AceLoggingServer"),
+      sources_(kRollSize),
+      lastReceivedBytes_(0),
+      lastTime_(Timestamp::now())
   {
     server_.setConnectionCallback(
         boost::bind(&LogServer::onConnection, this, _1));
@@ -97,14 +162,18 @@ class LogServer : boost::noncopyable
   void start()
   {
     server_.start();
+    loop_->runEvery(3.0, boost::bind(&Sources::flush, &sources_));
+    loop_->runEvery(10.0, boost::bind(&LogServer::printThroughput, this));
   }
 
  private:
+  static const off_t kRollSize = 1024*1024*1024;
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     if (conn->connected())
     {
-      SessionPtr session(new Session(conn));
+      SessionPtr session(new Session(conn, &sources_, &receivedBytes_));
       conn->setContext(session);
     }
     else
@@ -113,8 +182,26 @@ class LogServer : boost::noncopyable
     }
   }
 
+  void printThroughput()
+  {
+    Timestamp now(Timestamp::now());
+    int64_t bytes = receivedBytes_.get();
+    double seconds = timeDifference(now, lastTime_);
+    if (bytes > lastReceivedBytes_)
+    {
+      LOG_INFO << "received " << static_cast<double>(bytes - lastReceivedBytes_) / seconds / 1024 / 1024
+               << " MiB/s, " << bytes << " bytes in total";
+    }
+    lastReceivedBytes_ = bytes;
+    lastTime_ = now;
+  }
+
   EventLoop* loop_;
   TcpServer server_;
+  Sources sources_;
+  AtomicInt64 receivedBytes_;
+  int64_t lastReceivedBytes_;
+  Timestamp lastTime_;
 };
 
 }
@@ -129,5 +216,5 @@ int main(int argc, char* argv[])
   logging::LogServer server(&loop, listenAddr, numThreads);
   server.start();
   loop.loop();
-
+  google::protobuf::ShutdownProtobufLibrary();
 }
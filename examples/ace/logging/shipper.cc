@@ -0,0 +1,301 @@
+#include <examples/ace/logging/shipper.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/base/ProcessInfo.h>
+#include <muduo/net/EventLoop.h>
+
+#include <boost/bind.hpp>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace logging;
+
+namespace
+{
+// of a spill file shipped again
+const size_t kChunkSize = 1024*1024;
+
+// Not to Logger, write() runs in the backend thread of AsyncLogging.
+void printError(const char* what, const string& filename)
+{
+  fprintf(stderr, "LogShipper %s %s: %s\n", what, filename.c_str(), strerror_tl(errno));
+}
+}
+
+LogShipper::LogShipper(EventLoop* loop,
+                       const InetAddress& serverAddr,
+                       const string& name)
+  : loop_(loop),
+    client_(loop, serverAddr, "LogShipper"),
+    codec_(boost::bind(&LogShipper::onMessage, this, _1, _2, _3)),
+    name_(name),
+    spillFilename_(name + ".spill"),
+    maxPendingBytes_(64*1024*1024),
+    blockSeconds_(1.0),
+    maxSpillBytes_(1024*1024*1024),
+    mutex_(),
+    cond_(mutex_),
+    queuedBytes_(0),
+    outputBytes_(0),
+    spillFileBytes_(0),
+    spilled_(false)
+{
+  client_.setConnectionCallback(
+      boost::bind(&LogShipper::onConnection, this, _1));
+  client_.setMessageCallback(
+      boost::bind(&Codec::onMessage, &codec_, _1, _2, _3));
+  client_.setWriteCompleteCallback(
+      boost::bind(&LogShipper::onWriteComplete, this, _1));
+  client_.enableRetry();
+
+  // those of the last run, if any
+  spilled_ = ::access(spillFilename_.c_str(), F_OK) == 0
+          || ::access((spillFilename_ + ".sending").c_str(), F_OK) == 0;
+}
+
+LogShipper::~LogShipper()
+{
+}
+
+void LogShipper::setCompression(bool on)
+{
+  codec_.setCompression(on ? ProtobufCodecLite::kZlib : ProtobufCodecLite::kNoCompression);
+}
+
+void LogShipper::start()
+{
+  client_.connect();
+}
+
+void LogShipper::stop()
+{
+  {
+    MutexLockGuard lock(mutex_);
+    double remaining = blockSeconds_;
+    Timestamp start(Timestamp::now());
+    while (connection_ && queuedBytes_ + outputBytes_ > 0 && remaining > 0)
+    {
+      cond_.waitForSeconds(remaining);
+      remaining = blockSeconds_ - timeDifference(Timestamp::now(), start);
+    }
+    if (queuedBytes_ + outputBytes_ > 0)
+    {
+      LOG_WARN << "LogShipper " << name_ << " stops with "
+               << queuedBytes_ + outputBytes_ << " bytes not shipped";
+    }
+    spillFile_.reset();
+  }
+  client_.disconnect();
+}
+
+void LogShipper::write(const char* data, int len)
+{
+  bool spilled = false;
+  {
+    MutexLockGuard lock(mutex_);
+    spilled = spilled_ && connection_;
+  }
+  if (spilled)
+  {
+    sendSpilled();
+  }
+
+  if (waitForRoom(len))
+  {
+    ship(data, len);
+  }
+  else
+  {
+    spill(data, len);
+  }
+}
+
+LogShipper::Stats LogShipper::stats()
+{
+  MutexLockGuard lock(mutex_);
+  Stats stats = stats_;
+  stats.connected = connection_.get() != NULL;
+  stats.pendingBytes = queuedBytes_ + outputBytes_;
+  return stats;
+}
+
+void LogShipper::onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_INFO << conn->localAddress().toIpPort() << " -> "
+           << conn->peerAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+
+  if (conn->connected())
+  {
+    LogBatch batch;
+    LogRecord_Heartbeat* hb = batch.mutable_heartbeat();
+    hb->set_hostname(ProcessInfo::hostname().c_str());
+    hb->set_process_name(name_.c_str());
+    hb->set_process_id(ProcessInfo::pid());
+    hb->set_process_start_time(ProcessInfo::startTime().microSecondsSinceEpoch());
+    hb->set_username(ProcessInfo::username().c_str());
+    codec_.send(conn, batch);
+
+    MutexLockGuard lock(mutex_);
+    connection_ = conn;
+    outputBytes_ = conn->outputBuffer()->readableBytes();
+  }
+  else
+  {
+    MutexLockGuard lock(mutex_);
+    connection_.reset();
+    outputBytes_ = 0;
+    cond_.notifyAll();
+  }
+}
+
+void LogShipper::onMessage(const TcpConnectionPtr&,
+                           const boost::shared_ptr<LogBatch>& message,
+                           Timestamp)
+{
+  // SHOULD NOT HAPPEN
+  LOG_WARN << message->DebugString();
+}
+
+void LogShipper::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  MutexLockGuard lock(mutex_);
+  if (conn == connection_)
+  {
+    outputBytes_ = conn->outputBuffer()->readableBytes();
+    cond_.notifyAll();
+  }
+}
+
+void LogShipper::sendInLoop(const LogBatchPtr& batch)
+{
+  loop_->assertInLoopThread();
+  int len = static_cast<int>(batch->lines().size());
+  TcpConnectionPtr conn;
+  {
+    MutexLockGuard lock(mutex_);
+    queuedBytes_ -= len;
+    conn = connection_;
+  }
+
+  if (conn)
+  {
+    codec_.send(conn, *batch);
+    MutexLockGuard lock(mutex_);
+    outputBytes_ = conn->outputBuffer()->readableBytes();
+    stats_.shippedBytes += len;
+    cond_.notifyAll();
+  }
+  else
+  {
+    // disconnected after write()
+    spill(batch->lines().data(), len);
+    MutexLockGuard lock(mutex_);
+    cond_.notifyAll();
+  }
+}
+
+bool LogShipper::waitForRoom(int len)
+{
+  MutexLockGuard lock(mutex_);
+  double remaining = blockSeconds_;
+  Timestamp start(Timestamp::now());
+  while (connection_ && queuedBytes_ + outputBytes_ + len > maxPendingBytes_ && remaining > 0)
+  {
+    cond_.waitForSeconds(remaining);
+    remaining = blockSeconds_ - timeDifference(Timestamp::now(), start);
+  }
+  // one batch larger than maxPendingBytes_ goes when there is none pending
+  return connection_
+      && (queuedBytes_ + outputBytes_ + len <= maxPendingBytes_
+          || queuedBytes_ + outputBytes_ == 0);
+}
+
+void LogShipper::ship(const char* data, int len)
+{
+  // one copy, in the backend thread, to keep lines until they are sent
+  LogBatchPtr batch(new LogBatch);
+  batch->set_lines(data, len);
+  {
+    MutexLockGuard lock(mutex_);
+    queuedBytes_ += len;
+  }
+  loop_->runInLoop(boost::bind(&LogShipper::sendInLoop, this, batch));
+}
+
+void LogShipper::spill(const char* data, int len)
+{
+  MutexLockGuard lock(mutex_);
+  if (spillFileBytes_ + len > maxSpillBytes_)
+  {
+    stats_.droppedBytes += len;
+    return;
+  }
+  if (!spillFile_)
+  {
+    spillFile_.reset(new FileUtil::AppendFile(spillFilename_));
+  }
+  spillFile_->append(data, len);
+  spillFileBytes_ += len;
+  stats_.spilledBytes += len;
+  spilled_ = true;
+}
+
+void LogShipper::sendSpilled()
+{
+  // left by a crash of the last run
+  string sending = spillFilename_ + ".sending";
+  if (::access(sending.c_str(), F_OK) == 0)
+  {
+    sendFile(sending);
+  }
+
+  {
+    MutexLockGuard lock(mutex_);
+    spillFile_.reset();
+    spillFileBytes_ = 0;
+    spilled_ = false;
+    if (::rename(spillFilename_.c_str(), sending.c_str()) < 0)
+    {
+      if (errno != ENOENT)
+      {
+        printError("rename", spillFilename_);
+      }
+      return;
+    }
+  }
+  sendFile(sending);
+}
+
+void LogShipper::sendFile(const string& filename)
+{
+  FILE* fp = ::fopen(filename.c_str(), "rbe");
+  if (fp == NULL)
+  {
+    printError("open", filename);
+    return;
+  }
+
+  // Cut anywhere, the collector appends the bytes of a source in order.
+  string chunk(kChunkSize, '\0');
+  size_t n = 0;
+  while ((n = ::fread(&*chunk.begin(), 1, chunk.size(), fp)) > 0)
+  {
+    int len = static_cast<int>(n);
+    if (waitForRoom(len))
+    {
+      ship(chunk.data(), len);
+    }
+    else
+    {
+      spill(chunk.data(), len);
+    }
+  }
+  ::fclose(fp);
+  ::unlink(filename.c_str());
+}
@@ -0,0 +1,113 @@
+#ifndef MUDUO_EXAMPLES_ACE_LOGGING_SHIPPER_H
+#define MUDUO_EXAMPLES_ACE_LOGGING_SHIPPER_H
+
+#include <examples/ace/logging/codec.h>
+
+#include <muduo/base/Condition.h>
+#include <muduo/base/FileUtil.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace logging
+{
+
+// Ships log lines to ace_logging_server over a connection kept up by
+// TcpClient, as the WriteCallback of an AsyncLogging:
+//
+//   LogShipper shipper(loopThread.startLoop(), serverAddr, "myapp");
+//   shipper.start();
+//   AsyncLogging log("myapp", 0);
+//   log.setWriteCallback(boost::bind(&LogShipper::write, &shipper, _1, _2));
+//   log.start();
+//
+// write() hands the batch to the loop, and blocks up to blockSeconds while
+// more than maxPendingBytes are not written to the socket yet, so a slow
+// collector slows down the backend thread of AsyncLogging, whose buffers
+// then fill up, instead of taking all memory.  When still no room, or not
+// connected, lines are appended to name + ".spill", up to maxSpillBytes,
+// and are shipped by write() when connected again.  Lines already in the
+// socket buffers are lost when the connection breaks, the collector does
+// not acknowledge them.
+class LogShipper : boost::noncopyable
+{
+ public:
+  struct Stats
+  {
+    Stats()
+      : connected(false), shippedBytes(0), spilledBytes(0),
+        droppedBytes(0), pendingBytes(0)
+    { }
+
+    bool connected;
+    int64_t shippedBytes;   // given to the connection
+    int64_t spilledBytes;   // appended to the spill file
+    int64_t droppedBytes;   // the spill file full
+    int64_t pendingBytes;   // not written to the socket yet
+  };
+
+  // name is the source of lines to the collector, the process name by default.
+  LogShipper(muduo::net::EventLoop* loop,
+             const muduo::net::InetAddress& serverAddr,
+             const muduo::string& name);
+  ~LogShipper();
+
+  // Before start().
+  void setMaxPendingBytes(int64_t bytes) { maxPendingBytes_ = bytes; }
+  void setBlockSeconds(double seconds) { blockSeconds_ = seconds; }
+  void setMaxSpillBytes(int64_t bytes) { maxSpillBytes_ = bytes; }
+  // zlib, text of logs compresses several times
+  void setCompression(bool on);
+
+  void start();
+  // Waits up to blockSeconds for pending lines to be written, then
+  // disconnects.  Call it before destructing, and wait for the disconnect.
+  void stop();
+
+  // Of one thread, the backend thread of AsyncLogging.
+  void write(const char* data, int len);
+
+  // Thread safe.
+  Stats stats();
+
+ private:
+  typedef boost::shared_ptr<LogBatch> LogBatchPtr;
+
+  void onConnection(const muduo::net::TcpConnectionPtr& conn);
+  void onMessage(const muduo::net::TcpConnectionPtr& conn,
+                 const boost::shared_ptr<LogBatch>& message,
+                 muduo::Timestamp);
+  void onWriteComplete(const muduo::net::TcpConnectionPtr& conn);
+  void sendInLoop(const LogBatchPtr& batch);
+
+  bool waitForRoom(int len);
+  void ship(const char* data, int len);
+  void spill(const char* data, int len);
+  void sendSpilled();
+  void sendFile(const muduo::string& filename);
+
+  muduo::net::EventLoop* loop_;
+  muduo::net::TcpClient client_;
+  Codec codec_;
+  const muduo::string name_;
+  const muduo::string spillFilename_;
+  int64_t maxPendingBytes_;
+  double blockSeconds_;
+  int64_t maxSpillBytes_;
+
+  muduo::MutexLock mutex_;
+  muduo::Condition cond_;  // of room
+  muduo::net::TcpConnectionPtr connection_;
+  int64_t queuedBytes_;  // in the loop
+  int64_t outputBytes_;  // in the output buffer of connection_
+  boost::scoped_ptr<muduo::FileUtil::AppendFile> spillFile_;
+  int64_t spillFileBytes_;
+  bool spilled_;  // lines to ship in the spill files
+  Stats stats_;
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_ACE_LOGGING_SHIPPER_H
@@ -0,0 +1,298 @@
+#include <examples/protobuf/rpcbalancer/Backend.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace rpcbalancer;
+
+namespace
+{
+
+// calls and probes time out at this granularity
+const double kTickInterval = 0.1;
+// of a backend before its first response, so it is tried soon
+const double kInitialLatency = 0.001;
+const int kMaxEjectionMultiplier = 8;
+
+}
+
+Backend::Backend(EventLoop* loop,
+                 const InetAddress& backendAddr,
+                 const string& name,
+                 const BackendOptions& options)
+  : loop_(loop),
+    name_(name),
+    options_(options),
+    client_(loop, backendAddr, name),
+    codec_(boost::bind(&Backend::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&Backend::onRawMessage, this, _1, _2, _3)),
+    nextId_(0),
+    numCalls_(0),
+    healthy_(false),
+    probeResults_(0),
+    probeId_(0),
+    ejected_(false),
+    failures_(0),
+    ejections_(0),
+    latency_(kInitialLatency)
+{
+  client_.setConnectionCallback(
+      boost::bind(&Backend::onConnection, this, _1));
+  client_.setMessageCallback(
+      boost::bind(&RpcCodec::onMessage, &codec_, _1, _2, _3));
+  client_.enableRetry();
+}
+
+void Backend::connect()
+{
+  client_.connect();
+  timer_ = loop_->runEvery(kTickInterval, boost::bind(&Backend::onTimer, this));
+}
+
+void Backend::send(RawMessage& request,
+                   const TcpConnectionPtr& clientConn,
+                   bool retryable,
+                   int attempts)
+{
+  loop_->assertInLoopThread();
+  assert(conn_);
+  uint64_t id = ++nextId_;
+  Call& call = calls_.insert(calls_.end(), CallMap::value_type(id, Call()))->second;
+  call.origId = request.id();
+  call.clientConn = clientConn;
+  call.sent = Timestamp::now();
+  call.attempts = attempts + 1;
+  ++numCalls_;
+
+  request.set_id(id);
+  request.updateId();
+  conn_->send(request.message_);
+  if (retryable && call.attempts < options_.maxAttempts)
+  {
+    call.frame.assign(request.message_.data(), request.message_.size());
+  }
+}
+
+void Backend::onConnection(const TcpConnectionPtr& conn)
+{
+  loop_->assertInLoopThread();
+  LOG_INFO << "Backend "
+           << conn->localAddress().toIpPort() << " -> "
+           << conn->peerAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    conn_ = conn;
+    // until probes say otherwise
+    healthy_ = true;
+    probeResults_ = 0;
+    lastProbe_ = Timestamp::now();
+  }
+  else
+  {
+    conn_.reset();
+    healthy_ = false;
+    probeId_ = 0;
+    // these will never be answered
+    CallMap calls;
+    calls.swap(calls_);
+    numCalls_ = 0;
+    for (CallMap::iterator it = calls.begin(); it != calls.end(); ++it)
+    {
+      failCall(it->second, UNAVAILABLE);
+    }
+  }
+}
+
+void Backend::onRpcMessage(const TcpConnectionPtr&,
+                           const RpcMessagePtr& msg,
+                           Timestamp receiveTime)
+{
+  // not a plain frame, eg. compressed, forwarded as a plain one
+  Buffer buf;
+  codec_.fillEmptyBuffer(&buf, *msg);
+  RawMessage raw(StringPiece(buf.peek(), static_cast<int>(buf.readableBytes())));
+  if (raw.parse(codec_.tag()))
+  {
+    onResponse(raw, receiveTime);
+  }
+}
+
+bool Backend::onRawMessage(const TcpConnectionPtr&,
+                           StringPiece message,
+                           Timestamp receiveTime)
+{
+  RawMessage raw(message);
+  if (raw.parse(codec_.tag()))
+  {
+    onResponse(raw, receiveTime);
+    return false;
+  }
+  else
+    return true; // try normal rpc message callback
+}
+
+void Backend::onResponse(RawMessage& response, Timestamp receiveTime)
+{
+  loop_->assertInLoopThread();
+  if (probeId_ != 0 && response.id() == probeId_)
+  {
+    probeId_ = 0;
+    onProbe(true);
+    return;
+  }
+
+  CallMap::iterator it = calls_.find(response.id());
+  if (it == calls_.end())
+  {
+    LOG_DEBUG << name_ << " response " << response.id() << " has timed out";
+    return;
+  }
+  Call call;
+  call.frame.swap(it->second.frame);
+  call.origId = it->second.origId;
+  call.clientConn = it->second.clientConn;
+  call.sent = it->second.sent;
+  call.attempts = it->second.attempts;
+  calls_.erase(it);
+  --numCalls_;
+
+  if (response.parseFields() && response.error() == SERVER_BUSY)
+  {
+    // not run, safe to send again if it is retryable
+    onCallResult(false, receiveTime);
+    failCall(call, SERVER_BUSY);
+    return;
+  }
+
+  double sample = timeDifference(receiveTime, call.sent);
+  latency_ += options_.latencyWeight * (sample - latency_);
+  onCallResult(true, receiveTime);
+
+  TcpConnectionPtr clientConn = call.clientConn.lock();
+  if (clientConn)
+  {
+    response.set_id(call.origId);
+    response.updateId();
+    clientConn->send(response.message_);
+  }
+}
+
+void Backend::onTimer()
+{
+  Timestamp now = Timestamp::now();
+  // oldest first, they all have the same timeout
+  while (!calls_.empty()
+         && timeDifference(now, calls_.begin()->second.sent) >= options_.callTimeout)
+  {
+    Call call(calls_.begin()->second);
+    calls_.erase(calls_.begin());
+    --numCalls_;
+    LOG_WARN << name_ << " call " << call.origId << " timed out";
+    onCallResult(false, now);
+    failCall(call, TIMEOUT);
+  }
+
+  if (probeId_ != 0 && timeDifference(now, lastProbe_) >= options_.probeTimeout)
+  {
+    probeId_ = 0;
+    onProbe(false);
+  }
+  if (conn_ && probeId_ == 0 && timeDifference(now, lastProbe_) >= options_.probeInterval)
+  {
+    sendProbe(now);
+  }
+
+  if (ejected_ && !(now < ejectedUntil_))
+  {
+    LOG_INFO << name_ << " is back after ejection";
+    ejected_ = false;
+  }
+}
+
+void Backend::sendProbe(Timestamp now)
+{
+  RpcMessage message;
+  message.set_type(REQUEST);
+  probeId_ = ++nextId_;
+  message.set_id(probeId_);
+  message.set_service(options_.probeService);
+  message.set_method(options_.probeMethod);
+  codec_.send(conn_, message);
+  lastProbe_ = now;
+}
+
+void Backend::onProbe(bool succeeded)
+{
+  if (succeeded)
+  {
+    probeResults_ = std::max(probeResults_, 0) + 1;
+    if (!healthy_ && probeResults_ >= options_.healthyThreshold)
+    {
+      LOG_INFO << name_ << " is healthy";
+      healthy_ = true;
+    }
+  }
+  else
+  {
+    probeResults_ = std::min(probeResults_, 0) - 1;
+    if (healthy_ && -probeResults_ >= options_.unhealthyThreshold)
+    {
+      LOG_WARN << name_ << " is unhealthy";
+      healthy_ = false;
+    }
+  }
+}
+
+void Backend::onCallResult(bool succeeded, Timestamp now)
+{
+  if (succeeded)
+  {
+    failures_ = 0;
+    ejections_ = 0;
+  }
+  else if (++failures_ >= options_.ejectionFailures && !ejected_)
+  {
+    failures_ = 0;
+    ++ejections_;
+    double seconds = options_.ejectionTime * std::min(ejections_, kMaxEjectionMultiplier);
+    LOG_WARN << name_ << " is ejected for " << seconds << " seconds";
+    ejected_ = true;
+    ejectedUntil_ = addTime(now, seconds);
+  }
+}
+
+void Backend::failCall(const Call& call, ErrorCode error)
+{
+  TcpConnectionPtr clientConn = call.clientConn.lock();
+  if (!clientConn)
+  {
+    return;
+  }
+  if (!call.frame.empty()
+      && retryCallback_
+      && retryCallback_(this, call.frame, call.origId, clientConn, call.attempts))
+  {
+    return;
+  }
+  replyError(call.origId, clientConn, error);
+}
+
+void Backend::replyError(uint64_t origId,
+                         const TcpConnectionPtr& clientConn,
+                         ErrorCode error)
+{
+  RpcMessage message;
+  message.set_type(RESPONSE);
+  message.set_id(origId);
+  message.set_error(error);
+  codec_.send(clientConn, message);
+}
@@ -0,0 +1,173 @@
+#ifndef MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_BACKEND_H
+#define MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_BACKEND_H
+
+#include <examples/protobuf/rpcbalancer/RawMessage.h>
+
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TimerId.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+
+namespace rpcbalancer
+{
+
+struct BackendOptions
+{
+  BackendOptions()
+    : probeInterval(1.0),
+      probeTimeout(1.0),
+      unhealthyThreshold(2),
+      healthyThreshold(2),
+      callTimeout(5.0),
+      ejectionFailures(5),
+      ejectionTime(10.0),
+      maxAttempts(2),
+      latencyWeight(0.2),
+      probeService("muduo.net.HealthCheck"),
+      probeMethod("Check")
+  {
+  }
+
+  // A probe is a call of probeService.probeMethod, any response in
+  // probeTimeout is a success, even NO_SERVICE from a backend without it.
+  double probeInterval;
+  double probeTimeout;
+  int unhealthyThreshold;  // failed probes in a row to take it out
+  int healthyThreshold;    // succeeded probes in a row to put it back
+
+  // Calls without a response in callTimeout fail with TIMEOUT.
+  double callTimeout;
+  // Failed calls in a row, timeouts or SERVER_BUSY, eject the backend for
+  // ejectionTime, times the number of ejections in a row.
+  int ejectionFailures;
+  double ejectionTime;
+  // Of idempotent calls, counting the first one.
+  int maxAttempts;
+  // of each new latency sample in the moving average
+  double latencyWeight;
+
+  std::string probeService;
+  std::string probeMethod;
+};
+
+// One backend, as seen from one IO thread of the balancer.
+//
+// Not thread safe, everything runs in its loop, each IO thread has its
+// own backends, so they share nothing.
+class Backend : boost::noncopyable
+{
+ public:
+  // Resends the request of a failed call, to another backend.
+  // Returns false if there is none.
+  typedef boost::function<bool (Backend* failed,
+                                muduo::StringPiece frame,
+                                uint64_t origId,
+                                const muduo::net::TcpConnectionPtr& clientConn,
+                                int attempts)> RetryCallback;
+
+  Backend(muduo::net::EventLoop* loop,
+          const muduo::net::InetAddress& backendAddr,
+          const muduo::string& name,
+          const BackendOptions& options);
+
+  void setRetryCallback(const RetryCallback& cb)
+  { retryCallback_ = cb; }
+
+  void connect();
+
+  const muduo::string& name() const
+  { return name_; }
+
+  // Connected, passes the health check, and not ejected.
+  bool available() const
+  { return conn_ && healthy_ && !ejected_; }
+
+  // Ejected ones are the last resort.
+  bool availableIfEjected() const
+  { return conn_ && healthy_; }
+
+  // Lower is better, outstanding calls weighted by the average latency.
+  double load() const
+  { return static_cast<double>(numCalls_ + 1) * latency_; }
+
+  // Forwards request of clientConn, keeps a copy to retry it if
+  // retryable, attempts counts the earlier ones.
+  void send(RawMessage& request,
+            const muduo::net::TcpConnectionPtr& clientConn,
+            bool retryable,
+            int attempts);
+
+ private:
+  struct Call
+  {
+    Call()
+      : origId(0),
+        attempts(0)
+    {
+    }
+
+    uint64_t origId;
+    boost::weak_ptr<muduo::net::TcpConnection> clientConn;
+    muduo::Timestamp sent;
+    int attempts;
+    std::string frame;  // of retryable calls
+  };
+
+  // ordered by id, which is the order calls are sent in
+  typedef std::map<uint64_t, Call> CallMap;
+
+  void onConnection(const muduo::net::TcpConnectionPtr& conn);
+  void onRpcMessage(const muduo::net::TcpConnectionPtr& conn,
+                    const muduo::net::RpcMessagePtr& msg,
+                    muduo::Timestamp receiveTime);
+  bool onRawMessage(const muduo::net::TcpConnectionPtr& conn,
+                    muduo::StringPiece message,
+                    muduo::Timestamp receiveTime);
+  void onResponse(RawMessage& response, muduo::Timestamp receiveTime);
+
+  void onTimer();
+  void sendProbe(muduo::Timestamp now);
+  void onProbe(bool succeeded);
+
+  // a call failed, it is sent again, or error goes to the client
+  void failCall(const Call& call, muduo::net::ErrorCode error);
+  void onCallResult(bool succeeded, muduo::Timestamp now);
+  void replyError(uint64_t origId,
+                  const muduo::net::TcpConnectionPtr& clientConn,
+                  muduo::net::ErrorCode error);
+
+  muduo::net::EventLoop* loop_;
+  const muduo::string name_;
+  const BackendOptions& options_;
+  muduo::net::TcpClient client_;
+  muduo::net::RpcCodec codec_;
+  muduo::net::TcpConnectionPtr conn_;
+  RetryCallback retryCallback_;
+  muduo::net::TimerId timer_;
+  uint64_t nextId_;
+  CallMap calls_;  // without the probe
+  int numCalls_;
+
+  // health check
+  bool healthy_;
+  int probeResults_;  // successes in a row if > 0, failures if < 0
+  uint64_t probeId_;  // 0 if none outstanding
+  muduo::Timestamp lastProbe_;
+
+  // outlier ejection
+  bool ejected_;
+  int failures_;    // failed calls in a row
+  int ejections_;   // in a row, without a call succeeded in between
+  muduo::Timestamp ejectedUntil_;
+
+  double latency_;  // moving average, in seconds
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_BACKEND_H
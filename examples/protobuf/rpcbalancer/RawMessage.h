@@ -0,0 +1,140 @@
+#ifndef MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RAWMESSAGE_H
+#define MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RAWMESSAGE_H
+
+#include <muduo/net/Endian.h>
+#include <muduo/net/protorpc/RpcCodec.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <endian.h>
+#include <string.h>
+
+namespace rpcbalancer
+{
+
+// A frame of RpcMessage, forwarded without parsing the message.
+// Only the id is rewritten in place, fields after it are read on demand.
+struct RawMessage
+{
+  RawMessage(muduo::StringPiece m)
+    : message_(m), id_(0), loc_(NULL), end_(NULL), error_(muduo::net::NO_ERROR)
+  { }
+
+  uint64_t id() const { return id_; }
+  void set_id(uint64_t x) { id_ = x; }
+
+  bool parse(const muduo::string& tag)
+  {
+    using muduo::net::ProtobufCodecLite;
+    const char* const body = message_.data() + ProtobufCodecLite::kHeaderLen;
+    const int bodylen = message_.size() - ProtobufCodecLite::kHeaderLen;
+    const int taglen = static_cast<int>(tag.size());
+    if (ProtobufCodecLite::validateChecksum(body, bodylen)
+        && (memcmp(body, tag.data(), tag.size()) == 0)
+        && (bodylen >= taglen + 3 + 8))
+    {
+      const char* const p = body + taglen;
+      uint8_t type = *(p+1);
+
+      if (*p == 0x08 && (type == 0x01 || type == 0x02) && *(p+2) == 0x11)
+      {
+        uint64_t x = 0;
+        memcpy(&x, p+3, sizeof(x));
+        set_id(le64toh(x));
+        loc_ = p+3;
+        end_ = body + bodylen - ProtobufCodecLite::kChecksumLen;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Reads service, method and error, which follow the id.
+  // Other fields, the request or response among them, are skipped.
+  bool parseFields()
+  {
+    const char* p = static_cast<const char*>(loc_) + sizeof(uint64_t);
+    while (p < end_)
+    {
+      uint64_t key = 0;
+      if (!readVarint(&p, &key))
+      {
+        return false;
+      }
+      int wireType = static_cast<int>(key & 7);
+      uint64_t field = key >> 3;
+      uint64_t value = 0;
+      if (wireType == 0)
+      {
+        if (!readVarint(&p, &value))
+          return false;
+        if (field == muduo::net::RpcMessage::kErrorFieldNumber)
+          error_ = static_cast<muduo::net::ErrorCode>(value);
+      }
+      else if (wireType == 2)
+      {
+        if (!readVarint(&p, &value) || value > static_cast<uint64_t>(end_ - p))
+          return false;
+        if (field == muduo::net::RpcMessage::kServiceFieldNumber)
+          service_ = muduo::StringPiece(p, static_cast<int>(value));
+        else if (field == muduo::net::RpcMessage::kMethodFieldNumber)
+          method_ = muduo::StringPiece(p, static_cast<int>(value));
+        p += value;
+      }
+      else if (wireType == 1 || wireType == 5)
+      {
+        p += wireType == 1 ? 8 : 4;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return p == end_;
+  }
+
+  // after parseFields()
+  muduo::StringPiece service() const { return service_; }
+  muduo::StringPiece method() const { return method_; }
+  muduo::net::ErrorCode error() const { return error_; }
+
+  void updateId()
+  {
+    using muduo::net::ProtobufCodecLite;
+    uint64_t le64 = htole64(id_);
+    memcpy(const_cast<void*>(loc_), &le64, sizeof(le64));
+
+    const char* body = message_.data() + ProtobufCodecLite::kHeaderLen;
+    int bodylen = message_.size() - ProtobufCodecLite::kHeaderLen;
+    int32_t checkSum = ProtobufCodecLite::checksum(body, bodylen - ProtobufCodecLite::kChecksumLen);
+    int32_t be32 = muduo::net::sockets::hostToNetwork32(checkSum);
+    memcpy(const_cast<char*>(body + bodylen - ProtobufCodecLite::kChecksumLen), &be32, sizeof(be32));
+  }
+
+  muduo::StringPiece message_;
+
+ private:
+  bool readVarint(const char** p, uint64_t* value) const
+  {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end_; shift += 7)
+    {
+      uint8_t byte = static_cast<uint8_t>(**p);
+      ++*p;
+      *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  uint64_t id_;
+  const void* loc_;
+  const char* end_;
+  muduo::StringPiece service_;
+  muduo::StringPiece method_;
+  muduo::net::ErrorCode error_;
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RAWMESSAGE_H
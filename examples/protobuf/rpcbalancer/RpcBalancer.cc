@@ -0,0 +1,171 @@
+#include <examples/protobuf/rpcbalancer/RpcBalancer.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace rpcbalancer;
+
+RpcBalancer::RpcBalancer(EventLoop* loop,
+                         const InetAddress& listenAddr,
+                         const string& name,
+                         const std::vector<InetAddress>& backends)
+  : loop_(loop),
+    server_(loop, listenAddr, name),
+    codec_(boost::bind(&RpcBalancer::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcBalancer::onRawMessage, this, _1, _2, _3)),
+    backends_(backends)
+{
+  server_.setThreadInitCallback(
+      boost::bind(&RpcBalancer::initPerThread, this, _1));
+  server_.setConnectionCallback(
+      boost::bind(&RpcBalancer::onConnection, this, _1));
+  server_.setMessageCallback(
+      boost::bind(&RpcCodec::onMessage, &codec_, _1, _2, _3));
+}
+
+void RpcBalancer::initPerThread(EventLoop* ioLoop)
+{
+  int count = threadCount_.getAndAdd(1);
+  LOG_INFO << "IO thread " << count;
+  PerThread& t = t_backends_.value();
+  t.current = count % backends_.size();
+
+  for (size_t i = 0; i < backends_.size(); ++i)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%s#%d", backends_[i].toIpPort().c_str(), count);
+    t.backends.push_back(new Backend(ioLoop, backends_[i], buf, options_));
+    t.backends.back().setRetryCallback(
+        boost::bind(&RpcBalancer::retry, this, _1, _2, _3, _4, _5));
+    t.backends.back().connect();
+  }
+}
+
+void RpcBalancer::onConnection(const TcpConnectionPtr& conn)
+{
+  LOG_INFO << "Client "
+           << conn->peerAddress().toIpPort() << " -> "
+           << conn->localAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+  }
+  // Outstanding calls of a client gone are dropped when they complete or
+  // time out, backends hold it by weak_ptr.
+}
+
+bool RpcBalancer::onRawMessage(const TcpConnectionPtr& conn,
+                               StringPiece message,
+                               Timestamp)
+{
+  RawMessage raw(message);
+  if (raw.parse(codec_.tag()))
+  {
+    forward(conn, raw);
+    return false;
+  }
+  else
+    return true; // try normal rpc message callback
+}
+
+void RpcBalancer::onRpcMessage(const TcpConnectionPtr& conn,
+                               const RpcMessagePtr& msg,
+                               Timestamp)
+{
+  // not a plain frame, eg. compressed, forwarded as a plain one
+  Buffer buf;
+  codec_.fillEmptyBuffer(&buf, *msg);
+  RawMessage raw(StringPiece(buf.peek(), static_cast<int>(buf.readableBytes())));
+  if (raw.parse(codec_.tag()))
+  {
+    forward(conn, raw);
+  }
+}
+
+void RpcBalancer::forward(const TcpConnectionPtr& conn, RawMessage& request)
+{
+  PerThread& t = t_backends_.value();
+  Backend* backend = pick(t, NULL);
+  if (backend)
+  {
+    backend->send(request, conn, idempotent(request), 0);
+  }
+  else
+  {
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(request.id());
+    response.set_error(UNAVAILABLE);
+    codec_.send(conn, response);
+  }
+}
+
+bool RpcBalancer::retry(Backend* failed,
+                        StringPiece frame,
+                        uint64_t origId,
+                        const TcpConnectionPtr& clientConn,
+                        int attempts)
+{
+  PerThread& t = t_backends_.value();
+  Backend* backend = pick(t, failed);
+  if (backend == NULL)
+  {
+    return false;
+  }
+  // frame belongs to the failed call, which is gone after this returns
+  std::string copy(frame.data(), frame.size());
+  RawMessage raw(copy);
+  if (!raw.parse(codec_.tag()))
+  {
+    return false;
+  }
+  LOG_DEBUG << "retry " << origId << " of " << clientConn->name()
+            << " on " << backend->name() << " after " << failed->name();
+  raw.set_id(origId);
+  backend->send(raw, clientConn, true, attempts);
+  return true;
+}
+
+Backend* RpcBalancer::pick(PerThread& t, const Backend* exclude)
+{
+  Backend* best = NULL;
+  size_t n = t.backends.size();
+  // ejected ones only if there is nothing else
+  for (int pass = 0; pass < 2 && best == NULL; ++pass)
+  {
+    double bestLoad = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+      // starts from a different one each time, so ties take turns
+      Backend* backend = &t.backends[(t.current + i) % n];
+      bool usable = pass == 0 ? backend->available() : backend->availableIfEjected();
+      if (usable && backend != exclude && (best == NULL || backend->load() < bestLoad))
+      {
+        best = backend;
+        bestLoad = backend->load();
+      }
+    }
+  }
+  t.current = (t.current + 1) % n;
+  return best;
+}
+
+bool RpcBalancer::idempotent(RawMessage& request) const
+{
+  if (idempotentMethods_.empty() || !request.parseFields())
+  {
+    return false;
+  }
+  std::string method(request.service().data(), request.service().size());
+  method += '.';
+  method.append(request.method().data(), request.method().size());
+  return idempotentMethods_.count(method) > 0;
+}
@@ -0,0 +1,96 @@
+#ifndef MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RPCBALANCER_H
+#define MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RPCBALANCER_H
+
+#include <examples/protobuf/rpcbalancer/Backend.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/ThreadLocal.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <set>
+#include <vector>
+
+namespace rpcbalancer
+{
+
+// Forwards RPC calls to backends, without parsing their messages.
+//
+// Each call goes to the backend with the fewest outstanding calls,
+// weighted by its average latency, among those that are connected, pass
+// the health check, and are not ejected for failing calls.  Failed calls
+// of idempotent methods are sent again to another backend.
+//
+// Each IO thread connects to every backend on its own, so threads share
+// no state and take no locks.
+class RpcBalancer : boost::noncopyable
+{
+ public:
+  RpcBalancer(muduo::net::EventLoop* loop,
+              const muduo::net::InetAddress& listenAddr,
+              const muduo::string& name,
+              const std::vector<muduo::net::InetAddress>& backends);
+
+  void setThreadNum(int numThreads)
+  {
+    server_.setThreadNum(numThreads);
+  }
+
+  // Before start().
+  void setOptions(const BackendOptions& options)
+  {
+    options_ = options;
+  }
+
+  // Calls of method, eg. "echo.EchoService.Echo", can be sent again after
+  // a timeout, or when the backend is gone.  Before start().
+  void addIdempotentMethod(const std::string& method)
+  {
+    idempotentMethods_.insert(method);
+  }
+
+  void start()
+  {
+    server_.start();
+  }
+
+ private:
+  struct PerThread
+  {
+    size_t current;
+    boost::ptr_vector<Backend> backends;
+    PerThread() : current(0) { }
+  };
+
+  void initPerThread(muduo::net::EventLoop* ioLoop);
+  void onConnection(const muduo::net::TcpConnectionPtr& conn);
+  bool onRawMessage(const muduo::net::TcpConnectionPtr& conn,
+                    muduo::StringPiece message,
+                    muduo::Timestamp);
+  void onRpcMessage(const muduo::net::TcpConnectionPtr& conn,
+                    const muduo::net::RpcMessagePtr& msg,
+                    muduo::Timestamp);
+  void forward(const muduo::net::TcpConnectionPtr& conn, RawMessage& request);
+  bool retry(Backend* failed,
+             muduo::StringPiece frame,
+             uint64_t origId,
+             const muduo::net::TcpConnectionPtr& clientConn,
+             int attempts);
+  // NULL if none is available
+  Backend* pick(PerThread& t, const Backend* exclude);
+  bool idempotent(RawMessage& request) const;
+
+  muduo::net::EventLoop* loop_;
+  muduo::net::TcpServer server_;
+  muduo::net::RpcCodec codec_;
+  std::vector<muduo::net::InetAddress> backends_;
+  BackendOptions options_;
+  std::set<std::string> idempotentMethods_;
+  muduo::AtomicInt32 threadCount_;
+  muduo::ThreadLocal<PerThread> t_backends_;
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_PROTOBUF_RPCBALANCER_RPCBALANCER_H
@@ -12,14 +12,47 @@
 #include <boost/bind.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "histogram.h"
+
 using namespace muduo;
 using namespace muduo::net;
 
-static const int kRequests = 50000;
+struct Options
+{
+  Options()
+    : port(8888),
+      numClients(1),
+      numThreads(1),
+      depth(1),
+      rate(0),
+      calls(50000)
+  {
+  }
+
+  uint16_t port;
+  int numClients;
+  int numThreads;
+  int depth;    // calls in flight on each connection, closed-loop
+  double rate;  // calls per second of all connections, open-loop if > 0
+  int calls;    // of each connection
+  std::vector<int> payloadSizes;
+};
 
+// Closed-loop, it keeps depth calls in flight, and sends the next one
+// when one returns.  Open-loop, it sends calls at a fixed rate whether
+// or not earlier ones have returned, and the latency of each counts from
+// when it should have been sent, so a stalled server is not hidden by a
+// stalled client (no coordinated omission).
 class RpcClient : boost::noncopyable
 {
  public:
@@ -27,14 +60,19 @@ class RpcClient : boost::noncopyable
   RpcClient(EventLoop* loop,
             const InetAddress& serverAddr,
             CountDownLatch* allConnected,
-            CountDownLatch* allFinished)
-    : // loop_(loop),
+            const Options& options,
+            Histogram* histogram)
+    : loop_(loop),
       client_(loop, serverAddr, "RpcClient"),
       channel_(new RpcChannel),
       stub_(get_pointer(channel_)),
       allConnected_(allConnected),
-      allFinished_(allFinished),
-      count_(0)
+      options_(options),
+      histogram_(histogram),
+      allFinished_(NULL),
+      sent_(0),
+      received_(0),
+      errors_(0)
   {
     client_.setConnectionCallback(
         boost::bind(&RpcClient::onConnection, this, _1));
@@ -48,12 +86,17 @@ class RpcClient : boost::noncopyable
     client_.connect();
   }
 
-  void sendRequest()
+  // Thread safe, one run of options_.calls calls.
+  void start(int payloadSize, CountDownLatch* allFinished)
   {
-    echo::EchoRequest request;
-    request.set_payload("001010");
-    echo::EchoResponse* response = new echo::EchoResponse;
-    stub_.Echo(NULL, &request, response, NewCallback(this, &RpcClient::replied, response));
+    loop_->runInLoop(
+        boost::bind(&RpcClient::startInLoop, this, payloadSize, allFinished));
+  }
+
+  // After the run has finished.
+  int errors() const
+  {
+    return errors_;
   }
 
  private:
@@ -68,84 +111,295 @@ class RpcClient : boost::noncopyable
     }
   }
 
-  void replied(echo::EchoResponse* resp)
+  void startInLoop(int payloadSize, CountDownLatch* allFinished)
+  {
+    payload_.assign(payloadSize, 'x');
+    allFinished_ = allFinished;
+    sent_ = 0;
+    received_ = 0;
+    errors_ = 0;
+    start_ = Timestamp::now();
+    if (options_.rate > 0)
+    {
+      onTick();
+    }
+    else
+    {
+      while (sent_ < options_.depth && sent_ < options_.calls)
+      {
+        sendRequest(start_.microSecondsSinceEpoch());
+      }
+    }
+  }
+
+  void onTick()
+  {
+    double interval = Timestamp::kMicroSecondsPerSecond
+                      * options_.numClients / options_.rate;
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    while (sent_ < options_.calls)
+    {
+      int64_t due = start_.microSecondsSinceEpoch()
+                    + static_cast<int64_t>(sent_ * interval);
+      if (due > now)
+      {
+        // wakes up when the next one is due, calls missed meanwhile go
+        // out together, and count as late
+        loop_->runAfter(static_cast<double>(due - now) / Timestamp::kMicroSecondsPerSecond,
+                        boost::bind(&RpcClient::onTick, this));
+        break;
+      }
+      sendRequest(due);
+    }
+  }
+
+  void sendRequest(int64_t due)
+  {
+    echo::EchoRequest request;
+    request.set_payload(payload_);
+    echo::EchoResponse* response = new echo::EchoResponse;
+    ++sent_;
+    stub_.Echo(NULL, &request, response, NewCallback(this, &RpcClient::replied, response, due));
+  }
+
+  void replied(echo::EchoResponse* resp, int64_t due)
   {
     // LOG_INFO << "replied:\n" << resp->DebugString().c_str();
     // loop_->quit();
-    ++count_;
-    if (count_ < kRequests)
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    histogram_->add(now - due);
+    if (resp->payload().size() != payload_.size())
     {
-      sendRequest();
+      ++errors_;
     }
-    else
+    ++received_;
+    if (options_.rate <= 0 && sent_ < options_.calls)
+    {
+      sendRequest(now);
+    }
+    if (received_ == options_.calls)
     {
       LOG_INFO << "RpcClient " << this << " finished";
       allFinished_->countDown();
     }
   }
 
-  // EventLoop* loop_;
+  EventLoop* loop_;
   TcpClient client_;
   RpcChannelPtr channel_;
   echo::EchoService::Stub stub_;
   CountDownLatch* allConnected_;
+  const Options& options_;
+  Histogram* histogram_;  // of the loop
   CountDownLatch* allFinished_;
-  int count_;
+  std::string payload_;
+  Timestamp start_;
+  int sent_;
+  int received_;
+  int errors_;
 };
 
+void appendJson(std::string* json, const char* fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+void appendJson(std::string* json, const char* fmt, ...)
+{
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof buf, fmt, args);
+  va_end(args);
+  json->append(buf);
+}
+
+void usage(const char* prog)
+{
+  printf("Usage: %s [-c clients] [-t threads] [-d depth] [-r rate] [-n calls] [-P port]\n"
+         "          [-s size[,size]...] [-o json_file] host_ip\n"
+         "       %s host_ip numClients [numThreads [payloadSize]]\n"
+         "  -d  calls in flight on each connection, closed-loop\n"
+         "  -r  calls per second of all connections, open-loop\n"
+         "  -n  calls of each connection, for each payload size\n",
+         prog, prog);
+}
+
 int main(int argc, char* argv[])
 {
   LOG_INFO << "pid = " << getpid();
-  if (argc > 1)
+  Options options;
+  const char* jsonFile = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "c:t:d:r:n:P:s:o:")) != -1)
   {
-    int nClients = 1;
-
-    if (argc > 2)
+    switch (c)
     {
-      nClients = atoi(argv[2]);
+      case 'c':
+        options.numClients = atoi(optarg);
+        break;
+      case 't':
+        options.numThreads = atoi(optarg);
+        break;
+      case 'd':
+        options.depth = atoi(optarg);
+        break;
+      case 'r':
+        options.rate = atof(optarg);
+        break;
+      case 'n':
+        options.calls = atoi(optarg);
+        break;
+      case 'P':
+        options.port = static_cast<uint16_t>(atoi(optarg));
+        break;
+      case 's':
+        for (const char* p = optarg; p != NULL; p = strchr(p, ','))
+        {
+          if (*p == ',')
+            ++p;
+          options.payloadSizes.push_back(atoi(p));
+        }
+        break;
+      case 'o':
+        jsonFile = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
     }
+  }
 
-    int nThreads = 1;
-
-    if (argc > 3)
+  if (optind < argc)
+  {
+    const char* host = argv[optind];
+    // the old positional arguments
+    if (optind + 1 < argc)
+    {
+      options.numClients = atoi(argv[optind + 1]);
+    }
+    if (optind + 2 < argc)
     {
-      nThreads = atoi(argv[3]);
+      options.numThreads = atoi(argv[optind + 2]);
     }
+    if (optind + 3 < argc)
+    {
+      options.payloadSizes.assign(1, atoi(argv[optind + 3]));
+    }
+    if (options.payloadSizes.empty())
+    {
+      options.payloadSizes.push_back(6);
+    }
+    // the main thread only waits
+    options.numThreads = std::max(options.numThreads, 1);
 
-    CountDownLatch allConnected(nClients);
-    CountDownLatch allFinished(nClients);
+    CountDownLatch allConnected(options.numClients);
 
     EventLoop loop;
     EventLoopThreadPool pool(&loop, "rpcbench-client");
-    pool.setThreadNum(nThreads);
+    pool.setThreadNum(options.numThreads);
     pool.start();
-    InetAddress serverAddr(argv[1], 8888);
+    InetAddress serverAddr(host, options.port);
+
+    // one for each loop, so they need no lock
+    std::vector<EventLoop*> loops = pool.getAllLoops();
+    boost::ptr_vector<Histogram> histograms;
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      histograms.push_back(new Histogram);
+    }
 
     boost::ptr_vector<RpcClient> clients;
-    for (int i = 0; i < nClients; ++i)
+    for (int i = 0; i < options.numClients; ++i)
     {
-      clients.push_back(new RpcClient(pool.getNextLoop(), serverAddr, &allConnected, &allFinished));
+      size_t n = i % loops.size();
+      clients.push_back(new RpcClient(loops[n], serverAddr, &allConnected,
+                                      options, &histograms[n]));
       clients.back().connect();
     }
     allConnected.wait();
-    Timestamp start(Timestamp::now());
     LOG_INFO << "all connected";
-    for (int i = 0; i < nClients; ++i)
+
+    std::string json;
+    appendJson(&json, "{\"benchmark\": \"rpcbench\", \"mode\": \"%s\", "
+               "\"clients\": %d, \"threads\": %d, \"depth\": %d, \"rate\": %.1f, "
+               "\"calls\": %d, \"results\": [",
+               options.rate > 0 ? "open-loop" : "closed-loop",
+               options.numClients, options.numThreads, options.depth,
+               options.rate, options.calls);
+    for (size_t run = 0; run < options.payloadSizes.size(); ++run)
     {
-      clients[i].sendRequest();
+      int payloadSize = options.payloadSizes[run];
+      for (size_t i = 0; i < histograms.size(); ++i)
+      {
+        // loops are idle between runs
+        histograms[i].reset();
+      }
+      CountDownLatch allFinished(options.numClients);
+      Timestamp start(Timestamp::now());
+      for (int i = 0; i < options.numClients; ++i)
+      {
+        clients[i].start(payloadSize, &allFinished);
+      }
+      allFinished.wait();
+      Timestamp end(Timestamp::now());
+      LOG_INFO << "all finished";
+
+      Histogram total;
+      for (size_t i = 0; i < histograms.size(); ++i)
+      {
+        total.merge(histograms[i]);
+      }
+      int errors = 0;
+      for (int i = 0; i < options.numClients; ++i)
+      {
+        errors += clients[i].errors();
+      }
+      double seconds = timeDifference(end, start);
+      double callsPerSecond = static_cast<double>(total.count()) / seconds;
+      printf("payload %d: %f seconds, %.1f calls per second, "
+             "p50 %lld us, p99 %lld us, p99.9 %lld us, max %lld us, %d errors\n",
+             payloadSize, seconds, callsPerSecond,
+             static_cast<long long>(total.percentile(50)),
+             static_cast<long long>(total.percentile(99)),
+             static_cast<long long>(total.percentile(99.9)),
+             static_cast<long long>(total.max()), errors);
+      appendJson(&json, "%s{\"payload\": %d, \"seconds\": %f, \"calls_per_second\": %.1f, "
+                 "\"errors\": %d, \"latency_us\": {\"min\": %lld, \"mean\": %.1f, "
+                 "\"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"p999\": %lld, "
+                 "\"p9999\": %lld, \"max\": %lld}}",
+                 run > 0 ? ", " : "",
+                 payloadSize, seconds, callsPerSecond, errors,
+                 static_cast<long long>(total.min()), total.mean(),
+                 static_cast<long long>(total.percentile(50)),
+                 static_cast<long long>(total.percentile(90)),
+                 static_cast<long long>(total.percentile(99)),
+                 static_cast<long long>(total.percentile(99.9)),
+                 static_cast<long long>(total.percentile(99.99)),
+                 static_cast<long long>(total.max()));
     }
-    allFinished.wait();
-    Timestamp end(Timestamp::now());
-    LOG_INFO << "all finished";
-    double seconds = timeDifference(end, start);
-    printf("%f seconds\n", seconds);
-    printf("%.1f calls per second\n", nClients * kRequests / seconds);
+    json += "]}\n";
+
+    if (jsonFile)
+    {
+      FILE* fp = fopen(jsonFile, "w");
+      if (fp)
+      {
+        fputs(json.c_str(), fp);
+        fclose(fp);
+      }
+      else
+      {
+        LOG_SYSERR << "cannot open " << jsonFile;
+      }
+    }
+    else
+    {
+      fputs(json.c_str(), stdout);
+    }
+    fflush(stdout);
 
     exit(0);
   }
   else
   {
-    printf("Usage: %s host_ip numClients [numThreads]\n", argv[0]);
+    usage(argv[0]);
   }
 }
-
@@ -0,0 +1,99 @@
+
+// this is not a standalone header file
+
+// Counts of latencies in log-linear buckets, like HdrHistogram: values
+// below 2^kSubBits have a bucket each, above that every power of two is
+// split into 2^kSubBits buckets, so a value is off by less than 1/64.
+// Fixed size whatever the number of samples, and cheap to merge.
+class Histogram
+{
+ public:
+  static const int kSubBits = 6;
+  static const int64_t kSubBuckets = 1 << kSubBits;
+  static const int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+  Histogram()
+    : counts_(kBuckets)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = std::numeric_limits<int64_t>::max();
+    max_ = 0;
+  }
+
+  void add(int64_t value)
+  {
+    if (value < 0)
+      value = 0;
+    ++counts_[index(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const Histogram& rhs)
+  {
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      counts_[i] += rhs.counts_[i];
+    }
+    count_ += rhs.count_;
+    sum_ += rhs.sum_;
+    min_ = std::min(min_, rhs.min_);
+    max_ = std::max(max_, rhs.max_);
+  }
+
+  int64_t count() const { return count_; }
+  int64_t min() const { return count_ > 0 ? min_ : 0; }
+  int64_t max() const { return max_; }
+  double mean() const { return count_ > 0 ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+
+  // The nearest rank method, the highest value of its bucket.
+  int64_t percentile(double percent) const
+  {
+    if (count_ == 0)
+      return 0;
+    int64_t rank = static_cast<int64_t>(ceil(percent / 100 * static_cast<double>(count_)));
+    rank = std::max(rank, static_cast<int64_t>(1));
+    int64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      seen += counts_[i];
+      if (seen >= rank)
+        return std::min(highest(i), max_);
+    }
+    return max_;
+  }
+
+ private:
+  static int index(int64_t value)
+  {
+    if (value < kSubBuckets)
+      return static_cast<int>(value);
+    int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(value));
+    int shift = msb - kSubBits;
+    return static_cast<int>(((shift + 1) << kSubBits) + (value >> shift) - kSubBuckets);
+  }
+
+  static int64_t highest(int index)
+  {
+    if (index < kSubBuckets)
+      return index;
+    int shift = (index >> kSubBits) - 1;
+    int64_t sub = (index & (kSubBuckets - 1)) + kSubBuckets;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  std::vector<int64_t> counts_;
+  int64_t count_;
+  int64_t sum_;
+  int64_t min_;
+  int64_t max_;
+};
@@ -0,0 +1,207 @@
+#include <examples/protobuf/rpcbench/echo.pb.h>
+
+#include <muduo/base/CurrentThread.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Tail latency of small messages next to large ones, with and without the
+// thread pool of ProtobufCodecLite on the server.  The server echoes in one
+// IO thread, the main one.  Four connections echo large messages back to back, a fifth
+// sends small ones one at a time and records their round trips.
+//
+//   protobuf_rpc_pool_bench [large_bytes] [pool_threads] [seconds]
+//   protobuf_rpc_pool_bench 4194304 0 10
+//   protobuf_rpc_pool_bench 4194304 4 10
+
+extern const char g_tag[] = "ECHO";
+typedef ProtobufCodecLiteT<echo::EchoRequest, g_tag> EchoCodec;
+typedef boost::shared_ptr<echo::EchoRequest> EchoRequestPtr;
+
+const uint16_t kPort = 19600;
+const int kBulkClients = 4;
+
+class EchoServer : boost::noncopyable
+{
+ public:
+  EchoServer(EventLoop* loop, ThreadPool* pool)
+    : server_(loop, InetAddress(kPort), "PoolBenchServer"),
+      codec_(boost::bind(&EchoServer::onMessage, this, _1, _2, _3))
+  {
+    if (pool)
+    {
+      codec_.setThreadPool(pool);
+    }
+    server_.setConnectionCallback(
+        boost::bind(&EchoServer::onConnection, this, _1));
+    server_.setMessageCallback(
+        boost::bind(&EchoCodec::onMessage, &codec_, _1, _2, _3));
+  }
+
+  void start()
+  {
+    server_.start();
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, const EchoRequestPtr& message, Timestamp)
+  {
+    // reading from conn stops if it is behind
+    codec_.send(conn, message);
+  }
+
+  TcpServer server_;
+  EchoCodec codec_;
+};
+
+// Sends the next one when one comes back, large ones count, small ones
+// are timed.
+class EchoClient : boost::noncopyable
+{
+ public:
+  EchoClient(EventLoop* loop, int size, Histogram* histogram)
+    : client_(loop, InetAddress("127.0.0.1", kPort), "PoolBenchClient"),
+      codec_(boost::bind(&EchoClient::onMessage, this, _1, _2, _3)),
+      message_(new echo::EchoRequest),
+      histogram_(histogram),
+      received_(0)
+  {
+    message_->set_payload(std::string(size, 'x'));
+    client_.setConnectionCallback(
+        boost::bind(&EchoClient::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&EchoCodec::onMessage, &codec_, _1, _2, _3));
+  }
+
+  void connect()
+  {
+    client_.connect();
+  }
+
+  // of the loop
+  int64_t received() const { return received_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      sent_ = Timestamp::now();
+      codec_.send(conn, *message_);
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, const EchoRequestPtr&, Timestamp)
+  {
+    Timestamp now(Timestamp::now());
+    if (histogram_)
+    {
+      histogram_->add(now.microSecondsSinceEpoch() - sent_.microSecondsSinceEpoch());
+    }
+    ++received_;
+    sent_ = now;
+    codec_.send(conn, *message_);
+  }
+
+  TcpClient client_;
+  EchoCodec codec_;
+  EchoRequestPtr message_;
+  Histogram* histogram_;
+  Timestamp sent_;
+  int64_t received_;
+};
+
+void connectAll(boost::ptr_vector<EchoClient>* clients)
+{
+  for (size_t i = 0; i < clients->size(); ++i)
+  {
+    (*clients)[i].connect();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int size = argc > 1 ? atoi(argv[1]) : 4*1024*1024;
+  int poolThreads = argc > 2 ? atoi(argv[2]) : 0;
+  double seconds = argc > 3 ? atof(argv[3]) : 10.0;
+  Logger::setLogLevel(Logger::WARN);
+
+  ThreadPool pool("PoolBench");
+  if (poolThreads > 0)
+  {
+    pool.start(poolThreads);
+  }
+  EventLoop loop;
+  EchoServer server(&loop, poolThreads > 0 ? &pool : NULL);
+  server.start();
+
+  // the probe has a loop of its own, so bulk clients do not delay it
+  EventLoopThread bulkThread;
+  EventLoop* bulkLoop = bulkThread.startLoop();
+  boost::ptr_vector<EchoClient> bulk;
+  for (int i = 0; i < kBulkClients; ++i)
+  {
+    bulk.push_back(new EchoClient(bulkLoop, size, NULL));
+  }
+  EventLoopThread probeThread;
+  EventLoop* probeLoop = probeThread.startLoop();
+  Histogram histogram;
+  boost::ptr_vector<EchoClient> probe;
+  probe.push_back(new EchoClient(probeLoop, 64, &histogram));
+
+  bulkLoop->runInLoop(boost::bind(connectAll, &bulk));
+  probeLoop->runInLoop(boost::bind(connectAll, &probe));
+  loop.runAfter(seconds, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  // the server does not echo any more, clients go idle
+  CurrentThread::sleepUsec(100*1000);
+  int64_t bulkReceived = 0;
+  for (int i = 0; i < kBulkClients; ++i)
+  {
+    // of an idle loop
+    bulkReceived += bulk[i].received();
+  }
+  printf("%d bytes, pool %d: small p50 %lld us p99 %lld us max %lld us, %lld round trips, "
+         "large %.1f msgs/s\n",
+         size, poolThreads,
+         static_cast<long long>(histogram.percentile(50)),
+         static_cast<long long>(histogram.percentile(99)),
+         static_cast<long long>(histogram.max()),
+         static_cast<long long>(histogram.count()),
+         static_cast<double>(bulkReceived) / seconds);
+  fflush(stdout);
+  // the loops and the pool are not shut down cleanly, connections may
+  // still be in flight
+  _exit(0);
+}
@@ -34,10 +34,15 @@ int main(int argc, char* argv[])
   LOG_INFO << "pid = " << getpid() << " threads = " << nThreads;
   EventLoop loop;
   int port = argc > 2 ? atoi(argv[2]) : 8888;
+  int nWorkers = argc > 3 ? atoi(argv[3]) : 0;
+  int arenaBlockSize = argc > 4 ? atoi(argv[4]) : 0;
   InetAddress listenAddr(static_cast<uint16_t>(port));
   echo::EchoServiceImpl impl;
   RpcServer server(&loop, listenAddr);
   server.setThreadNum(nThreads);
+  // Echo is cheap, in the IO threads is faster, this measures the hop
+  server.setWorkerThreadNum(nWorkers);
+  server.setArenaBlockSize(arenaBlockSize);
   server.registerService(&impl);
   server.start();
   loop.loop();
@@ -0,0 +1,173 @@
+#include <examples/protobuf/rpcstream/stream.pb.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Exports count rows from the server, then sends them back to be summed.
+class StreamClient : boost::noncopyable
+{
+ public:
+  StreamClient(EventLoop* loop, const InetAddress& serverAddr, int count, int size)
+    : loop_(loop),
+      client_(loop, serverAddr, "StreamClient"),
+      channel_(new RpcChannel),
+      count_(count),
+      size_(size),
+      received_(0),
+      bytes_(0),
+      sent_(0)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&StreamClient::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+  }
+
+  void connect()
+  {
+    client_.connect();
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      channel_->setConnection(conn);
+      startExport();
+    }
+    else
+    {
+      channel_->onDisconnected(conn);
+      loop_->quit();
+    }
+  }
+
+  void startExport()
+  {
+    stream::ExportRequest request;
+    request.set_count(count_);
+    request.set_size(size_);
+    start_ = Timestamp::now();
+    RpcStreamPtr s = channel_->openStream(
+        stream::StreamService::descriptor()->FindMethodByName("Export"),
+        &request,
+        boost::bind(&StreamClient::onRow, this, _1, _2),
+        boost::bind(&StreamClient::onExportClose, this, _1, _2));
+    // server-streaming, nothing to write
+    s->close();
+  }
+
+  void onRow(const RpcStreamPtr&, const MessagePtr& message)
+  {
+    boost::shared_ptr<stream::Row> row = down_pointer_cast<stream::Row>(message);
+    if (row)
+    {
+      ++received_;
+      bytes_ += row->ByteSize();
+    }
+  }
+
+  void onExportClose(const RpcStreamPtr&, ErrorCode error)
+  {
+    double seconds = timeDifference(Timestamp::now(), start_);
+    printf("Export %s: %d rows, %.2f MiB in %.3f seconds, %.0f rows/s, %.2f MiB/s\n",
+           ErrorCode_Name(error).c_str(), received_,
+           static_cast<double>(bytes_) / 1024 / 1024, seconds,
+           received_ / seconds, static_cast<double>(bytes_) / 1024 / 1024 / seconds);
+    startSum();
+  }
+
+  void startSum()
+  {
+    start_ = Timestamp::now();
+    sum_ = channel_->openStream(
+        stream::StreamService::descriptor()->FindMethodByName("Sum"),
+        NULL,
+        boost::bind(&StreamClient::onSumResponse, this, _1, _2),
+        boost::bind(&StreamClient::onSumClose, this, _1, _2));
+    sum_->setWritableCallback(boost::bind(&StreamClient::writeRows, this, _1));
+  }
+
+  void writeRows(const RpcStreamPtr& s)
+  {
+    stream::Row row;
+    row.set_data(std::string(size_, 'y'));
+    while (sent_ < count_ && s->writable())
+    {
+      row.set_id(sent_++);
+      s->write(row);
+    }
+    if (sent_ == count_ && !s->writeClosed())
+    {
+      s->close();
+    }
+  }
+
+  void onSumResponse(const RpcStreamPtr&, const MessagePtr& message)
+  {
+    boost::shared_ptr<stream::SumResponse> response
+        = down_pointer_cast<stream::SumResponse>(message);
+    if (response)
+    {
+      int64_t expected = static_cast<int64_t>(count_) * (count_ - 1) / 2;
+      printf("Sum: %lld rows, sum %lld, %s\n",
+             static_cast<long long>(response->count()),
+             static_cast<long long>(response->sum()),
+             response->sum() == expected ? "correct" : "WRONG");
+    }
+  }
+
+  void onSumClose(const RpcStreamPtr&, ErrorCode error)
+  {
+    double seconds = timeDifference(Timestamp::now(), start_);
+    printf("Sum %s: %d rows in %.3f seconds\n",
+           ErrorCode_Name(error).c_str(), sent_, seconds);
+    sum_.reset();
+    client_.disconnect();
+  }
+
+  EventLoop* loop_;
+  TcpClient client_;
+  RpcChannelPtr channel_;
+  const int count_;
+  const int size_;
+  Timestamp start_;
+  int received_;
+  int64_t bytes_;
+  int sent_;
+  RpcStreamPtr sum_;
+};
+
+int main(int argc, char* argv[])
+{
+  LOG_INFO << "pid = " << getpid();
+  if (argc > 1)
+  {
+    int count = argc > 2 ? atoi(argv[2]) : 100000;
+    int size = argc > 3 ? atoi(argv[3]) : 100;
+    EventLoop loop;
+    InetAddress serverAddr(argv[1], 9983);
+
+    StreamClient client(&loop, serverAddr, count, size);
+    client.connect();
+    loop.loop();
+  }
+  else
+  {
+    printf("Usage: %s host_ip [count [size]]\n", argv[0]);
+  }
+  google::protobuf::ShutdownProtobufLibrary();
+}
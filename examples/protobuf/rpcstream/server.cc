@@ -0,0 +1,128 @@
+#include <examples/protobuf/rpcstream/stream.pb.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/protorpc/RpcServer.h>
+
+#include <boost/bind.hpp>
+
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace stream
+{
+
+// Writes rows as the client takes them.
+class ExportSession : boost::noncopyable
+{
+ public:
+  ExportSession(int count, int size)
+    : count_(count),
+      next_(0),
+      data_(size, 'x')
+  {
+  }
+
+  void onWritable(const RpcStreamPtr& s)
+  {
+    Row row;
+    row.set_data(data_);
+    while (next_ < count_ && s->writable())
+    {
+      row.set_id(next_++);
+      s->write(row);
+    }
+    if (next_ == count_ && !s->writeClosed())
+    {
+      s->close();
+    }
+  }
+
+  void onClose(const RpcStreamPtr& s, ErrorCode error)
+  {
+    LOG_INFO << "Export " << s->id() << " wrote " << next_ << " rows, "
+             << ErrorCode_Name(error);
+  }
+
+ private:
+  const int count_;
+  int next_;
+  const std::string data_;
+};
+
+// Adds up ids of rows, replies when the client is done.
+class SumSession : boost::noncopyable
+{
+ public:
+  SumSession()
+    : count_(0),
+      sum_(0)
+  {
+  }
+
+  void onMessage(const RpcStreamPtr& s, const MessagePtr& message)
+  {
+    boost::shared_ptr<Row> row = down_pointer_cast<Row>(message);
+    if (row)
+    {
+      ++count_;
+      sum_ += row->id();
+    }
+    else
+    {
+      SumResponse response;
+      response.set_count(count_);
+      response.set_sum(sum_);
+      if (!s->write(response))
+      {
+        LOG_WARN << "Sum " << s->id() << " has no credits";
+      }
+      s->close();
+    }
+  }
+
+ private:
+  int64_t count_;
+  int64_t sum_;
+};
+
+void onExport(const RpcStreamPtr& s, const MessagePtr& request)
+{
+  boost::shared_ptr<ExportRequest> req = down_pointer_cast<ExportRequest>(request);
+  if (!req)
+  {
+    s->close(INVALID_REQUEST);
+    return;
+  }
+  // held by the callbacks, until the stream is done
+  boost::shared_ptr<ExportSession> session(new ExportSession(req->count(), req->size()));
+  s->setWritableCallback(boost::bind(&ExportSession::onWritable, session, _1));
+  s->setCloseCallback(boost::bind(&ExportSession::onClose, session, _1, _2));
+  session->onWritable(s);
+}
+
+void onSum(const RpcStreamPtr& s, const MessagePtr&)
+{
+  boost::shared_ptr<SumSession> session(new SumSession);
+  s->setMessageCallback(boost::bind(&SumSession::onMessage, session, _1, _2));
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  int nThreads =  argc > 1 ? atoi(argv[1]) : 0;
+  LOG_INFO << "pid = " << getpid() << " threads = " << nThreads;
+  EventLoop loop;
+  InetAddress listenAddr(9983);
+  RpcServer server(&loop, listenAddr);
+  server.setThreadNum(nThreads);
+  const google::protobuf::ServiceDescriptor* desc = stream::StreamService::descriptor();
+  server.registerStreamHandler(desc->FindMethodByName("Export"), stream::onExport);
+  server.registerStreamHandler(desc->FindMethodByName("Sum"), stream::onSum);
+  server.start();
+  loop.loop();
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -1,11 +1,230 @@
 #include <muduo/base/AsyncLogging.h>
 #include <muduo/base/LogFile.h>
+#include <muduo/base/Logging.h>
 #include <muduo/base/Timestamp.h>
 
+#include <boost/scoped_array.hpp>
+
+#include <algorithm>
+
 #include <stdio.h>
+#include <string.h>
 
 using namespace muduo;
 
+namespace
+{
+
+const uint64_t kThreadBufferSize = 1024*1024;
+// longer lines go to the shared buffer
+const int kMaxThreadBufferLine = 64*1024;
+// Logger starts each line with the time in a fixed width,
+// "20140101 12:34:56.123456", so lines sort by their first bytes.
+const size_t kTimeLength = 24;
+// the rest of the buffer is unused, the next line starts from the beginning
+const int32_t kPadding = -1;
+// in the length of a line that is a binary record
+const int32_t kRecordFlag = 1 << 30;
+// of lines to a WriteCallback
+const size_t kBatchSize = 1024*1024;
+
+uint64_t recordSize(int len)
+{
+  // a length, then the line, keeps lengths aligned
+  return (sizeof(int32_t) + len + 3) & ~static_cast<uint64_t>(3);
+}
+
+// Text lines sort by their time, binary records too, raw ones come after
+// text lines, which are not from Logger then.
+bool earlier(StringPiece lhs, bool lhsRecord, StringPiece rhs, bool rhsRecord)
+{
+  if (lhsRecord && rhsRecord)
+  {
+    return Logger::recordTime(lhs.data()) < Logger::recordTime(rhs.data());
+  }
+  else if (lhsRecord || rhsRecord)
+  {
+    return rhsRecord;
+  }
+  // JSON lines of Logger::setJson() have the time after this
+  StringPiece json("{\"time\":\"");
+  if (lhs.starts_with(json) && rhs.starts_with(json))
+  {
+    lhs.remove_prefix(json.size());
+    rhs.remove_prefix(json.size());
+  }
+  size_t n = std::min(kTimeLength, static_cast<size_t>(std::min(lhs.size(), rhs.size())));
+  return memcmp(lhs.data(), rhs.data(), n) < 0;
+}
+
+}
+
+// A ring buffer of lines of one thread, which appends to it without a
+// lock, and the backend thread takes lines out of it.
+class AsyncLogging::ThreadBuffer : boost::noncopyable
+{
+ public:
+  // Where the backend thread is in one buffer, when it writes lines.
+  struct Cursor
+  {
+    ThreadBuffer* buffer;
+    uint64_t index;
+    uint64_t end;
+    bool closed;
+    StringPiece line;  // at index, formatted if it is a binary record
+    bool record;       // line is a binary record, with setRawRecords()
+    string text;       // of the formatted record
+
+    void setLine(AsyncLogging* log)
+    {
+      line = buffer->line(&index, &record);
+      if (record && !log->rawRecords_)
+      {
+        // recordStream_ is reused before the line is written
+        log->formatRecord(line).CopyToString(&text);
+        line = text;
+        record = false;
+      }
+    }
+  };
+
+  ThreadBuffer()
+    : data_(new char[kThreadBufferSize]),
+      tid_(CurrentThread::tid()),
+      writeIndex_(0),
+      dropped_(0),
+      closed_(false),
+      readIndex_(0)
+  {
+  }
+
+  int tid() const { return tid_; }
+
+  // In its thread.  Returns false if the line does not fit, sets
+  // halfFull when it is the line that fills the buffer to over half.
+  bool append(const char* logline, int len, bool record, bool* halfFull)
+  {
+    uint64_t size = recordSize(len);
+    uint64_t write = writeIndex_;
+    uint64_t read = __atomic_load_n(&readIndex_, __ATOMIC_ACQUIRE);
+    uint64_t offset = write % kThreadBufferSize;
+    uint64_t padding = kThreadBufferSize - offset < size ? kThreadBufferSize - offset : 0;
+    if (write + padding + size - read > kThreadBufferSize)
+    {
+      return false;
+    }
+    if (padding > 0)
+    {
+      memcpy(data_.get() + offset, &kPadding, sizeof kPadding);
+      offset = 0;
+    }
+    int32_t length = record ? len | kRecordFlag : len;
+    memcpy(data_.get() + offset, &length, sizeof length);
+    memcpy(data_.get() + offset + sizeof length, logline, len);
+    __atomic_store_n(&writeIndex_, write + padding + size, __ATOMIC_RELEASE);
+    *halfFull = write - read <= kThreadBufferSize / 2
+                && write + padding + size - read > kThreadBufferSize / 2;
+    return true;
+  }
+
+  // In its thread.  Returns true if it is the first since the backend
+  // thread looked.
+  bool drop()
+  {
+    return __atomic_fetch_add(&dropped_, 1, __ATOMIC_RELAXED) == 0;
+  }
+
+  // At the exit of its thread.
+  void close()
+  {
+    __atomic_store_n(&closed_, true, __ATOMIC_RELEASE);
+  }
+
+  // The rest are in the backend thread.
+
+  bool closed() const
+  {
+    return __atomic_load_n(&closed_, __ATOMIC_ACQUIRE);
+  }
+
+  int64_t takeDropped()
+  {
+    return __atomic_exchange_n(&dropped_, 0, __ATOMIC_RELAXED);
+  }
+
+  uint64_t readIndex() const
+  {
+    return readIndex_;
+  }
+
+  // Any thread.
+  int64_t readableBytes() const
+  {
+    return static_cast<int64_t>(__atomic_load_n(&writeIndex_, __ATOMIC_ACQUIRE)
+                                - __atomic_load_n(&readIndex_, __ATOMIC_ACQUIRE));
+  }
+
+  uint64_t writeIndex() const
+  {
+    return __atomic_load_n(&writeIndex_, __ATOMIC_ACQUIRE);
+  }
+
+  // The line at *index, which is moved over padding.
+  StringPiece line(uint64_t* index, bool* record) const
+  {
+    const char* entry = data_.get() + *index % kThreadBufferSize;
+    int32_t length;
+    memcpy(&length, entry, sizeof length);
+    if (length == kPadding)
+    {
+      *index += kThreadBufferSize - *index % kThreadBufferSize;
+      entry = data_.get();
+      memcpy(&length, entry, sizeof length);
+    }
+    *record = (length & kRecordFlag) != 0;
+    return StringPiece(entry + sizeof length, length & ~kRecordFlag);
+  }
+
+  // Lines before index have been written, their room can be reused.
+  void retire(uint64_t index)
+  {
+    __atomic_store_n(&readIndex_, index, __ATOMIC_RELEASE);
+  }
+
+ private:
+  boost::scoped_array<char> data_;
+  const int tid_;
+
+  // changed by its thread
+  uint64_t writeIndex_;
+  int64_t dropped_;
+  bool closed_;
+
+  // changed by the backend thread, on a cache line of its own
+  char pad_[64];
+  uint64_t readIndex_;
+};
+
+// Closes the buffer of a thread when the thread exits, the backend
+// thread deletes it after writing what is left in it.
+struct AsyncLogging::LocalBuffer
+{
+  ThreadBuffer* buffer;
+
+  LocalBuffer()
+    : buffer(NULL)
+  {
+  }
+
+  ~LocalBuffer()
+  {
+    if (buffer)
+    {
+      buffer->close();
+    }
+  }
+};
+
 AsyncLogging::AsyncLogging(const string& basename,
                            off_t rollSize,
                            int flushInterval)
@@ -17,21 +236,76 @@ AsyncLogging::AsyncLogging(const string& basename,
     latch_(1),
     mutex_(),
     cond_(mutex_),
+    notFull_(mutex_),
     currentBuffer_(new Buffer),
     nextBuffer_(new Buffer),
-    buffers_()
+    buffers_(),
+    perThreadBuffers_(false),
+    rawRecords_(false),
+    preallocate_(false),
+    threadBufferFull_(false),
+    overflowPolicy_(kDropBacklog),
+    maxQueuedBuffers_(25),
+    blockSeconds_(0.1),
+    sampleRate_(10),
+    sampled_(0),
+    writtenBytes_(0),
+    writtenBytesPerSecond_(0),
+    droppedLines_(0),
+    droppedBuffers_(0),
+    blockedLines_(0),
+    writeMicroSeconds_(0),
+    maxWriteMicroSeconds_(0),
+    roundBytes_(0),
+    roundDroppedLines_(0),
+    rateBytes_(0)
 {
   currentBuffer_->bzero();
   nextBuffer_->bzero();
   buffers_.reserve(16);
 }
 
+AsyncLogging::~AsyncLogging()
+{
+  if (running_)
+  {
+    stop();
+  }
+  // threads still alive leak their LocalBuffer, but never touch it again
+  for (size_t i = 0; i < threadBuffers_.size(); ++i)
+  {
+    delete threadBuffers_[i];
+  }
+}
+
 void AsyncLogging::append(const char* logline, int len)
 {
+  // Lines are only taken for binary records in binary mode, where all
+  // lines of Logger are, text may have '\0' in it.
+  bool record = Logger::binary() && LogStream::recordLength(logline, len) == len;
+  if (perThreadBuffers_ && len <= kMaxThreadBufferLine)
+  {
+    appendToThreadBuffer(logline, len, record);
+    return;
+  }
+
   muduo::MutexLockGuard lock(mutex_);
+  if (overflowPolicy_ != kDropBacklog
+      && static_cast<int>(buffers_.size()) >= maxQueuedBuffers_
+      && !keepOnOverflow(logline, len))
+  {
+    ++droppedLines_;
+    return;
+  }
+  appendLocked(logline, len, record);
+}
+
+void AsyncLogging::appendLocked(const char* logline, int len, bool record)
+{
+  mutex_.assertLocked();
   if (currentBuffer_->avail() > len)
   {
-    currentBuffer_->append(logline, len);
+    currentBuffer_->append(logline, len, record);
   }
   else
   {
@@ -45,23 +319,131 @@ void AsyncLogging::append(const char* logline, int len)
     {
       currentBuffer_.reset(new Buffer); // Rarely happens
     }
-    currentBuffer_->append(logline, len);
+    currentBuffer_->append(logline, len, record);
     cond_.notify();
   }
 }
 
+bool AsyncLogging::keepOnOverflow(const char* logline, int len)
+{
+  mutex_.assertLocked();
+  if (Logger::lineLevel(logline, len) >= Logger::ERROR)
+  {
+    return true;
+  }
+  switch (overflowPolicy_)
+  {
+    case kBlock:
+    {
+      ++blockedLines_;
+      Timestamp deadline = addTime(Timestamp::now(), blockSeconds_);
+      while (static_cast<int>(buffers_.size()) >= maxQueuedBuffers_)
+      {
+        double seconds = timeDifference(deadline, Timestamp::now());
+        if (seconds <= 0)
+        {
+          return false;
+        }
+        notFull_.waitForSeconds(seconds);
+      }
+      return true;
+    }
+    case kSample:
+      return ++sampled_ % sampleRate_ == 0;
+    default:
+      return false;
+  }
+}
+
+void AsyncLogging::appendToThreadBuffer(const char* logline, int len, bool record)
+{
+  LocalBuffer& local = localBuffer_.value();
+  if (local.buffer == NULL)
+  {
+    local.buffer = new ThreadBuffer;
+    muduo::MutexLockGuard lock(mutex_);
+    threadBuffers_.push_back(local.buffer);
+  }
+
+  bool halfFull = false;
+  if (local.buffer->append(logline, len, record, &halfFull))
+  {
+    if (halfFull)
+    {
+      wakeup();
+    }
+    return;
+  }
+
+  // full
+  if (overflowPolicy_ == kBlock && waitForRoom(local.buffer, logline, len, record))
+  {
+    return;
+  }
+  if (overflowPolicy_ != kDropBacklog)
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    // kept ones go to the shared buffer, lines of a thread can be out of
+    // order then
+    if (Logger::lineLevel(logline, len) >= Logger::ERROR
+        || (overflowPolicy_ == kSample && ++sampled_ % sampleRate_ == 0))
+    {
+      appendLocked(logline, len, record);
+      return;
+    }
+  }
+  if (local.buffer->drop())
+  {
+    wakeup();
+  }
+}
+
+bool AsyncLogging::waitForRoom(ThreadBuffer* buffer, const char* logline, int len, bool record)
+{
+  muduo::MutexLockGuard lock(mutex_);
+  ++blockedLines_;
+  threadBufferFull_ = true;
+  cond_.notify();
+  Timestamp deadline = addTime(Timestamp::now(), blockSeconds_);
+  bool halfFull = false;
+  while (!buffer->append(logline, len, record, &halfFull))
+  {
+    double seconds = timeDifference(deadline, Timestamp::now());
+    if (seconds <= 0)
+    {
+      return false;
+    }
+    notFull_.waitForSeconds(seconds);
+  }
+  return true;
+}
+
+void AsyncLogging::wakeup()
+{
+  // the lock is taken once in half a buffer, not for every line
+  muduo::MutexLockGuard lock(mutex_);
+  threadBufferFull_ = true;
+  cond_.notify();
+}
+
 void AsyncLogging::threadFunc()
 {
   assert(running_ == true);
   latch_.countDown();
-  LogFile output(basename_, rollSize_, false);
+  if (!writeCallback_)
+  {
+    output_.reset(new LogFile(basename_, rollSize_, false, flushInterval_, 1024, preallocate_));
+    output_->setRollCallback(rollCallback_);
+  }
   BufferPtr newBuffer1(new Buffer);
   BufferPtr newBuffer2(new Buffer);
   newBuffer1->bzero();
   newBuffer2->bzero();
   BufferVector buffersToWrite;
   buffersToWrite.reserve(16);
-  while (running_)
+  rateStart_ = Timestamp::now();
+  bool running = true;
+  while (running)
   {
     assert(newBuffer1 && newBuffer1->length() == 0);
     assert(newBuffer2 && newBuffer2->length() == 0);
@@ -69,10 +451,13 @@ void AsyncLogging::threadFunc()
 
     {
       muduo::MutexLockGuard lock(mutex_);
-      if (buffers_.empty())  // unusual usage!
+      if (buffers_.empty() && !threadBufferFull_ && running_)  // unusual usage!
       {
         cond_.waitForSeconds(flushInterval_);
       }
+      // one more round after stop(), for lines appended before it
+      running = running_;
+      threadBufferFull_ = false;
       buffers_.push_back(currentBuffer_.release());
       currentBuffer_ = boost::ptr_container::move(newBuffer1);
       buffersToWrite.swap(buffers_);
@@ -80,25 +465,38 @@ void AsyncLogging::threadFunc()
       {
         nextBuffer_ = boost::ptr_container::move(newBuffer2);
       }
+      if (overflowPolicy_ == kBlock)
+      {
+        notFull_.notifyAll();
+      }
     }
 
     assert(!buffersToWrite.empty());
+    Timestamp start = Timestamp::now();
+    int64_t droppedBuffers = 0;
 
-    if (buffersToWrite.size() > 25)
+    if (overflowPolicy_ == kDropBacklog
+        && static_cast<int>(buffersToWrite.size()) > maxQueuedBuffers_)
     {
+      droppedBuffers = buffersToWrite.size() - 2;
       char buf[256];
       snprintf(buf, sizeof buf, "Dropped log messages at %s, %zd larger buffers\n",
                Timestamp::now().toFormattedString().c_str(),
                buffersToWrite.size()-2);
       fputs(buf, stderr);
-      output.append(buf, static_cast<int>(strlen(buf)));
+      write(buf, static_cast<int>(strlen(buf)));
       buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
     }
 
     for (size_t i = 0; i < buffersToWrite.size(); ++i)
     {
       // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffersToWrite[i].data(), buffersToWrite[i].length());
+      writeLines(buffersToWrite[i]);
+    }
+
+    if (perThreadBuffers_)
+    {
+      writeThreadBuffers();
     }
 
     if (buffersToWrite.size() > 2)
@@ -122,8 +520,216 @@ void AsyncLogging::threadFunc()
     }
 
     buffersToWrite.clear();
-    output.flush();
+    flush();
+    updateStats(start, droppedBuffers);
   }
-  output.flush();
+  flush();
+  output_.reset();
 }
 
+void AsyncLogging::write(const char* data, int len)
+{
+  if (output_)
+  {
+    output_->append(data, len);
+  }
+  else
+  {
+    // Lines of thread buffers and of binary records come one by one, runs
+    // of whole lines of shared buffers go as they are.
+    if (batch_.size() + len > kBatchSize)
+    {
+      flush();
+    }
+    if (static_cast<size_t>(len) >= kBatchSize)
+    {
+      writeCallback_(data, len);
+    }
+    else
+    {
+      batch_.append(data, len);
+    }
+  }
+  roundBytes_ += len;
+}
+
+void AsyncLogging::flush()
+{
+  if (output_)
+  {
+    output_->flush();
+  }
+  else if (!batch_.empty())
+  {
+    writeCallback_(batch_.data(), static_cast<int>(batch_.size()));
+    batch_.clear();
+  }
+}
+
+void AsyncLogging::updateStats(Timestamp start, int64_t droppedBuffers)
+{
+  Timestamp now = Timestamp::now();
+  muduo::MutexLockGuard lock(mutex_);
+  writtenBytes_ += roundBytes_;
+  droppedLines_ += roundDroppedLines_;
+  droppedBuffers_ += droppedBuffers;
+  roundBytes_ = 0;
+  roundDroppedLines_ = 0;
+  writeMicroSeconds_ = now.microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+  maxWriteMicroSeconds_ = std::max(maxWriteMicroSeconds_, writeMicroSeconds_);
+  double seconds = timeDifference(now, rateStart_);
+  if (seconds >= 1.0)
+  {
+    writtenBytesPerSecond_ = static_cast<double>(writtenBytes_ - rateBytes_) / seconds;
+    rateStart_ = now;
+    rateBytes_ = writtenBytes_;
+  }
+  // buffers of threads have room now
+  if (overflowPolicy_ == kBlock)
+  {
+    notFull_.notifyAll();
+  }
+}
+
+AsyncLogging::Stats AsyncLogging::stats()
+{
+  Stats stats;
+  muduo::MutexLockGuard lock(mutex_);
+  stats.queuedBuffers = static_cast<int>(buffers_.size());
+  stats.queuedBytes = 0;
+  for (size_t i = 0; i < threadBuffers_.size(); ++i)
+  {
+    stats.queuedBytes += threadBuffers_[i]->readableBytes();
+  }
+  stats.writtenBytes = writtenBytes_;
+  stats.writtenBytesPerSecond = writtenBytesPerSecond_;
+  stats.droppedLines = droppedLines_;
+  stats.droppedBuffers = droppedBuffers_;
+  stats.blockedLines = blockedLines_;
+  stats.writeMicroSeconds = writeMicroSeconds_;
+  stats.maxWriteMicroSeconds = maxWriteMicroSeconds_;
+  return stats;
+}
+
+void AsyncLogging::writeLines(const Buffer& buffer)
+{
+  const char* data = buffer.data();
+  const std::vector<int>& records = buffer.records();
+  int start = 0;
+  for (size_t i = 0; i < records.size(); ++i)
+  {
+    if (records[i] > start)
+    {
+      write(data + start, records[i] - start);
+    }
+    const char* record = data + records[i];
+    StringPiece line(record, LogStream::recordLength(record, buffer.length() - records[i]));
+    start = records[i] + line.size();
+    if (!rawRecords_)
+    {
+      line = formatRecord(line);
+    }
+    write(line.data(), line.size());
+  }
+  if (buffer.length() > start)
+  {
+    write(data + start, buffer.length() - start);
+  }
+}
+
+StringPiece AsyncLogging::formatRecord(StringPiece record)
+{
+  recordStream_.resetBuffer();
+  if (!Logger::formatRecord(record.data(), record.size(), recordStream_))
+  {
+    recordStream_ << "Corrupted binary log record\n";
+  }
+  return recordStream_.buffer().toStringPiece();
+}
+
+void AsyncLogging::writeThreadBuffers()
+{
+  std::vector<ThreadBuffer::Cursor> cursors;
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    cursors.resize(threadBuffers_.size());
+    for (size_t i = 0; i < threadBuffers_.size(); ++i)
+    {
+      cursors[i].buffer = threadBuffers_[i];
+    }
+  }
+
+  for (size_t i = 0; i < cursors.size(); ++i)
+  {
+    ThreadBuffer::Cursor& c = cursors[i];
+    // before the lines, so none is appended after it is seen closed
+    c.closed = c.buffer->closed();
+    c.index = c.buffer->readIndex();
+    c.end = c.buffer->writeIndex();
+    int64_t dropped = c.buffer->takeDropped();
+    if (dropped > 0)
+    {
+      char buf[256];
+      snprintf(buf, sizeof buf, "Dropped %lld log messages of thread %d at %s\n",
+               static_cast<long long>(dropped), c.buffer->tid(),
+               Timestamp::now().toFormattedString().c_str());
+      fputs(buf, stderr);
+      write(buf, static_cast<int>(strlen(buf)));
+      roundDroppedLines_ += dropped;
+    }
+  }
+
+  // lines of each thread are in order, the earliest of their first lines
+  // goes first.  Lines appended after this look can be earlier than some
+  // written now, but not by more than the time of one round.
+  for (size_t i = 0; i < cursors.size(); ++i)
+  {
+    if (cursors[i].index != cursors[i].end)
+    {
+      cursors[i].setLine(this);
+    }
+  }
+  for (;;)
+  {
+    ThreadBuffer::Cursor* next = NULL;
+    for (size_t i = 0; i < cursors.size(); ++i)
+    {
+      ThreadBuffer::Cursor& c = cursors[i];
+      if (c.index != c.end
+          && (next == NULL || earlier(c.line, c.record, next->line, next->record)))
+      {
+        next = &c;
+      }
+    }
+    if (next == NULL)
+    {
+      break;
+    }
+    write(next->line.data(), next->line.size());
+    bool record = false;
+    next->index += recordSize(next->buffer->line(&next->index, &record).size());
+    if (next->index != next->end)
+    {
+      next->setLine(this);
+    }
+  }
+
+  std::vector<ThreadBuffer*> closed;
+  for (size_t i = 0; i < cursors.size(); ++i)
+  {
+    cursors[i].buffer->retire(cursors[i].end);
+    if (cursors[i].closed)
+    {
+      closed.push_back(cursors[i].buffer);
+    }
+  }
+  if (!closed.empty())
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    for (size_t i = 0; i < closed.size(); ++i)
+    {
+      threadBuffers_.erase(std::find(threadBuffers_.begin(), threadBuffers_.end(), closed[i]));
+      delete closed[i];
+    }
+  }
+}
@@ -4,34 +4,121 @@
 #include <muduo/base/BlockingQueue.h>
 #include <muduo/base/BoundedBlockingQueue.h>
 #include <muduo/base/CountDownLatch.h>
+#include <muduo/base/LogFile.h>
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Thread.h>
+#include <muduo/base/ThreadLocal.h>
+#include <muduo/base/Timestamp.h>
 #include <muduo/base/LogStream.h>
 
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
+#include <vector>
+
 namespace muduo
 {
 
 class AsyncLogging : boost::noncopyable
 {
  public:
+  // What append() does when the backend thread falls behind, ie. more
+  // than maxQueuedBuffers full buffers wait for it, or the buffer of the
+  // thread is full.  Lines of ERROR and FATAL are kept, but by
+  // kDropBacklog.
+  enum OverflowPolicy
+  {
+    kDropBacklog,  // the backend thread discards all but two buffers
+    kBlock,        // waits for room up to blockSeconds, then drops
+    kDropNewest,   // drops new lines
+    kSample,       // keeps one in sampleRate new lines
+  };
+
+  struct Stats
+  {
+    int queuedBuffers;             // full ones waiting for the backend thread
+    int64_t queuedBytes;           // in buffers of threads
+    int64_t writtenBytes;
+    double writtenBytesPerSecond;  // in the last few seconds
+    int64_t droppedLines;          // by the overflow policy
+    int64_t droppedBuffers;        // by kDropBacklog
+    int64_t blockedLines;          // waited for room, by kBlock
+    int64_t writeMicroSeconds;     // of the last round of the backend thread
+    int64_t maxWriteMicroSeconds;
+  };
 
   AsyncLogging(const string& basename,
                off_t rollSize,
                int flushInterval = 3);
 
-  ~AsyncLogging()
+  ~AsyncLogging();
+
+  // Each thread appends to a buffer of its own, without taking a lock,
+  // instead of all threads sharing one under a mutex.  The backend thread
+  // merges lines of all threads by the time Logger puts in front of them.
+  // Before start().
+  void setPerThreadBuffers(bool on)
   {
-    if (running_)
-    {
-      stop();
-    }
+    perThreadBuffers_ = on;
+  }
+
+  // Binary records of Logger are formatted in the backend thread, or
+  // written as they are, for logdecoder to format them.  Before start().
+  void setRawRecords(bool on)
+  {
+    rawRecords_ = on;
+  }
+
+  // Before start().
+  void setOverflowPolicy(OverflowPolicy policy)
+  {
+    overflowPolicy_ = policy;
+  }
+
+  void setMaxQueuedBuffers(int maxBuffers)
+  {
+    maxQueuedBuffers_ = maxBuffers;
+  }
+
+  void setBlockSeconds(double seconds)
+  {
+    blockSeconds_ = seconds;
+  }
+
+  void setSampleRate(int rate)
+  {
+    sampleRate_ = rate;
+  }
+
+  // Log files are preallocated to rollSize and kept out of the page cache,
+  // see FileUtil::AppendFile.  Before start().
+  void setPreallocate(bool on)
+  {
+    preallocate_ = on;
   }
 
+  // See LogFile::setRollCallback().  Before start().
+  void setRollCallback(const LogFile::RollCallback& cb)
+  {
+    rollCallback_ = cb;
+  }
+
+  typedef boost::function<void (const char* data, int len)> WriteCallback;
+
+  // Lines go to cb in the backend thread, instead of log files, in batches
+  // of whole ones, of up to a buffer, eg. to a sink shipping them over the
+  // network.  basename and rollSize are not used then.  Before start().
+  void setWriteCallback(const WriteCallback& cb)
+  {
+    writeCallback_ = cb;
+  }
+
+  // Thread safe.
+  Stats stats();
+
   void append(const char* logline, int len);
 
   void start()
@@ -41,10 +128,14 @@ class AsyncLogging : boost::noncopyable
     latch_.wait();
   }
 
+  // Lines appended before are written.
   void stop()
   {
-    running_ = false;
-    cond_.notify();
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      running_ = false;
+      cond_.notify();
+    }
     thread_.join();
   }
 
@@ -54,9 +145,49 @@ class AsyncLogging : boost::noncopyable
   AsyncLogging(const AsyncLogging&);  // ptr_container
   void operator=(const AsyncLogging&);  // ptr_container
 
+  class ThreadBuffer;
+  struct LocalBuffer;
+
   void threadFunc();
+  void appendLocked(const char* logline, int len, bool record);
+  bool keepOnOverflow(const char* logline, int len);
+  void appendToThreadBuffer(const char* logline, int len, bool record);
+  bool waitForRoom(ThreadBuffer* buffer, const char* logline, int len, bool record);
+  void wakeup();
+  void writeThreadBuffers();
+  void write(const char* data, int len);
+  void flush();
+  StringPiece formatRecord(StringPiece record);
+  void updateStats(Timestamp start, int64_t droppedBuffers);
+
+  // Lines, and where the binary records among them start, so a text line
+  // is never taken for one.
+  class Buffer : public muduo::detail::FixedBuffer<muduo::detail::kLargeBuffer>
+  {
+   public:
+    void append(const char* logline, int len, bool record)
+    {
+      if (record)
+      {
+        records_.push_back(length());
+      }
+      FixedBuffer::append(logline, len);
+    }
+
+    void reset()
+    {
+      FixedBuffer::reset();
+      records_.clear();
+    }
+
+    const std::vector<int>& records() const { return records_; }
+
+   private:
+    std::vector<int> records_;
+  };
+
+  void writeLines(const Buffer& buffer);
 
-  typedef muduo::detail::FixedBuffer<muduo::detail::kLargeBuffer> Buffer;
   typedef boost::ptr_vector<Buffer> BufferVector;
   typedef BufferVector::auto_type BufferPtr;
 
@@ -64,13 +195,46 @@ class AsyncLogging : boost::noncopyable
   bool running_;
   string basename_;
   off_t rollSize_;
+  LogFile::RollCallback rollCallback_;
+  WriteCallback writeCallback_;
+  boost::scoped_ptr<LogFile> output_;  // of the backend thread, NULL with writeCallback_
+  string batch_;  // of the backend thread, for writeCallback_
   muduo::Thread thread_;
   muduo::CountDownLatch latch_;
   muduo::MutexLock mutex_;
   muduo::Condition cond_;
+  muduo::Condition notFull_;
   BufferPtr currentBuffer_;
   BufferPtr nextBuffer_;
   BufferVector buffers_;
+
+  bool perThreadBuffers_;
+  bool rawRecords_;
+  bool preallocate_;
+  bool threadBufferFull_;  // guarded by mutex_
+  muduo::ThreadLocal<LocalBuffer> localBuffer_;
+  std::vector<ThreadBuffer*> threadBuffers_;  // guarded by mutex_
+  LogStream recordStream_;  // of the backend thread
+
+  OverflowPolicy overflowPolicy_;
+  int maxQueuedBuffers_;
+  double blockSeconds_;
+  int sampleRate_;
+  int64_t sampled_;  // guarded by mutex_
+
+  // guarded by mutex_
+  int64_t writtenBytes_;
+  double writtenBytesPerSecond_;
+  int64_t droppedLines_;
+  int64_t droppedBuffers_;
+  int64_t blockedLines_;
+  int64_t writeMicroSeconds_;
+  int64_t maxWriteMicroSeconds_;
+  // of the backend thread
+  int64_t roundBytes_;
+  int64_t roundDroppedLines_;
+  Timestamp rateStart_;
+  int64_t rateBytes_;
 };
 
 }
@@ -0,0 +1,154 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/base/Crc32c.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <string.h>
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+// reversed 0x1EDC6F41
+const uint32_t kPolynomial = 0x82F63B78;
+
+struct Tables
+{
+  Tables()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j)
+      {
+        crc = (crc >> 1) ^ (kPolynomial & (0 - (crc & 1)));
+      }
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      for (int k = 1; k < 8; ++k)
+      {
+        table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xff];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+const Tables& tables()
+{
+  static const Tables t;
+  return t;
+}
+
+inline uint32_t load32(const uint8_t* p)
+{
+  // little endian, a single load on x86
+  return static_cast<uint32_t>(p[0])
+      | (static_cast<uint32_t>(p[1]) << 8)
+      | (static_cast<uint32_t>(p[2]) << 16)
+      | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t extendSse42(uint32_t crc, const void* data, size_t n)
+{
+  const char* p = static_cast<const char*>(data);
+  uint32_t l = ~crc;
+  while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+  {
+    l = _mm_crc32_u8(l, static_cast<uint8_t>(*p++));
+    --n;
+  }
+  uint64_t l64 = l;
+  while (n >= 8)
+  {
+    uint64_t word;
+    ::memcpy(&word, p, sizeof word);
+    l64 = _mm_crc32_u64(l64, word);
+    p += 8;
+    n -= 8;
+  }
+  l = static_cast<uint32_t>(l64);
+  while (n > 0)
+  {
+    l = _mm_crc32_u8(l, static_cast<uint8_t>(*p++));
+    --n;
+  }
+  return ~l;
+}
+#endif
+
+typedef uint32_t (*ExtendFunction)(uint32_t crc, const void* data, size_t n);
+
+ExtendFunction chooseExtend()
+{
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    return extendSse42;
+  }
+#endif
+  return crc32c::extendPortable;
+}
+
+ExtendFunction extendFunction()
+{
+  static const ExtendFunction f = chooseExtend();
+  return f;
+}
+
+}
+
+uint32_t crc32c::extendPortable(uint32_t crc, const void* data, size_t n)
+{
+  const uint32_t (*t)[256] = tables().table;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint32_t l = ~crc;
+  while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+  {
+    l = t[0][(l ^ *p++) & 0xff] ^ (l >> 8);
+    --n;
+  }
+  // slice-by-8, eight table lookups per eight bytes
+  while (n >= 8)
+  {
+    uint32_t lo = load32(p) ^ l;
+    uint32_t hi = load32(p + 4);
+    l = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+      ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+      ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+      ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    n -= 8;
+  }
+  while (n > 0)
+  {
+    l = t[0][(l ^ *p++) & 0xff] ^ (l >> 8);
+    --n;
+  }
+  return ~l;
+}
+
+uint32_t crc32c::extend(uint32_t crc, const void* data, size_t n)
+{
+  return extendFunction()(crc, data, n);
+}
+
+bool crc32c::isHardwareAccelerated()
+{
+  return extendFunction() != extendPortable;
+}
@@ -0,0 +1,44 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_CRC32C_H
+#define MUDUO_BASE_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace muduo
+{
+namespace crc32c
+{
+
+///
+/// CRC-32C (Castagnoli), as in iSCSI, SCTP and ext4.
+///
+/// Uses the SSE4.2 crc32 instruction if the CPU has it,
+/// slice-by-8 tables otherwise.
+///
+
+/// Returns the crc32c of A+data[0, n), where crc is the crc32c of A.
+uint32_t extend(uint32_t crc, const void* data, size_t n);
+
+inline uint32_t value(const void* data, size_t n)
+{
+  return extend(0, data, n);
+}
+
+/// Slice-by-8 only, for tests and benchmarks.
+uint32_t extendPortable(uint32_t crc, const void* data, size_t n);
+
+/// Whether extend() uses the crc32 instruction.
+bool isHardwareAccelerated();
+
+}
+}
+
+#endif  // MUDUO_BASE_CRC32C_H
@@ -0,0 +1,622 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/base/Dtoa.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::detail;
+
+namespace
+{
+
+// digits of a double that are ever needed
+const int kMaxDigits = 17;
+// Up to this many, the shortest digits of v are also v rounded to that
+// many, as half of their last unit is more than half an ulp of v.
+const int kMaxShortDigits = 15;
+
+// f * 2^e
+struct DiyFp
+{
+  DiyFp(uint64_t significand, int exponent)
+    : f(significand), e(exponent)
+  {
+  }
+
+  uint64_t f;
+  int e;
+};
+
+const int kSignificandSize = 64;
+
+// the upper half of the 128 bits product, rounded
+DiyFp multiply(const DiyFp& x, const DiyFp& y)
+{
+  const uint64_t kM32 = 0xFFFFFFFFu;
+  uint64_t a = x.f >> 32;
+  uint64_t b = x.f & kM32;
+  uint64_t c = y.f >> 32;
+  uint64_t d = y.f & kM32;
+  uint64_t ac = a * c;
+  uint64_t bc = b * c;
+  uint64_t ad = a * d;
+  uint64_t bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & kM32) + (bc & kM32);
+  tmp += 1U << 31;
+  return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + kSignificandSize);
+}
+
+DiyFp normalize(const DiyFp& x)
+{
+  int shift = __builtin_clzll(x.f);
+  return DiyFp(x.f << shift, x.e - shift);
+}
+
+const uint64_t kHiddenBit = static_cast<uint64_t>(1) << 52;
+const uint64_t kSignificandMask = kHiddenBit - 1;
+const int kExponentBias = 0x3FF + 52;
+const int kDenormalExponent = 1 - kExponentBias;
+
+DiyFp toDiyFp(double v)
+{
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof bits);
+  int biased = static_cast<int>((bits >> 52) & 0x7FF);
+  uint64_t significand = bits & kSignificandMask;
+  if (biased == 0)
+  {
+    return DiyFp(significand, kDenormalExponent);
+  }
+  return DiyFp(significand + kHiddenBit, biased - kExponentBias);
+}
+
+// Halfway to the neighbours of v, with the exponent of normalize(v).
+void boundaries(double v, DiyFp* minus, DiyFp* plus)
+{
+  DiyFp w = toDiyFp(v);
+  *plus = normalize(DiyFp((w.f << 1) + 1, w.e - 1));
+  // the one below is closer at powers of two, but the smallest normal
+  if (w.f == kHiddenBit && w.e != kDenormalExponent)
+  {
+    *minus = DiyFp((w.f << 2) - 1, w.e - 2);
+  }
+  else
+  {
+    *minus = DiyFp((w.f << 1) - 1, w.e - 1);
+  }
+  minus->f <<= minus->e - plus->e;
+  minus->e = plus->e;
+}
+
+struct CachedPower
+{
+  uint64_t significand;
+  int16_t binaryExponent;
+  int16_t decimalExponent;
+};
+
+// 10^k for k = -348, -340, ... 340, rounded to 64 bits
+const CachedPower kCachedPowers[] =
+{
+  { UINT64_C(0xfa8fd5a0081c0288), -1220, -348 },
+  { UINT64_C(0xbaaee17fa23ebf76), -1193, -340 },
+  { UINT64_C(0x8b16fb203055ac76), -1166, -332 },
+  { UINT64_C(0xcf42894a5dce35ea), -1140, -324 },
+  { UINT64_C(0x9a6bb0aa55653b2d), -1113, -316 },
+  { UINT64_C(0xe61acf033d1a45df), -1087, -308 },
+  { UINT64_C(0xab70fe17c79ac6ca), -1060, -300 },
+  { UINT64_C(0xff77b1fcbebcdc4f), -1034, -292 },
+  { UINT64_C(0xbe5691ef416bd60c), -1007, -284 },
+  { UINT64_C(0x8dd01fad907ffc3c), -980, -276 },
+  { UINT64_C(0xd3515c2831559a83), -954, -268 },
+  { UINT64_C(0x9d71ac8fada6c9b5), -927, -260 },
+  { UINT64_C(0xea9c227723ee8bcb), -901, -252 },
+  { UINT64_C(0xaecc49914078536d), -874, -244 },
+  { UINT64_C(0x823c12795db6ce57), -847, -236 },
+  { UINT64_C(0xc21094364dfb5637), -821, -228 },
+  { UINT64_C(0x9096ea6f3848984f), -794, -220 },
+  { UINT64_C(0xd77485cb25823ac7), -768, -212 },
+  { UINT64_C(0xa086cfcd97bf97f4), -741, -204 },
+  { UINT64_C(0xef340a98172aace5), -715, -196 },
+  { UINT64_C(0xb23867fb2a35b28e), -688, -188 },
+  { UINT64_C(0x84c8d4dfd2c63f3b), -661, -180 },
+  { UINT64_C(0xc5dd44271ad3cdba), -635, -172 },
+  { UINT64_C(0x936b9fcebb25c996), -608, -164 },
+  { UINT64_C(0xdbac6c247d62a584), -582, -156 },
+  { UINT64_C(0xa3ab66580d5fdaf6), -555, -148 },
+  { UINT64_C(0xf3e2f893dec3f126), -529, -140 },
+  { UINT64_C(0xb5b5ada8aaff80b8), -502, -132 },
+  { UINT64_C(0x87625f056c7c4a8b), -475, -124 },
+  { UINT64_C(0xc9bcff6034c13053), -449, -116 },
+  { UINT64_C(0x964e858c91ba2655), -422, -108 },
+  { UINT64_C(0xdff9772470297ebd), -396, -100 },
+  { UINT64_C(0xa6dfbd9fb8e5b88f), -369, -92 },
+  { UINT64_C(0xf8a95fcf88747d94), -343, -84 },
+  { UINT64_C(0xb94470938fa89bcf), -316, -76 },
+  { UINT64_C(0x8a08f0f8bf0f156b), -289, -68 },
+  { UINT64_C(0xcdb02555653131b6), -263, -60 },
+  { UINT64_C(0x993fe2c6d07b7fac), -236, -52 },
+  { UINT64_C(0xe45c10c42a2b3b06), -210, -44 },
+  { UINT64_C(0xaa242499697392d3), -183, -36 },
+  { UINT64_C(0xfd87b5f28300ca0e), -157, -28 },
+  { UINT64_C(0xbce5086492111aeb), -130, -20 },
+  { UINT64_C(0x8cbccc096f5088cc), -103, -12 },
+  { UINT64_C(0xd1b71758e219652c), -77, -4 },
+  { UINT64_C(0x9c40000000000000), -50, 4 },
+  { UINT64_C(0xe8d4a51000000000), -24, 12 },
+  { UINT64_C(0xad78ebc5ac620000), 3, 20 },
+  { UINT64_C(0x813f3978f8940984), 30, 28 },
+  { UINT64_C(0xc097ce7bc90715b3), 56, 36 },
+  { UINT64_C(0x8f7e32ce7bea5c70), 83, 44 },
+  { UINT64_C(0xd5d238a4abe98068), 109, 52 },
+  { UINT64_C(0x9f4f2726179a2245), 136, 60 },
+  { UINT64_C(0xed63a231d4c4fb27), 162, 68 },
+  { UINT64_C(0xb0de65388cc8ada8), 189, 76 },
+  { UINT64_C(0x83c7088e1aab65db), 216, 84 },
+  { UINT64_C(0xc45d1df942711d9a), 242, 92 },
+  { UINT64_C(0x924d692ca61be758), 269, 100 },
+  { UINT64_C(0xda01ee641a708dea), 295, 108 },
+  { UINT64_C(0xa26da3999aef774a), 322, 116 },
+  { UINT64_C(0xf209787bb47d6b85), 348, 124 },
+  { UINT64_C(0xb454e4a179dd1877), 375, 132 },
+  { UINT64_C(0x865b86925b9bc5c2), 402, 140 },
+  { UINT64_C(0xc83553c5c8965d3d), 428, 148 },
+  { UINT64_C(0x952ab45cfa97a0b3), 455, 156 },
+  { UINT64_C(0xde469fbd99a05fe3), 481, 164 },
+  { UINT64_C(0xa59bc234db398c25), 508, 172 },
+  { UINT64_C(0xf6c69a72a3989f5c), 534, 180 },
+  { UINT64_C(0xb7dcbf5354e9bece), 561, 188 },
+  { UINT64_C(0x88fcf317f22241e2), 588, 196 },
+  { UINT64_C(0xcc20ce9bd35c78a5), 614, 204 },
+  { UINT64_C(0x98165af37b2153df), 641, 212 },
+  { UINT64_C(0xe2a0b5dc971f303a), 667, 220 },
+  { UINT64_C(0xa8d9d1535ce3b396), 694, 228 },
+  { UINT64_C(0xfb9b7cd9a4a7443c), 720, 236 },
+  { UINT64_C(0xbb764c4ca7a44410), 747, 244 },
+  { UINT64_C(0x8bab8eefb6409c1a), 774, 252 },
+  { UINT64_C(0xd01fef10a657842c), 800, 260 },
+  { UINT64_C(0x9b10a4e5e9913129), 827, 268 },
+  { UINT64_C(0xe7109bfba19c0c9d), 853, 276 },
+  { UINT64_C(0xac2820d9623bf429), 880, 284 },
+  { UINT64_C(0x80444b5e7aa7cf85), 907, 292 },
+  { UINT64_C(0xbf21e44003acdd2d), 933, 300 },
+  { UINT64_C(0x8e679c2f5e44ff8f), 960, 308 },
+  { UINT64_C(0xd433179d9c8cb841), 986, 316 },
+  { UINT64_C(0x9e19db92b4e31ba9), 1013, 324 },
+  { UINT64_C(0xeb96bf6ebadf77d9), 1039, 332 },
+  { UINT64_C(0xaf87023b9bf0ee6b), 1066, 340 },
+};
+
+const int kCachedPowersOffset = 348;
+const int kDecimalExponentDistance = 8;
+const double kD1Log210 = 0.30102999566398114;  // 1 / log2(10)
+
+// where digits are generated from, in 32 bits of integer part
+const int kMinimalTargetExponent = -60;
+const int kMaximalTargetExponent = -32;
+
+// A cached 10^k, such that w * 10^k has an exponent in the target range.
+DiyFp cachedPower(int e, int* k)
+{
+  int minExponent = kMinimalTargetExponent - (e + kSignificandSize);
+  int estimate = static_cast<int>(ceil((minExponent + kSignificandSize - 1) * kD1Log210));
+  int index = (kCachedPowersOffset + estimate - 1) / kDecimalExponentDistance + 1;
+  const CachedPower& power = kCachedPowers[index];
+  *k = power.decimalExponent;
+  assert(kMinimalTargetExponent <= e + power.binaryExponent + kSignificandSize);
+  assert(e + power.binaryExponent + kSignificandSize <= kMaximalTargetExponent);
+  return DiyFp(power.significand, power.binaryExponent);
+}
+
+const uint32_t kSmallPowersOfTen[] =
+{
+  0, 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// The largest 10^(exponentPlusOne-1) <= number, which has up to bits bits.
+void biggestPowerTen(uint32_t number, int bits, uint32_t* power, int* exponentPlusOne)
+{
+  int guess = ((bits + 1) * 1233 >> 12) + 1;
+  if (number < kSmallPowersOfTen[guess])
+  {
+    --guess;
+  }
+  *power = kSmallPowersOfTen[guess];
+  *exponentPlusOne = guess;
+}
+
+// Moves the last digit down towards w while that is safe.  False if the
+// result may not be the closest one.
+bool roundWeed(char* digits, int length, uint64_t distanceTooHighW,
+               uint64_t unsafeInterval, uint64_t rest, uint64_t tenKappa,
+               uint64_t unit)
+{
+  uint64_t smallDistance = distanceTooHighW - unit;
+  uint64_t bigDistance = distanceTooHighW + unit;
+  while (rest < smallDistance
+         && unsafeInterval - rest >= tenKappa
+         && (rest + tenKappa < smallDistance
+             || smallDistance - rest >= rest + tenKappa - smallDistance))
+  {
+    --digits[length - 1];
+    rest += tenKappa;
+  }
+  if (rest < bigDistance
+      && unsafeInterval - rest >= tenKappa
+      && (rest + tenKappa < bigDistance
+          || bigDistance - rest > rest + tenKappa - bigDistance))
+  {
+    return false;
+  }
+  return 2 * unit <= rest && rest <= unsafeInterval - 4 * unit;
+}
+
+// The shortest digits between low and high, all scaled.
+bool digitGen(DiyFp low, DiyFp w, DiyFp high, char* digits, int* length, int* kappa)
+{
+  uint64_t unit = 1;
+  DiyFp tooLow(low.f - unit, low.e);
+  DiyFp tooHigh(high.f + unit, high.e);
+  uint64_t unsafeInterval = tooHigh.f - tooLow.f;
+  int shift = -w.e;
+  uint64_t one = static_cast<uint64_t>(1) << shift;
+  uint32_t integrals = static_cast<uint32_t>(tooHigh.f >> shift);
+  uint64_t fractionals = tooHigh.f & (one - 1);
+  uint32_t divisor;
+  biggestPowerTen(integrals, kSignificandSize - shift, &divisor, kappa);
+  *length = 0;
+
+  while (*kappa > 0)
+  {
+    digits[(*length)++] = static_cast<char>('0' + integrals / divisor);
+    integrals %= divisor;
+    --*kappa;
+    uint64_t rest = (static_cast<uint64_t>(integrals) << shift) + fractionals;
+    if (rest < unsafeInterval)
+    {
+      return roundWeed(digits, *length, tooHigh.f - w.f, unsafeInterval, rest,
+                       static_cast<uint64_t>(divisor) << shift, unit);
+    }
+    divisor /= 10;
+  }
+
+  while (true)
+  {
+    fractionals *= 10;
+    unit *= 10;
+    unsafeInterval *= 10;
+    digits[(*length)++] = static_cast<char>('0' + (fractionals >> shift));
+    fractionals &= one - 1;
+    --*kappa;
+    if (fractionals < unsafeInterval)
+    {
+      return roundWeed(digits, *length, (tooHigh.f - w.f) * unit, unsafeInterval,
+                       fractionals, one, unit);
+    }
+  }
+}
+
+// Rounds the last digit by rest, in units of tenKappa, of error unit.
+// False if it cannot tell which way.
+bool roundWeedCounted(char* digits, int length, uint64_t rest, uint64_t tenKappa,
+                      uint64_t unit, int* kappa)
+{
+  if (unit >= tenKappa || tenKappa - unit <= unit)
+  {
+    return false;
+  }
+  if (tenKappa - rest > rest && tenKappa - 2 * rest >= 2 * unit)
+  {
+    return true;
+  }
+  if (rest > unit && tenKappa - (rest - unit) <= rest - unit)
+  {
+    ++digits[length - 1];
+    for (int i = length - 1; i > 0 && digits[i] == '0' + 10; --i)
+    {
+      digits[i] = '0';
+      ++digits[i - 1];
+    }
+    if (digits[0] == '0' + 10)
+    {
+      digits[0] = '1';
+      ++*kappa;
+    }
+    return true;
+  }
+  return false;
+}
+
+// The first count digits of w, rounded.
+bool digitGenCounted(DiyFp w, int count, char* digits, int* length, int* kappa)
+{
+  uint64_t error = 1;
+  int shift = -w.e;
+  uint64_t one = static_cast<uint64_t>(1) << shift;
+  uint32_t integrals = static_cast<uint32_t>(w.f >> shift);
+  uint64_t fractionals = w.f & (one - 1);
+  uint32_t divisor;
+  biggestPowerTen(integrals, kSignificandSize - shift, &divisor, kappa);
+  *length = 0;
+
+  while (*kappa > 0)
+  {
+    digits[(*length)++] = static_cast<char>('0' + integrals / divisor);
+    integrals %= divisor;
+    --*kappa;
+    if (--count == 0)
+    {
+      uint64_t rest = (static_cast<uint64_t>(integrals) << shift) + fractionals;
+      return roundWeedCounted(digits, *length, rest,
+                              static_cast<uint64_t>(divisor) << shift, error, kappa);
+    }
+    divisor /= 10;
+  }
+
+  while (count > 0 && fractionals > error)
+  {
+    fractionals *= 10;
+    error *= 10;
+    digits[(*length)++] = static_cast<char>('0' + (fractionals >> shift));
+    fractionals &= one - 1;
+    --*kappa;
+    --count;
+  }
+  if (count != 0)
+  {
+    return false;
+  }
+  return roundWeedCounted(digits, *length, fractionals, one, error, kappa);
+}
+
+// v > 0 is 0.digits * 10^point.
+bool grisuShortest(double v, char* digits, int* length, int* point)
+{
+  DiyFp w = normalize(toDiyFp(v));
+  DiyFp minus(0, 0);
+  DiyFp plus(0, 0);
+  boundaries(v, &minus, &plus);
+  assert(plus.e == w.e);
+  int k;
+  DiyFp power = cachedPower(w.e, &k);
+  int kappa;
+  bool ok = digitGen(multiply(minus, power), multiply(w, power), multiply(plus, power),
+                     digits, length, &kappa);
+  *point = *length - k + kappa;
+  return ok;
+}
+
+bool grisuPrecision(double v, int count, char* digits, int* length, int* point)
+{
+  DiyFp w = normalize(toDiyFp(v));
+  int k;
+  DiyFp power = cachedPower(w.e, &k);
+  int kappa;
+  bool ok = digitGenCounted(multiply(w, power), count, digits, length, &kappa);
+  *point = *length - k + kappa;
+  return ok;
+}
+
+// Digits of "%.*e" of snprintf, where Grisu3 gives up.  Skips the decimal
+// point, whatever the locale has.
+int snprintfDigits(double v, int count, char* digits, int* point)
+{
+  char buf[kMaxGeneralLength];
+  snprintf(buf, sizeof buf, "%.*e", count - 1, v);
+  int length = 0;
+  const char* p = buf;
+  for (; *p != 'e'; ++p)
+  {
+    if (*p >= '0' && *p <= '9')
+    {
+      digits[length++] = *p;
+    }
+  }
+  *point = atoi(p + 1) + 1;
+  return length;
+}
+
+int stripZeros(const char* digits, int length)
+{
+  while (length > 1 && digits[length - 1] == '0')
+  {
+    --length;
+  }
+  return length;
+}
+
+// As "%.*g" lays them out.
+int layoutGeneral(char* buf, bool negative, const char* digits, int length,
+                  int point, int precision)
+{
+  char* p = buf;
+  if (negative)
+  {
+    *p++ = '-';
+  }
+  int exponent = point - 1;
+  if (exponent < -4 || exponent >= precision)
+  {
+    *p++ = digits[0];
+    if (length > 1)
+    {
+      *p++ = '.';
+      memcpy(p, digits + 1, length - 1);
+      p += length - 1;
+    }
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    exponent = abs(exponent);
+    if (exponent >= 100)
+    {
+      *p++ = static_cast<char>('0' + exponent / 100);
+      exponent %= 100;
+    }
+    *p++ = static_cast<char>('0' + exponent / 10);
+    *p++ = static_cast<char>('0' + exponent % 10);
+  }
+  else if (point <= 0)
+  {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -point);
+    p += -point;
+    memcpy(p, digits, length);
+    p += length;
+  }
+  else if (point < length)
+  {
+    memcpy(p, digits, point);
+    p += point;
+    *p++ = '.';
+    memcpy(p, digits + point, length - point);
+    p += length - point;
+  }
+  else
+  {
+    memcpy(p, digits, length);
+    p += length;
+    memset(p, '0', point - length);
+    p += point - length;
+  }
+  *p = '\0';
+  return static_cast<int>(p - buf);
+}
+
+}
+
+int detail::formatGeneral(char* buf, double v, int precision)
+{
+  if (precision == 0)
+  {
+    precision = 1;
+  }
+  if (!isfinite(v) || precision < 0 || precision > kMaxDigits)
+  {
+    return snprintf(buf, kMaxGeneralLength, "%.*g", precision, v);
+  }
+
+  char digits[kMaxDigits + 1] = "0";
+  int length = 1;
+  int point = 1;
+  if (v != 0)
+  {
+    // Grisu3 gives up when v has fewer digits, eg. whole numbers.  Then
+    // the shortest ones are right, if they are that few.
+    if (!grisuPrecision(fabs(v), precision, digits, &length, &point)
+        && !(precision <= kMaxShortDigits
+             && grisuShortest(fabs(v), digits, &length, &point)
+             && length <= precision))
+    {
+      length = snprintfDigits(fabs(v), precision, digits, &point);
+    }
+    length = stripZeros(digits, length);
+  }
+  return layoutGeneral(buf, signbit(v), digits, length, point, precision);
+}
+
+int detail::formatShortest(char* buf, double v)
+{
+  if (!isfinite(v))
+  {
+    return snprintf(buf, kMaxGeneralLength, "%.17g", v);
+  }
+
+  char digits[kMaxDigits + 1] = "0";
+  int length = 1;
+  int point = 1;
+  if (v != 0 && !grisuShortest(fabs(v), digits, &length, &point))
+  {
+    // 15 digits always read back if fewer do, 17 always do
+    int count = 15;
+    for (; count < kMaxDigits; ++count)
+    {
+      char tmp[kMaxGeneralLength];
+      snprintf(tmp, sizeof tmp, "%.*e", count - 1, fabs(v));
+      if (strtod(tmp, NULL) == fabs(v))
+      {
+        break;
+      }
+    }
+    length = snprintfDigits(fabs(v), count, digits, &point);
+  }
+  length = stripZeros(digits, length);
+  return layoutGeneral(buf, signbit(v), digits, length, point, kMaxDigits);
+}
+
+int detail::formatFixed(char* buf, size_t size, double v, int precision)
+{
+  // up to 10^17, the digits wanted are at most 17 + precision
+  if (!isfinite(v) || fabs(v) >= 1e17 || precision < 0 || precision > kMaxDigits)
+  {
+    return snprintf(buf, size, "%.*f", precision, v);
+  }
+
+  char digits[kMaxDigits + 1] = "0";
+  int length = 1;
+  int point = 1;
+  if (v != 0)
+  {
+    // The point of the shortest is that of v, or one more when it is
+    // rounded up to a power of ten.
+    int shortestPoint;
+    if (!grisuShortest(fabs(v), digits, &length, &shortestPoint))
+    {
+      return snprintf(buf, size, "%.*f", precision, v);
+    }
+    int count = shortestPoint + precision;
+    if (length <= count && count <= kMaxShortDigits)
+    {
+      point = shortestPoint;
+    }
+    // A point one more is a carry of 9s, so the digits are still right.
+    else if (count <= 0 || count > kMaxDigits
+             || !grisuPrecision(fabs(v), count, digits, &length, &point)
+             || (point != shortestPoint && point != shortestPoint + 1))
+    {
+      return snprintf(buf, size, "%.*f", precision, v);
+    }
+  }
+
+  bool negative = signbit(v);
+  size_t total = negative + (point > 0 ? point : 1) + (precision > 0 ? 1 + precision : 0);
+  if (total >= size)
+  {
+    return snprintf(buf, size, "%.*f", precision, v);
+  }
+  char* p = buf;
+  if (negative)
+  {
+    *p++ = '-';
+  }
+  if (point <= 0)
+  {
+    *p++ = '0';
+  }
+  for (int i = 0; i < point; ++i)
+  {
+    *p++ = i < length ? digits[i] : '0';
+  }
+  if (precision > 0)
+  {
+    *p++ = '.';
+    for (int i = point; i < point + precision; ++i)
+    {
+      *p++ = i >= 0 && i < length ? digits[i] : '0';
+    }
+  }
+  *p = '\0';
+  return static_cast<int>(p - buf);
+}
@@ -0,0 +1,43 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_DTOA_H
+#define MUDUO_BASE_DTOA_H
+
+#include <stddef.h>
+
+namespace muduo
+{
+namespace detail
+{
+
+///
+/// Formats doubles without snprintf, with Grisu3 by Florian Loitsch,
+/// "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+/// as in double-conversion.  Grisu3 gives up on about 0.5% of values, which
+/// then go to snprintf, so results are always exact.
+///
+/// Output is the same as glibc printf in the "C" locale.
+///
+
+// Longest output of formatGeneral() and formatShortest(), with the '\0'.
+const int kMaxGeneralLength = 32;
+
+// Same as snprintf(buf, kMaxGeneralLength, "%.*g", precision, v).
+int formatGeneral(char* buf, double v, int precision);
+
+// The fewest digits that read back as v, laid out as "%.17g" does.
+int formatShortest(char* buf, double v);
+
+// Same as snprintf(buf, size, "%.*f", precision, v).
+int formatFixed(char* buf, size_t size, double v, int precision);
+
+}
+}
+
+#endif  // MUDUO_BASE_DTOA_H
@@ -12,10 +12,13 @@
 
 #include <boost/static_assert.hpp>
 
+#include <algorithm>
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -23,20 +26,82 @@ using namespace muduo;
 
 FileUtil::AppendFile::AppendFile(StringArg filename)
   : fp_(::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
-    writtenBytes_(0)
+    writtenBytes_(0),
+    fd_(-1),
+    chunkOffset_(0),
+    chunkSize_(0),
+    chunkLength_(0),
+    chunkWritten_(0),
+    evictedOffset_(0)
 {
   assert(fp_);
   ::setbuffer(fp_, buffer_, sizeof buffer_);
   // posix_fadvise POSIX_FADV_DONTNEED ?
 }
 
+FileUtil::AppendFile::AppendFile(StringArg filename, off_t preallocateSize)
+  : fp_(NULL),
+    writtenBytes_(0),
+    fd_(::open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644)),
+    chunk_(new char[kChunkSize]),
+    chunkOffset_(0),
+    chunkSize_(kChunkSize),
+    chunkLength_(0),
+    chunkWritten_(0),
+    evictedOffset_(0)
+{
+  assert(fd_ >= 0);
+  struct stat statbuf;
+  if (::fstat(fd_, &statbuf) == 0)
+  {
+    chunkOffset_ = statbuf.st_size;
+    evictedOffset_ = statbuf.st_size;
+    chunkSize_ = kChunkSize - static_cast<size_t>(statbuf.st_size) % kChunkSize;
+  }
+  // KEEP_SIZE, so readers and a crash never see the zeros after the end
+  if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, chunkOffset_, preallocateSize) < 0
+      && errno != EOPNOTSUPP)
+  {
+    fprintf(stderr, "AppendFile::AppendFile() fallocate failed %s\n", strerror_tl(errno));
+  }
+}
+
 FileUtil::AppendFile::~AppendFile()
 {
-  ::fclose(fp_);
+  if (fp_)
+  {
+    ::fclose(fp_);
+  }
+  else
+  {
+    writeChunk();
+    // gives back what is preallocated but not used
+    ::ftruncate(fd_, chunkOffset_ + static_cast<off_t>(chunkLength_));
+    ::posix_fadvise(fd_, evictedOffset_, 0, POSIX_FADV_DONTNEED);
+    ::close(fd_);
+  }
 }
 
 void FileUtil::AppendFile::append(const char* logline, const size_t len)
 {
+  if (fp_ == NULL)
+  {
+    size_t n = 0;
+    while (n < len)
+    {
+      size_t x = std::min(len - n, chunkSize_ - chunkLength_);
+      memcpy(chunk_.get() + chunkLength_, logline + n, x);
+      chunkLength_ += x;
+      n += x;
+      if (chunkLength_ == chunkSize_)
+      {
+        writeChunk();
+      }
+    }
+    writtenBytes_ += len;
+    return;
+  }
+
   size_t n = write(logline, len);
   size_t remain = len - n;
   while (remain > 0)
@@ -60,7 +125,62 @@ void FileUtil::AppendFile::append(const char* logline, const size_t len)
 
 void FileUtil::AppendFile::flush()
 {
-  ::fflush(fp_);
+  if (fp_)
+  {
+    ::fflush(fp_);
+  }
+  else
+  {
+    writeChunk();
+  }
+}
+
+// Writes what is not written yet of the chunk, once more if it is flushed
+// before full.  A full chunk is sent to disk without waiting, the one
+// before it is waited for and evicted, so at most two chunks are dirty.
+void FileUtil::AppendFile::writeChunk()
+{
+  while (chunkWritten_ < chunkLength_)
+  {
+    ssize_t n = ::pwrite(fd_, chunk_.get() + chunkWritten_,
+                         chunkLength_ - chunkWritten_,
+                         chunkOffset_ + static_cast<off_t>(chunkWritten_));
+    if (n > 0)
+    {
+      chunkWritten_ += static_cast<size_t>(n);
+    }
+    else if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else
+    {
+      fprintf(stderr, "AppendFile::append() failed %s\n", strerror_tl(errno));
+      // drops the chunk, as the stdio path drops a line
+      chunkWritten_ = chunkLength_;
+    }
+  }
+
+  if (chunkLength_ == chunkSize_)
+  {
+    off_t end = chunkOffset_ + static_cast<off_t>(chunkSize_);
+    ::sync_file_range(fd_, chunkOffset_, static_cast<off_t>(chunkSize_),
+                      SYNC_FILE_RANGE_WRITE);
+    if (evictedOffset_ < chunkOffset_)
+    {
+      ::sync_file_range(fd_, evictedOffset_, chunkOffset_ - evictedOffset_,
+                        SYNC_FILE_RANGE_WAIT_BEFORE
+                        | SYNC_FILE_RANGE_WRITE
+                        | SYNC_FILE_RANGE_WAIT_AFTER);
+      ::posix_fadvise(fd_, evictedOffset_, chunkOffset_ - evictedOffset_,
+                      POSIX_FADV_DONTNEED);
+      evictedOffset_ = chunkOffset_;
+    }
+    chunkOffset_ = end;
+    chunkSize_ = kChunkSize;
+    chunkLength_ = 0;
+    chunkWritten_ = 0;
+  }
 }
 
 size_t FileUtil::AppendFile::write(const char* logline, size_t len)
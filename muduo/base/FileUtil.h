@@ -13,6 +13,7 @@
 
 #include <muduo/base/StringPiece.h>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
 
 namespace muduo
 {
@@ -68,6 +69,12 @@ class AppendFile : boost::noncopyable
  public:
   explicit AppendFile(StringArg filename);
 
+  // Reserves preallocateSize bytes of disk up front, and writes aligned
+  // chunks of kChunkSize with pwrite(2) instead of stdio.  Chunks written
+  // are pushed to disk and dropped from the page cache, so a busy log
+  // neither piles up dirty pages nor evicts hot ones.
+  AppendFile(StringArg filename, off_t preallocateSize);
+
   ~AppendFile();
 
   void append(const char* logline, const size_t len);
@@ -79,10 +86,22 @@ class AppendFile : boost::noncopyable
  private:
 
   size_t write(const char* logline, size_t len);
+  void writeChunk();
+
+  static const size_t kChunkSize = 1024*1024;
 
   FILE* fp_;
   char buffer_[64*1024];
   off_t writtenBytes_;
+
+  // preallocated
+  int fd_;
+  boost::scoped_array<char> chunk_;
+  off_t chunkOffset_;     // in the file
+  size_t chunkSize_;      // up to the next multiple of kChunkSize
+  size_t chunkLength_;
+  size_t chunkWritten_;
+  off_t evictedOffset_;   // written before this are out of the page cache
 };
 }
 
@@ -0,0 +1,230 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/base/FlightRecorder.h>
+
+#include <muduo/base/Crc32c.h>
+#include <muduo/base/Logging.h>
+
+#include <boost/static_assert.hpp>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+
+// The file is the header, then the ring.  Records in the ring are 16 bytes
+// aligned, of 4 bytes of length, 4 bytes of crc32c of the length and the
+// line, 8 bytes of stamp, then the line.  The stamp is of the position of
+// the record, and written last, so a record is whole if it has the stamp
+// of where it is, and the reader finds the next whole one by looking at
+// every 16 bytes, past one a crash cut.  The header of a record is never
+// split by the end of the ring, which is a multiple of 16 bytes, only the
+// line wraps.
+//
+// A writer stalled between reserving its record and copying the line can
+// be lapped by the others, then its late copy tears newer records, whose
+// stamps can still be there.  The checksum tells those from whole ones.
+struct FlightRecorder::Header
+{
+  char magic[8];
+  uint64_t capacity;
+  uint64_t position;  // of the next record, counted from the first one
+  char padding[40];   // the ring starts in the next cache line
+};
+
+namespace
+{
+
+const char kMagic[] = "MUDUOFR3";
+const uint64_t kMinCapacity = 64*1024;
+const uint64_t kRecordHeaderSize = 16;
+const uint64_t kRecordAlign = 16;  // so is kRecordHeaderSize
+
+uint64_t recordSize(uint64_t len)
+{
+  return (kRecordHeaderSize + len + kRecordAlign - 1) & ~(kRecordAlign - 1);
+}
+
+// never 0, of a file just made
+uint64_t stamp(uint64_t position)
+{
+  return position / kRecordAlign + 1;
+}
+
+uint32_t checksum(uint32_t length, const char* line, uint64_t first, const char* rest)
+{
+  uint32_t crc = crc32c::value(&length, sizeof length);
+  crc = crc32c::extend(crc, line, first);
+  return crc32c::extend(crc, rest, length - first);
+}
+
+}
+
+FlightRecorder::FlightRecorder(const string& filename, size_t capacity)
+  : header_(NULL),
+    data_(NULL),
+    capacity_(kMinCapacity),
+    mapSize_(0)
+{
+  BOOST_STATIC_ASSERT(sizeof(Header) == 64);
+  while (capacity_ < capacity)
+  {
+    capacity_ *= 2;
+  }
+
+  if (::rename(filename.c_str(), (filename + ".old").c_str()) < 0 && errno != ENOENT)
+  {
+    LOG_SYSERR << "rename " << filename;
+  }
+  int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    LOG_SYSERR << "open " << filename;
+    return;
+  }
+
+  // Blocks up front, touching a page of a sparse file is SIGBUS when the
+  // disk is full.
+  size_t mapSize = sizeof(Header) + capacity_;
+  int err = ::posix_fallocate(fd, 0, static_cast<off_t>(mapSize));
+  if (err != 0)
+  {
+    errno = err;
+    LOG_SYSERR << "posix_fallocate " << filename;
+  }
+  else
+  {
+    void* addr = ::mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      LOG_SYSERR << "mmap " << filename;
+    }
+    else
+    {
+      mapSize_ = mapSize;
+      header_ = static_cast<Header*>(addr);
+      header_->capacity = capacity_;
+      header_->position = 0;
+      memcpy(header_->magic, kMagic, sizeof header_->magic);
+      data_ = static_cast<char*>(addr) + sizeof(Header);
+    }
+  }
+  ::close(fd);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  if (header_ != NULL)
+  {
+    ::munmap(header_, mapSize_);
+  }
+}
+
+void FlightRecorder::append(const char* line, int len)
+{
+  if (data_ == NULL || len <= 0)
+  {
+    return;
+  }
+  uint64_t length = std::min(static_cast<uint64_t>(len), capacity_ / 4);
+  uint64_t start = __atomic_fetch_add(&header_->position, recordSize(length), __ATOMIC_RELAXED);
+
+  // the line can wrap, not the header of the record, see recordSize()
+  uint64_t mask = capacity_ - 1;
+  char* record = data_ + (start & mask);
+  uint64_t offset = (start + kRecordHeaderSize) & mask;
+  uint64_t first = std::min(length, capacity_ - offset);
+  memcpy(data_ + offset, line, first);
+  memcpy(data_, line + first, length - first);
+
+  uint32_t length32 = static_cast<uint32_t>(length);
+  uint32_t crc = checksum(length32, line, first, line + first);
+  memcpy(record, &length32, sizeof length32);
+  memcpy(record + 4, &crc, sizeof crc);
+  __atomic_store_n(reinterpret_cast<uint64_t*>(record + 8), stamp(start), __ATOMIC_RELEASE);
+}
+
+bool FlightRecorder::read(const string& filename, const LineCallback& cb)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat st;
+  void* addr = MAP_FAILED;
+  size_t mapSize = 0;
+  if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header)))
+  {
+    mapSize = static_cast<size_t>(st.st_size);
+    addr = ::mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (addr == MAP_FAILED)
+  {
+    return false;
+  }
+
+  const Header* header = static_cast<const Header*>(addr);
+  uint64_t capacity = header->capacity;
+  if (memcmp(header->magic, kMagic, sizeof header->magic) != 0
+      || capacity < kMinCapacity
+      || (capacity & (capacity - 1)) != 0
+      || mapSize < sizeof(Header) + capacity)
+  {
+    ::munmap(addr, mapSize);
+    return false;
+  }
+
+  // The process can still be writing, records before the last capacity
+  // bytes are overwritten, or being so.
+  const char* data = static_cast<const char*>(addr) + sizeof(Header);
+  uint64_t mask = capacity - 1;
+  uint64_t position = __atomic_load_n(&header->position, __ATOMIC_ACQUIRE);
+  uint64_t p = position > capacity ? position - capacity : 0;
+  string line;
+  while (p + kRecordHeaderSize <= position)
+  {
+    const char* record = data + (p & mask);
+    uint64_t recordStamp = __atomic_load_n(reinterpret_cast<const uint64_t*>(record + 8),
+                                           __ATOMIC_ACQUIRE);
+    uint32_t length;
+    uint32_t crc;
+    memcpy(&length, record, sizeof length);
+    memcpy(&crc, record + 4, sizeof crc);
+    uint64_t size = recordSize(length);
+    uint64_t offset = (p + kRecordHeaderSize) & mask;
+    uint64_t first = std::min(static_cast<uint64_t>(length), capacity - offset);
+    if (recordStamp != stamp(p) || length == 0 || length > capacity / 4 || p + size > position)
+    {
+      p += kRecordAlign;
+      continue;
+    }
+
+    // checked as copied, the process can be tearing it
+    line.assign(data + offset, first);
+    line.append(data, length - first);
+    if (crc != checksum(length, line.data(), length, NULL))
+    {
+      p += kRecordAlign;
+      continue;
+    }
+    cb(line.data(), static_cast<int>(line.size()));
+    p += size;
+  }
+  ::munmap(addr, mapSize);
+  return true;
+}
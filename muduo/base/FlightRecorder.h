@@ -0,0 +1,74 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_BASE_FLIGHTRECORDER_H
+#define MUDUO_BASE_FLIGHTRECORDER_H
+
+#include <muduo/base/Types.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+
+// The most recent log lines of the process, in a ring in a file mapped into
+// memory.  Lines are in the page cache as soon as they are appended, so
+// they outlive a crash of the process, which takes the lines AsyncLogging
+// has not written yet with it.  Not those of a crash of the machine, the
+// file is never synced.
+//
+//   FlightRecorder recorder("myapp.flight", 16*1024*1024);
+//
+//   void output(const char* msg, int len)
+//   {
+//     recorder.append(msg, len);
+//     if (Logger::lineLevel(msg, len) >= Logger::WARN)
+//       asyncLog.append(msg, len);
+//   }
+//
+//   Logger::setLogLevel(Logger::DEBUG);
+//   Logger::setOutput(output);
+//
+// keeps DEBUG lines of the last moments in the ring, and only writes WARN
+// and above to disk.  flightdecoder prints the lines of the file, binary
+// records of Logger::setBinary() formatted.
+class FlightRecorder : boost::noncopyable
+{
+ public:
+  // capacity is rounded up to a power of two.  The file of the last run,
+  // if any, is renamed to filename + ".old", so it is not lost to a restart.
+  FlightRecorder(const string& filename, size_t capacity);
+  ~FlightRecorder();
+
+  // false if the file could not be set up, then append() does nothing
+  bool valid() const { return data_ != NULL; }
+
+  // Thread safe, without a lock.  A line longer than a quarter of the
+  // capacity is cut.
+  void append(const char* line, int len);
+
+  typedef boost::function<void (const char* line, int len)> LineCallback;
+
+  // The lines in a file of FlightRecorder, oldest first, but those not
+  // written whole.  Returns false if it is not such a file.
+  static bool read(const string& filename, const LineCallback& cb);
+
+ private:
+  struct Header;
+
+  Header* header_;
+  char* data_;
+  uint64_t capacity_;
+  size_t mapSize_;
+};
+
+}
+#endif  // MUDUO_BASE_FLIGHTRECORDER_H
@@ -0,0 +1,251 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/base/LogArchiver.h>
+
+#include <muduo/base/Logging.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+// from linux/ioprio.h, which glibc does not wrap
+const int kIoprioWhoProcess = 1;
+const int kIoprioClassIdle = 3;
+const int kIoprioClassShift = 13;
+
+const int kLowestPriority = 19;
+const size_t kBufferSize = 256*1024;
+
+bool endsWith(const string& s, const char* suffix)
+{
+  size_t len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+}
+
+LogArchiver::LogArchiver(const string& basename)
+  : basename_(basename),
+    level_(6),
+    maxFiles_(0),
+    maxBytes_(0),
+    running_(false),
+    thread_(boost::bind(&LogArchiver::threadFunc, this), "LogArchiver")
+{
+  assert(basename.find('/') == string::npos);
+}
+
+LogArchiver::~LogArchiver()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void LogArchiver::start()
+{
+  assert(!running_);
+  running_ = true;
+  thread_.start();
+}
+
+void LogArchiver::stop()
+{
+  assert(running_);
+  running_ = false;
+  queue_.put(string());
+  thread_.join();
+}
+
+void LogArchiver::archive(const string& filename)
+{
+  if (!filename.empty())
+  {
+    queue_.put(filename);
+  }
+}
+
+void LogArchiver::threadFunc()
+{
+  // of this thread only, on Linux
+  id_t tid = static_cast<id_t>(CurrentThread::tid());
+  if (::setpriority(PRIO_PROCESS, tid, kLowestPriority) < 0)
+  {
+    LOG_SYSERR << "setpriority";
+  }
+  if (::syscall(SYS_ioprio_set, kIoprioWhoProcess, tid,
+                kIoprioClassIdle << kIoprioClassShift) < 0)
+  {
+    LOG_SYSERR << "ioprio_set";
+  }
+
+  // left by earlier runs
+  removeOldFiles();
+  while (true)
+  {
+    string filename(queue_.take());
+    if (filename.empty())
+    {
+      break;
+    }
+    if (level_ > 0)
+    {
+      compress(filename);
+    }
+    lastArchived_ = std::max(lastArchived_, filename);
+    removeOldFiles();
+  }
+}
+
+bool LogArchiver::compress(const string& filename)
+{
+#ifdef HAVE_ZLIB
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    LOG_SYSERR << "open " << filename;
+    return false;
+  }
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // renamed when complete, so a .gz file is never a partial one
+  string gzname = filename + ".gz";
+  string tmpname = gzname + ".tmp";
+  char mode[16];
+  snprintf(mode, sizeof mode, "wb%de", std::min(level_, 9));
+  gzFile gz = ::gzopen(tmpname.c_str(), mode);
+  bool ok = gz != NULL;
+#if ZLIB_VERNUM >= 0x1240
+  if (ok)
+  {
+    ::gzbuffer(gz, static_cast<unsigned>(kBufferSize));
+  }
+#endif
+
+  std::vector<char> buf(kBufferSize);
+  while (ok)
+  {
+    ssize_t n = ::read(fd, &*buf.begin(), buf.size());
+    if (n > 0)
+    {
+      ok = ::gzwrite(gz, &*buf.begin(), static_cast<unsigned>(n)) == n;
+    }
+    else if (n == 0)
+    {
+      break;
+    }
+    else if (errno != EINTR)
+    {
+      ok = false;
+    }
+  }
+  if (gz != NULL && ::gzclose(gz) != Z_OK)
+  {
+    ok = false;
+  }
+  ::close(fd);
+
+  if (ok && ::rename(tmpname.c_str(), gzname.c_str()) == 0)
+  {
+    if (::unlink(filename.c_str()) < 0)
+    {
+      LOG_SYSERR << "unlink " << filename;
+    }
+    return true;
+  }
+  LOG_ERROR << "failed to compress " << filename;
+  ::unlink(tmpname.c_str());
+#else
+  (void)filename;
+#endif
+  return false;
+}
+
+void LogArchiver::removeOldFiles()
+{
+  if (maxFiles_ <= 0 && maxBytes_ <= 0)
+  {
+    return;
+  }
+  DIR* dir = ::opendir(".");
+  if (dir == NULL)
+  {
+    LOG_SYSERR << "opendir";
+    return;
+  }
+
+  // Names start with the time they are opened, so they sort by age.  Those
+  // not compressed count once handed over, the one LogFile is writing to
+  // is newer than all of them.
+  string prefix = basename_ + ".";
+  std::vector<string> files;
+  struct dirent* entry;
+  while ((entry = ::readdir(dir)) != NULL)
+  {
+    string name(entry->d_name);
+    if (name.compare(0, prefix.size(), prefix) == 0
+        && (endsWith(name, ".log.gz")
+            || (endsWith(name, ".log") && name <= lastArchived_)))
+    {
+      files.push_back(name);
+    }
+  }
+  ::closedir(dir);
+  std::sort(files.begin(), files.end());
+
+  std::vector<int64_t> sizes(files.size());
+  int64_t totalBytes = 0;
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    struct stat st;
+    sizes[i] = ::stat(files[i].c_str(), &st) == 0 ? st.st_size : 0;
+    totalBytes += sizes[i];
+  }
+
+  size_t count = files.size();
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    if ((maxFiles_ <= 0 || count <= static_cast<size_t>(maxFiles_))
+        && (maxBytes_ <= 0 || totalBytes <= maxBytes_))
+    {
+      break;
+    }
+    if (::unlink(files[i].c_str()) == 0)
+    {
+      LOG_INFO << "removed " << files[i];
+    }
+    else
+    {
+      LOG_SYSERR << "unlink " << files[i];
+    }
+    --count;
+    totalBytes -= sizes[i];
+  }
+}
@@ -0,0 +1,75 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_BASE_LOGARCHIVER_H
+#define MUDUO_BASE_LOGARCHIVER_H
+
+#include <muduo/base/BlockingQueue.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+
+// Compresses log files rolled by LogFile into .gz files, and removes the
+// oldest ones beyond maxFiles or maxBytes, in a thread of its own.
+//
+//   LogArchiver archiver(basename);
+//   archiver.start();
+//   asyncLog.setRollCallback(boost::bind(&LogArchiver::archive, &archiver, _1));
+//
+// The thread runs at the lowest CPU priority and in the idle IO class, so
+// it only takes the disk when nobody else wants it, and never holds up
+// the flush of AsyncLogging.  Without zlib, files are only removed.
+class LogArchiver : boost::noncopyable
+{
+ public:
+  // of LogFile, files are in the current directory
+  explicit LogArchiver(const string& basename);
+  ~LogArchiver();
+
+  // 1 to 9 of gzip, 0 keeps files uncompressed.  Before start().
+  void setCompressionLevel(int level)
+  { level_ = level; }
+
+  // 0 for no limit.  Before start().
+  void setMaxFiles(int maxFiles)
+  { maxFiles_ = maxFiles; }
+
+  void setMaxBytes(int64_t maxBytes)
+  { maxBytes_ = maxBytes; }
+
+  void start();
+  // Waits for files archive()d before it to be done, those of later calls
+  // are left as they are.
+  void stop();
+
+  // Thread safe.  filename is a closed file of LogFile.
+  void archive(const string& filename);
+
+ private:
+  void threadFunc();
+  bool compress(const string& filename);
+  void removeOldFiles();
+
+  const string basename_;
+  int level_;
+  int maxFiles_;
+  int64_t maxBytes_;
+  bool running_;
+  BlockingQueue<string> queue_;  // empty string to stop
+  muduo::Thread thread_;
+  string lastArchived_;  // of the thread
+};
+
+}
+#endif  // MUDUO_BASE_LOGARCHIVER_H
@@ -13,11 +13,13 @@ LogFile::LogFile(const string& basename,
                  off_t rollSize,
                  bool threadSafe,
                  int flushInterval,
-                 int checkEveryN)
+                 int checkEveryN,
+                 bool preallocate)
   : basename_(basename),
     rollSize_(rollSize),
     flushInterval_(flushInterval),
     checkEveryN_(checkEveryN),
+    preallocate_(preallocate),
     count_(0),
     mutex_(threadSafe ? new MutexLock : NULL),
     startOfPeriod_(0),
@@ -98,7 +100,19 @@ bool LogFile::rollFile()
     lastRoll_ = now;
     lastFlush_ = now;
     startOfPeriod_ = start;
-    file_.reset(new FileUtil::AppendFile(filename));
+    if (preallocate_)
+    {
+      file_.reset(new FileUtil::AppendFile(filename, rollSize_));
+    }
+    else
+    {
+      file_.reset(new FileUtil::AppendFile(filename));
+    }
+    filename_.swap(filename);
+    if (rollCallback_ && !filename.empty())
+    {
+      rollCallback_(filename);
+    }
     return true;
   }
   return false;
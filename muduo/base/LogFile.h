@@ -4,6 +4,7 @@
 #include <muduo/base/Mutex.h>
 #include <muduo/base/Types.h>
 
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 
@@ -18,17 +19,26 @@ class AppendFile;
 class LogFile : boost::noncopyable
 {
  public:
+  typedef boost::function<void (const string& filename)> RollCallback;
+
   LogFile(const string& basename,
           off_t rollSize,
           bool threadSafe = true,
           int flushInterval = 3,
-          int checkEveryN = 1024);
+          int checkEveryN = 1024,
+          bool preallocate = false);
   ~LogFile();
 
   void append(const char* logline, int len);
   void flush();
   bool rollFile();
 
+  // Called with the name of each file rollFile() has closed, in the thread
+  // that appends, eg. to hand it to a LogArchiver.  The file open at
+  // destruction is left as it is.
+  void setRollCallback(const RollCallback& cb)
+  { rollCallback_ = cb; }
+
  private:
   void append_unlocked(const char* logline, int len);
 
@@ -38,6 +48,7 @@ class LogFile : boost::noncopyable
   const off_t rollSize_;
   const int flushInterval_;
   const int checkEveryN_;
+  const bool preallocate_;  // see FileUtil::AppendFile
 
   int count_;
 
@@ -46,6 +57,8 @@ class LogFile : boost::noncopyable
   time_t lastRoll_;
   time_t lastFlush_;
   boost::scoped_ptr<FileUtil::AppendFile> file_;
+  string filename_;
+  RollCallback rollCallback_;
 
   const static int kRollPerSeconds_ = 60*60*24;
 };
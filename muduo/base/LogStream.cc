@@ -1,10 +1,14 @@
 #include <muduo/base/LogStream.h>
 
+#include <muduo/base/Dtoa.h>
+
 #include <algorithm>
 #include <limits>
+#include <cmath>
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
 #include <assert.h>
+#include <ctype.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -75,6 +79,102 @@ size_t convertHex(char buf[], uintptr_t value)
 template class FixedBuffer<kSmallBuffer>;
 template class FixedBuffer<kLargeBuffer>;
 
+// types of values in binary mode, in the byte before each value
+enum ValueType
+{
+  kString = 1,  // two bytes of length, then the bytes
+  kInt32,
+  kUInt32,
+  kInt64,
+  kUInt64,
+  kDouble,
+  kPointer,
+  kKey,         // one byte of length, then the bytes, before the value of kv()
+  kBool,
+};
+
+template<typename T>
+char integerType()
+{
+  BOOST_STATIC_ASSERT(sizeof(T) == 4 || sizeof(T) == 8);
+  if (std::numeric_limits<T>::is_signed)
+    return sizeof(T) == 4 ? kInt32 : kInt64;
+  else
+    return sizeof(T) == 4 ? kUInt32 : kUInt64;
+}
+
+template<typename T>
+T readValue(const char* data)
+{
+  T value;
+  memcpy(&value, data, sizeof value);
+  return value;
+}
+
+// JSON escaping, of strings in JSON and quoted values in logfmt
+size_t escapedLength(const char* data, size_t len)
+{
+  size_t n = len;
+  for (size_t i = 0; i < len; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    if (c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\t')
+      n += 1;
+    else if (c < 0x20)
+      n += 5;
+  }
+  return n;
+}
+
+// escaped is of escapedLength()
+char* escape(char* buf, const char* data, size_t len, size_t escaped)
+{
+  if (escaped == len)
+  {
+    memcpy(buf, data, len);
+    return buf + len;
+  }
+  for (size_t i = 0; i < len; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    switch (c)
+    {
+      case '"': *buf++ = '\\'; *buf++ = '"'; break;
+      case '\\': *buf++ = '\\'; *buf++ = '\\'; break;
+      case '\n': *buf++ = '\\'; *buf++ = 'n'; break;
+      case '\r': *buf++ = '\\'; *buf++ = 'r'; break;
+      case '\t': *buf++ = '\\'; *buf++ = 't'; break;
+      default:
+        if (c < 0x20)
+        {
+          memcpy(buf, "\\u00", 4);
+          buf[4] = digitsHex[c >> 4];
+          buf[5] = digitsHex[c & 0xF];
+          buf += 6;
+        }
+        else
+        {
+          *buf++ = static_cast<char>(c);
+        }
+    }
+  }
+  return buf;
+}
+
+// as go-logfmt does
+bool needsQuotes(const char* data, size_t len)
+{
+  if (len == 0)
+    return true;
+  for (size_t i = 0; i < len; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    if (c <= ' ' || c == '=' || c == '"')
+      return true;
+  }
+  return false;
+}
+
 }
 }
 
@@ -95,18 +195,405 @@ void FixedBuffer<SIZE>::cookieEnd()
 {
 }
 
+bool LogKey::valid() const
+{
+  if (size_ <= 0 || size_ > 255)
+    return false;
+  for (int i = 0; i < size_; ++i)
+  {
+    char c = data_[i];
+    if (!(isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '-'))
+      return false;
+  }
+  return true;
+}
+
 void LogStream::staticCheck()
 {
   BOOST_STATIC_ASSERT(kMaxNumericSize - 10 > std::numeric_limits<double>::digits10);
   BOOST_STATIC_ASSERT(kMaxNumericSize - 10 > std::numeric_limits<long double>::digits10);
   BOOST_STATIC_ASSERT(kMaxNumericSize - 10 > std::numeric_limits<long>::digits10);
   BOOST_STATIC_ASSERT(kMaxNumericSize - 10 > std::numeric_limits<long long>::digits10);
+  BOOST_STATIC_ASSERT(kMaxNumericSize >= kMaxGeneralLength);
+}
+
+void LogStream::appendString(const char* data, size_t len)
+{
+  // whole or nothing, like FixedBuffer::append()
+  uint16_t length = static_cast<uint16_t>(len);
+  if (len <= 0xFFFF && implicit_cast<size_t>(buffer_.avail()) > 1 + sizeof length + len)
+  {
+    char* buf = buffer_.current();
+    buf[0] = kString;
+    memcpy(buf + 1, &length, sizeof length);
+    memcpy(buf + 1 + sizeof length, data, len);
+    buffer_.add(1 + sizeof length + len);
+  }
+}
+
+void LogStream::appendValue(char type, const void* value, size_t len)
+{
+  if (implicit_cast<size_t>(buffer_.avail()) > 1 + len)
+  {
+    char* buf = buffer_.current();
+    buf[0] = type;
+    memcpy(buf + 1, value, len);
+    buffer_.add(1 + len);
+  }
+}
+
+bool LogStream::appendKey(const LogKey& key, size_t valueSize)
+{
+  // with the value, whole or nothing
+  if (implicit_cast<size_t>(buffer_.avail()) > 2 + key.size() + 1 + valueSize)
+  {
+    char* buf = buffer_.current();
+    buf[0] = kKey;
+    buf[1] = static_cast<char>(key.size());
+    memcpy(buf + 2, key.data(), key.size());
+    buffer_.add(2 + key.size());
+    return true;
+  }
+  return false;
+}
+
+void LogStream::appendMessage(const char* data, size_t len)
+{
+  // Appended to the end first, then rotated to where the message ends,
+  // which is before the fields.
+  int start = buffer_.length();
+  int at = fieldsStart_ >= 0 ? fieldsStart_ : start;
+  if (json_)
+  {
+    size_t escaped = escapedLength(data, len);
+    static const char kMsg[] = ",\"msg\":\"";
+    const size_t kMsgLength = sizeof kMsg - 1;
+    if (messageEnd_ < 0)
+    {
+      if (implicit_cast<size_t>(buffer_.avail()) <= kMsgLength + escaped + 1)
+        return;
+      char* buf = buffer_.current();
+      memcpy(buf, kMsg, kMsgLength);
+      buf = escape(buf + kMsgLength, data, len, escaped);
+      *buf = '"';
+      buffer_.add(kMsgLength + escaped + 1);
+      messageEnd_ = at + static_cast<int>(kMsgLength + escaped);
+    }
+    else
+    {
+      if (implicit_cast<size_t>(buffer_.avail()) <= escaped)
+        return;
+      escape(buffer_.current(), data, len, escaped);
+      buffer_.add(escaped);
+      at = messageEnd_;
+      messageEnd_ += static_cast<int>(escaped);
+    }
+  }
+  else
+  {
+    if (implicit_cast<size_t>(buffer_.avail()) <= len)
+      return;
+    buffer_.append(data, len);
+  }
+
+  int end = buffer_.length();
+  if (at < start)
+  {
+    char* base = buffer_.data();
+    size_t added = end - start;
+    char moved[128];
+    if (added <= sizeof moved)
+    {
+      // faster than std::rotate() for the usual few words of text
+      memcpy(moved, base + start, added);
+      memmove(base + at + added, base + at, start - at);
+      memcpy(base + at, moved, added);
+    }
+    else
+    {
+      std::rotate(base + at, base + start, base + end);
+    }
+  }
+  if (fieldsStart_ >= at)
+  {
+    fieldsStart_ += end - start;
+  }
+}
+
+bool LogStream::beginField(const LogKey& key, size_t valueLength)
+{
+  // ' key=' or ',"key":'
+  size_t keyLength = key.size() + (json_ ? 4 : 2);
+  if (implicit_cast<size_t>(buffer_.avail()) <= keyLength + valueLength)
+  {
+    return false;
+  }
+  if (fieldsStart_ < 0)
+  {
+    fieldsStart_ = buffer_.length();
+  }
+  char* buf = buffer_.current();
+  if (json_)
+  {
+    buf[0] = ',';
+    buf[1] = '"';
+    memcpy(buf + 2, key.data(), key.size());
+    buf[2 + key.size()] = '"';
+    buf[3 + key.size()] = ':';
+  }
+  else
+  {
+    buf[0] = ' ';
+    memcpy(buf + 1, key.data(), key.size());
+    buf[1 + key.size()] = '=';
+  }
+  buffer_.add(keyLength);
+  return true;
+}
+
+LogStream& LogStream::kv(const LogKey& key, const StringPiece& value)
+{
+  size_t len = value.size();
+  if (binary_)
+  {
+    if (len <= 0xFFFF && appendKey(key, 2 + len))
+      appendString(value.data(), len);
+  }
+  else if (json_ || needsQuotes(value.data(), len))
+  {
+    size_t escaped = escapedLength(value.data(), len);
+    if (beginField(key, escaped + 2))
+    {
+      char* buf = buffer_.current();
+      buf[0] = '"';
+      escape(buf + 1, value.data(), len, escaped);
+      buf[1 + escaped] = '"';
+      buffer_.add(escaped + 2);
+    }
+  }
+  else if (beginField(key, len))
+  {
+    buffer_.append(value.data(), len);
+  }
+  return *this;
+}
+
+template<typename T>
+void LogStream::formatField(const LogKey& key, T v)
+{
+  if (binary_)
+  {
+    if (appendKey(key, sizeof v))
+      appendValue(integerType<T>(), &v, sizeof v);
+  }
+  else
+  {
+    char buf[kMaxNumericSize];
+    size_t len = convert(buf, v);
+    if (beginField(key, len))
+      buffer_.append(buf, len);
+  }
+}
+
+LogStream& LogStream::kv(const LogKey& key, int v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, unsigned int v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, long v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, unsigned long v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, long long v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, unsigned long long v)
+{
+  formatField(key, v);
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, double v)
+{
+  if (binary_)
+  {
+    if (appendKey(key, sizeof v))
+      appendValue(kDouble, &v, sizeof v);
+  }
+  else if (json_ && !std::isfinite(v))
+  {
+    if (beginField(key, 4))
+      buffer_.append("null", 4);
+  }
+  else
+  {
+    char buf[kMaxGeneralLength];
+    int len = formatShortest(buf, v);
+    if (beginField(key, len))
+      buffer_.append(buf, len);
+  }
+  return *this;
+}
+
+LogStream& LogStream::kv(const LogKey& key, bool v)
+{
+  if (binary_)
+  {
+    uint8_t value = v;
+    if (appendKey(key, sizeof value))
+      appendValue(kBool, &value, sizeof value);
+  }
+  else if (beginField(key, v ? 4 : 5))
+  {
+    buffer_.append(v ? "true" : "false", v ? 4 : 5);
+  }
+  return *this;
+}
+
+template<typename T>
+void LogStream::formatValue(const LogKey* key, T v)
+{
+  if (key)
+    kv(*key, v);
+  else
+    *this << v;
+}
+
+bool LogStream::appendFormatted(const char* data, int len)
+{
+  assert(!binary_);
+  const char* end = data + len;
+  // of the next value, from kv()
+  LogKey key(NULL, 0);
+  bool hasKey = false;
+  while (data < end)
+  {
+    char type = *data++;
+    size_t size = 0;
+    switch (type)
+    {
+      case kString:
+        if (end - data >= 2)
+          size = 2 + readValue<uint16_t>(data);
+        break;
+      case kKey:
+        if (end - data >= 1)
+          size = 1 + static_cast<unsigned char>(*data);
+        break;
+      case kBool:
+        size = 1;
+        break;
+      case kInt32:
+      case kUInt32:
+        size = 4;
+        break;
+      case kInt64:
+      case kUInt64:
+      case kDouble:
+      case kPointer:
+        size = 8;
+        break;
+      default:
+        return false;
+    }
+    if (size == 0 || implicit_cast<size_t>(end - data) < size)
+    {
+      return false;
+    }
+
+    switch (type)
+    {
+      case kKey:
+        key = LogKey(data + 1, static_cast<int>(size - 1));
+        hasKey = true;
+        data += size;
+        continue;
+      case kString:
+        formatValue(hasKey ? &key : NULL, StringPiece(data + 2, static_cast<int>(size - 2)));
+        break;
+      case kBool:
+        formatValue(hasKey ? &key : NULL, *data != 0);
+        break;
+      case kInt32:
+        formatValue(hasKey ? &key : NULL, readValue<int32_t>(data));
+        break;
+      case kUInt32:
+        formatValue(hasKey ? &key : NULL, readValue<uint32_t>(data));
+        break;
+      case kInt64:
+        formatValue(hasKey ? &key : NULL, static_cast<long long>(readValue<int64_t>(data)));
+        break;
+      case kUInt64:
+        formatValue(hasKey ? &key : NULL, static_cast<unsigned long long>(readValue<uint64_t>(data)));
+        break;
+      case kDouble:
+        formatValue(hasKey ? &key : NULL, readValue<double>(data));
+        break;
+      case kPointer:
+        *this << reinterpret_cast<const void*>(static_cast<uintptr_t>(readValue<uint64_t>(data)));
+        break;
+    }
+    hasKey = false;
+    data += size;
+  }
+  return true;
+}
+
+void LogStream::beginRecord()
+{
+  assert(buffer_.length() == 0);
+  char header[kRecordHeaderLength] = { kRecordMarker, 0, 0 };
+  buffer_.append(header, sizeof header);
+}
+
+void LogStream::endRecord()
+{
+  uint16_t length = static_cast<uint16_t>(buffer_.length());
+  // buffer_ starts with the header
+  memcpy(buffer_.current() - length + 1, &length, sizeof length);
+}
+
+int LogStream::recordLength(const char* data, int len)
+{
+  if (len < kRecordHeaderLength || data[0] != kRecordMarker)
+  {
+    return 0;
+  }
+  int length = readValue<uint16_t>(data + 1);
+  return length >= kRecordHeaderLength && length <= len ? length : 0;
 }
 
 template<typename T>
 void LogStream::formatInteger(T v)
 {
-  if (buffer_.avail() >= kMaxNumericSize)
+  if (binary_)
+  {
+    appendValue(integerType<T>(), &v, sizeof v);
+  }
+  else if (!plain())
+  {
+    char buf[kMaxNumericSize];
+    appendMessage(buf, convert(buf, v));
+  }
+  else if (buffer_.avail() >= kMaxNumericSize)
   {
     size_t len = convert(buffer_.current(), v);
     buffer_.add(len);
@@ -164,7 +651,19 @@ LogStream& LogStream::operator<<(unsigned long long v)
 LogStream& LogStream::operator<<(const void* p)
 {
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
-  if (buffer_.avail() >= kMaxNumericSize)
+  if (binary_)
+  {
+    uint64_t value = v;
+    appendValue(kPointer, &value, sizeof value);
+  }
+  else if (!plain())
+  {
+    char buf[kMaxNumericSize];
+    buf[0] = '0';
+    buf[1] = 'x';
+    appendMessage(buf, convertHex(buf+2, v) + 2);
+  }
+  else if (buffer_.avail() >= kMaxNumericSize)
   {
     char* buf = buffer_.current();
     buf[0] = '0';
@@ -175,12 +674,21 @@ LogStream& LogStream::operator<<(const void* p)
   return *this;
 }
 
-// FIXME: replace this with Grisu3 by Florian Loitsch.
 LogStream& LogStream::operator<<(double v)
 {
-  if (buffer_.avail() >= kMaxNumericSize)
+  if (binary_)
+  {
+    appendValue(kDouble, &v, sizeof v);
+  }
+  else if (!plain())
+  {
+    char buf[kMaxNumericSize];
+    appendMessage(buf, formatGeneral(buf, v, 12));
+  }
+  else if (buffer_.avail() >= kMaxNumericSize)
   {
-    int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
+    // same as "%.12g"
+    int len = formatGeneral(buffer_.current(), v, 12);
     buffer_.add(len);
   }
   return *this;
@@ -195,6 +703,25 @@ Fmt::Fmt(const char* fmt, T val)
   assert(static_cast<size_t>(length_) < sizeof buf_);
 }
 
+Fmt Fmt::shortest(double v)
+{
+  Fmt fmt;
+  fmt.length_ = formatShortest(fmt.buf_, v);
+  return fmt;
+}
+
+Fmt Fmt::fixed(double v, int precision)
+{
+  Fmt fmt;
+  fmt.length_ = formatFixed(fmt.buf_, sizeof fmt.buf_, v, precision);
+  if (fmt.length_ < 0 || static_cast<size_t>(fmt.length_) >= sizeof fmt.buf_)
+  {
+    // cut, or the digits of 1e308, so not truncated but exact
+    fmt.length_ = formatShortest(fmt.buf_, v);
+  }
+  return fmt;
+}
+
 // Explicit instantiations
 
 template Fmt::Fmt(const char* fmt, char);
@@ -9,6 +9,7 @@
 #include <string>
 #endif
 #include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
 
 namespace muduo
 {
@@ -45,6 +46,7 @@ class FixedBuffer : boost::noncopyable
   }
 
   const char* data() const { return data_; }
+  char* data() { return data_; }
   int length() const { return static_cast<int>(cur_ - data_); }
 
   // write to data_ directly
@@ -75,15 +77,58 @@ class FixedBuffer : boost::noncopyable
 
 }
 
+// A key of LogStream::kv(), which only takes string literals, so the keys
+// of a program are fixed when it compiles, and are never escaped.
+// Keys are of letters, digits, '_', '.' and '-', 1 to 255 of them.  The
+// length is checked when it compiles, the characters only by assert() of
+// debug builds; a release build writes a bad key as it is.
+class LogKey
+{
+ public:
+  template<int N>
+  LogKey(const char (&key)[N])
+    : data_(key),
+      size_(N-1)
+  {
+    BOOST_STATIC_ASSERT(N > 1 && N <= 256);
+    assert(valid());
+  }
+
+  const char* data() const { return data_; }
+  int size() const { return size_; }
+
+ private:
+  friend class LogStream;
+  // of a binary stream
+  LogKey(const char* data, int size)
+    : data_(data),
+      size_(size)
+  {
+  }
+
+  bool valid() const;
+
+  const char* data_;
+  int size_;
+};
+
 class LogStream : boost::noncopyable
 {
   typedef LogStream self;
  public:
   typedef detail::FixedBuffer<detail::kSmallBuffer> Buffer;
 
+  LogStream()
+    : binary_(false),
+      json_(false),
+      fieldsStart_(-1),
+      messageEnd_(-1)
+  {
+  }
+
   self& operator<<(bool v)
   {
-    buffer_.append(v ? "1" : "0", 1);
+    appendText(v ? "1" : "0", 1);
     return *this;
   }
 
@@ -108,7 +153,7 @@ class LogStream : boost::noncopyable
 
   self& operator<<(char v)
   {
-    buffer_.append(&v, 1);
+    appendText(&v, 1);
     return *this;
   }
 
@@ -119,11 +164,11 @@ class LogStream : boost::noncopyable
   {
     if (str)
     {
-      buffer_.append(str, strlen(str));
+      appendText(str, strlen(str));
     }
     else
     {
-      buffer_.append("(null)", 6);
+      appendText("(null)", 6);
     }
     return *this;
   }
@@ -135,21 +180,21 @@ class LogStream : boost::noncopyable
 
   self& operator<<(const string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    appendText(v.c_str(), v.size());
     return *this;
   }
 
 #ifndef MUDUO_STD_STRING
   self& operator<<(const std::string& v)
   {
-    buffer_.append(v.c_str(), v.size());
+    appendText(v.c_str(), v.size());
     return *this;
   }
 #endif
 
   self& operator<<(const StringPiece& v)
   {
-    buffer_.append(v.data(), v.size());
+    appendText(v.data(), v.size());
     return *this;
   }
 
@@ -159,17 +204,115 @@ class LogStream : boost::noncopyable
     return *this;
   }
 
-  void append(const char* data, int len) { buffer_.append(data, len); }
+  // Structured fields, " key=value" as logfmt, or ",\"key\":value" in a JSON
+  // object after beginJson(), strings quoted and escaped as needed.  Text
+  // streamed after fields still goes before them, as the message, so
+  //   LOG_INFO.kv("conn", name).kv("bytes", n) << "closed";
+  // reads "closed conn=... bytes=...".  A field is written whole or not at all.
+  self& kv(const LogKey& key, const StringPiece& value);
+  self& kv(const LogKey& key, const char* value)
+  { return kv(key, value ? StringPiece(value) : StringPiece("(null)", 6)); }
+  self& kv(const LogKey& key, const string& value)
+  { return kv(key, StringPiece(value)); }
+#ifndef MUDUO_STD_STRING
+  self& kv(const LogKey& key, const std::string& value)
+  { return kv(key, StringPiece(value)); }
+#endif
+  self& kv(const LogKey& key, int);
+  self& kv(const LogKey& key, unsigned int);
+  self& kv(const LogKey& key, long);
+  self& kv(const LogKey& key, unsigned long);
+  self& kv(const LogKey& key, long long);
+  self& kv(const LogKey& key, unsigned long long);
+  // the fewest digits that read back as the value, null in JSON if not finite
+  self& kv(const LogKey& key, double);
+  self& kv(const LogKey& key, bool);
+
+  // After the opening of a JSON object, text goes into ",\"msg\":\"...\"",
+  // escaped, and fields are JSON members.
+  void beginJson() { json_ = true; }
+  bool json() const { return json_; }
+  // After the message and the fields, so what follows is appended as it is.
+  void endFields()
+  {
+    json_ = false;
+    fieldsStart_ = -1;
+    messageEnd_ = -1;
+  }
+
+  void append(const char* data, int len) { appendText(data, len); }
   const Buffer& buffer() const { return buffer_; }
-  void resetBuffer() { buffer_.reset(); }
+  void resetBuffer()
+  {
+    buffer_.reset();
+    endFields();
+  }
+
+  // In binary mode values are copied as they are, with their types,
+  // instead of formatted, for appendFormatted() to format them later, on
+  // another thread or in another process of the same machine type.
+  void setBinary(bool on) { binary_ = on; }
+  bool binary() const { return binary_; }
+
+  // Copies bytes as they are, in either mode.
+  void appendRaw(const void* data, size_t len)
+  { buffer_.append(static_cast<const char*>(data), len); }
+
+  // Formats values of a binary stream, as operator<<() does in text mode.
+  // Returns false if they are corrupted.
+  bool appendFormatted(const char* data, int len);
+
+  // A binary record, of a log line, starts with kRecordMarker and its
+  // length in two bytes.  Text can have '\0' in it too, so data is only
+  // taken for records where there are some, eg. lines of Logger::binary().
+  static const char kRecordMarker = '\0';
+  static const int kRecordHeaderLength = 3;
+
+  // Before anything else is written.
+  void beginRecord();
+  // After everything else is written.
+  void endRecord();
+
+  static bool isRecord(const char* data, int len)
+  { return len > 0 && data[0] == kRecordMarker; }
+
+  // Of the record data starts with, 0 if it is not a whole one.
+  static int recordLength(const char* data, int len);
 
  private:
   void staticCheck();
 
+  void appendText(const char* data, size_t len)
+  {
+    if (binary_)
+      appendString(data, len);
+    else if (plain())
+      buffer_.append(data, len);
+    else
+      appendMessage(data, len);
+  }
+
+  // no message to keep before fields
+  bool plain() const { return fieldsStart_ < 0 && !json_; }
+  void appendMessage(const char* data, size_t len);
+  bool beginField(const LogKey& key, size_t valueLength);
+
+  void appendString(const char* data, size_t len);
+  void appendValue(char type, const void* value, size_t len);
+  bool appendKey(const LogKey& key, size_t valueSize);
+
   template<typename T>
   void formatInteger(T);
+  template<typename T>
+  void formatField(const LogKey& key, T);
+  template<typename T>
+  void formatValue(const LogKey* key, T);
 
   Buffer buffer_;
+  bool binary_;
+  bool json_;
+  int fieldsStart_;  // -1 before the first field
+  int messageEnd_;   // of JSON, at the closing quote of "msg", -1 before text
 
   static const int kMaxNumericSize = 32;
 };
@@ -180,10 +323,19 @@ class Fmt // : boost::noncopyable
   template<typename T>
   Fmt(const char* fmt, T val);
 
+  // The fewest digits that read back as v, and "%.*f" of v, without
+  // snprintf, see detail::formatShortest() and detail::formatFixed().
+  // fixed() longer than 31 characters, eg. of 1e40 or of a precision of
+  // 40, is shortest() instead.
+  static Fmt shortest(double v);
+  static Fmt fixed(double v, int precision);
+
   const char* data() const { return buf_; }
   int length() const { return length_; }
 
  private:
+  Fmt() : length_(0) { }
+
   char buf_[32];
   int length_;
 };
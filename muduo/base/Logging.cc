@@ -4,10 +4,14 @@
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/TimeZone.h>
 
+#include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
+#include <algorithm>
 #include <sstream>
 
 namespace muduo
@@ -61,6 +65,9 @@ const char* LogLevelName[Logger::NUM_LOG_LEVELS] =
   "FATAL ",
 };
 
+// without the padding, for JSON
+const int LogLevelNameLength[Logger::NUM_LOG_LEVELS] = { 5, 5, 4, 4, 5, 5 };
+
 // helper class for known string length at compile time
 class T
 {
@@ -103,31 +110,23 @@ void defaultFlush()
 Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
 TimeZone g_logTimeZone;
-
-}
-
-using namespace muduo;
-
-Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line)
-  : time_(Timestamp::now()),
-    stream_(),
-    level_(level),
-    line_(line),
-    basename_(file)
+bool g_logBinary = false;
+bool g_logJson = false;
+
+// A binary record, after the header of LogStream, has
+const int kLevelOffset = LogStream::kRecordHeaderLength;  // 1 byte
+const int kLineOffset = kLevelOffset + 1;                 // int32_t
+const int kTidOffset = kLineOffset + 4;                   // int32_t
+const int kTimeOffset = kTidOffset + 4;                   // int64_t
+const int kBasenameOffset = kTimeOffset + 8;              // 1 byte of length, then the bytes
+// then values of the stream
+
+// A JSON line starts with this, then the time as in a text line.
+const char kJsonTime[] = "{\"time\":\"";
+
+// followed by a space, or by the closing quote in JSON
+void formatTime(LogStream& stream, int64_t microSecondsSinceEpoch, bool json)
 {
-  formatTime();
-  CurrentThread::tid();
-  stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
-  stream_ << T(LogLevelName[level], 6);
-  if (savedErrno != 0)
-  {
-    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
-  }
-}
-
-void Logger::Impl::formatTime()
-{
-  int64_t microSecondsSinceEpoch = time_.microSecondsSinceEpoch();
   time_t seconds = static_cast<time_t>(microSecondsSinceEpoch / Timestamp::kMicroSecondsPerSecond);
   int microseconds = static_cast<int>(microSecondsSinceEpoch % Timestamp::kMicroSecondsPerSecond);
   if (seconds != t_lastSecond)
@@ -151,20 +150,112 @@ void Logger::Impl::formatTime()
 
   if (g_logTimeZone.valid())
   {
-    Fmt us(".%06d ", microseconds);
+    Fmt us(json ? ".%06d\"" : ".%06d ", microseconds);
     assert(us.length() == 8);
-    stream_ << T(t_time, 17) << T(us.data(), 8);
+    stream << T(t_time, 17) << T(us.data(), 8);
   }
   else
   {
-    Fmt us(".%06dZ ", microseconds);
+    Fmt us(json ? ".%06dZ\"" : ".%06dZ ", microseconds);
     assert(us.length() == 9);
-    stream_ << T(t_time, 17) << T(us.data(), 9);
+    stream << T(t_time, 17) << T(us.data(), 9);
+  }
+}
+
+// {"time":"20140101 12:34:56.123456Z","tid":1234,"level":"INFO"
+// then the message and the fields go in as members
+void formatJsonHeader(LogStream& stream, int64_t microSecondsSinceEpoch,
+                      int tid, int level)
+{
+  stream << T(kJsonTime, sizeof kJsonTime - 1);
+  formatTime(stream, microSecondsSinceEpoch, true);
+  stream << T(",\"tid\":", 7) << tid
+         << T(",\"level\":\"", 10) << T(LogLevelName[level], LogLevelNameLength[level]) << '"';
+  stream.beginJson();
+}
+
+// ,"file":"Logging.cc","line":123}
+void formatJsonTrailer(LogStream& stream, const StringPiece& basename, int line)
+{
+  stream.endFields();
+  stream << T(",\"file\":\"", 9) << basename << T("\",\"line\":", 9) << line << T("}\n", 2);
+}
+
+template<typename To>
+To readField(const char* record, int offset)
+{
+  To value;
+  memcpy(&value, record + offset, sizeof value);
+  return value;
+}
+
+}
+
+using namespace muduo;
+
+Logger::Impl::Impl(LogLevel level, int savedErrno, const SourceFile& file, int line)
+  : time_(Timestamp::now()),
+    stream_(),
+    level_(level),
+    line_(line),
+    basename_(file)
+{
+  if (g_logBinary)
+  {
+    beginRecord();
+  }
+  else if (g_logJson)
+  {
+    formatJsonHeader(stream_, time_.microSecondsSinceEpoch(), CurrentThread::tid(), level);
+  }
+  else
+  {
+    formatTime();
+    CurrentThread::tid();
+    stream_ << T(CurrentThread::tidString(), CurrentThread::tidStringLength());
+    stream_ << T(LogLevelName[level], 6);
+  }
+  if (savedErrno != 0)
+  {
+    stream_ << strerror_tl(savedErrno) << " (errno=" << savedErrno << ") ";
   }
 }
 
+void Logger::Impl::formatTime()
+{
+  muduo::formatTime(stream_, time_.microSecondsSinceEpoch(), false);
+}
+
+void Logger::Impl::beginRecord()
+{
+  stream_.setBinary(true);
+  stream_.beginRecord();
+  uint8_t level = static_cast<uint8_t>(level_);
+  int32_t line = line_;
+  int32_t tid = CurrentThread::tid();
+  int64_t time = time_.microSecondsSinceEpoch();
+  uint8_t basenameLength = static_cast<uint8_t>(std::min(basename_.size_, 255));
+  stream_.appendRaw(&level, sizeof level);
+  stream_.appendRaw(&line, sizeof line);
+  stream_.appendRaw(&tid, sizeof tid);
+  stream_.appendRaw(&time, sizeof time);
+  stream_.appendRaw(&basenameLength, sizeof basenameLength);
+  stream_.appendRaw(basename_.data_, basenameLength);
+}
+
 void Logger::Impl::finish()
 {
+  if (stream_.binary())
+  {
+    stream_.endRecord();
+    return;
+  }
+  if (stream_.json())
+  {
+    formatJsonTrailer(stream_, StringPiece(basename_.data_, basename_.size_), line_);
+    return;
+  }
+  stream_.endFields();
   stream_ << " - " << basename_ << ':' << line_ << '\n';
 }
 
@@ -220,3 +311,152 @@ void Logger::setTimeZone(const TimeZone& tz)
 {
   g_logTimeZone = tz;
 }
+
+void Logger::setBinary(bool on)
+{
+  g_logBinary = on;
+}
+
+bool Logger::binary()
+{
+  return g_logBinary;
+}
+
+void Logger::setJson(bool on)
+{
+  g_logJson = on;
+}
+
+bool Logger::formatRecord(const char* record, int len, LogStream& stream)
+{
+  if (LogStream::recordLength(record, len) != len || len <= kBasenameOffset)
+  {
+    return false;
+  }
+  int level = readField<uint8_t>(record, kLevelOffset);
+  int basenameLength = readField<uint8_t>(record, kBasenameOffset);
+  int valuesOffset = kBasenameOffset + 1 + basenameLength;
+  if (level >= NUM_LOG_LEVELS || valuesOffset > len)
+  {
+    return false;
+  }
+
+  int64_t time = readField<int64_t>(record, kTimeOffset);
+  int tid = readField<int32_t>(record, kTidOffset);
+  if (g_logJson)
+  {
+    formatJsonHeader(stream, time, tid, level);
+  }
+  else
+  {
+    formatTime(stream, time, false);
+    stream << Fmt("%5d ", tid);
+    stream << T(LogLevelName[level], 6);
+  }
+  if (!stream.appendFormatted(record + valuesOffset, len - valuesOffset))
+  {
+    stream.endFields();
+    return false;
+  }
+  StringPiece basename(record + kBasenameOffset + 1, basenameLength);
+  int line = readField<int32_t>(record, kLineOffset);
+  if (stream.json())
+  {
+    formatJsonTrailer(stream, basename, line);
+  }
+  else
+  {
+    stream.endFields();
+    stream << " - " << basename << ':' << line << '\n';
+  }
+  return true;
+}
+
+Timestamp Logger::recordTime(const char* record)
+{
+  return Timestamp(readField<int64_t>(record, kTimeOffset));
+}
+
+LogRateLimiter::LogRateLimiter(int perSecond)
+  : interval_(Timestamp::kMicroSecondsPerSecond / std::max(perSecond, 1)),
+    burst_(interval_ * std::max(perSecond, 1)),
+    due_(0),
+    suppressed_(0)
+{
+}
+
+int64_t LogRateLimiter::pass()
+{
+  // the coarse clock takes a few nanoseconds, ticks of some milliseconds
+  // only make lines pass in small bursts
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  int64_t now = static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+
+  // As GCRA: a line takes interval_ out of the bucket, which is full when
+  // due_ is no later than now.
+  int64_t due = __atomic_load_n(&due_, __ATOMIC_RELAXED);
+  for (;;)
+  {
+    int64_t next = std::max(due, now) + interval_;
+    if (next - now > burst_)
+    {
+      __atomic_fetch_add(&suppressed_, 1, __ATOMIC_RELAXED);
+      return 0;
+    }
+    if (__atomic_compare_exchange_n(&due_, &due, next, true,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+  return 1 + __atomic_exchange_n(&suppressed_, 0, __ATOMIC_RELAXED);
+}
+
+Logger::LogLevel Logger::lineLevel(const char* line, int len)
+{
+  if (g_logBinary && len > 0 && LogStream::recordLength(line, len) == len)
+  {
+    int level = len > kLevelOffset ? readField<uint8_t>(line, kLevelOffset) : static_cast<int>(INFO);
+    return level < NUM_LOG_LEVELS ? static_cast<LogLevel>(level) : INFO;
+  }
+
+  if (len > 0 && line[0] == '{')
+  {
+    // {"time":"...","tid":1234,"level":"INFO"
+    static const char kLevel[] = "\"level\":\"";
+    const char* end = line + std::min(len, 80);
+    const char* p = std::search(line, end, kLevel, kLevel + sizeof kLevel - 1);
+    for (int level = 0; p != end && level < NUM_LOG_LEVELS; ++level)
+    {
+      const char* name = p + sizeof kLevel - 1;
+      int n = LogLevelNameLength[level];
+      if (name + n < end && memcmp(name, LogLevelName[level], n) == 0 && name[n] == '"')
+      {
+        return static_cast<LogLevel>(level);
+      }
+    }
+    return INFO;
+  }
+
+  // "20140101 12:34:56.123456Z  1234 INFO  "
+  int i = 24;
+  if (i < len && line[i] == 'Z')
+    ++i;
+  while (i < len && line[i] == ' ')
+    ++i;
+  while (i < len && isdigit(line[i]))
+    ++i;
+  ++i;
+  if (i + 6 <= len)
+  {
+    for (int level = 0; level < NUM_LOG_LEVELS; ++level)
+    {
+      if (memcmp(line + i, LogLevelName[level], 6) == 0)
+      {
+        return static_cast<LogLevel>(level);
+      }
+    }
+  }
+  return INFO;
+}
@@ -4,6 +4,8 @@
 #include <muduo/base/LogStream.h>
 #include <muduo/base/Timestamp.h>
 
+#include <boost/noncopyable.hpp>
+
 namespace muduo
 {
 
@@ -72,6 +74,26 @@ class Logger
   static void setFlush(FlushFunc);
   static void setTimeZone(const TimeZone& tz);
 
+  // In binary mode LOG_* statements copy the time, the thread, and the
+  // values given to the stream into a record, and leave formatting them
+  // to the output, which must take records, eg. AsyncLogging.
+  static void setBinary(bool on);
+  static bool binary();
+
+  // Lines as JSON objects, of "time", "tid", "level", "msg", the fields of
+  // LogStream::kv(), "file" and "line", instead of text.  Binary records
+  // are formatted as JSON too.
+  static void setJson(bool on);
+
+  // Formats a binary record as the text line of its LOG_* statement.
+  // Returns false if it is corrupted.
+  static bool formatRecord(const char* record, int len, LogStream& stream);
+  static Timestamp recordTime(const char* record);
+
+  // Of a text line or, in binary mode, a binary record of Logger, INFO if
+  // it is neither.
+  static LogLevel lineLevel(const char* line, int len);
+
  private:
 
 class Impl
@@ -80,6 +102,7 @@ class Impl
   typedef Logger::LogLevel LogLevel;
   Impl(LogLevel level, int old_errno, const SourceFile& file, int line);
   void formatTime();
+  void beginRecord();
   void finish();
 
   Timestamp time_;
@@ -128,6 +151,102 @@ inline Logger::LogLevel Logger::logLevel()
 #define LOG_SYSERR muduo::Logger(__FILE__, __LINE__, false).stream()
 #define LOG_SYSFATAL muduo::Logger(__FILE__, __LINE__, true).stream()
 
+// For statements which can fire at the rate of events, eg. errors of a
+// socket, so a storm of them does not swamp the log.
+//
+// LOG_*_LIMITED(perSecond) writes at most perSecond lines a second, in
+// bursts of up to perSecond.  LOG_*_EVERY_N(n) writes every nth line.  A
+// line after some suppressed ones has a field of how many, as in
+//   LOG_SYSERR_LIMITED(10) << "TcpConnection::handleWrite";
+//   ... Broken pipe (errno=32) TcpConnection::handleWrite suppressed=1234 - ...
+#define MUDUO_LOG_PASS(Limiter, arg) \
+  ({ static muduo::Limiter muduo_limiter(arg); muduo_limiter.pass(); })
+
+#define LOG_INFO_LIMITED(perSecond) if (muduo::Logger::logLevel() <= muduo::Logger::INFO) \
+  if (int64_t muduo_passed = MUDUO_LOG_PASS(LogRateLimiter, perSecond)) \
+    muduo::Logger(__FILE__, __LINE__).stream() << muduo::LogSuppressed(muduo_passed)
+#define LOG_WARN_LIMITED(perSecond) if (int64_t muduo_passed = MUDUO_LOG_PASS(LogRateLimiter, perSecond)) \
+  muduo::Logger(__FILE__, __LINE__, muduo::Logger::WARN).stream() << muduo::LogSuppressed(muduo_passed)
+#define LOG_ERROR_LIMITED(perSecond) if (int64_t muduo_passed = MUDUO_LOG_PASS(LogRateLimiter, perSecond)) \
+  muduo::Logger(__FILE__, __LINE__, muduo::Logger::ERROR).stream() << muduo::LogSuppressed(muduo_passed)
+#define LOG_SYSERR_LIMITED(perSecond) if (int64_t muduo_passed = MUDUO_LOG_PASS(LogRateLimiter, perSecond)) \
+  muduo::Logger(__FILE__, __LINE__, false).stream() << muduo::LogSuppressed(muduo_passed)
+
+#define LOG_INFO_EVERY_N(n) if (muduo::Logger::logLevel() <= muduo::Logger::INFO) \
+  if (int64_t muduo_passed = MUDUO_LOG_PASS(LogSampler, n)) \
+    muduo::Logger(__FILE__, __LINE__).stream() << muduo::LogSuppressed(muduo_passed)
+#define LOG_WARN_EVERY_N(n) if (int64_t muduo_passed = MUDUO_LOG_PASS(LogSampler, n)) \
+  muduo::Logger(__FILE__, __LINE__, muduo::Logger::WARN).stream() << muduo::LogSuppressed(muduo_passed)
+#define LOG_ERROR_EVERY_N(n) if (int64_t muduo_passed = MUDUO_LOG_PASS(LogSampler, n)) \
+  muduo::Logger(__FILE__, __LINE__, muduo::Logger::ERROR).stream() << muduo::LogSuppressed(muduo_passed)
+
+// Limits of one LOG_*_LIMITED or LOG_*_EVERY_N statement, kept in a static
+// of it.  pass() returns 0 if the line is suppressed, or else 1 + how many
+// were since the last one passed.  Thread safe, without a lock.
+
+// A token bucket of perSecond lines, filled at perSecond lines a second.
+class LogRateLimiter : boost::noncopyable
+{
+ public:
+  explicit LogRateLimiter(int perSecond);
+
+  int64_t pass();
+
+ private:
+  const int64_t interval_;  // in microseconds, of one line
+  const int64_t burst_;     // in microseconds, of a full bucket
+  int64_t due_;             // when the bucket will be full, of CLOCK_MONOTONIC
+  int64_t suppressed_;
+};
+
+// Every nth line, the first one included.
+class LogSampler : boost::noncopyable
+{
+ public:
+  explicit LogSampler(int n)
+    : n_(n > 0 ? n : 1),
+      count_(0)
+  {
+  }
+
+  int64_t pass()
+  {
+    int64_t count = __atomic_fetch_add(&count_, 1, __ATOMIC_RELAXED);
+    if (count % n_ != 0)
+      return 0;
+    return count == 0 ? 1 : n_;
+  }
+
+ private:
+  const int64_t n_;
+  int64_t count_;
+};
+
+// A "suppressed" field of how many lines of the statement were not
+// written since its last one, if any.
+class LogSuppressed
+{
+ public:
+  explicit LogSuppressed(int64_t passed)
+    : count_(passed - 1)
+  {
+  }
+
+  int64_t count() const { return count_; }
+
+ private:
+  int64_t count_;
+};
+
+inline LogStream& operator<<(LogStream& s, const LogSuppressed& v)
+{
+  if (v.count() > 0)
+  {
+    s.kv("suppressed", v.count());
+  }
+  return s;
+}
+
 const char* strerror_tl(int savedErrno);
 
 // Taken from glog/logging.h
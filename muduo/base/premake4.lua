@@ -10,9 +10,13 @@ project "base"
             'AsyncLogging.cc',
             'Condition.cc',
             'CountDownLatch.cc',
+            'Crc32c.cc',
             'Date.cc',
+            'Dtoa.cc',
             'Exception.cc',
             'FileUtil.cc',
+            'FlightRecorder.cc',
+            'LogArchiver.cc',
             'LogFile.cc',
             'Logging.cc',
             'LogStream.cc',
@@ -1,11 +1,20 @@
 #include <muduo/base/AsyncLogging.h>
+#include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
 #include <muduo/base/Timestamp.h>
 
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
+#include <vector>
+
 off_t kRollSize = 500*1000*1000;
 
 muduo::AsyncLogging* g_asyncLog = NULL;
@@ -15,17 +24,22 @@ void asyncOutput(const char* msg, int len)
   g_asyncLog->append(msg, len);
 }
 
-void bench(bool longLog)
-{
-  muduo::Logger::setOutput(asyncOutput);
+const int kRounds = 30;
+const int kBatch = 1000;
+
+// seconds spent in logging, of each thread
+std::vector<double> g_seconds;
 
+void bench(bool longLog, int index, muduo::CountDownLatch* latch)
+{
   int cnt = 0;
-  const int kBatch = 1000;
   muduo::string empty = " ";
   muduo::string longStr(3000, 'X');
   longStr += " ";
 
-  for (int t = 0; t < 30; ++t)
+  latch->countDown();
+  latch->wait();
+  for (int t = 0; t < kRounds; ++t)
   {
     muduo::Timestamp start = muduo::Timestamp::now();
     for (int i = 0; i < kBatch; ++i)
@@ -36,7 +50,13 @@ void bench(bool longLog)
       ++cnt;
     }
     muduo::Timestamp end = muduo::Timestamp::now();
-    printf("%f\n", timeDifference(end, start)*1000000/kBatch);
+    double seconds = timeDifference(end, start);
+    g_seconds[index] += seconds;
+    // microseconds per line, of the first thread
+    if (index == 0)
+    {
+      printf("%f\n", seconds*1000000/kBatch);
+    }
     struct timespec ts = { 0, 500*1000*1000 };
     nanosleep(&ts, NULL);
   }
@@ -51,14 +71,88 @@ int main(int argc, char* argv[])
     setrlimit(RLIMIT_AS, &rl);
   }
 
+  bool longLog = false;
+  bool perThreadBuffers = false;
+  bool binary = false;
+  muduo::AsyncLogging::OverflowPolicy policy = muduo::AsyncLogging::kDropBacklog;
+  int numThreads = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "blpt:P:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b':
+        binary = true;
+        break;
+      case 'l':
+        longLog = true;
+        break;
+      case 'p':
+        perThreadBuffers = true;
+        break;
+      case 't':
+        numThreads = atoi(optarg);
+        break;
+      case 'P':
+        if (strcmp(optarg, "block") == 0)
+          policy = muduo::AsyncLogging::kBlock;
+        else if (strcmp(optarg, "drop") == 0)
+          policy = muduo::AsyncLogging::kDropNewest;
+        else if (strcmp(optarg, "sample") == 0)
+          policy = muduo::AsyncLogging::kSample;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-b] [-l] [-p] [-t threads] [-P block|drop|sample]\n"
+                "  -b  binary records\n"
+                "  -l  long log lines\n"
+                "  -P  overflow policy, drops backlog by default\n"
+                "  -p  per-thread buffers\n", argv[0]);
+        return 1;
+    }
+  }
+
   printf("pid = %d\n", getpid());
 
   char name[256];
   strncpy(name, argv[0], 256);
   muduo::AsyncLogging log(::basename(name), kRollSize);
+  log.setPerThreadBuffers(perThreadBuffers);
+  log.setOverflowPolicy(policy);
   log.start();
   g_asyncLog = &log;
+  muduo::Logger::setOutput(asyncOutput);
+  muduo::Logger::setBinary(binary);
+
+  g_seconds.resize(numThreads);
+  muduo::CountDownLatch latch(numThreads);
+  boost::ptr_vector<muduo::Thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads.push_back(new muduo::Thread(boost::bind(bench, longLog, i, &latch)));
+    threads.back().start();
+  }
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].join();
+  }
+
+  double total = 0;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    total += g_seconds[i];
+  }
+  double lines = static_cast<double>(numThreads) * kRounds * kBatch;
+  printf("%d threads, %s buffers, %s, %.3f us per line, %.0f lines per second in all threads\n",
+         numThreads, perThreadBuffers ? "per-thread" : "shared",
+         binary ? "binary" : "text",
+         total * 1000000 / lines, lines * numThreads / total);
 
-  bool longLog = argc > 1;
-  bench(longLog);
+  muduo::AsyncLogging::Stats stats = log.stats();
+  printf("written %lld bytes, dropped %lld lines %lld buffers, blocked %lld lines, "
+         "max write %lld us\n",
+         static_cast<long long>(stats.writtenBytes),
+         static_cast<long long>(stats.droppedLines),
+         static_cast<long long>(stats.droppedBuffers),
+         static_cast<long long>(stats.blockedLines),
+         static_cast<long long>(stats.maxWriteMicroSeconds));
 }
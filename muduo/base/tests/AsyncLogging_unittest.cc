@@ -0,0 +1,293 @@
+#include <muduo/base/AsyncLogging.h>
+#include <muduo/base/Condition.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+//#define BOOST_TEST_MODULE AsyncLoggingTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::AsyncLogging;
+using muduo::string;
+
+string g_written;
+AsyncLogging* g_asyncLog = NULL;
+
+void collect(const char* data, int len)
+{
+  g_written.append(data, len);
+}
+
+void output(const char* msg, int len)
+{
+  g_asyncLog->append(msg, len);
+}
+
+void outputToStdout(const char* msg, int len)
+{
+  fwrite(msg, 1, len, stdout);
+}
+
+void appendTextWithNul(bool perThreadBuffers)
+{
+  g_written.clear();
+  AsyncLogging log("asynclogging_unittest", 0);
+  log.setPerThreadBuffers(perThreadBuffers);
+  log.setWriteCallback(collect);
+  log.start();
+  const char text[] = "zero \0 in text\n\0\x05\0ab\nlast\n";
+  log.append(text, sizeof text - 1);
+  log.stop();
+  BOOST_CHECK_EQUAL(g_written, string(text, sizeof text - 1));
+}
+
+BOOST_AUTO_TEST_CASE(testTextWithNul)
+{
+  appendTextWithNul(false);
+  appendTextWithNul(true);
+}
+
+void logRecords(bool perThreadBuffers, bool rawRecords)
+{
+  g_written.clear();
+  AsyncLogging log("asynclogging_unittest", 0);
+  log.setPerThreadBuffers(perThreadBuffers);
+  log.setRawRecords(rawRecords);
+  log.setWriteCallback(collect);
+  log.start();
+  g_asyncLog = &log;
+  muduo::Logger::setOutput(output);
+  muduo::Logger::setBinary(true);
+  LOG_INFO << "binary " << 42;
+  // not a record, though it starts with one
+  const char text[] = "\0\x05\0ab\n";
+  log.append(text, sizeof text - 1);
+  muduo::Logger::setBinary(false);
+  LOG_INFO << "text " << 43;
+  log.stop();
+  g_asyncLog = NULL;
+  muduo::Logger::setOutput(outputToStdout);
+
+  BOOST_CHECK_EQUAL(g_written.find(string(text, sizeof text - 1)) != string::npos, true);
+  BOOST_CHECK_EQUAL(g_written.find("binary 42") != string::npos, !rawRecords);
+  BOOST_CHECK_EQUAL(g_written.find("text 43") != string::npos, true);
+}
+
+BOOST_AUTO_TEST_CASE(testBinaryRecords)
+{
+  logRecords(false, false);
+  logRecords(true, false);
+  logRecords(false, true);
+  logRecords(true, true);
+}
+
+// The backend thread is held in the write callback, until opened, so the
+// buffers queue up and the overflow policy decides what append() does.
+muduo::MutexLock g_gateMutex;
+muduo::Condition g_gateCond(g_gateMutex);
+bool g_stalled = false;
+bool g_open = false;
+
+void collectAfterGate(const char* data, int len)
+{
+  {
+    muduo::MutexLockGuard lock(g_gateMutex);
+    g_stalled = true;
+    g_gateCond.notifyAll();
+    while (!g_open)
+    {
+      g_gateCond.wait();
+    }
+  }
+  g_written.append(data, len);
+}
+
+void openGate()
+{
+  muduo::MutexLockGuard lock(g_gateMutex);
+  g_open = true;
+  g_gateCond.notifyAll();
+}
+
+void openGateLater(double seconds)
+{
+  muduo::CurrentThread::sleepUsec(static_cast<int64_t>(seconds * 1000 * 1000));
+  openGate();
+}
+
+const int kMaxQueuedBuffers = 2;
+const int kOverflowLines = 1000;
+const char kFillLine[] = "20261019 05:00:00.123456Z  4242 INFO  fill line\n";
+const char kFirstLine[] = "20261019 05:00:00.123456Z  4242 INFO  first line\n";
+const char kLastLine[] = "20261019 05:00:00.123456Z  4242 INFO  last line\n";
+const char kOverLine[] = "20261019 05:00:00.123456Z  4242 INFO  over line\n";
+const char kErrorLine[] = "20261019 05:00:00.123456Z  4242 ERROR over error\n";
+
+template<int N>
+void appendLine(AsyncLogging& log, const char (&line)[N])
+{
+  log.append(line, N - 1);
+}
+
+int countLines(const char* line)
+{
+  int count = 0;
+  for (size_t pos = g_written.find(line); pos != string::npos;
+       pos = g_written.find(line, pos + 1))
+  {
+    ++count;
+  }
+  return count;
+}
+
+// Holds the backend thread in its first write, then fills buffers until
+// queued ones reach queuedBuffers.
+void stallAndFill(AsyncLogging& log, int queuedBuffers)
+{
+  g_written.clear();
+  g_stalled = false;
+  g_open = false;
+  appendLine(log, kFirstLine);
+  {
+    muduo::MutexLockGuard lock(g_gateMutex);
+    while (!g_stalled)
+    {
+      g_gateCond.wait();
+    }
+  }
+  while (log.stats().queuedBuffers < queuedBuffers)
+  {
+    appendLine(log, kFillLine);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testDropNewest)
+{
+  AsyncLogging log("asynclogging_unittest", 0, 1);
+  log.setOverflowPolicy(AsyncLogging::kDropNewest);
+  log.setMaxQueuedBuffers(kMaxQueuedBuffers);
+  log.setWriteCallback(collectAfterGate);
+  log.start();
+  stallAndFill(log, kMaxQueuedBuffers);
+  for (int i = 0; i < kOverflowLines; ++i)
+  {
+    appendLine(log, kOverLine);
+  }
+  appendLine(log, kErrorLine);
+  AsyncLogging::Stats stats = log.stats();
+  openGate();
+  log.stop();
+
+  BOOST_CHECK_EQUAL(stats.droppedLines, kOverflowLines);
+  BOOST_CHECK_EQUAL(stats.blockedLines, 0);
+  BOOST_CHECK_EQUAL(countLines(kFirstLine), 1);
+  BOOST_CHECK_EQUAL(countLines(kOverLine), 0);
+  BOOST_CHECK_EQUAL(countLines(kErrorLine), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testSample)
+{
+  const int sampleRate = 10;
+  AsyncLogging log("asynclogging_unittest", 0, 1);
+  log.setOverflowPolicy(AsyncLogging::kSample);
+  log.setMaxQueuedBuffers(kMaxQueuedBuffers);
+  log.setSampleRate(sampleRate);
+  log.setWriteCallback(collectAfterGate);
+  log.start();
+  stallAndFill(log, kMaxQueuedBuffers);
+  for (int i = 0; i < kOverflowLines; ++i)
+  {
+    appendLine(log, kOverLine);
+  }
+  appendLine(log, kErrorLine);
+  AsyncLogging::Stats stats = log.stats();
+  openGate();
+  log.stop();
+
+  BOOST_CHECK_EQUAL(stats.droppedLines, kOverflowLines - kOverflowLines / sampleRate);
+  BOOST_CHECK_EQUAL(countLines(kOverLine), kOverflowLines / sampleRate);
+  BOOST_CHECK_EQUAL(countLines(kErrorLine), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testBlockUntilTimeout)
+{
+  const int lines = 3;
+  AsyncLogging log("asynclogging_unittest", 0, 1);
+  log.setOverflowPolicy(AsyncLogging::kBlock);
+  log.setMaxQueuedBuffers(kMaxQueuedBuffers);
+  log.setBlockSeconds(0.05);
+  log.setWriteCallback(collectAfterGate);
+  log.start();
+  stallAndFill(log, kMaxQueuedBuffers);
+  muduo::Timestamp start(muduo::Timestamp::now());
+  for (int i = 0; i < lines; ++i)
+  {
+    appendLine(log, kOverLine);
+  }
+  double seconds = timeDifference(muduo::Timestamp::now(), start);
+  // not waited for
+  appendLine(log, kErrorLine);
+  AsyncLogging::Stats stats = log.stats();
+  openGate();
+  log.stop();
+
+  BOOST_CHECK(seconds >= lines * 0.05);
+  BOOST_CHECK_EQUAL(stats.blockedLines, lines);
+  BOOST_CHECK_EQUAL(stats.droppedLines, lines);
+  BOOST_CHECK_EQUAL(countLines(kOverLine), 0);
+  BOOST_CHECK_EQUAL(countLines(kErrorLine), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testBlockUntilRoom)
+{
+  AsyncLogging log("asynclogging_unittest", 0, 1);
+  log.setOverflowPolicy(AsyncLogging::kBlock);
+  log.setMaxQueuedBuffers(kMaxQueuedBuffers);
+  log.setBlockSeconds(10.0);
+  log.setWriteCallback(collectAfterGate);
+  log.start();
+  stallAndFill(log, kMaxQueuedBuffers);
+  muduo::Thread opener(boost::bind(openGateLater, 0.1));
+  opener.start();
+  for (int i = 0; i < kOverflowLines; ++i)
+  {
+    appendLine(log, kOverLine);
+  }
+  opener.join();
+  log.stop();
+  AsyncLogging::Stats stats = log.stats();
+
+  BOOST_CHECK(stats.blockedLines > 0);
+  BOOST_CHECK_EQUAL(stats.droppedLines, 0);
+  BOOST_CHECK_EQUAL(countLines(kOverLine), kOverflowLines);
+}
+
+BOOST_AUTO_TEST_CASE(testDropBacklog)
+{
+  AsyncLogging log("asynclogging_unittest", 0, 1);
+  log.setMaxQueuedBuffers(kMaxQueuedBuffers);
+  log.setWriteCallback(collectAfterGate);
+  log.start();
+  // append() never drops, the backend thread does
+  stallAndFill(log, kMaxQueuedBuffers + 1);
+  appendLine(log, kErrorLine);
+  appendLine(log, kLastLine);
+  BOOST_CHECK_EQUAL(log.stats().droppedLines, 0);
+  openGate();
+  log.stop();
+  AsyncLogging::Stats stats = log.stats();
+
+  // the first two of the three queued buffers are kept, the last and the
+  // current one not
+  BOOST_CHECK_EQUAL(stats.droppedBuffers, 2);
+  BOOST_CHECK(g_written.find("Dropped log messages") != string::npos);
+  BOOST_CHECK_EQUAL(countLines(kFirstLine), 1);
+  BOOST_CHECK(countLines(kFillLine) > 0);
+  BOOST_CHECK_EQUAL(countLines(kErrorLine), 0);
+  BOOST_CHECK_EQUAL(countLines(kLastLine), 0);
+}
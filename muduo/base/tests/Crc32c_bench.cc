@@ -0,0 +1,50 @@
+#include <muduo/base/Crc32c.h>
+#include <muduo/base/Timestamp.h>
+
+#include <vector>
+#include <stdio.h>
+#include <zlib.h>
+
+using namespace muduo;
+
+// Checksums of 64 B to 16 MB frames, in MB/s.
+
+uint32_t adler(uint32_t crc, const void* data, size_t n)
+{
+  return static_cast<uint32_t>(::adler32(crc, static_cast<const Bytef*>(data), static_cast<uInt>(n)));
+}
+
+typedef uint32_t (*Checksum)(uint32_t, const void*, size_t);
+
+double bench(Checksum f, const std::vector<char>& data, size_t size)
+{
+  // about 256 MB for each size
+  const int times = static_cast<int>(256 * 1024 * 1024 / size);
+  uint32_t sum = 0;
+  Timestamp start(Timestamp::now());
+  for (int i = 0; i < times; ++i)
+  {
+    sum += f(1, &data[0], size);
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  if (sum == 42)  // keeps the calls
+  {
+    printf("\n");
+  }
+  return static_cast<double>(size) * times / seconds / 1024 / 1024;
+}
+
+int main()
+{
+  const size_t kMaxSize = 16 * 1024 * 1024;
+  std::vector<char> data(kMaxSize, 'x');
+  printf("crc32c hardware accelerated: %s\n", crc32c::isHardwareAccelerated() ? "yes" : "no");
+  printf("%10s %12s %12s %12s\n", "size", "adler32", "crc32c-sw", "crc32c");
+  for (size_t size = 64; size <= kMaxSize; size *= 4)
+  {
+    printf("%10zd %12.1f %12.1f %12.1f\n", size,
+           bench(adler, data, size),
+           bench(crc32c::extendPortable, data, size),
+           bench(crc32c::extend, data, size));
+  }
+}
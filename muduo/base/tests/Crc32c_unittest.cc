@@ -0,0 +1,71 @@
+#include <muduo/base/Crc32c.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+//#define BOOST_TEST_MODULE Crc32cTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace muduo;
+
+// RFC 3720, section B.4
+BOOST_AUTO_TEST_CASE(testStandardResults)
+{
+  char buf[32];
+
+  memset(buf, 0, sizeof buf);
+  BOOST_CHECK_EQUAL(crc32c::value(buf, sizeof buf), 0x8a9136aaU);
+  BOOST_CHECK_EQUAL(crc32c::extendPortable(0, buf, sizeof buf), 0x8a9136aaU);
+
+  memset(buf, 0xff, sizeof buf);
+  BOOST_CHECK_EQUAL(crc32c::value(buf, sizeof buf), 0x62a8ab43U);
+  BOOST_CHECK_EQUAL(crc32c::extendPortable(0, buf, sizeof buf), 0x62a8ab43U);
+
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(i);
+  }
+  BOOST_CHECK_EQUAL(crc32c::value(buf, sizeof buf), 0x46dd794eU);
+
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(31 - i);
+  }
+  BOOST_CHECK_EQUAL(crc32c::value(buf, sizeof buf), 0x113fdb5cU);
+
+  BOOST_CHECK_EQUAL(crc32c::value("123456789", 9), 0xe3069283U);
+  BOOST_CHECK_EQUAL(crc32c::value("", 0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(testExtend)
+{
+  const char* hello = "hello world";
+  BOOST_CHECK_EQUAL(crc32c::value(hello, 11),
+                    crc32c::extend(crc32c::value(hello, 5), hello + 5, 6));
+}
+
+BOOST_AUTO_TEST_CASE(testHardwareMatchesPortable)
+{
+  BOOST_TEST_MESSAGE("hardware accelerated " << crc32c::isHardwareAccelerated());
+  std::vector<char> data(4096 + 16);
+  srand(1);
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    data[i] = static_cast<char>(rand());
+  }
+  // every alignment, head and tail length
+  for (size_t offset = 0; offset < 16; ++offset)
+  {
+    for (size_t len = 0; len < 80; ++len)
+    {
+      BOOST_CHECK_EQUAL(crc32c::value(&data[offset], len),
+                        crc32c::extendPortable(0, &data[offset], len));
+    }
+    BOOST_CHECK_EQUAL(crc32c::value(&data[offset], 4096),
+                      crc32c::extendPortable(0, &data[offset], 4096));
+  }
+}
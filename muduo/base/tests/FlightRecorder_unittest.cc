@@ -0,0 +1,233 @@
+#include <muduo/base/FlightRecorder.h>
+#include <muduo/base/Thread.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//#define BOOST_TEST_MODULE FlightRecorderTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using muduo::FlightRecorder;
+using muduo::string;
+
+// of this process, so runs in parallel do not share it
+struct TempFile
+{
+  TempFile()
+  {
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s/flightrecorder_unittest.%d.flight",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", ::getpid());
+    name = buf;
+    oldName = name + ".old";
+    unlinkAll();
+  }
+
+  ~TempFile()
+  {
+    unlinkAll();
+  }
+
+  void unlinkAll()
+  {
+    ::unlink(name.c_str());
+    ::unlink(oldName.c_str());
+  }
+
+  string name;
+  string oldName;
+};
+
+// Only the bytes in the file, unlike another mapping of it in this process,
+// which shares the page cache, also past the end of the file.
+void copyFile(const string& from, const string& to)
+{
+  FILE* in = ::fopen(from.c_str(), "rb");
+  FILE* out = ::fopen(to.c_str(), "wb");
+  BOOST_REQUIRE(in != NULL && out != NULL);
+  char buf[8192];
+  size_t n = 0;
+  while ((n = ::fread(buf, 1, sizeof buf, in)) > 0)
+  {
+    BOOST_REQUIRE_EQUAL(::fwrite(buf, 1, n, out), n);
+  }
+  ::fclose(in);
+  ::fclose(out);
+}
+
+void collect(std::vector<string>* lines, const char* line, int len)
+{
+  lines->push_back(string(line, len));
+}
+
+std::vector<string> readLines(const string& filename)
+{
+  std::vector<string> lines;
+  BOOST_CHECK(FlightRecorder::read(filename, boost::bind(collect, &lines, _1, _2)));
+  return lines;
+}
+
+// of different lengths, so some wrap around the end of the ring
+int formatLine(char* buf, size_t size, int thread, int i)
+{
+  return snprintf(buf, size, "%d %d %.*s\n", thread, i, i % 37, "abcdefghijklmnopqrstuvwxyz0123456789");
+}
+
+void appendLines(FlightRecorder* recorder, int thread, int count)
+{
+  char buf[64];
+  for (int i = 0; i < count; ++i)
+  {
+    recorder->append(buf, formatLine(buf, sizeof buf, thread, i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testFlightRecorderWrap)
+{
+  TempFile file;
+  const int kLines = 20000;
+  {
+    FlightRecorder recorder(file.name, 1);
+    BOOST_REQUIRE(recorder.valid());
+    appendLines(&recorder, 0, kLines);
+  }
+
+  // the most recent ones, in order, each whole
+  std::vector<string> lines = readLines(file.name);
+  BOOST_REQUIRE(!lines.empty());
+  BOOST_CHECK_LT(lines.size(), static_cast<size_t>(kLines));
+  int first = kLines - static_cast<int>(lines.size());
+  char buf[64];
+  for (size_t i = 0; i < lines.size(); ++i)
+  {
+    int len = formatLine(buf, sizeof buf, 0, first + static_cast<int>(i));
+    BOOST_CHECK_EQUAL(lines[i], string(buf, len));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testFlightRecorderThreads)
+{
+  TempFile file;
+  const int kThreads = 4;
+  const int kLines = 50000;
+  {
+    FlightRecorder recorder(file.name, 256*1024);
+    boost::ptr_vector<muduo::Thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+      threads.push_back(new muduo::Thread(boost::bind(appendLines, &recorder, t, kLines)));
+      threads.back().start();
+    }
+    for (int t = 0; t < kThreads; ++t)
+    {
+      threads[t].join();
+    }
+  }
+
+  std::vector<string> lines = readLines(file.name);
+  std::vector<int> last(kThreads, -1);
+  char buf[64];
+  for (size_t i = 0; i < lines.size(); ++i)
+  {
+    int thread = -1;
+    int n = -1;
+    BOOST_REQUIRE_EQUAL(sscanf(lines[i].c_str(), "%d %d", &thread, &n), 2);
+    BOOST_REQUIRE(thread >= 0 && thread < kThreads);
+    int len = formatLine(buf, sizeof buf, thread, n);
+    BOOST_CHECK_EQUAL(lines[i], string(buf, len));
+    // Lines of a thread are in order, but not always consecutive, a writer
+    // lapped by the others tears newer records, which are then skipped.
+    BOOST_CHECK_GT(n, last[thread]);
+    last[thread] = n;
+  }
+  BOOST_CHECK(!lines.empty());
+}
+
+BOOST_AUTO_TEST_CASE(testFlightRecorderCrash)
+{
+  TempFile file;
+  pid_t pid = ::fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0)
+  {
+    FlightRecorder recorder(file.name, 1);
+    appendLines(&recorder, 0, 1000);
+    // no destructor, no flush
+    ::kill(::getpid(), SIGKILL);
+  }
+  int status = 0;
+  BOOST_REQUIRE_EQUAL(::waitpid(pid, &status, 0), pid);
+  BOOST_CHECK(WIFSIGNALED(status));
+
+  std::vector<string> lines = readLines(file.name);
+  BOOST_REQUIRE_EQUAL(lines.size(), 1000U);
+  char buf[64];
+  int len = formatLine(buf, sizeof buf, 0, 999);
+  BOOST_CHECK_EQUAL(lines.back(), string(buf, len));
+
+  // kept for after a restart
+  {
+    FlightRecorder recorder(file.name, 1);
+    recorder.append("restarted\n", 10);
+  }
+  BOOST_CHECK_EQUAL(readLines(file.oldName).size(), 1000U);
+  BOOST_CHECK_EQUAL(readLines(file.name).size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(testFlightRecorderLongLine)
+{
+  TempFile file;
+  {
+    FlightRecorder recorder(file.name, 1);
+    string line(1024*1024, 'x');
+    recorder.append(line.data(), static_cast<int>(line.size()));
+  }
+  std::vector<string> lines = readLines(file.name);
+  BOOST_REQUIRE_EQUAL(lines.size(), 1U);
+  BOOST_CHECK_EQUAL(lines[0], string(16*1024, 'x'));
+
+  BOOST_CHECK(!FlightRecorder::read("/dev/null", boost::bind(collect, static_cast<std::vector<string>*>(NULL), _1, _2)));
+}
+
+BOOST_AUTO_TEST_CASE(testFlightRecorderHeaderAtEnd)
+{
+  TempFile file;
+  TempFile copy;
+  copy.name += ".copy";
+  // Records are 16 bytes of header, then the line, rounded up to 16 bytes.
+  // 1023 of 64 bytes, then one of a tail of the ring, so the next record
+  // starts 64 to 16 bytes before its end, or wraps to its start.  Also
+  // 8 bytes before, were records rounded to 8 bytes.
+  const char kLast[] = "WRAPPED-HEADER-RECORD, long enough to wrap around the end of the ring\n";
+  for (int tail = 8; tail <= 64; tail += 8)
+  {
+    {
+      FlightRecorder recorder(file.name, 64*1024);
+      BOOST_REQUIRE(recorder.valid());
+      string line(48, 'x');
+      for (int i = 0; i < 1023; ++i)
+      {
+        recorder.append(line.data(), static_cast<int>(line.size()));
+      }
+      string tailLine(tail, 't');
+      recorder.append(tailLine.data(), static_cast<int>(tailLine.size()));
+      recorder.append(kLast, sizeof kLast - 1);
+    }
+    copyFile(file.name, copy.name);
+    std::vector<string> lines = readLines(copy.name);
+    BOOST_REQUIRE(!lines.empty());
+    BOOST_CHECK_EQUAL(lines.back(), string(kLast, sizeof kLast - 1));
+    BOOST_CHECK_EQUAL(lines[lines.size() - 2], string(tail, 't'));
+    BOOST_CHECK(lines == readLines(file.name));
+  }
+}
@@ -0,0 +1,120 @@
+// Writes the same lines through LogFile with stdio and with preallocated
+// files, reports throughput, the slowest append, and how much of the
+// files is left in the page cache.
+//
+// Usage: logfile_bench [megabytes] [roll megabytes]
+
+#include <muduo/base/LogFile.h>
+#include <muduo/base/Timestamp.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+
+const char* kBasename = "logfile_bench";
+
+// pages of the files in the page cache, then removes the files
+int64_t residentAndRemove(int64_t* fileBytes)
+{
+  size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  int64_t resident = 0;
+  *fileBytes = 0;
+  DIR* dir = ::opendir(".");
+  struct dirent* entry;
+  while (dir && (entry = ::readdir(dir)) != NULL)
+  {
+    if (strncmp(entry->d_name, kBasename, strlen(kBasename)) != 0
+        || entry->d_name[strlen(kBasename)] != '.')
+    {
+      continue;
+    }
+    int fd = ::open(entry->d_name, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      *fileBytes += st.st_size;
+      size_t len = static_cast<size_t>(st.st_size);
+      void* addr = ::mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr != MAP_FAILED)
+      {
+        std::vector<unsigned char> vec((len + pageSize - 1) / pageSize);
+        if (::mincore(addr, len, &*vec.begin()) == 0)
+        {
+          for (size_t i = 0; i < vec.size(); ++i)
+          {
+            resident += vec[i] & 1;
+          }
+        }
+        ::munmap(addr, len);
+      }
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    ::unlink(entry->d_name);
+  }
+  if (dir)
+  {
+    ::closedir(dir);
+  }
+  return resident * static_cast<int64_t>(pageSize);
+}
+
+void bench(const char* name, bool preallocate, int64_t totalBytes, off_t rollSize)
+{
+  char line[128];
+  int len = snprintf(line, sizeof line,
+                     "20140101 12:34:56.123456Z 12345 INFO  "
+                     "Hello 0123456789 abcdefghijklmnopqrstuvwxyz - Bench.cc:51\n");
+  int64_t maxMicroSeconds = 0;
+  Timestamp start = Timestamp::now();
+  {
+    LogFile file(kBasename, rollSize, false, 3, 1024, preallocate);
+    Timestamp last = start;
+    for (int64_t written = 0; written < totalBytes; written += len)
+    {
+      file.append(line, len);
+      if (written % (1024*len) == 0)
+      {
+        Timestamp now = Timestamp::now();
+        maxMicroSeconds = std::max(maxMicroSeconds,
+                                   now.microSecondsSinceEpoch() - last.microSecondsSinceEpoch());
+        last = now;
+      }
+    }
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+  int64_t fileBytes = 0;
+  int64_t resident = residentAndRemove(&fileBytes);
+  printf("%-12s %8.2f MiB/s  slowest 1024 lines %6lld us  %7.2f MiB of %7.2f MiB cached\n",
+         name,
+         static_cast<double>(totalBytes) / seconds / 1024 / 1024,
+         static_cast<long long>(maxMicroSeconds),
+         static_cast<double>(resident) / 1024 / 1024,
+         static_cast<double>(fileBytes) / 1024 / 1024);
+}
+
+int main(int argc, char* argv[])
+{
+  int64_t megabytes = argc > 1 ? atoi(argv[1]) : 512;
+  int64_t rollMegabytes = argc > 2 ? atoi(argv[2]) : 128;
+  int64_t totalBytes = megabytes * 1024 * 1024;
+  off_t rollSize = static_cast<off_t>(rollMegabytes * 1024 * 1024);
+
+  // LogFile rolls at most once a second
+  bench("stdio", false, totalBytes, rollSize);
+  sleep(1);
+  bench("preallocate", true, totalBytes, rollSize);
+}
@@ -1,6 +1,9 @@
+#include <muduo/base/LogArchiver.h>
 #include <muduo/base/LogFile.h>
 #include <muduo/base/Logging.h>
 
+#include <boost/bind.hpp>
+
 #include <unistd.h>
 
 boost::scoped_ptr<muduo::LogFile> g_logFile;
@@ -19,7 +22,12 @@ int main(int argc, char* argv[])
 {
   char name[256];
   strncpy(name, argv[0], 256);
+  // rolled files are compressed, the last three are kept
+  muduo::LogArchiver archiver(::basename(name));
+  archiver.setMaxFiles(3);
+  archiver.start();
   g_logFile.reset(new muduo::LogFile(::basename(name), 200*1000));
+  g_logFile->setRollCallback(boost::bind(&muduo::LogArchiver::archive, &archiver, _1));
   muduo::Logger::setOutput(outputFunc);
   muduo::Logger::setFlush(flushFunc);
 
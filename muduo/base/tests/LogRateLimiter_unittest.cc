@@ -0,0 +1,109 @@
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <unistd.h>
+
+//#define BOOST_TEST_MODULE LogRateLimiterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using muduo::string;
+
+std::vector<string> g_lines;
+
+void output(const char* msg, int len)
+{
+  g_lines.push_back(string(msg, len));
+}
+
+bool contains(const string& line, const char* text)
+{
+  return line.find(text) != string::npos;
+}
+
+void logWarnings(int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    LOG_WARN_LIMITED(10) << "storm";
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testLogLimited)
+{
+  muduo::Logger::setOutput(output);
+  g_lines.clear();
+
+  // a burst of a second of lines, then one every 100 milliseconds
+  logWarnings(1000);
+  BOOST_CHECK_EQUAL(g_lines.size(), 10U);
+  BOOST_CHECK(!contains(g_lines.back(), "suppressed"));
+
+  ::usleep(250*1000);
+  logWarnings(1000);
+  BOOST_REQUIRE_GE(g_lines.size(), 11U);
+  BOOST_CHECK_LE(g_lines.size(), 13U);
+  BOOST_CHECK(contains(g_lines[10], "storm suppressed=990 - "));
+  BOOST_CHECK(contains(g_lines[10], " WARN  "));
+}
+
+BOOST_AUTO_TEST_CASE(testLogEveryN)
+{
+  muduo::Logger::setOutput(output);
+  g_lines.clear();
+  for (int i = 0; i < 1000; ++i)
+  {
+    LOG_INFO_EVERY_N(100) << "sample " << i;
+  }
+  BOOST_REQUIRE_EQUAL(g_lines.size(), 10U);
+  BOOST_CHECK(contains(g_lines[0], "sample 0 - "));
+  BOOST_CHECK(contains(g_lines[1], "sample 100 suppressed=99 - "));
+
+  // a statement of its own
+  errno = EPIPE;
+  LOG_SYSERR_LIMITED(1) << "write";
+  BOOST_REQUIRE_EQUAL(g_lines.size(), 11U);
+  BOOST_CHECK(contains(g_lines.back(), "Broken pipe (errno=32) write - "));
+}
+
+void pass(muduo::LogRateLimiter* limiter, int count, int64_t* passed)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    *passed += limiter->pass() > 0;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testLogRateLimiterThreads)
+{
+  const int kThreads = 4;
+  muduo::LogRateLimiter limiter(1000);
+  std::vector<int64_t> passed(kThreads);
+  boost::ptr_vector<muduo::Thread> threads;
+  muduo::Timestamp start(muduo::Timestamp::now());
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.push_back(new muduo::Thread(boost::bind(pass, &limiter, 1000*1000, &passed[t])));
+    threads.back().start();
+  }
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads[t].join();
+  }
+  double seconds = timeDifference(muduo::Timestamp::now(), start);
+
+  int64_t total = 0;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    total += passed[t];
+  }
+  // the burst, then the rate, with a tick of the coarse clock
+  BOOST_CHECK_GE(total, 1000);
+  BOOST_CHECK_LE(total, 1000 + static_cast<int64_t>(1000 * (seconds + 0.01)));
+}
@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <stdio.h>
+#include <string.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
@@ -55,6 +56,90 @@ void benchLogStream()
   printf("benchLogStream %f\n", timeDifference(end, start));
 }
 
+// not whole numbers, which take all the digits
+double fraction(size_t i)
+{
+  return (double)(i) / 7.0;
+}
+
+void benchPrintfFraction(const char* fmt)
+{
+  char buf[32];
+  Timestamp start(Timestamp::now());
+  for (size_t i = 0; i < N; ++i)
+    snprintf(buf, sizeof buf, fmt, fraction(i));
+  Timestamp end(Timestamp::now());
+
+  printf("benchPrintf %s %f\n", fmt, timeDifference(end, start));
+}
+
+void benchLogStreamFraction()
+{
+  Timestamp start(Timestamp::now());
+  LogStream os;
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << fraction(i);
+    os.resetBuffer();
+  }
+  Timestamp end(Timestamp::now());
+
+  printf("benchLogStream %f\n", timeDifference(end, start));
+}
+
+void benchFmtShortest()
+{
+  Timestamp start(Timestamp::now());
+  LogStream os;
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << Fmt::shortest(fraction(i));
+    os.resetBuffer();
+  }
+  Timestamp end(Timestamp::now());
+
+  printf("benchFmtShortest %f\n", timeDifference(end, start));
+}
+
+void benchFmtFixed()
+{
+  Timestamp start(Timestamp::now());
+  LogStream os;
+  for (size_t i = 0; i < N; ++i)
+  {
+    os << Fmt::fixed(fraction(i), 3);
+    os.resetBuffer();
+  }
+  Timestamp end(Timestamp::now());
+
+  printf("benchFmtFixed %f\n", timeDifference(end, start));
+}
+
+// the same line as text, and with fields
+void benchFields(const char* type)
+{
+  Timestamp start(Timestamp::now());
+  LogStream os;
+  string name("127.0.0.1:8080#42");
+  for (size_t i = 0; i < N; ++i)
+  {
+    if (strcmp(type, "text") == 0)
+    {
+      os << "closed conn=" << name << " bytes=" << i;
+    }
+    else
+    {
+      if (strcmp(type, "json") == 0)
+        os.beginJson();
+      os.kv("conn", name).kv("bytes", i) << "closed";
+    }
+    os.resetBuffer();
+  }
+  Timestamp end(Timestamp::now());
+
+  printf("benchLogStream %s %f\n", type, timeDifference(end, start));
+}
+
 int main()
 {
   benchPrintf<int>("%d");
@@ -69,6 +154,14 @@ int main()
   benchStringStream<double>();
   benchLogStream<double>();
 
+  puts("double fraction");
+  benchPrintfFraction("%.12g");
+  benchLogStreamFraction();
+  benchPrintfFraction("%.17g");
+  benchFmtShortest();
+  benchPrintfFraction("%.3f");
+  benchFmtFixed();
+
   puts("int64_t");
   benchPrintf<int64_t>("%" PRId64);
   benchStringStream<int64_t>();
@@ -79,4 +172,9 @@ int main()
   benchStringStream<void*>();
   benchLogStream<void*>();
 
+  puts("fields");
+  benchFields("text");
+  benchFields("logfmt");
+  benchFields("json");
+
 }
@@ -1,7 +1,11 @@
 #include <muduo/base/LogStream.h>
+#include <muduo/base/Dtoa.h>
 
 #include <limits>
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 //#define BOOST_TEST_MODULE LogStreamTest
 #define BOOST_TEST_MAIN
@@ -214,6 +218,137 @@ BOOST_AUTO_TEST_CASE(testLogStreamFmts)
   os.resetBuffer();
 }
 
+BOOST_AUTO_TEST_CASE(testLogStreamFmtShortestFixed)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+
+  os << muduo::Fmt::shortest(0.1) << ' ' << muduo::Fmt::shortest(0.1 + 0.2);
+  BOOST_CHECK_EQUAL(buf.toString(), string("0.1 0.30000000000000004"));
+  os.resetBuffer();
+
+  os << muduo::Fmt::shortest(-0.0) << ' ' << muduo::Fmt::shortest(5e-324)
+     << ' ' << muduo::Fmt::shortest(1e21) << ' ' << muduo::Fmt::shortest(123456789012345680.0);
+  BOOST_CHECK_EQUAL(buf.toString(), string("-0 5e-324 1e+21 1.2345678901234568e+17"));
+  os.resetBuffer();
+
+  os << muduo::Fmt::fixed(1.2, 2) << ' ' << muduo::Fmt::fixed(1.005, 2)
+     << ' ' << muduo::Fmt::fixed(-2.5, 0) << ' ' << muduo::Fmt::fixed(99.9999, 3);
+  BOOST_CHECK_EQUAL(buf.toString(), string("1.20 1.00 -2 100.000"));
+  os.resetBuffer();
+
+  // too long for Fmt
+  os << muduo::Fmt::fixed(1e40, 2) << ' ' << muduo::Fmt::fixed(-1.7976931348623157e308, 0)
+     << ' ' << muduo::Fmt::fixed(1.5, 100) << ' ' << muduo::Fmt::fixed(0.1, 1000);
+  BOOST_CHECK_EQUAL(buf.toString(), string("1e+40 -1.7976931348623157e+308 1.5 0.1"));
+  os.resetBuffer();
+
+  // the longest that fit
+  os << muduo::Fmt::fixed(1e29, 0) << ' ' << muduo::Fmt::fixed(0.5, 29);
+  BOOST_CHECK_EQUAL(buf.toString(),
+                    string("99999999999999991433150857216 0.50000000000000000000000000000"));
+  os.resetBuffer();
+}
+
+namespace
+{
+
+uint64_t g_random = 88172645463325252ULL;
+
+// xorshift, the same numbers on every run
+uint64_t random64()
+{
+  g_random ^= g_random << 13;
+  g_random ^= g_random >> 7;
+  g_random ^= g_random << 17;
+  return g_random;
+}
+
+double randomDouble(int i)
+{
+  double v = 0;
+  switch (i % 4)
+  {
+    case 0:
+    {
+      // any bits, finite or not
+      uint64_t bits = random64();
+      memcpy(&v, &bits, sizeof v);
+      break;
+    }
+    case 1:
+      // as measured, with a few decimals
+      v = static_cast<double>(static_cast<int64_t>(random64() % 200000000) - 100000000)
+          / static_cast<double>(1 + random64() % 10000);
+      break;
+    case 2:
+      // fewer digits than asked for, eg. whole numbers
+      v = static_cast<double>(random64() % 1000000) / static_cast<double>(1 << (random64() % 12));
+      break;
+    default:
+      v = ldexp(static_cast<double>(random64() >> 11), static_cast<int>(random64() % 200) - 150);
+  }
+  return v;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testFormatDoubleRandom)
+{
+  char buf[512];
+  char expected[512];
+  int mismatches = 0;
+  for (int i = 0; i < 100000; ++i)
+  {
+    double v = randomDouble(i);
+
+    int precision = static_cast<int>(random64() % 17) + 1;
+    muduo::detail::formatGeneral(buf, v, precision);
+    snprintf(expected, sizeof expected, "%.*g", precision, v);
+    if (strcmp(buf, expected) != 0 && ++mismatches < 10)
+    {
+      BOOST_CHECK_EQUAL(string(buf), string(expected));
+    }
+
+    precision = static_cast<int>(random64() % 10);
+    muduo::detail::formatFixed(buf, sizeof buf, v, precision);
+    snprintf(expected, sizeof expected, "%.*f", precision, v);
+    if (strcmp(buf, expected) != 0 && ++mismatches < 10)
+    {
+      BOOST_CHECK_EQUAL(string(buf), string(expected));
+    }
+
+    if (isfinite(v))
+    {
+      muduo::detail::formatShortest(buf, v);
+      // reads back, and is no longer than what "%.*g" needs
+      int length = 1;
+      for (; length < 17; ++length)
+      {
+        snprintf(expected, sizeof expected, "%.*g", length, v);
+        if (strtod(expected, NULL) == v)
+          break;
+      }
+      // significant ones, without zeros in front or at the end
+      int digits = 0;
+      int zeros = 0;
+      for (const char* p = buf; *p != '\0' && *p != 'e'; ++p)
+      {
+        if (*p >= '0' && *p <= '9' && (digits > 0 || *p != '0'))
+        {
+          ++digits;
+          zeros = *p == '0' ? zeros + 1 : 0;
+        }
+      }
+      if ((strtod(buf, NULL) != v || digits - zeros > length) && ++mismatches < 10)
+      {
+        BOOST_CHECK_EQUAL(string(buf), string(expected));
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(mismatches, 0);
+}
+
 BOOST_AUTO_TEST_CASE(testLogStreamLong)
 {
   muduo::LogStream os;
@@ -233,3 +368,134 @@ BOOST_AUTO_TEST_CASE(testLogStreamLong)
   BOOST_CHECK_EQUAL(buf.length(), 3999);
   BOOST_CHECK_EQUAL(buf.avail(), 1);
 }
+
+BOOST_AUTO_TEST_CASE(testLogStreamBinary)
+{
+  muduo::LogStream text;
+  muduo::LogStream binary;
+  binary.setBinary(true);
+
+  std::string str = "std::string";
+  double pi = 3.1415926;
+  const void* p = &pi;
+  text << true << ' ' << 'x' << "Hello" << str << muduo::StringPiece("piece")
+       << static_cast<short>(-1) << 123U << -4567890123LL
+       << std::numeric_limits<uint64_t>::max() << pi << 0.1f << p
+       << muduo::Fmt("%4d", 1) << "" << static_cast<const char*>(NULL);
+  binary << true << ' ' << 'x' << "Hello" << str << muduo::StringPiece("piece")
+         << static_cast<short>(-1) << 123U << -4567890123LL
+         << std::numeric_limits<uint64_t>::max() << pi << 0.1f << p
+         << muduo::Fmt("%4d", 1) << "" << static_cast<const char*>(NULL);
+
+  muduo::LogStream formatted;
+  BOOST_CHECK(formatted.appendFormatted(binary.buffer().data(), binary.buffer().length()));
+  BOOST_CHECK_EQUAL(formatted.buffer().toString(), text.buffer().toString());
+
+  // a value cut in the middle
+  formatted.resetBuffer();
+  BOOST_CHECK(!formatted.appendFormatted(binary.buffer().data(), binary.buffer().length() - 1));
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamRecord)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+  os.setBinary(true);
+  os.beginRecord();
+  os << "Hello" << 42;
+  os.endRecord();
+
+  BOOST_CHECK(muduo::LogStream::isRecord(buf.data(), buf.length()));
+  BOOST_CHECK_EQUAL(muduo::LogStream::recordLength(buf.data(), buf.length()), buf.length());
+  BOOST_CHECK_EQUAL(muduo::LogStream::recordLength(buf.data(), buf.length() - 1), 0);
+  BOOST_CHECK(!muduo::LogStream::isRecord("2014", 4));
+
+  muduo::LogStream formatted;
+  int header = muduo::LogStream::kRecordHeaderLength;
+  BOOST_CHECK(formatted.appendFormatted(buf.data() + header, buf.length() - header));
+  BOOST_CHECK_EQUAL(formatted.buffer().toString(), string("Hello42"));
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamKv)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+
+  os.kv("conn", "127.0.0.1:80").kv("bytes", 1024).kv("ok", true);
+  BOOST_CHECK_EQUAL(buf.toString(), string(" conn=127.0.0.1:80 bytes=1024 ok=true"));
+
+  // the message goes before the fields, in whatever order
+  os.resetBuffer();
+  os << "closed";
+  os.kv("n", -1);
+  os << ' ' << 42;
+  os.kv("ratio", 0.1).kv("max", std::numeric_limits<uint64_t>::max());
+  os << " after";
+  BOOST_CHECK_EQUAL(buf.toString(),
+                    string("closed 42 after n=-1 ratio=0.1 max=18446744073709551615"));
+
+  // quoted as needed
+  os.resetBuffer();
+  os.kv("a", "").kv("b", "x y").kv("c", "x=y").kv("d", "say \"hi\"\n")
+    .kv("e", string("a\\b")).kv("f", static_cast<const char*>(NULL));
+  BOOST_CHECK_EQUAL(buf.toString(),
+                    string(" a=\"\" b=\"x y\" c=\"x=y\" d=\"say \\\"hi\\\"\\n\" e=a\\b f=(null)"));
+
+  // whole or nothing
+  os.resetBuffer();
+  string big(buf.avail() - 8, 'x');
+  os << big;
+  os.kv("key", "value");
+  BOOST_CHECK_EQUAL(buf.length(), static_cast<int>(big.size()));
+  os.kv("k", 1);
+  BOOST_CHECK_EQUAL(buf.toString(), big + " k=1");
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamKvJson)
+{
+  muduo::LogStream os;
+  const muduo::LogStream::Buffer& buf = os.buffer();
+
+  os << "{\"level\":\"INFO\"";
+  os.beginJson();
+  os.kv("conn", "c1").kv("bytes", 1024);
+  os << "tab\there " << 7;
+  os.kv("inf", HUGE_VAL).kv("ok", false);
+  os << " \"quoted\"\x01";
+  os.endFields();
+  os << "}";
+  BOOST_CHECK_EQUAL(buf.toString(),
+                    string("{\"level\":\"INFO\",\"msg\":\"tab\\there 7 \\\"quoted\\\"\\u0001\""
+                           ",\"conn\":\"c1\",\"bytes\":1024,\"inf\":null,\"ok\":false}"));
+
+  // no message
+  os.resetBuffer();
+  os << "{\"tid\":1";
+  os.beginJson();
+  os.kv("a", 1.5);
+  os.endFields();
+  os << "}";
+  BOOST_CHECK_EQUAL(buf.toString(), string("{\"tid\":1,\"a\":1.5}"));
+}
+
+BOOST_AUTO_TEST_CASE(testLogStreamKvBinary)
+{
+  muduo::LogStream text;
+  muduo::LogStream binary;
+  binary.setBinary(true);
+
+  text << "msg ";
+  text.kv("s", "x y").kv("i", -3).kv("u", 3U).kv("l", -4567890123LL)
+      .kv("d", 0.1).kv("b", true);
+  text << 1;
+  binary << "msg ";
+  binary.kv("s", "x y").kv("i", -3).kv("u", 3U).kv("l", -4567890123LL)
+        .kv("d", 0.1).kv("b", true);
+  binary << 1;
+
+  muduo::LogStream formatted;
+  BOOST_CHECK(formatted.appendFormatted(binary.buffer().data(), binary.buffer().length()));
+  BOOST_CHECK_EQUAL(formatted.buffer().toString(), text.buffer().toString());
+  BOOST_CHECK_EQUAL(formatted.buffer().toString(),
+                    string("msg 1 s=\"x y\" i=-3 u=3 l=-4567890123 d=0.1 b=true"));
+}
@@ -46,6 +46,25 @@ void bench(const char* type)
          type, seconds, g_total, n / seconds, g_total / seconds / (1024 * 1024));
 }
 
+// the same line, with fields instead of text
+void benchKv(const char* type)
+{
+  muduo::Logger::setOutput(dummyOutput);
+  muduo::Timestamp start(muduo::Timestamp::now());
+  g_total = 0;
+
+  int n = 1000*1000;
+  for (int i = 0; i < n; ++i)
+  {
+    LOG_INFO.kv("digits", "0123456789").kv("letters", "abcdefghijklmnopqrstuvwxyz").kv("i", i)
+        << "Hello";
+  }
+  muduo::Timestamp end(muduo::Timestamp::now());
+  double seconds = timeDifference(end, start);
+  printf("%12s: %f seconds, %d bytes, %10.2f msg/s, %.2f MiB/s\n",
+         type, seconds, g_total, n / seconds, g_total / seconds / (1024 * 1024));
+}
+
 void logInThread()
 {
   LOG_INFO << "logInThread";
@@ -73,10 +92,23 @@ int main()
   LOG_INFO << sizeof(muduo::LogStream);
   LOG_INFO << sizeof(muduo::Fmt);
   LOG_INFO << sizeof(muduo::LogStream::Buffer);
+  LOG_INFO.kv("conn", "127.0.0.1:80").kv("bytes", 1024) << "closed";
+  muduo::Logger::setJson(true);
+  LOG_WARN.kv("conn", "127.0.0.1:80").kv("bytes", 1024) << "closed \"early\"";
+  muduo::Logger::setJson(false);
 
   sleep(1);
   bench("nop");
 
+  muduo::Logger::setBinary(true);
+  bench("binary nop");
+  muduo::Logger::setBinary(false);
+
+  benchKv("kv nop");
+  muduo::Logger::setJson(true);
+  benchKv("json nop");
+  muduo::Logger::setJson(false);
+
   char buffer[64*1024];
 
   g_file = fopen("/dev/null", "w");
@@ -0,0 +1,38 @@
+#include <muduo/base/FlightRecorder.h>
+#include <muduo/base/Logging.h>
+
+#include <stdio.h>
+
+// Prints the lines in a file of FlightRecorder, oldest first, binary
+// records formatted as LogDecoder does, on the same type of machine.
+// Logger::setTimeZone() is not known here, the time is in UTC.
+// A line which is not a record that formats is text.
+
+void printLine(const char* line, int len)
+{
+  muduo::LogStream stream;
+  if (muduo::LogStream::recordLength(line, len) == len
+      && muduo::Logger::formatRecord(line, len, stream))
+  {
+    const muduo::LogStream::Buffer& buf = stream.buffer();
+    fwrite(buf.data(), 1, buf.length(), stdout);
+  }
+  else
+  {
+    fwrite(line, 1, len, stdout);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: %s flight_file\n", argv[0]);
+    return 1;
+  }
+  if (!muduo::FlightRecorder::read(argv[1], printLine))
+  {
+    fprintf(stderr, "%s is not a file of FlightRecorder\n", argv[1]);
+    return 1;
+  }
+}
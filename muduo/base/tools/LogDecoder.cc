@@ -0,0 +1,101 @@
+#include <muduo/base/Logging.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+// Formats binary records in a log file of AsyncLogging::setRawRecords(),
+// on the same type of machine, and copies text lines as they are.
+// Logger::setTimeZone() is not known here, the time is in UTC.
+// A '\0' which does not start a record that formats is text, eg. of a
+// line written in text mode.
+
+namespace
+{
+
+// Of the record data starts with, -1 if it is not one, 0 if it is not all
+// in data yet.
+int recordLength(const char* data, size_t len)
+{
+  if (len < static_cast<size_t>(muduo::LogStream::kRecordHeaderLength))
+  {
+    return 0;
+  }
+  uint16_t length = 0;
+  memcpy(&length, data + 1, sizeof length);
+  if (length < muduo::LogStream::kRecordHeaderLength)
+  {
+    return -1;
+  }
+  return static_cast<size_t>(length) <= len ? length : 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 2)
+  {
+    fprintf(stderr, "Usage: %s [log_file]\n", argv[0]);
+    return 1;
+  }
+  FILE* fp = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (fp == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  muduo::LogStream stream;
+  std::string pending;
+  char buf[64*1024];
+  bool eof = false;
+  while (!eof)
+  {
+    size_t n = fread(buf, 1, sizeof buf, fp);
+    eof = n < sizeof buf;
+    pending.append(buf, n);
+
+    size_t start = 0;
+    while (start < pending.size())
+    {
+      const char* data = pending.data() + start;
+      int len = static_cast<int>(pending.size() - start);
+      const char* record = static_cast<const char*>(
+          memchr(data, muduo::LogStream::kRecordMarker, len));
+      if (record != data)
+      {
+        size_t textLength = record ? record - data : len;
+        fwrite(data, 1, textLength, stdout);
+        start += textLength;
+        continue;
+      }
+
+      int length = recordLength(record, static_cast<size_t>(len));
+      if (length == 0 && !eof)
+      {
+        // the rest is in the next read
+        break;
+      }
+      stream.resetBuffer();
+      if (length > 0 && muduo::Logger::formatRecord(record, length, stream))
+      {
+        fwrite(stream.buffer().data(), 1, stream.buffer().length(), stdout);
+        start += length;
+      }
+      else
+      {
+        fwrite(record, 1, 1, stdout);
+        start += 1;
+      }
+    }
+    pending.erase(0, start);
+  }
+
+  if (fp != stdin)
+  {
+    fclose(fp);
+  }
+}
@@ -79,7 +79,7 @@ void Acceptor::handleRead()
   }
   else
   {
-    LOG_SYSERR << "in Acceptor::handleRead";
+    LOG_SYSERR_LIMITED(10) << "in Acceptor::handleRead";
     // Read the section named "The special problem of
     // accept()ing when you can't" in libev's doc.
     // By Marc Lehmann, author of libev.
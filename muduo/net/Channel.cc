@@ -93,14 +93,14 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
   {
     if (logHup_)
     {
-      LOG_WARN << "fd = " << fd_ << " Channel::handle_event() POLLHUP";
+      LOG_WARN_LIMITED(10) << "fd = " << fd_ << " Channel::handle_event() POLLHUP";
     }
     if (closeCallback_) closeCallback_();
   }
 
   if (revents_ & POLLNVAL)
   {
-    LOG_WARN << "fd = " << fd_ << " Channel::handle_event() POLLNVAL";
+    LOG_WARN_LIMITED(10) << "fd = " << fd_ << " Channel::handle_event() POLLNVAL";
   }
 
   if (revents_ & (POLLERR | POLLNVAL))
@@ -126,7 +126,7 @@ int sockets::accept(int sockfd, struct sockaddr_in6* addr)
   if (connfd < 0)
   {
     int savedErrno = errno;
-    LOG_SYSERR << "Socket::accept";
+    LOG_SYSERR_LIMITED(10) << "Socket::accept";
     switch (savedErrno)
     {
       case EAGAIN:
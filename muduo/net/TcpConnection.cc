@@ -50,7 +50,8 @@ TcpConnection::TcpConnection(EventLoop* loop,
     channel_(new Channel(loop, sockfd)),
     localAddr_(localAddr),
     peerAddr_(peerAddr),
-    highWaterMark_(64*1024*1024)
+    highWaterMark_(64*1024*1024),
+    queuedOutput_(0)
 {
   channel_->setReadCallback(
       boost::bind(&TcpConnection::handleRead, this, _1));
@@ -132,6 +133,40 @@ void TcpConnection::send(Buffer* buf)
   }
 }
 
+void TcpConnection::flushOutputBuffer()
+{
+  loop_->assertInLoopThread();
+  assert(queuedOutput_ <= outputBuffer_.readableBytes());
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN_LIMITED(10) << "disconnected, give up writing";
+    outputBuffer_.retrieveAll();
+    queuedOutput_ = 0;
+    return;
+  }
+  const size_t oldLen = queuedOutput_;
+  const size_t len = outputBuffer_.readableBytes() - oldLen;
+  if (len == 0)
+  {
+    return;
+  }
+  // as sendInLoop(), but the data is in outputBuffer_ already
+  if (!channel_->isWriting() && oldLen == 0)
+  {
+    ssize_t nwrote = writeDirectly(outputBuffer_.peek(), len);
+    if (nwrote < 0)
+    {
+      outputBuffer_.retrieveAll();
+      return;
+    }
+    outputBuffer_.retrieve(nwrote);
+  }
+  if (outputBuffer_.readableBytes() > oldLen)
+  {
+    queueOutput(oldLen);
+  }
+}
+
 void TcpConnection::sendInLoop(const StringPiece& message)
 {
   sendInLoop(message.data(), message.size());
@@ -142,60 +177,67 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
 {
   loop_->assertInLoopThread();
   ssize_t nwrote = 0;
-  size_t remaining = len;
-  bool faultError = false;
   if (state_ == kDisconnected)
   {
-    LOG_WARN << "disconnected, give up writing";
+    LOG_WARN_LIMITED(10) << "disconnected, give up writing";
     return;
   }
   // todo: 1. 跳过buffer直接写fd
   // if no thing in output queue, try writing directly
   if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
   {
-    nwrote = sockets::write(channel_->fd(), data, len);
-    if (nwrote >= 0)
-    {
-      remaining = len - nwrote;
-      if (remaining == 0 && writeCompleteCallback_)
-      {
-        // 写完了,直接跳过handleWrite，call最终的cb
-        loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
-      }
-    }
-    else // nwrote < 0
-    {
-      nwrote = 0;
-      if (errno != EWOULDBLOCK)
-      {
-        LOG_SYSERR << "TcpConnection::sendInLoop";
-        if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
-        {
-          faultError = true;
-        }
-      }
-    }
+    nwrote = writeDirectly(data, len);
   }
 
   // todo: 间接写，enable channel
   // 当直接发送一次发不完时，放入buffer让handleWrite来发送, 并且要保序
   // 拷贝待发送数据到outputbuffer，enableWrite
-  assert(remaining <= len);
-  if (!faultError && remaining > 0)
+  assert(nwrote < 0 || implicit_cast<size_t>(nwrote) <= len);
+  if (nwrote >= 0 && implicit_cast<size_t>(nwrote) < len)
   {
     size_t oldLen = outputBuffer_.readableBytes();
-    if (oldLen + remaining >= highWaterMark_
-        && oldLen < highWaterMark_
-        && highWaterMarkCallback_)
+    outputBuffer_.append(static_cast<const char*>(data)+nwrote, len - nwrote); // 添加到末尾保序
+    queueOutput(oldLen);
+  }
+}
+
+ssize_t TcpConnection::writeDirectly(const void* data, size_t len)
+{
+  ssize_t nwrote = sockets::write(channel_->fd(), data, len);
+  if (nwrote >= 0)
+  {
+    if (implicit_cast<size_t>(nwrote) == len && writeCompleteCallback_)
     {
-      loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+      // 写完了,直接跳过handleWrite，call最终的cb
+      loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
     }
-    outputBuffer_.append(static_cast<const char*>(data)+nwrote, remaining); // 添加到末尾保序
-    if (!channel_->isWriting())
+    return nwrote;
+  }
+  if (errno != EWOULDBLOCK)
+  {
+    LOG_SYSERR_LIMITED(10) << "TcpConnection::sendInLoop";
+    if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
     {
-      channel_->enableWriting();
+      return -1;
     }
   }
+  return 0;
+}
+
+void TcpConnection::queueOutput(size_t oldLen)
+{
+  const size_t newLen = outputBuffer_.readableBytes();
+  if (newLen >= highWaterMark_
+      && oldLen < highWaterMark_
+      && highWaterMarkCallback_)
+  {
+    loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+  }
+  queuedOutput_ = newLen;
+  if (!channel_->isWriting())
+  {
+    channel_->enableWriting();
+  }
 }
 
 void TcpConnection::shutdown()
@@ -383,7 +425,7 @@ void TcpConnection::handleRead(Timestamp receiveTime)
   else
   {
     errno = savedErrno;
-    LOG_SYSERR << "TcpConnection::handleRead";
+    LOG_SYSERR_LIMITED(10) << "TcpConnection::handleRead";
     handleError();
   }
 }
@@ -403,6 +445,7 @@ void TcpConnection::handleWrite()
     if (n > 0)
     {
       outputBuffer_.retrieve(n);
+      queuedOutput_ = outputBuffer_.readableBytes();
       if (outputBuffer_.readableBytes() == 0)
       {
         channel_->disableWriting();
@@ -418,7 +461,7 @@ void TcpConnection::handleWrite()
     }
     else
     {
-      LOG_SYSERR << "TcpConnection::handleWrite";
+      LOG_SYSERR_LIMITED(10) << "TcpConnection::handleWrite";
       // if (state_ == kDisconnecting)
       // {
       //   shutdownInLoop();
@@ -454,7 +497,7 @@ void TcpConnection::handleClose()
 void TcpConnection::handleError()
 {
   int err = sockets::getSocketError(channel_->fd());
-  LOG_ERROR << "TcpConnection::handleError [" << name_
-            << "] - SO_ERROR = " << err << " " << strerror_tl(err);
+  LOG_ERROR_LIMITED(10) << "TcpConnection::handleError [" << name_
+                        << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
 
@@ -96,6 +96,9 @@ class TcpConnection : boost::noncopyable,
   void setWriteCompleteCallback(const WriteCompleteCallback& cb)
   { writeCompleteCallback_ = cb; }
 
+  const WriteCompleteCallback& writeCompleteCallback() const
+  { return writeCompleteCallback_; }
+
   void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
   { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
 
@@ -106,6 +109,11 @@ class TcpConnection : boost::noncopyable,
   Buffer* outputBuffer()
   { return &outputBuffer_; }
 
+  /// Advanced interface, must be called in loop thread.
+  /// Sends data appended to outputBuffer() without copying it,
+  /// so a message can be serialized in place.
+  void flushOutputBuffer();
+
   /// Internal use only.
   void setCloseCallback(const CloseCallback& cb)
   { closeCallback_ = cb; }
@@ -131,6 +139,11 @@ class TcpConnection : boost::noncopyable,
   // void sendInLoop(string&& message);
   void sendInLoop(const StringPiece& message);
   void sendInLoop(const void* message, size_t len);
+  // of sendInLoop() and flushOutputBuffer(), writes to fd, returns -1 on
+  // faults which give up the rest
+  ssize_t writeDirectly(const void* data, size_t len);
+  // handleWrite() sends outputBuffer_, which grew from oldLen bytes
+  void queueOutput(size_t oldLen);
   void shutdownInLoop();
   // void shutdownAndForceCloseInLoop(double seconds);
   void forceCloseInLoop();
@@ -162,6 +175,9 @@ class TcpConnection : boost::noncopyable,
   size_t highWaterMark_;
   Buffer inputBuffer_;
   Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer.
+  // bytes of outputBuffer_ waiting for handleWrite(), those after them are
+  // appended for flushOutputBuffer()
+  size_t queuedOutput_;
   boost::any context_;
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
@@ -85,9 +85,9 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
   ++nextConnId_;
   string connName = name_ + buf;
 
-  LOG_INFO << "TcpServer::newConnection [" << name_
-           << "] - new connection [" << connName
-           << "] from " << peerAddr.toIpPort();
+  LOG_INFO_LIMITED(100) << "TcpServer::newConnection [" << name_
+                        << "] - new connection [" << connName
+                        << "] from " << peerAddr.toIpPort();
   InetAddress localAddr(sockets::getLocalAddr(sockfd));
   // FIXME poll with zero timeout to double confirm the new connection
   // FIXME use make_shared if necessary
@@ -127,8 +127,8 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn)
 {
   // conn ref = 2
   loop_->assertInLoopThread();
-  LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_
-           << "] - connection " << conn->name();
+  LOG_INFO_LIMITED(100) << "TcpServer::removeConnectionInLoop [" << name_
+                        << "] - connection " << conn->name();
   size_t n = connections_.erase(conn->name()); // 这里conn ref=1 不析构
   (void)n;
   assert(n == 1);
@@ -11,13 +11,13 @@ namespace net
 {
 
 // input is zlib compressed data, output uncompressed data
-// FIXME: finish this
 class ZlibInputStream : boost::noncopyable
 {
  public:
   explicit ZlibInputStream(Buffer* output)
     : output_(output),
-      zerror_(Z_OK)
+      zerror_(Z_OK),
+      bufferSize_(1024)
   {
     bzero(&zstream_, sizeof zstream_);
     zerror_ = inflateInit(&zstream_);
@@ -28,30 +28,98 @@ class ZlibInputStream : boost::noncopyable
     finish();
   }
 
-  bool write(StringPiece buf);
-  bool write(Buffer* input);
-  bool finish();
-    // inflateEnd(&zstream_);
+  // Return last error message or NULL if no error.
+  const char* zlibErrorMessage() const { return zstream_.msg; }
+
+  // Z_STREAM_END once the end of compressed data is seen.
+  int zlibErrorCode() const { return zerror_; }
+  int64_t inputBytes() const { return zstream_.total_in; }
+  int64_t outputBytes() const { return zstream_.total_out; }
+
+  // false if buf is not all consumed, eg. data after the end of stream.
+  bool write(StringPiece buf)
+  {
+    if (zerror_ != Z_OK)
+      return false;
+
+    void* in = const_cast<char*>(buf.data());
+    zstream_.next_in = static_cast<Bytef*>(in);
+    zstream_.avail_in = buf.size();
+    do
+    {
+      zerror_ = decompress(Z_NO_FLUSH);
+    } while (zerror_ == Z_OK && (zstream_.avail_in > 0 || zstream_.avail_out == 0));
+    if (zerror_ == Z_BUF_ERROR && zstream_.avail_in == 0)
+    {
+      // no progress possible, waiting for more input
+      zerror_ = Z_OK;
+    }
+    bool ok = (zerror_ == Z_OK || zerror_ == Z_STREAM_END) && zstream_.avail_in == 0;
+    zstream_.next_in = NULL;
+    zstream_.avail_in = 0;
+    return ok;
+  }
+
+  bool write(Buffer* input)
+  {
+    bool ok = write(input->toStringPiece());
+    input->retrieveAll();
+    return ok;
+  }
+
+  // true if all compressed data was seen, releases the zlib state.
+  bool finish()
+  {
+    bool ok = zerror_ == Z_STREAM_END;
+    if (zstream_.state != Z_NULL)
+    {
+      inflateEnd(&zstream_);
+    }
+    return ok;
+  }
+
+  // Starts another stream to output, reusing the zlib state.
+  bool reset(Buffer* output)
+  {
+    output_ = output;
+    zstream_.next_in = NULL;
+    zstream_.avail_in = 0;
+    zerror_ = inflateReset(&zstream_);
+    return zerror_ == Z_OK;
+  }
 
  private:
-  int decompress(int flush);
+  int decompress(int flush)
+  {
+    output_->ensureWritableBytes(bufferSize_);
+    zstream_.next_out = reinterpret_cast<Bytef*>(output_->beginWrite());
+    zstream_.avail_out = static_cast<int>(output_->writableBytes());
+    int error = ::inflate(&zstream_, flush);
+    output_->hasWritten(output_->writableBytes() - zstream_.avail_out);
+    if (zstream_.avail_out == 0 && bufferSize_ < 65536)
+    {
+      bufferSize_ *= 2;
+    }
+    return error;
+  }
 
   Buffer* output_;
   z_stream zstream_;
   int zerror_;
+  int bufferSize_;
 };
 
 // input is uncompressed data, output zlib compressed data
 class ZlibOutputStream : boost::noncopyable
 {
  public:
-  explicit ZlibOutputStream(Buffer* output)
+  explicit ZlibOutputStream(Buffer* output, int level = Z_DEFAULT_COMPRESSION)
     : output_(output),
       zerror_(Z_OK),
       bufferSize_(1024)
   {
     bzero(&zstream_, sizeof zstream_);
-    zerror_ = deflateInit(&zstream_, Z_DEFAULT_COMPRESSION);
+    zerror_ = deflateInit(&zstream_, level);
   }
 
   ~ZlibOutputStream()
@@ -105,19 +173,37 @@ class ZlibOutputStream : boost::noncopyable
     return zerror_ == Z_OK;
   }
 
+  // Ends the compressed data, and releases the zlib state.
   bool finish()
   {
-    if (zerror_ != Z_OK)
-      return false;
+    bool ok = finishStream();
+    if (zstream_.state != Z_NULL)
+    {
+      ok = deflateEnd(&zstream_) == Z_OK && ok;
+    }
+    zerror_ = Z_STREAM_END;
+    return ok;
+  }
 
+  // Ends the compressed data like finish(), but keeps the zlib state,
+  // so reset() starts another stream without deflateInit().
+  bool finishStream()
+  {
     while (zerror_ == Z_OK)
     {
       zerror_ = compress(Z_FINISH);
     }
-    zerror_ = deflateEnd(&zstream_);
-    bool ok = zerror_ == Z_OK;
-    zerror_ = Z_STREAM_END;
-    return ok;
+    return zerror_ == Z_STREAM_END;
+  }
+
+  // Starts another stream to output, reusing the zlib state.
+  bool reset(Buffer* output)
+  {
+    output_ = output;
+    zstream_.next_in = NULL;
+    zstream_.avail_in = 0;
+    zerror_ = deflateReset(&zstream_);
+    return zerror_ == Z_OK;
   }
 
  private:
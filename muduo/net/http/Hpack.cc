@@ -0,0 +1,635 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/Hpack.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <stdint.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace muduo::net::hpack;
+
+namespace
+{
+
+// Bit lengths of the Huffman code of RFC 7541 Appendix B, the last one is EOS.
+// The code is canonical, so the codes follow from the lengths:
+// shorter codes first, symbols of the same length in ascending order.
+const uint8_t kHuffmanLengths[257] =
+{
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+   6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+   5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+  13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+   7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+  15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+   6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+const int kEos = 256;
+
+// RFC 7541 Appendix A
+const char* const kStaticTable[HpackTable::kStaticEntries][2] =
+{
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" },
+};
+
+// Tables built once at start up.
+class Tables : boost::noncopyable
+{
+ public:
+  enum Flags
+  {
+    kEmit = 1,
+    kAccept = 2,
+    kFail = 4,
+  };
+
+  // Decoding consumes 4 bits at a time, a state is an inner node of the code
+  // tree, the node reached by the bits so far.  No code is shorter than
+  // 5 bits, so a nibble emits at most one symbol.
+  struct Transition
+  {
+    uint8_t next;
+    uint8_t flags;
+    uint8_t symbol;
+  };
+
+  Tables()
+  {
+    buildStaticTable();
+    buildHuffmanCodes();
+    buildHuffmanTransitions();
+  }
+
+  std::vector<Header> staticTable;
+  uint32_t codes[257];
+  Transition transitions[256][16];
+
+ private:
+  void buildStaticTable()
+  {
+    for (size_t i = 0; i < HpackTable::kStaticEntries; ++i)
+    {
+      staticTable.push_back(Header(kStaticTable[i][0], kStaticTable[i][1]));
+    }
+  }
+
+  void buildHuffmanCodes()
+  {
+    uint32_t code = 0;
+    int length = 0;
+    for (int bits = 1; bits <= 30; ++bits)
+    {
+      for (int sym = 0; sym <= kEos; ++sym)
+      {
+        if (kHuffmanLengths[sym] == bits)
+        {
+          code <<= (bits - length);
+          length = bits;
+          codes[sym] = code++;
+        }
+      }
+    }
+    assert(codes[kEos] == 0x3fffffff);
+  }
+
+  void buildHuffmanTransitions()
+  {
+    // children of inner nodes, -1 - symbol for leaves
+    int children[256][2];
+    // padding is at most 7 bits of the EOS prefix
+    bool acceptable[256];
+    int depth[256];
+    int nodes = 1;
+    children[0][0] = children[0][1] = 0;
+    acceptable[0] = true;
+    depth[0] = 0;
+    for (int sym = 0; sym <= kEos; ++sym)
+    {
+      int node = 0;
+      for (int bit = kHuffmanLengths[sym] - 1; bit >= 0; --bit)
+      {
+        int b = (codes[sym] >> bit) & 1;
+        if (bit == 0)
+        {
+          children[node][b] = -1 - sym;
+        }
+        else
+        {
+          if (children[node][b] == 0)
+          {
+            assert(nodes < 256);
+            children[nodes][0] = children[nodes][1] = 0;
+            acceptable[nodes] = acceptable[node] && b == 1 && depth[node] < 7;
+            depth[nodes] = depth[node] + 1;
+            children[node][b] = nodes++;
+          }
+          node = children[node][b];
+        }
+      }
+    }
+    assert(nodes == 256);
+
+    for (int state = 0; state < nodes; ++state)
+    {
+      for (int nibble = 0; nibble < 16; ++nibble)
+      {
+        Transition& t = transitions[state][nibble];
+        t.flags = 0;
+        t.symbol = 0;
+        int node = state;
+        for (int bit = 3; bit >= 0; --bit)
+        {
+          int child = children[node][(nibble >> bit) & 1];
+          if (child < 0)
+          {
+            int sym = -1 - child;
+            if (sym == kEos)
+            {
+              t.flags = kFail;
+            }
+            else
+            {
+              t.flags = kEmit;
+              t.symbol = static_cast<uint8_t>(sym);
+            }
+            node = 0;
+          }
+          else
+          {
+            node = child;
+          }
+        }
+        t.next = static_cast<uint8_t>(node);
+        if (acceptable[node] && !(t.flags & kFail))
+        {
+          t.flags |= kAccept;
+        }
+      }
+    }
+  }
+};
+
+const Tables kTables;
+
+bool decodeInteger(const uint8_t** p, const uint8_t* end, int prefixBits, size_t* value)
+{
+  if (*p == end)
+  {
+    return false;
+  }
+  const size_t prefixMax = (1 << prefixBits) - 1;
+  size_t result = **p & prefixMax;
+  ++*p;
+  if (result < prefixMax)
+  {
+    *value = result;
+    return true;
+  }
+  for (int shift = 0; *p != end && shift < 28; shift += 7)
+  {
+    uint8_t b = **p;
+    ++*p;
+    result += static_cast<size_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0)
+    {
+      *value = result;
+      return true;
+    }
+  }
+  return false;  // truncated, or too large for anything we accept
+}
+
+bool decodeString(const uint8_t** p, const uint8_t* end, string* output)
+{
+  if (*p == end)
+  {
+    return false;
+  }
+  bool huffman = (**p & 0x80) != 0;
+  size_t len = 0;
+  if (!decodeInteger(p, end, 7, &len) || len > static_cast<size_t>(end - *p))
+  {
+    return false;
+  }
+  const char* data = reinterpret_cast<const char*>(*p);
+  *p += len;
+  if (huffman)
+  {
+    return huffmanDecode(data, len, output);
+  }
+  output->assign(data, len);
+  return true;
+}
+
+void appendInteger(string* output, uint8_t pattern, int prefixBits, size_t value)
+{
+  const size_t prefixMax = (1 << prefixBits) - 1;
+  if (value < prefixMax)
+  {
+    output->push_back(static_cast<char>(pattern | value));
+  }
+  else
+  {
+    output->push_back(static_cast<char>(pattern | prefixMax));
+    value -= prefixMax;
+    while (value >= 128)
+    {
+      output->push_back(static_cast<char>(0x80 | (value & 0x7f)));
+      value >>= 7;
+    }
+    output->push_back(static_cast<char>(value));
+  }
+}
+
+void appendString(string* output, const StringPiece& str)
+{
+  size_t len = static_cast<size_t>(str.size());
+  size_t huffmanLen = huffmanEncodedLength(str.data(), len);
+  if (huffmanLen <= len)
+  {
+    appendInteger(output, 0x80, 7, huffmanLen);
+    huffmanEncode(str.data(), len, output);
+  }
+  else
+  {
+    appendInteger(output, 0, 7, len);
+    output->append(str.data(), len);
+  }
+}
+
+}
+
+bool hpack::huffmanDecode(const char* data, size_t len, string* output)
+{
+  output->clear();
+  output->reserve(len * 8 / 5);
+  uint8_t state = 0;
+  uint8_t flags = Tables::kAccept;
+  for (size_t i = 0; i < len; ++i)
+  {
+    uint8_t b = static_cast<uint8_t>(data[i]);
+    for (int shift = 4; shift >= 0; shift -= 4)
+    {
+      const Tables::Transition& t = kTables.transitions[state][(b >> shift) & 0xf];
+      if (t.flags & Tables::kFail)
+      {
+        return false;
+      }
+      if (t.flags & Tables::kEmit)
+      {
+        output->push_back(static_cast<char>(t.symbol));
+      }
+      state = t.next;
+      flags = t.flags;
+    }
+  }
+  return (flags & Tables::kAccept) != 0;
+}
+
+size_t hpack::huffmanEncodedLength(const char* data, size_t len)
+{
+  size_t bits = 0;
+  for (size_t i = 0; i < len; ++i)
+  {
+    bits += kHuffmanLengths[static_cast<uint8_t>(data[i])];
+  }
+  return (bits + 7) / 8;
+}
+
+void hpack::huffmanEncode(const char* data, size_t len, string* output)
+{
+  uint64_t bits = 0;
+  int count = 0;
+  for (size_t i = 0; i < len; ++i)
+  {
+    uint8_t sym = static_cast<uint8_t>(data[i]);
+    bits = (bits << kHuffmanLengths[sym]) | kTables.codes[sym];
+    count += kHuffmanLengths[sym];
+    while (count >= 8)
+    {
+      count -= 8;
+      output->push_back(static_cast<char>(bits >> count));
+    }
+  }
+  if (count > 0)
+  {
+    // pads with the most significant bits of EOS
+    output->push_back(static_cast<char>((bits << (8 - count)) | (0xff >> count)));
+  }
+}
+
+HpackTable::HpackTable(size_t maxSize)
+  : size_(0),
+    maxSize_(maxSize)
+{
+}
+
+void HpackTable::setMaxSize(size_t maxSize)
+{
+  maxSize_ = maxSize;
+  evict(maxSize_);
+}
+
+void HpackTable::add(const StringPiece& name, const StringPiece& value)
+{
+  size_t entrySize = name.size() + value.size() + kEntryOverhead;
+  if (entrySize > maxSize_)
+  {
+    // not an error, empties the table
+    evict(0);
+    return;
+  }
+  evict(maxSize_ - entrySize);
+  dynamic_.push_front(Header());
+  name.CopyToString(&dynamic_.front().first);
+  value.CopyToString(&dynamic_.front().second);
+  size_ += entrySize;
+}
+
+const Header& HpackTable::get(size_t index) const
+{
+  assert(index > 0 && index <= entries());
+  if (index <= kStaticEntries)
+  {
+    return kTables.staticTable[index - 1];
+  }
+  return dynamic_[index - kStaticEntries - 1];
+}
+
+size_t HpackTable::find(const StringPiece& name,
+                        const StringPiece& value,
+                        size_t* nameIndex) const
+{
+  *nameIndex = 0;
+  for (size_t i = 0; i < kStaticEntries; ++i)
+  {
+    const Header& h = kTables.staticTable[i];
+    if (StringPiece(h.first) == name)
+    {
+      if (StringPiece(h.second) == value)
+      {
+        return i + 1;
+      }
+      if (*nameIndex == 0)
+      {
+        *nameIndex = i + 1;
+      }
+    }
+  }
+  for (size_t i = 0; i < dynamic_.size(); ++i)
+  {
+    const Header& h = dynamic_[i];
+    if (StringPiece(h.first) == name)
+    {
+      if (StringPiece(h.second) == value)
+      {
+        return kStaticEntries + i + 1;
+      }
+      if (*nameIndex == 0)
+      {
+        *nameIndex = kStaticEntries + i + 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void HpackTable::evict(size_t maxSize)
+{
+  while (size_ > maxSize)
+  {
+    const Header& h = dynamic_.back();
+    size_ -= h.first.size() + h.second.size() + kEntryOverhead;
+    dynamic_.pop_back();
+  }
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize, size_t maxListSize)
+  : maxTableSize_(maxTableSize),
+    maxListSize_(maxListSize),
+    table_(maxTableSize)
+{
+}
+
+bool HpackDecoder::decode(const char* data, size_t len, HeaderList* headers)
+{
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = p + len;
+  bool fieldSeen = false;
+  size_t listSize = 0;
+  while (p < end)
+  {
+    uint8_t b = *p;
+    size_t index = 0;
+    if (b & 0x80)
+    {
+      // indexed header field
+      if (!decodeInteger(&p, end, 7, &index) || index == 0 || index > table_.entries())
+      {
+        return false;
+      }
+      const Header& h = table_.get(index);
+      listSize += h.first.size() + h.second.size() + HpackTable::kEntryOverhead;
+      if (listSize > maxListSize_)
+      {
+        return false;
+      }
+      headers->push_back(h);
+      fieldSeen = true;
+    }
+    else if ((b & 0xe0) == 0x20)
+    {
+      // dynamic table size update, only at the beginning of a block
+      size_t size = 0;
+      if (fieldSeen || !decodeInteger(&p, end, 5, &size) || size > maxTableSize_)
+      {
+        return false;
+      }
+      table_.setMaxSize(size);
+    }
+    else
+    {
+      // literal header field, with incremental indexing, without indexing,
+      // or never indexed.
+      bool indexing = (b & 0xc0) == 0x40;
+      if (!decodeInteger(&p, end, indexing ? 6 : 4, &index) || index > table_.entries())
+      {
+        return false;
+      }
+      headers->push_back(Header());
+      Header& h = headers->back();
+      if (index > 0)
+      {
+        h.first = table_.get(index).first;
+      }
+      else if (!decodeString(&p, end, &h.first))
+      {
+        return false;
+      }
+      if (!decodeString(&p, end, &h.second))
+      {
+        return false;
+      }
+      listSize += h.first.size() + h.second.size() + HpackTable::kEntryOverhead;
+      if (listSize > maxListSize_)
+      {
+        return false;
+      }
+      if (indexing)
+      {
+        table_.add(h.first, h.second);
+      }
+      fieldSeen = true;
+    }
+  }
+  return true;
+}
+
+HpackEncoder::HpackEncoder(size_t maxTableSize)
+  : limit_(maxTableSize),
+    table_(maxTableSize),
+    minPendingSize_(maxTableSize),
+    sizeUpdatePending_(false)
+{
+}
+
+void HpackEncoder::setMaxTableSize(size_t peerTableSize)
+{
+  size_t size = std::min(peerTableSize, limit_);
+  if (size == table_.maxSize() && !sizeUpdatePending_)
+  {
+    return;
+  }
+  // the decoder must see the smallest size between two blocks,
+  // so that it evicts the same entries as we do.
+  minPendingSize_ = sizeUpdatePending_ ? std::min(minPendingSize_, size) : size;
+  sizeUpdatePending_ = true;
+  table_.setMaxSize(size);
+}
+
+void HpackEncoder::startBlock(string* output)
+{
+  if (sizeUpdatePending_)
+  {
+    if (minPendingSize_ < table_.maxSize())
+    {
+      appendInteger(output, 0x20, 5, minPendingSize_);
+    }
+    appendInteger(output, 0x20, 5, table_.maxSize());
+    sizeUpdatePending_ = false;
+  }
+}
+
+void HpackEncoder::encode(const StringPiece& name, const StringPiece& value, string* output)
+{
+  size_t nameIndex = 0;
+  size_t index = table_.find(name, value, &nameIndex);
+  if (index > 0)
+  {
+    appendInteger(output, 0x80, 7, index);
+    return;
+  }
+
+  // content-length hardly repeats, and an entry taking more than half of
+  // the table would evict too much.
+  size_t entrySize = name.size() + value.size() + HpackTable::kEntryOverhead;
+  bool indexing = entrySize <= table_.maxSize() / 2 && name != "content-length";
+  if (indexing)
+  {
+    appendInteger(output, 0x40, 6, nameIndex);
+  }
+  else
+  {
+    appendInteger(output, 0, 4, nameIndex);
+  }
+  if (nameIndex == 0)
+  {
+    appendString(output, name);
+  }
+  appendString(output, value);
+  if (indexing)
+  {
+    table_.add(name, value);
+  }
+}
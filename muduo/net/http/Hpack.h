@@ -0,0 +1,132 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HPACK_H
+#define MUDUO_NET_HTTP_HPACK_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+namespace hpack
+{
+
+typedef std::pair<string, string> Header;
+typedef std::vector<Header> HeaderList;
+
+/// Huffman code of RFC 7541 Appendix B.
+/// Returns false on invalid code or padding.
+bool huffmanDecode(const char* data, size_t len, string* output);
+void huffmanEncode(const char* data, size_t len, string* output);
+size_t huffmanEncodedLength(const char* data, size_t len);
+
+}
+
+/// The static and dynamic table of RFC 7541 section 2.3,
+/// index starts from 1, the dynamic table follows the 61 static entries.
+class HpackTable : boost::noncopyable
+{
+ public:
+  explicit HpackTable(size_t maxSize);
+
+  size_t maxSize() const { return maxSize_; }
+  size_t size() const { return size_; }
+  size_t entries() const { return kStaticEntries + dynamic_.size(); }
+
+  /// Evicts entries to fit in the new size.
+  void setMaxSize(size_t maxSize);
+
+  /// Adds an entry in front of the dynamic table.
+  void add(const StringPiece& name, const StringPiece& value);
+
+  /// Requires 0 < index <= entries()
+  const hpack::Header& get(size_t index) const;
+
+  /// Returns the index of name and value, or 0 if not found,
+  /// *nameIndex is set to an entry of the same name if any.
+  size_t find(const StringPiece& name, const StringPiece& value, size_t* nameIndex) const;
+
+  static const size_t kStaticEntries = 61;
+  static const size_t kEntryOverhead = 32;
+
+ private:
+  void evict(size_t maxSize);
+
+  // newest first
+  std::deque<hpack::Header> dynamic_;
+  size_t size_;
+  size_t maxSize_;
+};
+
+/// Decodes header blocks of one direction of a connection.
+class HpackDecoder : boost::noncopyable
+{
+ public:
+  /// maxTableSize is our SETTINGS_HEADER_TABLE_SIZE,
+  /// maxListSize is our SETTINGS_MAX_HEADER_LIST_SIZE.
+  explicit HpackDecoder(size_t maxTableSize = 4096, size_t maxListSize = 64 * 1024);
+
+  /// Appends decoded fields to headers.
+  /// Returns false on compression error, or when the fields of the block
+  /// are larger than maxListSize, as counted by RFC 7540 section 6.5.2,
+  /// the connection must be closed.  Stops at the field over the limit,
+  /// a small block of indexed fields can decode to a huge list.
+  bool decode(const char* data, size_t len, hpack::HeaderList* headers);
+
+  const HpackTable& table() const { return table_; }
+
+ private:
+  const size_t maxTableSize_;
+  const size_t maxListSize_;
+  HpackTable table_;
+};
+
+/// Encodes header blocks of one direction of a connection.
+///
+/// Uses incremental indexing for fields that fit in the dynamic table,
+/// and Huffman code for strings it makes no longer.
+class HpackEncoder : boost::noncopyable
+{
+ public:
+  /// maxTableSize is the most we use, whatever the peer allows.
+  explicit HpackEncoder(size_t maxTableSize = 4096);
+
+  /// Follows the peer's SETTINGS_HEADER_TABLE_SIZE,
+  /// the change is signaled at the beginning of next header block.
+  void setMaxTableSize(size_t peerTableSize);
+
+  /// Must be called at the beginning of every header block.
+  void startBlock(string* output);
+
+  /// name must be in lower case.
+  void encode(const StringPiece& name, const StringPiece& value, string* output);
+
+  const HpackTable& table() const { return table_; }
+
+ private:
+  const size_t limit_;
+  HpackTable table_;
+  size_t minPendingSize_;
+  bool sizeUpdatePending_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HPACK_H
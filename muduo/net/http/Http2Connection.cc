@@ -0,0 +1,973 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/Http2Connection.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/Endian.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+// in HttpResponse.cc
+StringPiece formatHttpDate(time_t seconds);
+
+}
+}
+}
+
+namespace
+{
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t kFrameHeaderLength = 9;
+
+// we never change SETTINGS_MAX_FRAME_SIZE and SETTINGS_HEADER_TABLE_SIZE
+// from their defaults.
+const size_t kMaxFrameSize = 16384;
+const size_t kHeaderTableSize = 4096;
+const int64_t kDefaultWindow = 65535;
+const int64_t kMaxWindow = 0x7fffffff;
+const int64_t kLocalWindow = 1024 * 1024;
+const uint32_t kMaxConcurrentStreams = 100;
+// of HEADERS and CONTINUATION frames, and of the fields decoded from them,
+// SETTINGS_MAX_HEADER_LIST_SIZE.
+const size_t kMaxHeaderBlock = 64 * 1024;
+const size_t kMaxHeaderList = 64 * 1024;
+const size_t kMaxBodySize = 64 * 1024 * 1024;
+
+enum FrameType
+{
+  kData = 0,
+  kHeaders = 1,
+  kPriority = 2,
+  kRstStream = 3,
+  kSettings = 4,
+  kPushPromise = 5,
+  kPing = 6,
+  kGoAway = 7,
+  kWindowUpdate = 8,
+  kContinuation = 9,
+};
+
+enum FrameFlag
+{
+  kEndStream = 0x1,
+  kAck = 0x1,
+  kEndHeaders = 0x4,
+  kPadded = 0x8,
+  kPriorityFlag = 0x20,
+};
+
+enum ErrorCode
+{
+  kNoError = 0,
+  kProtocolError = 1,
+  kInternalError = 2,
+  kFlowControlError = 3,
+  kStreamClosed = 5,
+  kFrameSizeError = 6,
+  kRefusedStream = 7,
+  kCancel = 8,
+  kCompressionError = 9,
+  kEnhanceYourCalm = 11,
+};
+
+enum SettingsId
+{
+  kSettingsHeaderTableSize = 1,
+  kSettingsEnablePush = 2,
+  kSettingsMaxConcurrentStreams = 3,
+  kSettingsInitialWindowSize = 4,
+  kSettingsMaxFrameSize = 5,
+  kSettingsMaxHeaderListSize = 6,
+};
+
+uint16_t readUint16(const char* p)
+{
+  uint16_t be16 = 0;
+  ::memcpy(&be16, p, sizeof be16);
+  return sockets::networkToHost16(be16);
+}
+
+uint32_t readUint32(const char* p)
+{
+  uint32_t be32 = 0;
+  ::memcpy(&be32, p, sizeof be32);
+  return sockets::networkToHost32(be32);
+}
+
+void appendFrameHeader(Buffer* output, size_t length, uint8_t type,
+                       uint8_t flags, uint32_t streamId)
+{
+  char header[kFrameHeaderLength];
+  header[0] = static_cast<char>(length >> 16);
+  header[1] = static_cast<char>(length >> 8);
+  header[2] = static_cast<char>(length);
+  header[3] = static_cast<char>(type);
+  header[4] = static_cast<char>(flags);
+  uint32_t be32 = sockets::hostToNetwork32(streamId);
+  ::memcpy(header + 5, &be32, sizeof be32);
+  output->append(header, sizeof header);
+}
+
+void appendUint32(Buffer* output, uint32_t x)
+{
+  output->appendInt32(static_cast<int32_t>(x));
+}
+
+void appendSetting(Buffer* output, uint16_t id, uint32_t value)
+{
+  output->appendInt16(static_cast<int16_t>(id));
+  appendUint32(output, value);
+}
+
+void appendWindowUpdate(Buffer* output, uint32_t streamId, int64_t increment)
+{
+  appendFrameHeader(output, 4, kWindowUpdate, 0, streamId);
+  appendUint32(output, static_cast<uint32_t>(increment));
+}
+
+// strips the Pad Length field and the padding
+bool stripPadding(uint8_t flags, const char** data, size_t* length)
+{
+  if (flags & kPadded)
+  {
+    if (*length < 1)
+    {
+      return false;
+    }
+    size_t padding = static_cast<uint8_t>(**data);
+    if (padding >= *length)
+    {
+      return false;
+    }
+    ++*data;
+    *length -= 1 + padding;
+  }
+  return true;
+}
+
+// "content-type" to "Content-Type"
+string canonicalName(const string& name)
+{
+  string result(name);
+  bool upper = true;
+  for (size_t i = 0; i < result.size(); ++i)
+  {
+    if (upper && result[i] >= 'a' && result[i] <= 'z')
+    {
+      result[i] = static_cast<char>(result[i] - 'a' + 'A');
+    }
+    upper = result[i] == '-';
+  }
+  return result;
+}
+
+// Returns false if the request is malformed.
+bool fillRequest(const hpack::HeaderList& headers, HttpRequest* req)
+{
+  bool hasMethod = false;
+  bool hasPath = false;
+  const string* authority = NULL;
+  for (size_t i = 0; i < headers.size(); ++i)
+  {
+    const string& name = headers[i].first;
+    const string& value = headers[i].second;
+    if (!name.empty() && name[0] == ':')
+    {
+      if (name == ":method")
+      {
+        // unknown methods are answered with 400
+        req->setMethod(value.data(), value.data() + value.size());
+        hasMethod = true;
+      }
+      else if (name == ":path")
+      {
+        const char* start = value.data();
+        const char* end = start + value.size();
+        const char* question = std::find(start, end, '?');
+        req->setPath(start, question);
+        if (question != end)
+        {
+          req->setQuery(question, end);
+        }
+        hasPath = !value.empty();
+      }
+      else if (name == ":authority")
+      {
+        authority = &value;
+      }
+      else if (name != ":scheme")
+      {
+        return false;
+      }
+    }
+    else
+    {
+      string field = canonicalName(name);
+      string old = req->getHeader(field);
+      if (old.empty())
+      {
+        req->addHeader(field, value);
+      }
+      else
+      {
+        // crumbs of a cookie, or a repeated field
+        req->addHeader(field, old + (field == "Cookie" ? "; " : ", ") + value);
+      }
+    }
+  }
+  if (authority && req->getHeader("Host").empty())
+  {
+    req->addHeader("Host", *authority);
+  }
+  req->setVersion(HttpRequest::kHttp20);
+  return hasMethod && hasPath;
+}
+
+// RFC 4648 base64url, without padding
+bool base64UrlDecode(const string& input, string* output)
+{
+  uint32_t bits = 0;
+  int count = 0;
+  for (size_t i = 0; i < input.size(); ++i)
+  {
+    char c = input[i];
+    int value = 0;
+    if (c >= 'A' && c <= 'Z')
+      value = c - 'A';
+    else if (c >= 'a' && c <= 'z')
+      value = c - 'a' + 26;
+    else if (c >= '0' && c <= '9')
+      value = c - '0' + 52;
+    else if (c == '-')
+      value = 62;
+    else if (c == '_')
+      value = 63;
+    else if (c == '=')
+      break;
+    else
+      return false;
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    count += 6;
+    if (count >= 8)
+    {
+      count -= 8;
+      output->push_back(static_cast<char>(bits >> count));
+    }
+  }
+  return true;
+}
+
+bool isConnectionSpecific(const string& name)
+{
+  return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+      || name == "transfer-encoding" || name == "upgrade";
+}
+
+}
+
+Http2Connection::Http2Connection(const HttpServer::HttpCallback& cb)
+  : httpCallback_(cb),
+    state_(kExpectPreface),
+    decoder_(kHeaderTableSize, kMaxHeaderList),
+    lastStreamId_(0),
+    headerStreamId_(0),
+    headerEndStream_(false),
+    expectContinuation_(false),
+    sendWindow_(kDefaultWindow),
+    recvWindow_(kLocalWindow),
+    peerInitialWindow_(kDefaultWindow),
+    peerMaxFrameSize_(kMaxFrameSize),
+    goAwayReceived_(false)
+{
+}
+
+Http2Connection::~Http2Connection()
+{
+}
+
+bool Http2Connection::startsWithPreface(const Buffer& buf)
+{
+  size_t len = buf.readableBytes() < kPrefaceLength ? buf.readableBytes() : kPrefaceLength;
+  return len > 0 && ::memcmp(buf.peek(), kPreface, len) == 0;
+}
+
+void Http2Connection::start(const TcpConnectionPtr& conn)
+{
+  sendPreface(conn->outputBuffer());
+  conn->flushOutputBuffer();
+}
+
+bool Http2Connection::upgrade(const TcpConnectionPtr& conn,
+                              const string& settings,
+                              const HttpRequest& req)
+{
+  string payload;
+  if (!base64UrlDecode(settings, &payload)
+      || payload.size() % 6 != 0
+      || applySettings(payload.data(), payload.size()) != kNoError)
+  {
+    LOG_ERROR << conn->name() << " bad HTTP2-Settings " << settings;
+    return false;
+  }
+
+  Buffer* output = conn->outputBuffer();
+  output->append("HTTP/1.1 101 Switching Protocols\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Upgrade: h2c\r\n"
+                 "\r\n");
+  sendPreface(output);
+
+  // the request is on stream 1, half-closed (remote)
+  lastStreamId_ = 1;
+  Stream& stream = streams_[1];
+  stream.request = req;
+  stream.sendWindow = peerInitialWindow_;
+  stream.recvWindow = kLocalWindow;
+  stream.endStream = true;
+  dispatch(output, streams_.find(1));
+  conn->flushOutputBuffer();
+  return true;
+}
+
+void Http2Connection::onMessage(const TcpConnectionPtr& conn,
+                                Buffer* buf,
+                                Timestamp receiveTime)
+{
+  Buffer* output = conn->outputBuffer();
+  while (state_ != kClosed)
+  {
+    if (state_ == kExpectPreface)
+    {
+      if (!startsWithPreface(*buf))
+      {
+        connectionError(output, kProtocolError);
+      }
+      else if (buf->readableBytes() >= kPrefaceLength)
+      {
+        buf->retrieve(kPrefaceLength);
+        state_ = kExpectSettings;
+        continue;
+      }
+      break;
+    }
+
+    if (buf->readableBytes() < kFrameHeaderLength)
+    {
+      break;
+    }
+    const char* header = buf->peek();
+    size_t length = (static_cast<size_t>(static_cast<uint8_t>(header[0])) << 16)
+                  | (static_cast<size_t>(static_cast<uint8_t>(header[1])) << 8)
+                  | static_cast<uint8_t>(header[2]);
+    if (length > kMaxFrameSize)
+    {
+      connectionError(output, kFrameSizeError);
+      break;
+    }
+    if (buf->readableBytes() < kFrameHeaderLength + length)
+    {
+      break;
+    }
+    uint32_t error = onFrame(output,
+                             static_cast<uint8_t>(header[3]),
+                             static_cast<uint8_t>(header[4]),
+                             readUint32(header + 5) & 0x7fffffff,
+                             header + kFrameHeaderLength,
+                             length,
+                             receiveTime);
+    buf->retrieve(kFrameHeaderLength + length);
+    if (error != kNoError)
+    {
+      connectionError(output, error);
+    }
+  }
+
+  if (state_ == kClosed)
+  {
+    buf->retrieveAll();
+  }
+  conn->flushOutputBuffer();
+  if (state_ == kClosed || (goAwayReceived_ && streams_.empty()))
+  {
+    conn->shutdown();
+  }
+}
+
+// Returns an error code for connection errors.
+uint32_t Http2Connection::onFrame(Buffer* output, uint8_t type, uint8_t flags,
+                                  uint32_t streamId, const char* payload,
+                                  size_t length, Timestamp receiveTime)
+{
+  if (expectContinuation_ && type != kContinuation)
+  {
+    return kProtocolError;
+  }
+  if (state_ == kExpectSettings)
+  {
+    if (type != kSettings || (flags & kAck))
+    {
+      return kProtocolError;
+    }
+    state_ = kOpen;
+  }
+
+  uint32_t error = kNoError;
+  switch (type)
+  {
+    case kData:
+      error = onData(output, flags, streamId, payload, length);
+      break;
+    case kHeaders:
+      error = onHeaders(output, flags, streamId, payload, length, receiveTime);
+      break;
+    case kContinuation:
+      error = onContinuation(output, flags, streamId, payload, length, receiveTime);
+      break;
+    case kPriority:
+      if (streamId == 0)
+      {
+        error = kProtocolError;
+      }
+      else if (length != 5)
+      {
+        resetStream(output, streamId, kFrameSizeError);
+      }
+      break;
+    case kRstStream:
+      if (streamId == 0 || streamId > lastStreamId_)
+      {
+        error = kProtocolError;
+      }
+      else if (length != 4)
+      {
+        error = kFrameSizeError;
+      }
+      else
+      {
+        streams_.erase(streamId);
+      }
+      break;
+    case kSettings:
+      error = onSettings(output, flags, streamId, payload, length);
+      break;
+    case kPushPromise:
+      // clients never push
+      error = kProtocolError;
+      break;
+    case kPing:
+      if (streamId != 0)
+      {
+        error = kProtocolError;
+      }
+      else if (length != 8)
+      {
+        error = kFrameSizeError;
+      }
+      else if (!(flags & kAck))
+      {
+        appendFrameHeader(output, 8, kPing, kAck, 0);
+        output->append(payload, 8);
+      }
+      break;
+    case kGoAway:
+      if (streamId != 0)
+      {
+        error = kProtocolError;
+      }
+      else
+      {
+        // finishes the streams we have, then closes
+        goAwayReceived_ = true;
+      }
+      break;
+    case kWindowUpdate:
+      error = onWindowUpdate(output, streamId, payload, length);
+      break;
+    default:
+      // ignores unknown frame types
+      break;
+  }
+  return error;
+}
+
+uint32_t Http2Connection::onData(Buffer* output, uint8_t flags, uint32_t streamId,
+                                 const char* payload, size_t length)
+{
+  if (streamId == 0)
+  {
+    return kProtocolError;
+  }
+  // flow control counts the padding as well
+  int64_t flowControlled = static_cast<int64_t>(length);
+  if (flowControlled > recvWindow_)
+  {
+    return kFlowControlError;
+  }
+  recvWindow_ -= flowControlled;
+  if (!stripPadding(flags, &payload, &length))
+  {
+    return kProtocolError;
+  }
+
+  StreamMap::iterator it = streams_.find(streamId);
+  if (it == streams_.end() || it->second.endStream)
+  {
+    if (streamId > lastStreamId_)
+    {
+      return kProtocolError;
+    }
+    resetStream(output, streamId, kStreamClosed);
+  }
+  else if (flowControlled > it->second.recvWindow)
+  {
+    resetStream(output, streamId, kFlowControlError);
+  }
+  else if (it->second.request.body().size() + length > kMaxBodySize)
+  {
+    LOG_WARN << "Http2Connection - request body too large on stream " << streamId;
+    resetStream(output, streamId, kCancel);
+  }
+  else
+  {
+    Stream& stream = it->second;
+    stream.recvWindow -= flowControlled;
+    stream.request.appendBody(payload, payload + length);
+    if (flags & kEndStream)
+    {
+      stream.endStream = true;
+      dispatch(output, it);
+    }
+    else if (stream.recvWindow < kLocalWindow / 2)
+    {
+      appendWindowUpdate(output, streamId, kLocalWindow - stream.recvWindow);
+      stream.recvWindow = kLocalWindow;
+    }
+  }
+  replenishWindow(output);
+  return kNoError;
+}
+
+uint32_t Http2Connection::onHeaders(Buffer* output, uint8_t flags, uint32_t streamId,
+                                    const char* payload, size_t length,
+                                    Timestamp receiveTime)
+{
+  if (streamId == 0)
+  {
+    return kProtocolError;
+  }
+  if (!stripPadding(flags, &payload, &length))
+  {
+    return kProtocolError;
+  }
+  if (flags & kPriorityFlag)
+  {
+    // stream dependency and weight, we don't prioritize
+    if (length < 5)
+    {
+      return kFrameSizeError;
+    }
+    payload += 5;
+    length -= 5;
+  }
+  headerBlock_.assign(payload, length);
+  headerStreamId_ = streamId;
+  headerEndStream_ = (flags & kEndStream) != 0;
+  if (flags & kEndHeaders)
+  {
+    return onHeaderBlock(output, receiveTime);
+  }
+  expectContinuation_ = true;
+  return kNoError;
+}
+
+uint32_t Http2Connection::onContinuation(Buffer* output, uint8_t flags,
+                                         uint32_t streamId, const char* payload,
+                                         size_t length, Timestamp receiveTime)
+{
+  if (!expectContinuation_ || streamId != headerStreamId_)
+  {
+    return kProtocolError;
+  }
+  if (headerBlock_.size() + length > kMaxHeaderBlock)
+  {
+    return kEnhanceYourCalm;
+  }
+  headerBlock_.append(payload, length);
+  if (flags & kEndHeaders)
+  {
+    expectContinuation_ = false;
+    return onHeaderBlock(output, receiveTime);
+  }
+  return kNoError;
+}
+
+uint32_t Http2Connection::onHeaderBlock(Buffer* output, Timestamp receiveTime)
+{
+  // decodes every block, to keep the dynamic table in sync, a block whose
+  // fields are over kMaxHeaderList leaves it out of sync, so it closes the
+  // connection too.
+  hpack::HeaderList headers;
+  if (!decoder_.decode(headerBlock_.data(), headerBlock_.size(), &headers))
+  {
+    return kCompressionError;
+  }
+
+  const uint32_t streamId = headerStreamId_;
+  StreamMap::iterator it = streams_.find(streamId);
+  if (it != streams_.end())
+  {
+    // trailers, which we ignore
+    if (it->second.endStream)
+    {
+      resetStream(output, streamId, kStreamClosed);
+      return kNoError;
+    }
+    if (!headerEndStream_)
+    {
+      return kProtocolError;
+    }
+    it->second.endStream = true;
+    dispatch(output, it);
+    return kNoError;
+  }
+
+  if ((streamId & 1) == 0)
+  {
+    return kProtocolError;
+  }
+  if (streamId <= lastStreamId_)
+  {
+    return kStreamClosed;
+  }
+  lastStreamId_ = streamId;
+  if (goAwayReceived_ || streams_.size() >= kMaxConcurrentStreams)
+  {
+    resetStream(output, streamId, kRefusedStream);
+    return kNoError;
+  }
+
+  Stream& stream = streams_[streamId];
+  stream.sendWindow = peerInitialWindow_;
+  stream.recvWindow = kLocalWindow;
+  if (!fillRequest(headers, &stream.request))
+  {
+    resetStream(output, streamId, kProtocolError);
+    return kNoError;
+  }
+  stream.request.setReceiveTime(receiveTime);
+  if (headerEndStream_)
+  {
+    stream.endStream = true;
+    dispatch(output, streams_.find(streamId));
+  }
+  return kNoError;
+}
+
+uint32_t Http2Connection::onSettings(Buffer* output, uint8_t flags, uint32_t streamId,
+                                     const char* payload, size_t length)
+{
+  if (streamId != 0)
+  {
+    return kProtocolError;
+  }
+  if (flags & kAck)
+  {
+    return length == 0 ? kNoError : kFrameSizeError;
+  }
+  if (length % 6 != 0)
+  {
+    return kFrameSizeError;
+  }
+  uint32_t error = applySettings(payload, length);
+  if (error == kNoError)
+  {
+    appendFrameHeader(output, 0, kSettings, kAck, 0);
+    // SETTINGS_INITIAL_WINDOW_SIZE may open stream windows
+    sendPendingData(output);
+  }
+  return error;
+}
+
+uint32_t Http2Connection::applySettings(const char* payload, size_t length)
+{
+  for (size_t i = 0; i + 6 <= length; i += 6)
+  {
+    uint16_t id = readUint16(payload + i);
+    uint32_t value = readUint32(payload + i + 2);
+    switch (id)
+    {
+      case kSettingsHeaderTableSize:
+        encoder_.setMaxTableSize(value);
+        break;
+      case kSettingsEnablePush:
+        if (value > 1)
+        {
+          return kProtocolError;
+        }
+        break;
+      case kSettingsInitialWindowSize:
+        {
+          if (value > kMaxWindow)
+          {
+            return kFlowControlError;
+          }
+          int64_t delta = static_cast<int64_t>(value) - peerInitialWindow_;
+          for (StreamMap::iterator it = streams_.begin(); it != streams_.end(); ++it)
+          {
+            it->second.sendWindow += delta;
+            if (it->second.sendWindow > kMaxWindow)
+            {
+              return kFlowControlError;
+            }
+          }
+          peerInitialWindow_ = value;
+        }
+        break;
+      case kSettingsMaxFrameSize:
+        if (value < kMaxFrameSize || value > 0xffffff)
+        {
+          return kProtocolError;
+        }
+        peerMaxFrameSize_ = value;
+        break;
+      default:
+        // we never push, and our responses have few headers
+        break;
+    }
+  }
+  return kNoError;
+}
+
+uint32_t Http2Connection::onWindowUpdate(Buffer* output, uint32_t streamId,
+                                         const char* payload, size_t length)
+{
+  if (length != 4)
+  {
+    return kFrameSizeError;
+  }
+  int64_t increment = readUint32(payload) & 0x7fffffff;
+  if (streamId == 0)
+  {
+    if (increment == 0)
+    {
+      return kProtocolError;
+    }
+    sendWindow_ += increment;
+    if (sendWindow_ > kMaxWindow)
+    {
+      return kFlowControlError;
+    }
+    sendPendingData(output);
+    return kNoError;
+  }
+
+  StreamMap::iterator it = streams_.find(streamId);
+  if (it == streams_.end())
+  {
+    return streamId > lastStreamId_ ? kProtocolError : kNoError;
+  }
+  Stream& stream = it->second;
+  stream.sendWindow += increment;
+  if (increment == 0)
+  {
+    resetStream(output, streamId, kProtocolError);
+  }
+  else if (stream.sendWindow > kMaxWindow)
+  {
+    resetStream(output, streamId, kFlowControlError);
+  }
+  else if (stream.responding && sendData(output, streamId, &stream))
+  {
+    streams_.erase(it);
+  }
+  return kNoError;
+}
+
+void Http2Connection::dispatch(Buffer* output, StreamMap::iterator it)
+{
+  const uint32_t streamId = it->first;
+  Stream& stream = it->second;
+  const HttpRequest& req = stream.request;
+  HttpResponse response(false);
+  if (req.method() == HttpRequest::kInvalid)
+  {
+    response.setStatusCode(HttpResponse::k400BadRequest);
+    response.setStatusMessage("Bad Request");
+  }
+  else
+  {
+    httpCallback_(req, &response);
+  }
+
+  encoded_.clear();
+  encoder_.startBlock(&encoded_);
+  int code = response.statusCode();
+  char buf[32];
+  snprintf(buf, sizeof buf, "%d", code >= 100 && code <= 999 ? code : 500);
+  encoder_.encode(":status", buf, &encoded_);
+  const std::vector<std::pair<string, string> >& headers = response.headers();
+  bool hasContentLength = false;
+  string name;
+  for (size_t i = 0; i < headers.size(); ++i)
+  {
+    name = headers[i].first;
+    for (size_t j = 0; j < name.size(); ++j)
+    {
+      if (name[j] >= 'A' && name[j] <= 'Z')
+      {
+        name[j] = static_cast<char>(name[j] - 'A' + 'a');
+      }
+    }
+    if (isConnectionSpecific(name))
+    {
+      continue;
+    }
+    hasContentLength = hasContentLength || name == "content-length";
+    encoder_.encode(name, headers[i].second, &encoded_);
+  }
+  if (!hasContentLength)
+  {
+    snprintf(buf, sizeof buf, "%zu", response.body().size());
+    encoder_.encode("content-length", buf, &encoded_);
+  }
+  encoder_.encode("date", detail::formatHttpDate(req.receiveTime().secondsSinceEpoch()),
+                  &encoded_);
+
+  // HEADERS, then CONTINUATION if the block is larger than a frame
+  const bool noBody = response.body().empty() || req.method() == HttpRequest::kHead;
+  size_t offset = 0;
+  do
+  {
+    size_t len = encoded_.size() - offset;
+    if (len > peerMaxFrameSize_)
+    {
+      len = peerMaxFrameSize_;
+    }
+    uint8_t flags = offset + len == encoded_.size() ? kEndHeaders : 0;
+    if (offset == 0 && noBody)
+    {
+      flags |= kEndStream;
+    }
+    appendFrameHeader(output, len, offset == 0 ? kHeaders : kContinuation,
+                      flags, streamId);
+    output->append(encoded_.data() + offset, len);
+    offset += len;
+  } while (offset < encoded_.size());
+
+  if (noBody)
+  {
+    streams_.erase(it);
+  }
+  else
+  {
+    response.swapBody(&stream.body);
+    stream.responding = true;
+    if (sendData(output, streamId, &stream))
+    {
+      streams_.erase(it);
+    }
+  }
+}
+
+bool Http2Connection::sendData(Buffer* output, uint32_t streamId, Stream* stream)
+{
+  assert(stream->responding);
+  while (stream->sent < stream->body.size())
+  {
+    int64_t window = sendWindow_ < stream->sendWindow ? sendWindow_ : stream->sendWindow;
+    if (window <= 0)
+    {
+      return false;
+    }
+    size_t len = stream->body.size() - stream->sent;
+    if (len > static_cast<size_t>(window))
+    {
+      len = static_cast<size_t>(window);
+    }
+    if (len > peerMaxFrameSize_)
+    {
+      len = peerMaxFrameSize_;
+    }
+    bool last = stream->sent + len == stream->body.size();
+    appendFrameHeader(output, len, kData, last ? kEndStream : 0, streamId);
+    output->append(stream->body.data() + stream->sent, len);
+    stream->sent += len;
+    sendWindow_ -= static_cast<int64_t>(len);
+    stream->sendWindow -= static_cast<int64_t>(len);
+  }
+  return true;
+}
+
+void Http2Connection::sendPendingData(Buffer* output)
+{
+  StreamMap::iterator it = streams_.begin();
+  while (it != streams_.end() && sendWindow_ > 0)
+  {
+    if (it->second.responding && sendData(output, it->first, &it->second))
+    {
+      streams_.erase(it++);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void Http2Connection::sendPreface(Buffer* output)
+{
+  appendFrameHeader(output, 3 * 6, kSettings, 0, 0);
+  appendSetting(output, kSettingsMaxConcurrentStreams, kMaxConcurrentStreams);
+  appendSetting(output, kSettingsInitialWindowSize, static_cast<uint32_t>(kLocalWindow));
+  appendSetting(output, kSettingsMaxHeaderListSize, static_cast<uint32_t>(kMaxHeaderList));
+  // the connection window is not a setting
+  appendWindowUpdate(output, 0, kLocalWindow - kDefaultWindow);
+}
+
+void Http2Connection::resetStream(Buffer* output, uint32_t streamId, uint32_t error)
+{
+  appendFrameHeader(output, 4, kRstStream, 0, streamId);
+  appendUint32(output, error);
+  streams_.erase(streamId);
+}
+
+void Http2Connection::connectionError(Buffer* output, uint32_t error)
+{
+  LOG_ERROR << "Http2Connection - connection error " << error
+            << " last stream " << lastStreamId_;
+  appendFrameHeader(output, 8, kGoAway, 0, 0);
+  appendUint32(output, lastStreamId_);
+  appendUint32(output, error);
+  state_ = kClosed;
+}
+
+void Http2Connection::replenishWindow(Buffer* output)
+{
+  if (recvWindow_ < kLocalWindow / 2)
+  {
+    appendWindowUpdate(output, 0, kLocalWindow - recvWindow_);
+    recvWindow_ = kLocalWindow;
+  }
+}
@@ -0,0 +1,142 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HTTP2CONNECTION_H
+#define MUDUO_NET_HTTP_HTTP2CONNECTION_H
+
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/http/Hpack.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpServer.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+
+namespace muduo
+{
+namespace net
+{
+
+/// Server side of a cleartext HTTP/2 connection (h2c), RFC 7540.
+///
+/// Requests of all streams go to the same HttpCallback as HTTP/1.1 ones.
+/// Header names are turned into the usual HTTP/1.1 spelling, eg.
+/// "content-type" to "Content-Type", and :authority to Host.
+/// Response bodies wait in their streams while flow control windows are
+/// closed, and are sent when WINDOW_UPDATE or SETTINGS opens them.
+///
+/// Lives in the context of a TcpConnection, all calls are in its loop.
+class Http2Connection : boost::noncopyable
+{
+ public:
+  explicit Http2Connection(const HttpServer::HttpCallback& cb);
+  ~Http2Connection();
+
+  /// Whether buf is the beginning of the client connection preface,
+  /// ie. the client has prior knowledge of HTTP/2.
+  static bool startsWithPreface(const Buffer& buf);
+  static const size_t kPrefaceLength = 24;
+
+  /// Sends the server connection preface.
+  void start(const TcpConnectionPtr& conn);
+
+  /// Switches from HTTP/1.1 with "Upgrade: h2c", sends 101 and the server
+  /// connection preface, then responds to req on stream 1.
+  /// settings is the value of HTTP2-Settings header,
+  /// returns false without sending anything if it is malformed.
+  bool upgrade(const TcpConnectionPtr& conn,
+               const string& settings,
+               const HttpRequest& req);
+
+  void onMessage(const TcpConnectionPtr& conn,
+                 Buffer* buf,
+                 Timestamp receiveTime);
+
+ private:
+  enum State
+  {
+    kExpectPreface,
+    kExpectSettings,
+    kOpen,
+    kClosed,
+  };
+
+  struct Stream
+  {
+    Stream()
+      : sendWindow(0),
+        recvWindow(0),
+        endStream(false),
+        responding(false),
+        sent(0)
+    {
+    }
+
+    HttpRequest request;
+    int64_t sendWindow;
+    int64_t recvWindow;
+    bool endStream;   // half-closed (remote), request is complete
+    bool responding;  // headers sent, body is being sent
+    string body;
+    size_t sent;
+  };
+  typedef std::map<uint32_t, Stream> StreamMap;
+
+  uint32_t onFrame(Buffer* output, uint8_t type, uint8_t flags, uint32_t streamId,
+                   const char* payload, size_t length, Timestamp receiveTime);
+  uint32_t onData(Buffer* output, uint8_t flags, uint32_t streamId,
+                  const char* payload, size_t length);
+  uint32_t onHeaders(Buffer* output, uint8_t flags, uint32_t streamId,
+                     const char* payload, size_t length, Timestamp receiveTime);
+  uint32_t onContinuation(Buffer* output, uint8_t flags, uint32_t streamId,
+                          const char* payload, size_t length, Timestamp receiveTime);
+  uint32_t onHeaderBlock(Buffer* output, Timestamp receiveTime);
+  uint32_t onSettings(Buffer* output, uint8_t flags, uint32_t streamId,
+                      const char* payload, size_t length);
+  uint32_t onWindowUpdate(Buffer* output, uint32_t streamId,
+                          const char* payload, size_t length);
+  uint32_t applySettings(const char* payload, size_t length);
+
+  void dispatch(Buffer* output, StreamMap::iterator it);
+  // returns true if the whole body is sent
+  bool sendData(Buffer* output, uint32_t streamId, Stream* stream);
+  void sendPendingData(Buffer* output);
+  void sendPreface(Buffer* output);
+  void resetStream(Buffer* output, uint32_t streamId, uint32_t error);
+  void connectionError(Buffer* output, uint32_t error);
+  void replenishWindow(Buffer* output);
+
+  HttpServer::HttpCallback httpCallback_;
+  State state_;
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  StreamMap streams_;
+  uint32_t lastStreamId_;
+  // a header block of HEADERS and CONTINUATION frames
+  string headerBlock_;
+  uint32_t headerStreamId_;
+  bool headerEndStream_;
+  bool expectContinuation_;
+  string encoded_;
+  int64_t sendWindow_;
+  int64_t recvWindow_;
+  int64_t peerInitialWindow_;
+  size_t peerMaxFrameSize_;
+  bool goAwayReceived_;
+};
+
+typedef boost::shared_ptr<Http2Connection> Http2ConnectionPtr;
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTP2CONNECTION_H
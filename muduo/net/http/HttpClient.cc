@@ -0,0 +1,585 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpClient.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/http/HttpClientContext.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <deque>
+#include <vector>
+
+#include <strings.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// A request waiting in its Host, or in flight on a Connection.
+struct HttpClient::Call : boost::noncopyable
+{
+  Call()
+    : head(false),
+      idempotent(true),
+      retried(false),
+      done(false),
+      host(NULL),
+      conn(NULL)
+  {
+  }
+
+  string message;
+  bool head;
+  bool idempotent;
+  bool retried;
+  bool done;
+  ResponseCallback cb;
+  BodyCallback bodyCb;
+  TimerId timer;
+  Host* host;
+  Connection* conn;  // NULL if waiting
+};
+
+// A keep-alive connection to a Host, responses come back in the order of
+// inflight_.
+class HttpClient::Connection : boost::noncopyable,
+                               public boost::enable_shared_from_this<Connection>
+{
+ public:
+  Connection(HttpClient* owner, Host* host, const InetAddress& serverAddr)
+    : owner_(owner),
+      host_(host),
+      client_(owner->loop_, serverAddr, owner->name_),
+      closing_(false),
+      removed_(false),
+      responses_(0)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Connection::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&Connection::onMessage, this, _1, _2, _3));
+  }
+
+  ~Connection()
+  {
+    // owner_ and host_ may be gone, TcpClient closes the connection.
+    if (conn_)
+    {
+      conn_->setConnectionCallback(defaultConnectionCallback);
+      conn_->setMessageCallback(defaultMessageCallback);
+      conn_.reset();
+    }
+  }
+
+  void connect()
+  {
+    client_.connect();
+  }
+
+  bool connecting() const
+  { return !conn_ && !closing_; }
+
+  bool available() const
+  {
+    return conn_ && !closing_
+        && inflight_.size() < static_cast<size_t>(owner_->pipelineDepth_);
+  }
+
+  size_t inflight() const
+  { return inflight_.size(); }
+
+  void send(const CallPtr& call)
+  {
+    assert(available());
+    if (inflight_.empty())
+    {
+      context_.reset(call->head);
+    }
+    call->conn = this;
+    inflight_.push_back(call);
+    conn_->send(call->message);
+  }
+
+  // in flight requests fail when the connection is closed
+  void close()
+  {
+    closing_ = true;
+    if (conn_)
+    {
+      conn_->forceClose();
+    }
+    else
+    {
+      onClosed();
+    }
+  }
+
+  // one timer of each connection, restarted whenever it turns idle
+  void startIdleTimer()
+  {
+    idleSince_ = Timestamp::now();
+    if (owner_->idleTimeout_ > 0)
+    {
+      owner_->loop_->cancel(idleTimer_);
+      idleTimer_ = owner_->loop_->runAfter(owner_->idleTimeout_,
+          boost::bind(&HttpClient::onIdleTimeout, boost::weak_ptr<Connection>(shared_from_this())));
+    }
+  }
+
+  void checkIdle()
+  {
+    if (conn_ && inflight_.empty()
+        && timeDifference(Timestamp::now(), idleSince_) >= owner_->idleTimeout_)
+    {
+      LOG_DEBUG << conn_->name() << " idle";
+      close();
+    }
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn);
+  void onMessage(const TcpConnectionPtr& conn,
+                 Buffer* buf,
+                 Timestamp receiveTime);
+  void onClosed();
+  void fail(const CallPtr& call, Error error);
+
+  HttpClient* owner_;
+  Host* host_;
+  TcpClient client_;
+  TcpConnectionPtr conn_;
+  std::deque<CallPtr> inflight_;
+  HttpClientContext context_;
+  bool closing_;   // no more requests on it
+  bool removed_;
+  int64_t responses_;
+  Timestamp idleSince_;
+  TimerId idleTimer_;
+};
+
+// Requests to one server address, and the connections to it.
+class HttpClient::Host : boost::noncopyable
+{
+ public:
+  Host(HttpClient* owner, const InetAddress& serverAddr)
+    : owner_(owner),
+      serverAddr_(serverAddr)
+  {
+  }
+
+  void add(const CallPtr& call)
+  {
+    waiting_.push_back(call);
+    dispatch();
+  }
+
+  // puts back requests which the server has not responded
+  void retry(const CallPtr& call)
+  {
+    call->conn = NULL;
+    call->retried = true;
+    waiting_.push_front(call);
+  }
+
+  HttpClient* owner() const
+  { return owner_; }
+
+  void dispatch();
+  void remove(Connection* conn);
+
+ private:
+  HttpClient* owner_;
+  InetAddress serverAddr_;
+  std::deque<CallPtr> waiting_;
+  std::vector<ConnectionPtr> connections_;
+};
+
+namespace
+{
+
+template<typename T>
+void release(const boost::shared_ptr<T>&)
+{
+}
+
+void appendHeader(string* message, const string& field, const string& value)
+{
+  message->append(field);
+  message->append(": ");
+  message->append(value);
+  message->append("\r\n");
+}
+
+}
+
+void HttpClient::Connection::onConnection(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn_ = conn;
+    conn->setTcpNoDelay(true);
+    host_->dispatch();
+    if (inflight_.empty())
+    {
+      startIdleTimer();
+    }
+  }
+  else
+  {
+    conn_.reset();
+    closing_ = true;
+    onClosed();
+  }
+}
+
+void HttpClient::Connection::onMessage(const TcpConnectionPtr& conn,
+                                       Buffer* buf,
+                                       Timestamp)
+{
+  while (!inflight_.empty())
+  {
+    CallPtr call = inflight_.front();
+    if (!context_.parseResponse(buf, call->bodyCb))
+    {
+      LOG_ERROR << conn->name() << " bad response";
+      inflight_.pop_front();
+      fail(call, kBadResponse);
+      close();
+      return;
+    }
+    if (!context_.gotAll())
+    {
+      break;
+    }
+
+    inflight_.pop_front();
+    ++responses_;
+    if (!context_.keepAlive())
+    {
+      closing_ = true;
+    }
+    Response resp;
+    resp.swap(context_.response());
+    if (!inflight_.empty())
+    {
+      context_.reset(inflight_.front()->head);
+    }
+    if (!call->done)
+    {
+      owner_->finish(call, &resp);
+    }
+  }
+
+  if (!conn_)
+  {
+    // closed in a callback
+    return;
+  }
+  if (inflight_.empty() && buf->readableBytes() > 0)
+  {
+    LOG_ERROR << conn->name() << " unexpected response";
+    buf->retrieveAll();
+    close();
+  }
+  else if (closing_)
+  {
+    close();
+  }
+  else
+  {
+    if (inflight_.empty())
+    {
+      startIdleTimer();
+    }
+    host_->dispatch();
+  }
+}
+
+void HttpClient::Connection::onClosed()
+{
+  if (removed_)
+  {
+    return;
+  }
+  removed_ = true;
+  // keep this alive until the end of this function
+  ConnectionPtr guard(shared_from_this());
+  owner_->loop_->cancel(idleTimer_);
+
+  std::vector<CallPtr> retries;
+  bool first = true;
+  while (!inflight_.empty())
+  {
+    CallPtr call = inflight_.front();
+    inflight_.pop_front();
+    if (!call->done)
+    {
+      if (first && context_.parseEof())
+      {
+        // the body ended with the connection
+        Response resp;
+        resp.swap(context_.response());
+        owner_->finish(call, &resp);
+      }
+      else if ((!first || context_.expectStatusLine())
+               && responses_ > 0 && call->idempotent && !call->retried)
+      {
+        // a reused connection was closed before the server saw the request,
+        // eg. it timed out the idle connection at the same time.
+        retries.push_back(call);
+      }
+      else
+      {
+        fail(call, kConnectionClosed);
+      }
+    }
+    first = false;
+  }
+  for (size_t i = retries.size(); i > 0; --i)
+  {
+    host_->retry(retries[i-1]);
+  }
+  host_->remove(this);
+}
+
+void HttpClient::Connection::fail(const CallPtr& call, Error error)
+{
+  if (!call->done)
+  {
+    Response resp;
+    resp.setError(error);
+    owner_->finish(call, &resp);
+  }
+}
+
+void HttpClient::Host::dispatch()
+{
+  while (!waiting_.empty())
+  {
+    if (waiting_.front()->done)
+    {
+      waiting_.pop_front();
+      continue;
+    }
+
+    Connection* best = NULL;
+    size_t connecting = 0;
+    for (size_t i = 0; i < connections_.size(); ++i)
+    {
+      Connection* conn = get_pointer(connections_[i]);
+      if (conn->available())
+      {
+        if (!best || conn->inflight() < best->inflight())
+        {
+          best = conn;
+        }
+      }
+      else if (conn->connecting())
+      {
+        ++connecting;
+      }
+    }
+
+    if (best)
+    {
+      CallPtr call = waiting_.front();
+      waiting_.pop_front();
+      best->send(call);
+    }
+    else if (connections_.size() < static_cast<size_t>(owner_->maxConnectionsPerHost_)
+             && waiting_.size() > connecting * owner_->pipelineDepth_)
+    {
+      ConnectionPtr conn(new Connection(owner_, this, serverAddr_));
+      connections_.push_back(conn);
+      conn->connect();
+      if (owner_->timeout_ > 0)
+      {
+        owner_->loop_->runAfter(owner_->timeout_,
+            boost::bind(&HttpClient::onConnectTimeout, boost::weak_ptr<Connection>(conn)));
+      }
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+void HttpClient::Host::remove(Connection* conn)
+{
+  for (size_t i = 0; i < connections_.size(); ++i)
+  {
+    if (get_pointer(connections_[i]) == conn)
+    {
+      // TcpClient can not be destroyed in its own callbacks
+      owner_->loop_->queueInLoop(boost::bind(&release<Connection>, connections_[i]));
+      connections_.erase(connections_.begin() + i);
+      break;
+    }
+  }
+  dispatch();
+}
+
+HttpClient::HttpClient(EventLoop* loop, const string& name)
+  : loop_(CHECK_NOTNULL(loop)),
+    name_(name),
+    maxConnectionsPerHost_(8),
+    pipelineDepth_(1),
+    timeout_(30.0),
+    idleTimeout_(60.0)
+{
+}
+
+HttpClient::~HttpClient()
+{
+  // pending requests are dropped silently, their timers find them gone.
+}
+
+void HttpClient::request(const InetAddress& server,
+                         const HttpRequest& req,
+                         const ResponseCallback& cb,
+                         const BodyCallback& bodyCb)
+{
+  CallPtr call(new Call);
+  call->head = req.method() == HttpRequest::kHead;
+  call->idempotent = req.method() != HttpRequest::kPost;
+  call->cb = cb;
+  call->bodyCb = bodyCb;
+
+  string& message = call->message;
+  message.reserve(128 + req.path().size() + req.query().size() + req.body().size());
+  message.append(req.methodString());
+  message.append(" ");
+  message.append(req.path().empty() ? "/" : req.path());
+  message.append(req.query());
+  message.append(" HTTP/1.1\r\n");
+
+  bool hasHost = false;
+  bool hasContentLength = false;
+  const std::map<string, string>& headers = req.headers();
+  for (std::map<string, string>::const_iterator it = headers.begin();
+       it != headers.end();
+       ++it)
+  {
+    hasHost = hasHost || strcasecmp(it->first.c_str(), "Host") == 0;
+    hasContentLength = hasContentLength
+        || strcasecmp(it->first.c_str(), "Content-Length") == 0;
+    appendHeader(&message, it->first, it->second);
+  }
+  if (!hasHost)
+  {
+    appendHeader(&message, "Host", server.toIpPort());
+  }
+  if (!hasContentLength
+      && (!req.body().empty()
+          || req.method() == HttpRequest::kPost
+          || req.method() == HttpRequest::kPut))
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%zu", req.body().size());
+    appendHeader(&message, "Content-Length", buf);
+  }
+  message.append("\r\n");
+  message.append(req.body());
+
+  loop_->runInLoop(
+      boost::bind(&HttpClient::requestInLoop, this, server, call));
+}
+
+void HttpClient::get(const InetAddress& server,
+                     const string& path,
+                     const ResponseCallback& cb)
+{
+  HttpRequest req;
+  req.setMethod(HttpRequest::kGet);
+  size_t question = path.find('?');
+  if (question != string::npos)
+  {
+    req.setPath(path.data(), path.data() + question);
+    req.setQuery(path.data() + question, path.data() + path.size());
+  }
+  else
+  {
+    req.setPath(path.data(), path.data() + path.size());
+  }
+  request(server, req, cb);
+}
+
+void HttpClient::requestInLoop(const InetAddress& server, const CallPtr& call)
+{
+  loop_->assertInLoopThread();
+  HostPtr& host = hosts_[server.toIpPort()];
+  if (!host)
+  {
+    host.reset(new Host(this, server));
+  }
+  call->host = get_pointer(host);
+  if (timeout_ > 0)
+  {
+    call->timer = loop_->runAfter(timeout_,
+        boost::bind(&HttpClient::onTimeout, boost::weak_ptr<Call>(call)));
+  }
+  host->add(call);
+}
+
+void HttpClient::finish(const CallPtr& call, Response* resp)
+{
+  assert(!call->done);
+  call->done = true;
+  call->conn = NULL;
+  if (timeout_ > 0)
+  {
+    loop_->cancel(call->timer);
+  }
+  if (call->cb)
+  {
+    call->cb(*resp);
+  }
+}
+
+void HttpClient::onTimeout(const boost::weak_ptr<Call>& wkCall)
+{
+  CallPtr call(wkCall.lock());
+  if (call && !call->done)
+  {
+    Connection* conn = call->conn;
+    HttpClient* owner = call->host->owner();
+    Response resp;
+    resp.setError(kTimeout);
+    owner->finish(call, &resp);
+    if (conn)
+    {
+      // responses after this one can not be told apart
+      conn->close();
+    }
+  }
+}
+
+void HttpClient::onConnectTimeout(const boost::weak_ptr<Connection>& wkConn)
+{
+  ConnectionPtr conn(wkConn.lock());
+  if (conn && conn->connecting())
+  {
+    conn->close();
+  }
+}
+
+void HttpClient::onIdleTimeout(const boost::weak_ptr<Connection>& wkConn)
+{
+  ConnectionPtr conn(wkConn.lock());
+  if (conn)
+  {
+    conn->checkIdle();
+  }
+}
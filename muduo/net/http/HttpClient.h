@@ -0,0 +1,195 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENT_H
+#define MUDUO_NET_HTTP_HTTPCLIENT_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/InetAddress.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+class HttpRequest;
+
+/// An asynchronous HTTP/1.1 client.
+///
+/// Keeps a pool of keep-alive connections per server address, and
+/// optionally pipelines requests on them.  Responses are parsed with
+/// Content-Length, chunked, or read-until-close bodies, and handed to the
+/// callback in the loop thread, bodies may be streamed piece by piece.
+///
+/// Each HttpClient belongs to one EventLoop, use one per IO thread to fan
+/// out from a multi-threaded server.
+class HttpClient : boost::noncopyable
+{
+ public:
+  enum Error
+  {
+    kNoError,
+    kTimeout,
+    kConnectionClosed,  // before the whole response arrives
+    kBadResponse,
+  };
+
+  class Response : public muduo::copyable
+  {
+   public:
+    Response()
+      : error_(kNoError),
+        statusCode_(0)
+    {
+    }
+
+    Error error() const
+    { return error_; }
+
+    void setError(Error error)
+    { error_ = error; }
+
+    int statusCode() const
+    { return statusCode_; }
+
+    void setStatusCode(int code)
+    { statusCode_ = code; }
+
+    const string& statusMessage() const
+    { return statusMessage_; }
+
+    void setStatusMessage(const char* start, const char* end)
+    { statusMessage_.assign(start, end); }
+
+    void addHeader(const string& field, const string& value)
+    { headers_[field] = value; }
+
+    string getHeader(const string& field) const
+    {
+      string result;
+      std::map<string, string>::const_iterator it = headers_.find(field);
+      if (it != headers_.end())
+      {
+        result = it->second;
+      }
+      return result;
+    }
+
+    const std::map<string, string>& headers() const
+    { return headers_; }
+
+    /// Empty if the body is streamed to a BodyCallback.
+    const string& body() const
+    { return body_; }
+
+    void appendBody(const char* data, size_t len)
+    { body_.append(data, len); }
+
+    void swap(Response& that)
+    {
+      std::swap(error_, that.error_);
+      std::swap(statusCode_, that.statusCode_);
+      statusMessage_.swap(that.statusMessage_);
+      headers_.swap(that.headers_);
+      body_.swap(that.body_);
+    }
+
+   private:
+    Error error_;
+    int statusCode_;
+    string statusMessage_;
+    std::map<string, string> headers_;
+    string body_;
+  };
+
+  /// Called once per request, with the whole response or an error.
+  typedef boost::function<void (const Response&)> ResponseCallback;
+  /// Called for each piece of the body, resp has status and headers.
+  typedef boost::function<void (const Response& resp,
+                                const char* data,
+                                size_t len)> BodyCallback;
+
+  HttpClient(EventLoop* loop, const string& name);
+  ~HttpClient();  // force out-line dtor, in the loop thread while it runs.
+
+  EventLoop* getLoop() const { return loop_; }
+
+  /// Not thread safe, be called before the first request.
+  void setMaxConnectionsPerHost(int n)
+  { maxConnectionsPerHost_ = n; }
+
+  /// Not thread safe, be called before the first request.
+  /// Up to depth requests are sent on a connection before their responses
+  /// come back.  Defaults to 1, ie. no pipelining.
+  void setPipelineDepth(int depth)
+  { pipelineDepth_ = depth; }
+
+  /// Not thread safe, be called before the first request.
+  /// A request fails with kTimeout if its response does not complete in
+  /// time, including waiting for and connecting a connection.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  /// Not thread safe, be called before the first request.
+  /// Keep-alive connections idle for this long are closed.
+  void setIdleTimeout(double seconds)
+  { idleTimeout_ = seconds; }
+
+  /// Thread safe, cb and bodyCb are called in the loop thread.
+  /// Sends req to server.  req carries method, path, query, headers and
+  /// body, a Host header is added if missing.
+  void request(const InetAddress& server,
+               const HttpRequest& req,
+               const ResponseCallback& cb,
+               const BodyCallback& bodyCb = BodyCallback());
+
+  /// Thread safe, shorthand for a GET request of path.
+  void get(const InetAddress& server,
+           const string& path,
+           const ResponseCallback& cb);
+
+ private:
+  struct Call;
+  class Connection;
+  class Host;
+  typedef boost::shared_ptr<Call> CallPtr;
+  typedef boost::shared_ptr<Connection> ConnectionPtr;
+  typedef boost::shared_ptr<Host> HostPtr;
+  typedef std::map<string, HostPtr> HostMap;
+
+  void requestInLoop(const InetAddress& server, const CallPtr& call);
+  void finish(const CallPtr& call, Response* resp);
+  static void onTimeout(const boost::weak_ptr<Call>& wkCall);
+  static void onConnectTimeout(const boost::weak_ptr<Connection>& wkConn);
+  static void onIdleTimeout(const boost::weak_ptr<Connection>& wkConn);
+
+  EventLoop* loop_;
+  const string name_;
+  int maxConnectionsPerHost_;
+  int pipelineDepth_;
+  double timeout_;
+  double idleTimeout_;
+  int nextConnId_;
+  HostMap hosts_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENT_H
@@ -0,0 +1,281 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/Buffer.h>
+#include <muduo/net/http/HttpClientContext.h>
+
+#include <algorithm>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <strings.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// a status line, header line or chunk size line longer than this is an error
+const size_t kMaxLineLength = 64 * 1024;
+
+string toLower(const string& str)
+{
+  string result(str);
+  for (size_t i = 0; i < result.size(); ++i)
+  {
+    result[i] = static_cast<char>(tolower(static_cast<unsigned char>(result[i])));
+  }
+  return result;
+}
+
+}
+
+bool HttpClientContext::processStatusLine(const char* begin, const char* end)
+{
+  // HTTP/1.1 200 OK
+  if (end - begin < 12
+      || !std::equal(begin, begin+7, "HTTP/1.")
+      || (begin[7] != '0' && begin[7] != '1')
+      || begin[8] != ' ')
+  {
+    return false;
+  }
+  http10_ = begin[7] == '0';
+  int code = 0;
+  for (const char* p = begin+9; p < begin+12; ++p)
+  {
+    if (!isdigit(static_cast<unsigned char>(*p)))
+    {
+      return false;
+    }
+    code = code * 10 + (*p - '0');
+  }
+  if (end - begin > 12 && begin[12] != ' ')
+  {
+    return false;
+  }
+  response_.setStatusCode(code);
+  response_.setStatusMessage(std::min(begin+13, end), end);
+  return true;
+}
+
+bool HttpClientContext::processHeader(const char* start, const char* colon, const char* end)
+{
+  string field(start, colon);
+  ++colon;
+  while (colon < end && isspace(*colon))
+  {
+    ++colon;
+  }
+  string value(colon, end);
+  while (!value.empty() && isspace(value[value.size()-1]))
+  {
+    value.resize(value.size()-1);
+  }
+
+  if (strcasecmp(field.c_str(), "Content-Length") == 0)
+  {
+    // must not guess the body length if it is malformed
+    if (value.empty()
+        || value.size() > 18
+        || value.find_first_not_of("0123456789") != string::npos)
+    {
+      return false;
+    }
+    hasContentLength_ = true;
+    remaining_ = static_cast<size_t>(strtoull(value.c_str(), NULL, 10));
+  }
+  else if (strcasecmp(field.c_str(), "Transfer-Encoding") == 0)
+  {
+    chunked_ = toLower(value).find("chunked") != string::npos;
+  }
+  else if (strcasecmp(field.c_str(), "Connection") == 0)
+  {
+    string tokens = toLower(value);
+    connectionClose_ = tokens.find("close") != string::npos;
+    connectionKeepAlive_ = tokens.find("keep-alive") != string::npos;
+  }
+  response_.addHeader(field, value);
+  return true;
+}
+
+bool HttpClientContext::processHeadersEnd()
+{
+  int code = response_.statusCode();
+  if (code >= 100 && code < 200 && code != 101)
+  {
+    // interim response, eg. 100 Continue, the real one follows
+    reset(headRequest_);
+    return true;
+  }
+
+  keepAlive_ = http10_ ? connectionKeepAlive_ : !connectionClose_;
+  if (headRequest_ || code == 204 || code == 304 || code == 101)
+  {
+    keepAlive_ = keepAlive_ && code != 101;
+    state_ = kGotAll;
+  }
+  else if (chunked_)
+  {
+    state_ = kExpectChunkSize;
+  }
+  else if (hasContentLength_)
+  {
+    state_ = remaining_ > 0 ? kExpectBody : kGotAll;
+  }
+  else
+  {
+    keepAlive_ = false;
+    state_ = kExpectClose;
+  }
+  return true;
+}
+
+bool HttpClientContext::processChunkSize(const char* begin, const char* end)
+{
+  // chunk-size [ chunk-ext ] CRLF
+  size_t size = 0;
+  const char* p = begin;
+  for (; p < end && isxdigit(static_cast<unsigned char>(*p)); ++p)
+  {
+    if (p - begin >= 15)
+    {
+      return false;
+    }
+    int digit = isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : (tolower(*p) - 'a' + 10);
+    size = size * 16 + static_cast<size_t>(digit);
+  }
+  if (p == begin || (p < end && *p != ';' && *p != ' ' && *p != '\t'))
+  {
+    return false;
+  }
+  remaining_ = size;
+  state_ = size > 0 ? kExpectChunkData : kExpectTrailers;
+  return true;
+}
+
+void HttpClientContext::deliverBody(const char* data, size_t len,
+                                    const HttpClient::BodyCallback& bodyCb)
+{
+  if (bodyCb)
+  {
+    bodyCb(response_, data, len);
+  }
+  else
+  {
+    response_.appendBody(data, len);
+  }
+}
+
+// return false if any error
+bool HttpClientContext::parseResponse(Buffer* buf, const HttpClient::BodyCallback& bodyCb)
+{
+  bool ok = true;
+  bool hasMore = true;
+  while (ok && hasMore)
+  {
+    if (state_ == kExpectStatusLine
+        || state_ == kExpectHeaders
+        || state_ == kExpectChunkSize
+        || state_ == kExpectTrailers)
+    {
+      const char* crlf = buf->findCRLF();
+      if (!crlf)
+      {
+        ok = buf->readableBytes() < kMaxLineLength;
+        hasMore = false;
+      }
+      else if (state_ == kExpectStatusLine)
+      {
+        ok = processStatusLine(buf->peek(), crlf);
+        state_ = kExpectHeaders;
+      }
+      else if (state_ == kExpectHeaders)
+      {
+        const char* colon = std::find(buf->peek(), crlf, ':');
+        if (colon != crlf)
+        {
+          ok = processHeader(buf->peek(), colon, crlf);
+        }
+        else if (buf->peek() == crlf)
+        {
+          // empty line, end of header
+          ok = processHeadersEnd();
+        }
+        else
+        {
+          ok = false;
+        }
+      }
+      else if (state_ == kExpectChunkSize)
+      {
+        ok = processChunkSize(buf->peek(), crlf);
+      }
+      else
+      {
+        // trailers are ignored
+        if (buf->peek() == crlf)
+        {
+          state_ = kGotAll;
+        }
+      }
+      if (ok && crlf)
+      {
+        buf->retrieveUntil(crlf + 2);
+      }
+    }
+    else if (state_ == kExpectBody || state_ == kExpectChunkData)
+    {
+      size_t n = std::min(remaining_, buf->readableBytes());
+      if (n > 0)
+      {
+        deliverBody(buf->peek(), n, bodyCb);
+        buf->retrieve(n);
+        remaining_ -= n;
+      }
+      if (remaining_ == 0)
+      {
+        state_ = state_ == kExpectBody ? kGotAll : kExpectChunkEnd;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectChunkEnd)
+    {
+      if (buf->readableBytes() >= 2)
+      {
+        ok = buf->peek()[0] == '\r' && buf->peek()[1] == '\n';
+        buf->retrieve(2);
+        state_ = kExpectChunkSize;
+      }
+      else
+      {
+        hasMore = false;
+      }
+    }
+    else if (state_ == kExpectClose)
+    {
+      if (buf->readableBytes() > 0)
+      {
+        deliverBody(buf->peek(), buf->readableBytes(), bodyCb);
+        buf->retrieveAll();
+      }
+      hasMore = false;
+    }
+    else
+    {
+      // kGotAll, leaves pipelined responses in buf
+      hasMore = false;
+    }
+  }
+  return ok;
+}
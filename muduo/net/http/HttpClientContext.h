@@ -0,0 +1,128 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+#define MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+
+#include <muduo/base/copyable.h>
+
+#include <muduo/net/http/HttpClient.h>
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+
+/// Parses HTTP/1.x responses, the client side sibling of HttpContext.
+class HttpClientContext : public muduo::copyable
+{
+ public:
+  enum HttpResponseParseState
+  {
+    kExpectStatusLine,
+    kExpectHeaders,
+    kExpectBody,         // Content-Length
+    kExpectChunkSize,
+    kExpectChunkData,
+    kExpectChunkEnd,
+    kExpectTrailers,
+    kExpectClose,        // body ends with the connection
+    kGotAll,
+  };
+
+  HttpClientContext()
+    : state_(kExpectStatusLine),
+      headRequest_(false),
+      keepAlive_(true),
+      http10_(false),
+      chunked_(false),
+      hasContentLength_(false),
+      connectionClose_(false),
+      connectionKeepAlive_(false),
+      remaining_(0)
+  {
+  }
+
+  // default copy-ctor, dtor and assignment are fine
+
+  // return false if any error
+  // Body goes to bodyCb if it is not empty, or to response().
+  bool parseResponse(Buffer* buf, const HttpClient::BodyCallback& bodyCb);
+
+  /// The connection has been closed by the server,
+  /// returns true if it completes the response.
+  bool parseEof()
+  {
+    if (state_ == kExpectClose)
+    {
+      state_ = kGotAll;
+    }
+    return gotAll();
+  }
+
+  bool gotAll() const
+  { return state_ == kGotAll; }
+
+  /// Whether nothing of the response has arrived.
+  bool expectStatusLine() const
+  { return state_ == kExpectStatusLine; }
+
+  /// Whether the connection can be reused after this response.
+  bool keepAlive() const
+  { return keepAlive_; }
+
+  /// Prepares for the response of next request,
+  /// which has no body if headRequest.
+  void reset(bool headRequest)
+  {
+    state_ = kExpectStatusLine;
+    headRequest_ = headRequest;
+    keepAlive_ = true;
+    http10_ = false;
+    chunked_ = false;
+    hasContentLength_ = false;
+    connectionClose_ = false;
+    connectionKeepAlive_ = false;
+    remaining_ = 0;
+    HttpClient::Response dummy;
+    response_.swap(dummy);
+  }
+
+  const HttpClient::Response& response() const
+  { return response_; }
+
+  HttpClient::Response& response()
+  { return response_; }
+
+ private:
+  bool processStatusLine(const char* begin, const char* end);
+  bool processHeader(const char* start, const char* colon, const char* end);
+  bool processHeadersEnd();
+  bool processChunkSize(const char* begin, const char* end);
+  void deliverBody(const char* data, size_t len, const HttpClient::BodyCallback& bodyCb);
+
+  HttpResponseParseState state_;
+  bool headRequest_;
+  bool keepAlive_;
+  bool http10_;
+  bool chunked_;
+  bool hasContentLength_;
+  bool connectionClose_;
+  bool connectionKeepAlive_;
+  size_t remaining_;
+  HttpClient::Response response_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
@@ -46,6 +46,9 @@ class HttpContext : public muduo::copyable
   bool gotAll() const
   { return state_ == kGotAll; }
 
+  bool expectRequestLine() const
+  { return state_ == kExpectRequestLine; }
+
   void reset()
   {
     state_ = kExpectRequestLine;
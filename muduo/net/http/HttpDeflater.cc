@@ -0,0 +1,288 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpDeflater.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/net/Buffer.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <strings.h>
+
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#include <zlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const int kChunkSize = 16 * 1024;
+const int kChunkSizeLen = 6;  // "4000\r\n", chunk-size may have leading zeros
+const int kMaxIdleStreams = 4;
+const int kMemLevel = 8;
+
+int windowBits(HttpDeflater::Coding coding)
+{
+  // 16 for gzip wrapper, zlib wrapper otherwise.
+  return coding == HttpDeflater::kGzip ? 15 + 16 : 15;
+}
+
+// Idle deflate states of one thread.
+class DeflatePool : boost::noncopyable
+{
+ public:
+  ~DeflatePool()
+  {
+    for (size_t i = 0; i < idle_.size(); ++i)
+    {
+      ::deflateEnd(idle_[i].zstream);
+      delete idle_[i].zstream;
+    }
+  }
+
+  z_stream* acquire(int bits, int level)
+  {
+    for (size_t i = 0; i < idle_.size(); ++i)
+    {
+      if (idle_[i].windowBits == bits && idle_[i].level == level)
+      {
+        z_stream* zs = idle_[i].zstream;
+        idle_.erase(idle_.begin() + i);
+        return zs;
+      }
+    }
+
+    z_stream* zs = new z_stream;
+    bzero(zs, sizeof *zs);
+    int error = ::deflateInit2(zs, level, Z_DEFLATED, bits, kMemLevel, Z_DEFAULT_STRATEGY);
+    if (error != Z_OK)
+    {
+      LOG_ERROR << "deflateInit2 " << error;
+      delete zs;
+      zs = NULL;
+    }
+    return zs;
+  }
+
+  void release(z_stream* zs, int bits, int level)
+  {
+    if (static_cast<int>(idle_.size()) < kMaxIdleStreams && ::deflateReset(zs) == Z_OK)
+    {
+      Entry entry = { bits, level, zs };
+      idle_.push_back(entry);
+    }
+    else
+    {
+      ::deflateEnd(zs);
+      delete zs;
+    }
+  }
+
+ private:
+  struct Entry
+  {
+    int windowBits;
+    int level;
+    z_stream* zstream;
+  };
+
+  std::vector<Entry> idle_;
+};
+
+typedef ThreadLocalSingleton<DeflatePool> ThreadDeflatePool;
+
+StringPiece trim(const char* begin, const char* end)
+{
+  while (begin < end && (*begin == ' ' || *begin == '\t'))
+  {
+    ++begin;
+  }
+  while (begin < end && (end[-1] == ' ' || end[-1] == '\t'))
+  {
+    --end;
+  }
+  return StringPiece(begin, static_cast<int>(end - begin));
+}
+
+bool equalsIgnoreCase(const StringPiece& lhs, const char* rhs)
+{
+  return lhs.size() == static_cast<int>(strlen(rhs))
+      && ::strncasecmp(lhs.data(), rhs, lhs.size()) == 0;
+}
+
+// "q=0", "q=0.0" and the like mean not acceptable.
+bool isZeroQuality(const StringPiece& param)
+{
+  if (param.size() < 3 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=')
+  {
+    return false;
+  }
+  for (int i = 2; i < param.size(); ++i)
+  {
+    if (param[i] != '0' && param[i] != '.')
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+HttpDeflater::Coding HttpDeflater::negotiate(const string& acceptEncoding, bool preferIdentity)
+{
+  // 1 accepted, 0 refused, -1 not given
+  int gzip = -1;
+  int deflate = -1;
+  int identity = -1;
+  int any = -1;
+  const char* p = acceptEncoding.data();
+  const char* end = p + acceptEncoding.size();
+  while (p < end)
+  {
+    const char* comma = std::find(p, end, ',');
+    const char* semicolon = std::find(p, comma, ';');
+    StringPiece coding = trim(p, semicolon);
+    int acceptable = semicolon == comma || !isZeroQuality(trim(semicolon + 1, comma));
+    if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip"))
+    {
+      gzip = acceptable;
+    }
+    else if (equalsIgnoreCase(coding, "deflate"))
+    {
+      deflate = acceptable;
+    }
+    else if (equalsIgnoreCase(coding, "identity"))
+    {
+      identity = acceptable;
+    }
+    else if (coding == "*")
+    {
+      any = acceptable;
+    }
+    p = comma == end ? end : comma + 1;
+  }
+
+  // "*" stands for the codings not given
+  const bool identityAcceptable = identity == 1 || (identity < 0 && any != 0);
+  if (preferIdentity && identityAcceptable)
+  {
+    return kIdentity;
+  }
+  if (gzip == 1 || (gzip < 0 && any == 1))
+  {
+    return kGzip;
+  }
+  if (deflate == 1 || (deflate < 0 && any == 1))
+  {
+    return kDeflate;
+  }
+  return identityAcceptable ? kIdentity : kNotAcceptable;
+}
+
+const char* HttpDeflater::codingName(Coding coding)
+{
+  const char* result = "identity";
+  switch (coding)
+  {
+    case kGzip:
+      result = "gzip";
+      break;
+    case kDeflate:
+      result = "deflate";
+      break;
+    default:
+      break;
+  }
+  return result;
+}
+
+HttpDeflater::HttpDeflater(Coding coding, int level, const StringPiece& input)
+  : coding_(coding),
+    level_(level),
+    zstream_(NULL),
+    finished_(false),
+    failed_(false)
+{
+  assert(coding_ == kGzip || coding_ == kDeflate);
+  zstream_ = ThreadDeflatePool::instance().acquire(windowBits(coding_), level_);
+  if (zstream_)
+  {
+    zstream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zstream_->avail_in = static_cast<uInt>(input.size());
+  }
+}
+
+HttpDeflater::~HttpDeflater()
+{
+  if (zstream_)
+  {
+    ThreadDeflatePool::instance().release(zstream_, windowBits(coding_), level_);
+  }
+}
+
+int64_t HttpDeflater::inputBytes() const
+{
+  return zstream_ ? static_cast<int64_t>(zstream_->total_in) : 0;
+}
+
+int64_t HttpDeflater::outputBytes() const
+{
+  return zstream_ ? static_cast<int64_t>(zstream_->total_out) : 0;
+}
+
+bool HttpDeflater::appendChunk(Buffer* output)
+{
+  assert(valid());
+  assert(!finished_);
+  output->ensureWritableBytes(kChunkSizeLen + kChunkSize + 2 + 5);
+  char* chunkSize = output->beginWrite();
+  output->hasWritten(kChunkSizeLen);
+
+  // deflate straight into output, then fill in chunk-size ahead of it.
+  zstream_->next_out = reinterpret_cast<Bytef*>(output->beginWrite());
+  zstream_->avail_out = kChunkSize;
+  int error = ::deflate(zstream_, Z_FINISH);
+  size_t len = kChunkSize - zstream_->avail_out;
+  if (len > 0)
+  {
+    static const char hex[] = "0123456789abcdef";
+    chunkSize[0] = hex[(len >> 12) & 0xF];
+    chunkSize[1] = hex[(len >> 8) & 0xF];
+    chunkSize[2] = hex[(len >> 4) & 0xF];
+    chunkSize[3] = hex[len & 0xF];
+    chunkSize[4] = '\r';
+    chunkSize[5] = '\n';
+    output->hasWritten(len);
+    output->append("\r\n", 2);
+  }
+  else
+  {
+    output->unwrite(kChunkSizeLen);
+  }
+
+  if (error == Z_STREAM_END)
+  {
+    output->append("0\r\n\r\n", 5);
+    finished_ = true;
+  }
+  else if (error != Z_OK)
+  {
+    // no last-chunk, the client must not take the body as whole
+    LOG_ERROR << "HttpDeflater::appendChunk - deflate " << error;
+    finished_ = true;
+    failed_ = true;
+  }
+  return !finished_;
+}
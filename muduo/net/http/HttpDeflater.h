@@ -0,0 +1,82 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HTTPDEFLATER_H
+#define MUDUO_NET_HTTP_HTTPDEFLATER_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+
+struct z_stream_s;
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+
+/// Compresses a response body into chunks of HTTP/1.1 chunked
+/// transfer coding.
+///
+/// The deflate state comes from a pool of the calling thread, and goes back
+/// there after deflateReset(), so responses do not pay for
+/// deflateInit2() and deflateEnd().
+class HttpDeflater : boost::noncopyable
+{
+ public:
+  enum Coding
+  {
+    kIdentity, kGzip, kDeflate,
+    kNotAcceptable,  // none of the above
+  };
+
+  /// Picks the coding from an Accept-Encoding header, gzip is preferred,
+  /// or identity if preferIdentity and it is acceptable.
+  /// A coding given with q=0 is refused, even if "*" accepts the rest,
+  /// identity is acceptable unless refused, by itself or by "*;q=0".
+  static Coding negotiate(const string& acceptEncoding, bool preferIdentity = false);
+
+  static const char* codingName(Coding coding);
+
+  /// level is a zlib compression level, -1 for the default.
+  HttpDeflater(Coding coding, int level, const StringPiece& input);
+  ~HttpDeflater();
+
+  /// false if the deflate state could not be initialized.
+  bool valid() const
+  { return zstream_ != NULL; }
+
+  /// Appends one chunk of compressed input, followed by the last-chunk
+  /// when all input is consumed.
+  /// Returns true if there are more chunks.  When deflate fails, it
+  /// returns false without the last-chunk, and failed() is true.
+  bool appendChunk(Buffer* output);
+
+  bool failed() const
+  { return failed_; }
+
+  int64_t inputBytes() const;
+  int64_t outputBytes() const;
+
+ private:
+  const Coding coding_;
+  const int level_;
+  z_stream_s* zstream_;
+  bool finished_;
+  bool failed_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPDEFLATER_H
@@ -33,7 +33,7 @@ class HttpRequest : public muduo::copyable
   };
   enum Version
   {
-    kUnknown, kHttp10, kHttp11
+    kUnknown, kHttp10, kHttp11, kHttp20
   };
 
   HttpRequest()
@@ -81,6 +81,9 @@ class HttpRequest : public muduo::copyable
     return method_ != kInvalid;
   }
 
+  void setMethod(Method m)
+  { method_ = m; }
+
   Method method() const
   { return method_; }
 
@@ -148,6 +151,11 @@ class HttpRequest : public muduo::copyable
     headers_[field] = value;
   }
 
+  void addHeader(const string& field, const string& value)
+  {
+    headers_[field] = value;
+  }
+
   string getHeader(const string& field) const
   {
     string result;
@@ -162,6 +170,15 @@ class HttpRequest : public muduo::copyable
   const std::map<string, string>& headers() const
   { return headers_; }
 
+  void appendBody(const char* start, const char* end)
+  {
+    body_.append(start, end);
+  }
+
+  /// Only HTTP/2 requests carry a body for now, HttpClient sends it.
+  const string& body() const
+  { return body_; }
+
   void swap(HttpRequest& that)
   {
     std::swap(method_, that.method_);
@@ -170,6 +187,7 @@ class HttpRequest : public muduo::copyable
     query_.swap(that.query_);
     receiveTime_.swap(that.receiveTime_);
     headers_.swap(that.headers_);
+    body_.swap(that.body_);
   }
 
  private:
@@ -179,6 +197,7 @@ class HttpRequest : public muduo::copyable
   string query_;
   Timestamp receiveTime_;
   std::map<string, string> headers_;
+  string body_;
 };
 
 }
@@ -10,18 +10,207 @@
 #include <muduo/net/http/HttpResponse.h>
 #include <muduo/net/Buffer.h>
 
-#include <stdio.h>
+#include <algorithm>
+
+#include <time.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
-void HttpResponse::appendToBuffer(Buffer* output) const
+namespace
+{
+
+struct StatusLine
+{
+  HttpResponse::HttpStatusCode code;
+  StringPiece message;
+  StringPiece line;
+};
+
+const StatusLine kStatusLines[] =
+{
+  { HttpResponse::k200Ok, "OK", "HTTP/1.1 200 OK\r\n" },
+  { HttpResponse::k301MovedPermanently, "Moved Permanently",
+    "HTTP/1.1 301 Moved Permanently\r\n" },
+  { HttpResponse::k400BadRequest, "Bad Request", "HTTP/1.1 400 Bad Request\r\n" },
+  { HttpResponse::k404NotFound, "Not Found", "HTTP/1.1 404 Not Found\r\n" },
+  { HttpResponse::k405MethodNotAllowed, "Method Not Allowed",
+    "HTTP/1.1 405 Method Not Allowed\r\n" },
+};
+
+const char kDays[][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+const char kMonths[][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+// "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+const int kDateLen = 37;
+__thread char t_date[kDateLen + 1];
+__thread time_t t_dateSecond;
+
+char* formatTwoDigits(char* p, int value)
+{
+  p[0] = static_cast<char>('0' + value / 10);
+  p[1] = static_cast<char>('0' + value % 10);
+  return p + 2;
+}
+
+char* formatThreeLetters(char* p, const char* str)
+{
+  p[0] = str[0];
+  p[1] = str[1];
+  p[2] = str[2];
+  return p + 3;
+}
+
+// RFC 1123 date, refreshed at most once per second in each IO thread.
+StringPiece formatDate(time_t seconds)
+{
+  if (seconds != t_dateSecond || t_date[0] == '\0')
+  {
+    t_dateSecond = seconds;
+    struct tm tm_time;
+    ::gmtime_r(&seconds, &tm_time);
+    char* p = t_date;
+    memcpy(p, "Date: ", 6);
+    p = formatThreeLetters(p + 6, kDays[tm_time.tm_wday]);
+    *p++ = ',';
+    *p++ = ' ';
+    p = formatTwoDigits(p, tm_time.tm_mday);
+    *p++ = ' ';
+    p = formatThreeLetters(p, kMonths[tm_time.tm_mon]);
+    *p++ = ' ';
+    p = formatTwoDigits(p, (tm_time.tm_year + 1900) / 100);
+    p = formatTwoDigits(p, (tm_time.tm_year + 1900) % 100);
+    *p++ = ' ';
+    p = formatTwoDigits(p, tm_time.tm_hour);
+    *p++ = ':';
+    p = formatTwoDigits(p, tm_time.tm_min);
+    *p++ = ':';
+    p = formatTwoDigits(p, tm_time.tm_sec);
+    memcpy(p, " GMT\r\n", 6);
+    assert(p + 6 == t_date + kDateLen);
+  }
+  return StringPiece(t_date, kDateLen);
+}
+
+// Requires output->writableBytes() >= 20
+void appendDecimal(Buffer* output, size_t value)
+{
+  char* start = output->beginWrite();
+  char* p = start;
+  do
+  {
+    *p++ = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  std::reverse(start, p);
+  output->hasWritten(p - start);
+}
+
+}
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+// the value of Date header, for HTTP/2
+StringPiece formatHttpDate(time_t seconds)
+{
+  StringPiece date = formatDate(seconds);
+  return StringPiece(date.data() + 6, date.size() - 8);
+}
+
+}
+}
+}
+
+void HttpResponse::addHeader(const string& key, const string& value)
+{
+  for (size_t i = 0; i < headers_.size(); ++i)
+  {
+    if (headers_[i].first == key)
+    {
+      headers_[i].second = value;
+      return;
+    }
+  }
+  headers_.push_back(std::make_pair(key, value));
+}
+
+string HttpResponse::getHeader(const string& key) const
+{
+  string result;
+  for (size_t i = 0; i < headers_.size(); ++i)
+  {
+    if (headers_[i].first == key)
+    {
+      result = headers_[i].second;
+      break;
+    }
+  }
+  return result;
+}
+
+void HttpResponse::appendToBuffer(Buffer* output, Timestamp now) const
+{
+  output->ensureWritableBytes(body_.size());
+  appendHeadersToBuffer(output, now, false);
+  output->append(body_);
+}
+
+void HttpResponse::appendChunkedHeadersToBuffer(Buffer* output, Timestamp now) const
+{
+  appendHeadersToBuffer(output, now, true);
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer* output, Timestamp now, bool chunked) const
 {
-  char buf[32];
-  snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
-  output->append(buf);
-  output->append(statusMessage_);
-  output->append("\r\n");
+  size_t headersLen = 0;
+  for (size_t i = 0; i < headers_.size(); ++i)
+  {
+    headersLen += headers_[i].first.size() + headers_[i].second.size() + 4;
+  }
+  // status line, Date, Content-Length and Connection take less than 160 bytes
+  output->ensureWritableBytes(160 + statusMessage_.size() + headersLen);
+
+  const StatusLine* status = NULL;
+  for (size_t i = 0; i < sizeof kStatusLines / sizeof kStatusLines[0]; ++i)
+  {
+    if (kStatusLines[i].code == statusCode_)
+    {
+      status = &kStatusLines[i];
+      break;
+    }
+  }
+
+  if (status && (statusMessage_.empty() || status->message == statusMessage_))
+  {
+    output->append(status->line);
+  }
+  else
+  {
+    output->append("HTTP/1.1 ", 9);
+    appendDecimal(output, statusCode_);
+    output->append(" ", 1);
+    output->append(statusMessage_);
+    output->append("\r\n", 2);
+  }
+
+  output->append(formatDate(now.secondsSinceEpoch()));
+
+  if (chunked)
+  {
+    output->append("Transfer-Encoding: chunked\r\n");
+  }
+  else if (!closeConnection_)
+  {
+    output->append("Content-Length: ");
+    appendDecimal(output, body_.size());
+    output->append("\r\n", 2);
+  }
 
   if (closeConnection_)
   {
@@ -29,21 +218,16 @@ void HttpResponse::appendToBuffer(Buffer* output) const
   }
   else
   {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->append(buf);
     output->append("Connection: Keep-Alive\r\n");
   }
 
-  for (std::map<string, string>::const_iterator it = headers_.begin();
-       it != headers_.end();
-       ++it)
+  for (size_t i = 0; i < headers_.size(); ++i)
   {
-    output->append(it->first);
-    output->append(": ");
-    output->append(it->second);
-    output->append("\r\n");
+    output->append(headers_[i].first);
+    output->append(": ", 2);
+    output->append(headers_[i].second);
+    output->append("\r\n", 2);
   }
 
-  output->append("\r\n");
-  output->append(body_);
+  output->append("\r\n", 2);
 }
@@ -12,9 +12,11 @@
 #define MUDUO_NET_HTTP_HTTPRESPONSE_H
 
 #include <muduo/base/copyable.h>
+#include <muduo/base/Timestamp.h>
 #include <muduo/base/Types.h>
 
-#include <map>
+#include <utility>
+#include <vector>
 
 namespace muduo
 {
@@ -32,6 +34,8 @@ class HttpResponse : public muduo::copyable
     k301MovedPermanently = 301,
     k400BadRequest = 400,
     k404NotFound = 404,
+    k405MethodNotAllowed = 405,
+    k406NotAcceptable = 406,
   };
 
   explicit HttpResponse(bool close)
@@ -43,6 +47,9 @@ class HttpResponse : public muduo::copyable
   void setStatusCode(HttpStatusCode code)
   { statusCode_ = code; }
 
+  HttpStatusCode statusCode() const
+  { return statusCode_; }
+
   void setStatusMessage(const string& message)
   { statusMessage_ = message; }
 
@@ -56,16 +63,45 @@ class HttpResponse : public muduo::copyable
   { addHeader("Content-Type", contentType); }
 
   // FIXME: replace string with StringPiece
-  void addHeader(const string& key, const string& value)
-  { headers_[key] = value; }
+  void addHeader(const string& key, const string& value);
+
+  string getHeader(const string& key) const;
+
+  const std::vector<std::pair<string, string> >& headers() const
+  { return headers_; }
+
+  const string& body() const
+  { return body_; }
 
   void setBody(const string& body)
   { body_ = body; }
 
-  void appendToBuffer(Buffer* output) const;
+  /// Takes the content of body without copying, body gets the old one.
+  void swapBody(string* body)
+  { body_.swap(*body); }
+
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+  void setBody(string&& body)
+  { body_ = std::move(body); }
+#endif
+
+  /// Appends status line, headers, a Date header and body to output.
+  /// now is used for the Date header, which is formatted once per second
+  /// per thread.
+  void appendToBuffer(Buffer* output, Timestamp now) const;
+
+  void appendToBuffer(Buffer* output) const
+  { appendToBuffer(output, Timestamp::now()); }
+
+  /// Appends status line and headers with "Transfer-Encoding: chunked",
+  /// the caller appends the body in chunks.
+  void appendChunkedHeadersToBuffer(Buffer* output, Timestamp now) const;
 
  private:
-  std::map<string, string> headers_;
+  void appendHeadersToBuffer(Buffer* output, Timestamp now, bool chunked) const;
+
+  // a few headers, linear search beats std::map
+  std::vector<std::pair<string, string> > headers_;
   HttpStatusCode statusCode_;
   // FIXME: add http version
   string statusMessage_;
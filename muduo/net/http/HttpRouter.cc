@@ -0,0 +1,350 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpRouter.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Node of the radix tree before compile()
+struct HttpRouter::BuildNode : boost::noncopyable
+{
+  BuildNode()
+  {
+    std::fill(handlers, handlers + kNumMethods, -1);
+  }
+
+  explicit BuildNode(const StringPiece& t)
+    : text(t.data(), t.size())
+  {
+    std::fill(handlers, handlers + kNumMethods, -1);
+  }
+
+  // returns the node where s ends, splits an existing child if needed.
+  BuildNode* insertStatic(const StringPiece& s)
+  {
+    if (s.empty())
+    {
+      return this;
+    }
+
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+      const string& prefix = children[i].text;
+      if (prefix[0] == s[0])
+      {
+        size_t common = 1;
+        size_t len = std::min(prefix.size(), static_cast<size_t>(s.size()));
+        while (common < len && prefix[common] == s[static_cast<int>(common)])
+        {
+          ++common;
+        }
+
+        if (common < prefix.size())
+        {
+          BuildNode* mid = new BuildNode(StringPiece(prefix.data(), static_cast<int>(common)));
+          boost::ptr_vector<BuildNode>::auto_type child = children.replace(i, mid);
+          child->text.erase(0, common);
+          mid->children.push_back(child.release());
+        }
+        return children[i].insertStatic(StringPiece(s.data() + common,
+                                                    s.size() - static_cast<int>(common)));
+      }
+    }
+
+    children.push_back(new BuildNode(s));
+    return &children.back();
+  }
+
+  string text;  // prefix for static node, name for param and wildcard node
+  boost::ptr_vector<BuildNode> children;
+  boost::scoped_ptr<BuildNode> param;
+  boost::scoped_ptr<BuildNode> wildcard;
+  int32_t handlers[kNumMethods];
+};
+
+HttpRouter::HttpRouter()
+  : root_(new BuildNode)
+{
+}
+
+HttpRouter::~HttpRouter()
+{
+}
+
+void HttpRouter::add(HttpRequest::Method method,
+                     const string& pattern,
+                     const Handler& handler)
+{
+  assert(method != HttpRequest::kInvalid);
+  addRoute(method, pattern, handler);
+}
+
+void HttpRouter::addAny(const string& pattern, const Handler& handler)
+{
+  addRoute(kAnyMethod, pattern, handler);
+}
+
+void HttpRouter::addRoute(int method, const string& pattern, const Handler& handler)
+{
+  if (pattern.empty() || pattern[0] != '/')
+  {
+    LOG_FATAL << "HttpRouter::add - pattern must begin with '/' " << pattern;
+  }
+
+  BuildNode* node = root_.get();
+  int numParams = 0;
+  size_t start = 0;
+  while (start < pattern.size())
+  {
+    size_t pos = pattern.find_first_of(":*", start);
+    size_t staticEnd = pos == string::npos ? pattern.size() : pos;
+    node = node->insertStatic(StringPiece(pattern.data() + start,
+                                          static_cast<int>(staticEnd - start)));
+    if (pos == string::npos)
+    {
+      break;
+    }
+
+    size_t nameEnd = pattern.find('/', pos);
+    if (nameEnd == string::npos)
+    {
+      nameEnd = pattern.size();
+    }
+    StringPiece name(pattern.data() + pos + 1, static_cast<int>(nameEnd - pos - 1));
+    if (pattern[pos-1] != '/' || name.empty())
+    {
+      LOG_FATAL << "HttpRouter::add - bad parameter in " << pattern;
+    }
+    if (++numParams > Params::kMaxParams)
+    {
+      LOG_FATAL << "HttpRouter::add - too many parameters in " << pattern;
+    }
+
+    boost::scoped_ptr<BuildNode>& child =
+        pattern[pos] == ':' ? node->param : node->wildcard;
+    if (pattern[pos] == '*' && nameEnd != pattern.size())
+    {
+      LOG_FATAL << "HttpRouter::add - wildcard must be at the end of " << pattern;
+    }
+    if (!child)
+    {
+      child.reset(new BuildNode(name));
+    }
+    else if (child->text != name.as_string())
+    {
+      LOG_FATAL << "HttpRouter::add - " << name.as_string() << " in " << pattern
+                << " conflicts with existing " << child->text;
+    }
+    node = child.get();
+    start = nameEnd;
+  }
+
+  int32_t& slot = node->handlers[method];
+  if (slot < 0)
+  {
+    slot = static_cast<int32_t>(handlers_.size());
+    handlers_.push_back(handler);
+  }
+  else
+  {
+    handlers_[slot] = handler;
+  }
+  nodes_.clear();  // compile() again
+}
+
+namespace
+{
+
+struct FirstByteLess
+{
+  template<typename T>
+  bool operator()(const T* lhs, const T* rhs) const
+  {
+    return lhs->text[0] < rhs->text[0];
+  }
+};
+
+}
+
+void HttpRouter::compile()
+{
+  std::vector<Node> nodes(1);
+  string text;
+  // breadth first, so that siblings are adjacent.
+  std::vector<std::pair<const BuildNode*, int32_t> > queue;
+  queue.push_back(std::make_pair(root_.get(), 0));
+  for (size_t i = 0; i < queue.size(); ++i)
+  {
+    const BuildNode* build = queue[i].first;
+    Node node;
+    assert(build->text.size() <= 0xFFFF);
+    node.text = static_cast<uint32_t>(text.size());
+    node.textLen = static_cast<uint16_t>(build->text.size());
+    text.append(build->text.data(), build->text.size());
+
+    node.hasHandler = false;
+    for (int m = 0; m < kNumMethods; ++m)
+    {
+      node.handlers[m] = build->handlers[m];
+      node.hasHandler = node.hasHandler || build->handlers[m] >= 0;
+    }
+
+    std::vector<const BuildNode*> children;
+    for (size_t j = 0; j < build->children.size(); ++j)
+    {
+      children.push_back(&build->children[j]);
+    }
+    std::sort(children.begin(), children.end(), FirstByteLess());
+    node.firstChild = static_cast<uint32_t>(nodes.size());
+    node.numChildren = static_cast<uint16_t>(children.size());
+    for (size_t j = 0; j < children.size(); ++j)
+    {
+      queue.push_back(std::make_pair(children[j], static_cast<int32_t>(nodes.size())));
+      nodes.push_back(Node());
+    }
+
+    node.paramChild = -1;
+    if (build->param)
+    {
+      node.paramChild = static_cast<int32_t>(nodes.size());
+      queue.push_back(std::make_pair(build->param.get(), node.paramChild));
+      nodes.push_back(Node());
+    }
+
+    node.wildcardChild = -1;
+    if (build->wildcard)
+    {
+      node.wildcardChild = static_cast<int32_t>(nodes.size());
+      queue.push_back(std::make_pair(build->wildcard.get(), node.wildcardChild));
+      nodes.push_back(Node());
+    }
+
+    nodes[queue[i].second] = node;
+  }
+
+  std::vector<char> firstBytes(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    firstBytes[i] = nodes[i].textLen > 0 ? text[nodes[i].text] : '\0';
+  }
+
+  nodes_.swap(nodes);
+  firstBytes_.swap(firstBytes);
+  text_.swap(text);
+  LOG_DEBUG << "HttpRouter::compile " << handlers_.size() << " routes, "
+            << nodes_.size() << " nodes";
+}
+
+int32_t HttpRouter::match(int32_t index,
+                          const char* path,
+                          const char* end,
+                          int method,
+                          Params* params) const
+{
+  const Node& node = nodes_[index];
+  if (path == end)
+  {
+    if (accepts(node, method))
+    {
+      return index;
+    }
+    else if (node.wildcardChild >= 0 && accepts(nodes_[node.wildcardChild], method))
+    {
+      params->push(text(nodes_[node.wildcardChild]), StringPiece(end, 0));
+      return node.wildcardChild;
+    }
+    return -1;
+  }
+
+  const uint32_t last = node.firstChild + node.numChildren;
+  for (uint32_t i = node.firstChild; i < last; ++i)
+  {
+    if (firstBytes_[i] == *path)
+    {
+      const Node& child = nodes_[i];
+      if (end - path >= child.textLen
+          && memcmp(text_.data() + child.text, path, child.textLen) == 0)
+      {
+        int32_t found = match(static_cast<int32_t>(i), path + child.textLen, end, method, params);
+        if (found >= 0)
+        {
+          return found;
+        }
+      }
+      break;
+    }
+  }
+
+  if (node.paramChild >= 0 && *path != '/')
+  {
+    const void* slash = memchr(path, '/', end - path);
+    const char* segEnd = slash ? static_cast<const char*>(slash) : end;
+    const int saved = params->size_;
+    params->push(text(nodes_[node.paramChild]),
+                 StringPiece(path, static_cast<int>(segEnd - path)));
+    int32_t found = match(node.paramChild, segEnd, end, method, params);
+    if (found >= 0)
+    {
+      return found;
+    }
+    params->size_ = saved;
+  }
+
+  if (node.wildcardChild >= 0 && accepts(nodes_[node.wildcardChild], method))
+  {
+    params->push(text(nodes_[node.wildcardChild]),
+                 StringPiece(path, static_cast<int>(end - path)));
+    return node.wildcardChild;
+  }
+  return -1;
+}
+
+bool HttpRouter::route(const HttpRequest& req, HttpResponse* resp) const
+{
+  assert(compiled());
+  const string& path = req.path();
+  Params params;
+  int32_t index = match(0, path.data(), path.data() + path.size(), req.method(), &params);
+  if (index >= 0)
+  {
+    const Node& node = nodes_[index];
+    int32_t handler = node.handlers[req.method()];
+    if (handler < 0)
+    {
+      handler = node.handlers[kAnyMethod];
+    }
+    assert(handler >= 0);
+    handlers_[handler](req, params, resp);
+    return true;
+  }
+
+  // no route of this method, is there one of another
+  Params ignored;
+  if (match(0, path.data(), path.data() + path.size(), kAnyHandler, &ignored) >= 0)
+  {
+    resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+    resp->setStatusMessage("Method Not Allowed");
+  }
+  else
+  {
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+  }
+  return false;
+}
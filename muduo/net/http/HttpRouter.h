@@ -0,0 +1,183 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPROUTER_H
+#define MUDUO_NET_HTTP_HTTPROUTER_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpResponse;
+
+/// Dispatches HTTP requests by method and path.
+///
+/// Patterns are made of static text, named parameters and one trailing
+/// wildcard, eg. "/users/:id/posts" or "/static/*filepath".
+/// A parameter matches one non-empty path segment, a wildcard matches
+/// the rest of the path, possibly empty.
+/// Static text takes precedence over a parameter, which takes precedence
+/// over a wildcard.
+///
+/// Routes are collected into a radix tree, compile() then flattens it into
+/// contiguous arrays. route() is const and takes no lock, so a compiled
+/// router can be shared by all IO threads of an HttpServer.
+class HttpRouter : boost::noncopyable
+{
+ public:
+  /// Values of matched parameters, they point into the path of the request
+  /// and the router, so they are valid during the call of handler only.
+  class Params : public muduo::copyable
+  {
+   public:
+    static const int kMaxParams = 8;
+
+    Params()
+      : size_(0)
+    {
+    }
+
+    int size() const
+    { return size_; }
+
+    StringPiece name(int i) const
+    {
+      assert(0 <= i && i < size_);
+      return names_[i];
+    }
+
+    StringPiece value(int i) const
+    {
+      assert(0 <= i && i < size_);
+      return values_[i];
+    }
+
+    /// returns empty StringPiece if name is not found.
+    StringPiece get(const StringPiece& name) const
+    {
+      for (int i = 0; i < size_; ++i)
+      {
+        if (names_[i] == name)
+        {
+          return values_[i];
+        }
+      }
+      return StringPiece();
+    }
+
+   private:
+    friend class HttpRouter;
+
+    void push(const StringPiece& name, const StringPiece& value)
+    {
+      assert(size_ < kMaxParams);
+      names_[size_] = name;
+      values_[size_] = value;
+      ++size_;
+    }
+
+    StringPiece names_[kMaxParams];
+    StringPiece values_[kMaxParams];
+    int size_;
+  };
+
+  typedef boost::function<void (const HttpRequest&,
+                                const Params&,
+                                HttpResponse*)> Handler;
+
+  HttpRouter();
+  ~HttpRouter();  // force out-line dtor, for scoped_ptr members.
+
+  /// Not thread safe, must be called before compile().
+  /// A later route with the same method and pattern replaces the former.
+  void add(HttpRequest::Method method,
+           const string& pattern,
+           const Handler& handler);
+
+  /// Same as add(), but matches any method without its own handler.
+  void addAny(const string& pattern, const Handler& handler);
+
+  /// Not thread safe, flattens routes for route().
+  void compile();
+
+  bool compiled() const
+  { return !nodes_.empty(); }
+
+  /// Thread safe after compile().
+  /// Fills 404 or 405 response if no route matches, returns false.
+  bool route(const HttpRequest& req, HttpResponse* resp) const;
+
+  /// Adapter for HttpServer::HttpCallback.
+  void onRequest(const HttpRequest& req, HttpResponse* resp) const
+  { route(req, resp); }
+
+ private:
+  static const int kNumMethods = HttpRequest::kDelete + 1;
+  static const int kAnyMethod = HttpRequest::kInvalid;
+
+  struct BuildNode;
+
+  // A node of compiled tree, static children are stored contiguously
+  // at [firstChild, firstChild + numChildren) of nodes_.
+  struct Node
+  {
+    uint32_t text;  // offset in text_ of prefix for static node, name otherwise
+    uint16_t textLen;
+    uint16_t numChildren;
+    uint32_t firstChild;
+    int32_t paramChild;
+    int32_t wildcardChild;
+    int32_t handlers[kNumMethods];  // index in handlers_, -1 if none
+    bool hasHandler;
+  };
+
+  // for match(), a node with a handler of any method
+  static const int kAnyHandler = -1;
+
+  void addRoute(int method, const string& pattern, const Handler& handler);
+  bool accepts(const Node& node, int method) const
+  {
+    return method == kAnyHandler
+        ? node.hasHandler
+        : node.handlers[method] >= 0 || node.handlers[kAnyMethod] >= 0;
+  }
+  // the node of path with a handler of method, backtracks to parameters
+  // and wildcards when a static match has none
+  int32_t match(int32_t index,
+                const char* path,
+                const char* end,
+                int method,
+                Params* params) const;
+  StringPiece text(const Node& node) const
+  { return StringPiece(text_.data() + node.text, node.textLen); }
+
+  boost::scoped_ptr<BuildNode> root_;
+  std::vector<Handler> handlers_;
+  std::vector<Node> nodes_;
+  std::vector<char> firstBytes_;  // first byte of prefix of each node
+  string text_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPROUTER_H
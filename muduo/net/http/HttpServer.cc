@@ -10,11 +10,17 @@
 #include <muduo/net/http/HttpServer.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/http/Http2Connection.h>
 #include <muduo/net/http/HttpContext.h>
+#ifdef HAVE_ZLIB
+#include <muduo/net/http/HttpDeflater.h>
+#endif
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpRouter.h>
 
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -37,12 +43,58 @@ void defaultHttpCallback(const HttpRequest&, HttpResponse* resp)
 }
 }
 
+#ifdef HAVE_ZLIB
+// A response body being compressed, as the output buffer drains.
+struct HttpServer::CompressedBody : boost::noncopyable
+{
+  CompressedBody(HttpResponse* response, const WriteCompleteCallback& writeCompleteCb)
+    : closeConnection(response->closeConnection()),
+      done(false),
+      previousWriteComplete(writeCompleteCb)
+  {
+    response->swapBody(&body);
+  }
+
+  string body;
+  boost::scoped_ptr<HttpDeflater> deflater;
+  const bool closeConnection;
+  bool done;
+  // of the connection, taken over while the body is sent
+  const WriteCompleteCallback previousWriteComplete;
+};
+#endif
+
+namespace
+{
+
+// the output buffer is refilled below it
+const size_t kCompressHighWaterMark = 64 * 1024;
+
+// skips formats which are compressed already
+bool isCompressible(const string& contentType)
+{
+  if (contentType.compare(0, 6, "image/") == 0)
+  {
+    return contentType.compare(0, 13, "image/svg+xml") == 0;
+  }
+  return contentType.compare(0, 6, "audio/") != 0
+      && contentType.compare(0, 6, "video/") != 0
+      && contentType.find("zip") == string::npos;
+}
+
+}
+
 HttpServer::HttpServer(EventLoop* loop,
                        const InetAddress& listenAddr,
                        const string& name,
                        TcpServer::Option option)
   : server_(loop, listenAddr, name, option),
-    httpCallback_(detail::defaultHttpCallback)
+    httpCallback_(detail::defaultHttpCallback),
+    router_(NULL),
+    compression_(false),
+    compressionLevel_(-1),
+    compressionMinSize_(0),
+    http2_(false)
 {
   server_.setConnectionCallback(
       boost::bind(&HttpServer::onConnection, this, _1));
@@ -54,8 +106,29 @@ HttpServer::~HttpServer()
 {
 }
 
+void HttpServer::setRouter(HttpRouter* router)
+{
+  router_ = router;
+  httpCallback_ = boost::bind(&HttpRouter::onRequest, router, _1, _2);
+}
+
+void HttpServer::enableCompression(int level, size_t minBodySize)
+{
+#ifdef HAVE_ZLIB
+  compression_ = true;
+  compressionLevel_ = level;
+  compressionMinSize_ = minBodySize;
+#else
+  LOG_WARN << "HttpServer::enableCompression - built without zlib";
+#endif
+}
+
 void HttpServer::start()
 {
+  if (router_)
+  {
+    router_->compile();
+  }
   LOG_WARN << "HttpServer[" << server_.name()
     << "] starts listenning on " << server_.ipPort();
   server_.start();
@@ -73,8 +146,31 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
                            Buffer* buf,
                            Timestamp receiveTime)
 {
+  if (http2_)
+  {
+    Http2ConnectionPtr* http2 = boost::any_cast<Http2ConnectionPtr>(conn->getMutableContext());
+    if (http2)
+    {
+      (*http2)->onMessage(conn, buf, receiveTime);
+      return;
+    }
+  }
+
   HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
 
+  if (http2_ && context->expectRequestLine() && Http2Connection::startsWithPreface(*buf))
+  {
+    // prior knowledge, waits for the whole preface
+    if (buf->readableBytes() >= Http2Connection::kPrefaceLength)
+    {
+      Http2ConnectionPtr http2(new Http2Connection(httpCallback_));
+      conn->setContext(http2);
+      http2->start(conn);
+      http2->onMessage(conn, buf, receiveTime);
+    }
+    return;
+  }
+
   if (!context->parseRequest(buf, receiveTime))
   {
     conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
@@ -83,11 +179,42 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
 
   if (context->gotAll())
   {
+    if (http2_ && upgradeToHttp2(conn, context->request(), buf, receiveTime))
+    {
+      return;
+    }
     onRequest(conn, context->request());
     context->reset();
   }
 }
 
+// returns false if the request stays in HTTP/1.1
+bool HttpServer::upgradeToHttp2(const TcpConnectionPtr& conn,
+                                const HttpRequest& req,
+                                Buffer* buf,
+                                Timestamp receiveTime)
+{
+  if (req.getVersion() != HttpRequest::kHttp11
+      || req.getHeader("Upgrade").find("h2c") == string::npos
+      || req.getHeader("HTTP2-Settings").empty())
+  {
+    return false;
+  }
+
+  Http2ConnectionPtr http2(new Http2Connection(httpCallback_));
+  if (!http2->upgrade(conn, req.getHeader("HTTP2-Settings"), req))
+  {
+    return false;
+  }
+  // req is gone with the HttpContext
+  conn->setContext(http2);
+  if (buf->readableBytes() > 0)
+  {
+    http2->onMessage(conn, buf, receiveTime);
+  }
+  return true;
+}
+
 void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
 {
   const string& connection = req.getHeader("Connection");
@@ -95,12 +222,113 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
     (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
   HttpResponse response(close);
   httpCallback_(req, &response);
-  Buffer buf;
-  response.appendToBuffer(&buf);
-  conn->send(&buf);
+  if (compression_ && sendCompressed(conn, req, &response))
+  {
+    // closes the connection after the last chunk, if asked
+    return;
+  }
+  // serialize in place, the output buffer keeps its capacity across requests
+  response.appendToBuffer(conn->outputBuffer(), req.receiveTime());
+  conn->flushOutputBuffer();
   if (response.closeConnection())
   {
     conn->shutdown();
   }
 }
 
+
+// returns false if the response should be sent as is.
+bool HttpServer::sendCompressed(const TcpConnectionPtr& conn,
+                                const HttpRequest& req,
+                                HttpResponse* response)
+{
+#ifdef HAVE_ZLIB
+  if (req.getVersion() != HttpRequest::kHttp11
+      || !response->getHeader("Content-Encoding").empty()
+      || !isCompressible(response->getHeader("Content-Type")))
+  {
+    return false;
+  }
+
+  response->addHeader("Vary", "Accept-Encoding");
+  // small ones go as is, unless the client refuses identity
+  HttpDeflater::Coding coding =
+      HttpDeflater::negotiate(req.getHeader("Accept-Encoding"),
+                              response->body().size() < compressionMinSize_);
+  if (coding == HttpDeflater::kNotAcceptable)
+  {
+    response->setStatusCode(HttpResponse::k406NotAcceptable);
+    response->setStatusMessage("Not Acceptable");
+    response->setBody("");
+    return false;
+  }
+  if (coding == HttpDeflater::kIdentity)
+  {
+    return false;
+  }
+
+  CompressedBodyPtr compressed(new CompressedBody(response, conn->writeCompleteCallback()));
+  compressed->deflater.reset(new HttpDeflater(coding, compressionLevel_, compressed->body));
+  if (!compressed->deflater->valid())
+  {
+    response->swapBody(&compressed->body);
+    return false;
+  }
+
+  response->addHeader("Content-Encoding", HttpDeflater::codingName(coding));
+  response->appendChunkedHeadersToBuffer(conn->outputBuffer(), req.receiveTime());
+  sendChunks(conn, compressed);
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+void HttpServer::sendChunks(const TcpConnectionPtr& conn, const CompressedBodyPtr& compressed)
+{
+  if (compressed->done)
+  {
+    // a write complete queued before the last chunk
+    return;
+  }
+
+  Buffer* output = conn->outputBuffer();
+  bool more = true;
+  while (more && output->readableBytes() < kCompressHighWaterMark)
+  {
+    more = compressed->deflater->appendChunk(output);
+    conn->flushOutputBuffer();
+  }
+  if (more)
+  {
+    // the rest when the output buffer drains, the next request after it
+    conn->setWriteCompleteCallback(
+        boost::bind(&HttpServer::sendChunks, this, _1, compressed));
+    conn->stopRead();
+    return;
+  }
+
+  compressed->done = true;
+  LOG_TRACE << conn->name() << " compressed " << compressed->deflater->inputBytes()
+            << " bytes to " << compressed->deflater->outputBytes();
+  conn->setWriteCompleteCallback(compressed->previousWriteComplete);
+  if (compressed->deflater->failed())
+  {
+    // the body is cut, a clean close would pass it as whole
+    conn->forceClose();
+  }
+  else if (compressed->closeConnection)
+  {
+    conn->shutdown();
+  }
+  else if (!conn->isReading() && conn->connected())
+  {
+    conn->startRead();
+    if (conn->inputBuffer()->readableBytes() > 0)
+    {
+      onMessage(conn, conn->inputBuffer(), Timestamp::now());
+    }
+  }
+}
+#endif
@@ -21,6 +21,7 @@ namespace net
 
 class HttpRequest;
 class HttpResponse;
+class HttpRouter;
 
 /// A simple embeddable HTTP server designed for report status of a program.
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
@@ -47,6 +48,27 @@ class HttpServer : boost::noncopyable
     httpCallback_ = cb;
   }
 
+  /// Not thread safe, router be set before calling start().
+  /// The router is compiled in start(), and must outlive this server.
+  void setRouter(HttpRouter* router);
+
+  /// Not thread safe, be called before calling start().
+  /// Compresses response bodies of at least minBodySize bytes with gzip
+  /// or deflate if the client accepts it, in chunked transfer coding,
+  /// as the output buffer drains.  Responds 406 to clients which refuse
+  /// identity and accept neither.
+  /// level is a zlib compression level, -1 for the default.
+  /// No-op if muduo is built without zlib.
+  void enableCompression(int level = -1, size_t minBodySize = 1024);
+
+  /// Not thread safe, be called before calling start().
+  /// Accepts cleartext HTTP/2 (h2c), either with prior knowledge or
+  /// upgraded from HTTP/1.1, requests go to the same HttpCallback.
+  void enableHttp2()
+  {
+    http2_ = true;
+  }
+
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
@@ -60,9 +82,21 @@ class HttpServer : boost::noncopyable
                  Buffer* buf,
                  Timestamp receiveTime);
   void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  struct CompressedBody;
+  typedef boost::shared_ptr<CompressedBody> CompressedBodyPtr;
+
+  bool sendCompressed(const TcpConnectionPtr&, const HttpRequest&, HttpResponse*);
+  void sendChunks(const TcpConnectionPtr&, const CompressedBodyPtr&);
+  bool upgradeToHttp2(const TcpConnectionPtr&, const HttpRequest&,
+                      Buffer* buf, Timestamp receiveTime);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  HttpRouter* router_;
+  bool compression_;
+  int compressionLevel_;
+  size_t compressionMinSize_;
+  bool http2_;
 };
 
 }
@@ -0,0 +1,245 @@
+#include <muduo/net/http/Hpack.h>
+
+//#define BOOST_TEST_MODULE HpackTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+
+using muduo::string;
+using muduo::net::HpackDecoder;
+using muduo::net::HpackEncoder;
+using muduo::net::hpack::HeaderList;
+
+// Examples of RFC 7541 Appendix C
+
+namespace
+{
+
+string fromHex(const char* hex)
+{
+  string result;
+  for (; hex[0] && hex[1]; hex += 2)
+  {
+    char byte[3] = { hex[0], hex[1], '\0' };
+    result.push_back(static_cast<char>(strtol(byte, NULL, 16)));
+  }
+  return result;
+}
+
+void checkDecode(HpackDecoder* decoder, const char* hex,
+                 const char* const expected[][2], size_t count, size_t tableSize)
+{
+  string block = fromHex(hex);
+  HeaderList headers;
+  BOOST_REQUIRE(decoder->decode(block.data(), block.size(), &headers));
+  BOOST_REQUIRE_EQUAL(headers.size(), count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    BOOST_CHECK_EQUAL(headers[i].first, expected[i][0]);
+    BOOST_CHECK_EQUAL(headers[i].second, expected[i][1]);
+  }
+  BOOST_CHECK_EQUAL(decoder->table().size(), tableSize);
+}
+
+void checkEncode(HpackEncoder* encoder, const char* const headers[][2],
+                 size_t count, const char* hex)
+{
+  string block;
+  encoder->startBlock(&block);
+  for (size_t i = 0; i < count; ++i)
+  {
+    encoder->encode(headers[i][0], headers[i][1], &block);
+  }
+  BOOST_CHECK_EQUAL(block, fromHex(hex));
+}
+
+const char* const kRequest1[][2] =
+{
+  { ":method", "GET" },
+  { ":scheme", "http" },
+  { ":path", "/" },
+  { ":authority", "www.example.com" },
+};
+
+const char* const kRequest2[][2] =
+{
+  { ":method", "GET" },
+  { ":scheme", "http" },
+  { ":path", "/" },
+  { ":authority", "www.example.com" },
+  { "cache-control", "no-cache" },
+};
+
+const char* const kRequest3[][2] =
+{
+  { ":method", "GET" },
+  { ":scheme", "https" },
+  { ":path", "/index.html" },
+  { ":authority", "www.example.com" },
+  { "custom-key", "custom-value" },
+};
+
+const char* const kResponse1[][2] =
+{
+  { ":status", "302" },
+  { "cache-control", "private" },
+  { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+  { "location", "https://www.example.com" },
+};
+
+const char* const kResponse2[][2] =
+{
+  { ":status", "307" },
+  { "cache-control", "private" },
+  { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+  { "location", "https://www.example.com" },
+};
+
+const char* const kResponse3[][2] =
+{
+  { ":status", "200" },
+  { "cache-control", "private" },
+  { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+  { "location", "https://www.example.com" },
+  { "content-encoding", "gzip" },
+  { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" },
+};
+
+const char kHuffmanResponse1[] =
+  "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff"
+  "6e919d29ad171863c78f0b97c8e9ae82ae43d3";
+const char kHuffmanResponse2[] = "4883640effc1c0bf";
+const char kHuffmanResponse3[] =
+  "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e782"
+  "1dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5"
+  "b1063d5007";
+
+}
+
+BOOST_AUTO_TEST_CASE(testHuffman)
+{
+  string output;
+  muduo::net::hpack::huffmanEncode("www.example.com", 15, &output);
+  BOOST_CHECK_EQUAL(output, fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+  BOOST_CHECK_EQUAL(muduo::net::hpack::huffmanEncodedLength("www.example.com", 15), 12);
+
+  string all;
+  for (int i = 0; i < 256; ++i)
+  {
+    all.push_back(static_cast<char>(i));
+  }
+  string encoded;
+  muduo::net::hpack::huffmanEncode(all.data(), all.size(), &encoded);
+  string decoded;
+  BOOST_CHECK(muduo::net::hpack::huffmanDecode(encoded.data(), encoded.size(), &decoded));
+  BOOST_CHECK(decoded == all);
+
+  // padding longer than 7 bits
+  string bad = fromHex("f1e3c2e5f23a6ba0ab90f4ffff");
+  BOOST_CHECK(!muduo::net::hpack::huffmanDecode(bad.data(), bad.size(), &decoded));
+  // padding not of EOS
+  bad = fromHex("a8eb10649cbe");
+  BOOST_CHECK(!muduo::net::hpack::huffmanDecode(bad.data(), bad.size(), &decoded));
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeRequests)
+{
+  HpackDecoder decoder;
+  checkDecode(&decoder, "828684410f7777772e6578616d706c652e636f6d", kRequest1, 4, 57);
+  checkDecode(&decoder, "828684be58086e6f2d6361636865", kRequest2, 5, 110);
+  checkDecode(&decoder, "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565",
+              kRequest3, 5, 164);
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeHuffmanRequests)
+{
+  HpackDecoder decoder;
+  checkDecode(&decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff", kRequest1, 4, 57);
+  checkDecode(&decoder, "828684be5886a8eb10649cbf", kRequest2, 5, 110);
+  checkDecode(&decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+              kRequest3, 5, 164);
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeResponses)
+{
+  HpackDecoder decoder(256);
+  checkDecode(&decoder, "4803333032580770726976617465611d4d6f6e2c203231204f6374203230"
+              "31332032303a31333a323120474d546e1768747470733a2f2f7777772e6578616d70"
+              "6c652e636f6d", kResponse1, 4, 222);
+  checkDecode(&decoder, "4803333037c1c0bf", kResponse2, 4, 222);
+  checkDecode(&decoder, "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220"
+              "474d54c05a04677a69707738666f6f3d4153444a4b48514b425a584f5157454f5049"
+              "5541585157454f49553b206d61782d6167653d333630303b2076657273696f6e3d31",
+              kResponse3, 6, 215);
+}
+
+BOOST_AUTO_TEST_CASE(testEncodeResponses)
+{
+  HpackEncoder encoder(256);
+  checkEncode(&encoder, kResponse1, 4, kHuffmanResponse1);
+  BOOST_CHECK_EQUAL(encoder.table().size(), 222);
+  checkEncode(&encoder, kResponse2, 4, kHuffmanResponse2);
+  BOOST_CHECK_EQUAL(encoder.table().size(), 222);
+  checkEncode(&encoder, kResponse3, 6, kHuffmanResponse3);
+  BOOST_CHECK_EQUAL(encoder.table().size(), 215);
+
+  HpackDecoder decoder(256);
+  checkDecode(&decoder, kHuffmanResponse1, kResponse1, 4, 222);
+  checkDecode(&decoder, kHuffmanResponse2, kResponse2, 4, 222);
+  checkDecode(&decoder, kHuffmanResponse3, kResponse3, 6, 215);
+}
+
+BOOST_AUTO_TEST_CASE(testTableSizeUpdate)
+{
+  HpackEncoder encoder;
+  HpackDecoder decoder;
+  checkEncode(&encoder, kResponse1, 4, kHuffmanResponse1);
+  encoder.setMaxTableSize(0);
+  encoder.setMaxTableSize(200);
+  string block;
+  encoder.startBlock(&block);
+  encoder.encode("cache-control", "private", &block);
+  // shrinks to 0, then grows to 200
+  BOOST_CHECK_EQUAL(block.substr(0, 4), fromHex("203fa901"));
+
+  string first = fromHex(kHuffmanResponse1);
+  HeaderList headers;
+  BOOST_CHECK(decoder.decode(first.data(), first.size(), &headers));
+  BOOST_CHECK(decoder.decode(block.data(), block.size(), &headers));
+  BOOST_CHECK_EQUAL(headers.back().second, "private");
+  BOOST_CHECK_EQUAL(decoder.table().size(), 32 + 13 + 7);
+
+  // size update after a field
+  string bad = fromHex("8220");
+  BOOST_CHECK(!decoder.decode(bad.data(), bad.size(), &headers));
+  // index out of range
+  bad = fromHex("ff00");
+  BOOST_CHECK(!decoder.decode(bad.data(), bad.size(), &headers));
+}
+
+BOOST_AUTO_TEST_CASE(testMaxListSize)
+{
+  HpackEncoder encoder;
+  HpackDecoder decoder;
+  string block;
+  encoder.startBlock(&block);
+  encoder.encode("x-big", string(2000, 'a'), &block);
+  HeaderList headers;
+  BOOST_CHECK(decoder.decode(block.data(), block.size(), &headers));
+
+  // 32 fields of 2000 + 5 + 32 are within 65536, the 33rd is not.
+  string indexed(32, '\xbe');
+  headers.clear();
+  BOOST_CHECK(decoder.decode(indexed.data(), indexed.size(), &headers));
+  BOOST_CHECK_EQUAL(headers.size(), 32u);
+  indexed.push_back('\xbe');
+  headers.clear();
+  BOOST_CHECK(!decoder.decode(indexed.data(), indexed.size(), &headers));
+  BOOST_CHECK_EQUAL(headers.size(), 32u);
+
+  HpackDecoder small(4096, 100);
+  headers.clear();
+  BOOST_CHECK(!small.decode(block.data(), block.size(), &headers));
+}
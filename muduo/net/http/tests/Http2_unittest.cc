@@ -0,0 +1,373 @@
+#include <muduo/net/http/HttpServer.h>
+#include <muduo/net/http/Hpack.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/base/Thread.h>
+#include <muduo/net/EventLoop.h>
+
+//#define BOOST_TEST_MODULE Http2Test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+
+#include <map>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Talks HTTP/2 to HttpServer over loopback with a blocking socket.
+
+namespace
+{
+
+// of the pid, below the ephemeral ports, so concurrent runs do not collide
+const uint16_t kPort = static_cast<uint16_t>(10000 + ::getpid() % 20000);
+const size_t kBigBody = 100 * 1000;
+
+void onRequest(const HttpRequest& req, HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  if (req.path() == "/big")
+  {
+    resp->setBody(string(kBigBody, 'x'));
+  }
+  else if (req.path() == "/echo")
+  {
+    resp->setBody(req.body());
+  }
+  else
+  {
+    resp->setBody(req.path() + " " + req.getHeader("Host") + " "
+                  + req.getHeader("User-Agent"));
+  }
+}
+
+struct Frame
+{
+  uint8_t type;
+  uint8_t flags;
+  uint32_t streamId;
+  string payload;
+};
+
+struct Response
+{
+  Response() : status(0), ended(false) {}
+  int status;
+  string body;
+  bool ended;
+};
+
+class Client
+{
+ public:
+  Client()
+    : sockfd_(::socket(AF_INET, SOCK_STREAM, 0))
+  {
+    struct timeval tv = { 5, 0 };
+    ::setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connected_ = ::connect(sockfd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) == 0;
+  }
+
+  ~Client()
+  {
+    ::close(sockfd_);
+  }
+
+  bool connected() const { return connected_; }
+
+  void send(const string& data)
+  {
+    ::write(sockfd_, data.data(), data.size());
+  }
+
+  void sendFrame(uint8_t type, uint8_t flags, uint32_t streamId, const string& payload)
+  {
+    string frame;
+    frame.push_back(static_cast<char>(payload.size() >> 16));
+    frame.push_back(static_cast<char>(payload.size() >> 8));
+    frame.push_back(static_cast<char>(payload.size()));
+    frame.push_back(static_cast<char>(type));
+    frame.push_back(static_cast<char>(flags));
+    appendUint32(&frame, streamId);
+    frame += payload;
+    send(frame);
+  }
+
+  void sendPreface()
+  {
+    send("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+    sendFrame(4, 0, 0, "");
+  }
+
+  void sendRequest(uint32_t streamId, const char* method, const char* path, bool endStream)
+  {
+    string block;
+    encoder_.startBlock(&block);
+    encoder_.encode(":method", method, &block);
+    encoder_.encode(":scheme", "http", &block);
+    encoder_.encode(":path", path, &block);
+    encoder_.encode(":authority", "localhost", &block);
+    encoder_.encode("user-agent", "h2test", &block);
+    sendFrame(1, endStream ? 0x5 : 0x4, streamId, block);
+  }
+
+  void sendWindowUpdate(uint32_t streamId, uint32_t increment)
+  {
+    string payload;
+    appendUint32(&payload, increment);
+    sendFrame(8, 0, streamId, payload);
+  }
+
+  bool readExactly(size_t len, string* output)
+  {
+    output->resize(len);
+    size_t n = 0;
+    while (n < len)
+    {
+      ssize_t nr = ::read(sockfd_, &(*output)[n], len - n);
+      if (nr <= 0)
+      {
+        return false;
+      }
+      n += static_cast<size_t>(nr);
+    }
+    return true;
+  }
+
+  // reads the response head of an HTTP/1.1 upgrade
+  string readHead()
+  {
+    string head;
+    char c;
+    while (head.find("\r\n\r\n") == string::npos && ::read(sockfd_, &c, 1) == 1)
+    {
+      head.push_back(c);
+    }
+    return head;
+  }
+
+  bool readFrame(Frame* frame)
+  {
+    string header;
+    if (!readExactly(9, &header))
+    {
+      return false;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(header.data());
+    size_t len = (p[0] << 16) | (p[1] << 8) | p[2];
+    frame->type = p[3];
+    frame->flags = p[4];
+    frame->streamId = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+    return readExactly(len, &frame->payload);
+  }
+
+  // reads frames until the response of streamId ends, or dataLimit bytes
+  // of its body arrive.
+  bool readResponse(uint32_t streamId, size_t dataLimit = string::npos)
+  {
+    if (responses_[streamId].ended)
+    {
+      return true;
+    }
+    Frame frame;
+    while (readFrame(&frame))
+    {
+      Response& resp = responses_[frame.streamId];
+      if (frame.type == 1)
+      {
+        hpack::HeaderList headers;
+        if (!decoder_.decode(frame.payload.data(), frame.payload.size(), &headers))
+        {
+          return false;
+        }
+        for (size_t i = 0; i < headers.size(); ++i)
+        {
+          if (headers[i].first == ":status")
+          {
+            resp.status = atoi(headers[i].second.c_str());
+          }
+        }
+      }
+      else if (frame.type == 0)
+      {
+        resp.body += frame.payload;
+      }
+      if ((frame.type == 0 || frame.type == 1) && (frame.flags & 0x1))
+      {
+        resp.ended = true;
+      }
+      if (frame.streamId == streamId
+          && (resp.ended || responses_[streamId].body.size() >= dataLimit))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const Response& response(uint32_t streamId) { return responses_[streamId]; }
+
+ private:
+  static void appendUint32(string* output, uint32_t x)
+  {
+    output->push_back(static_cast<char>(x >> 24));
+    output->push_back(static_cast<char>(x >> 16));
+    output->push_back(static_cast<char>(x >> 8));
+    output->push_back(static_cast<char>(x));
+  }
+
+  int sockfd_;
+  bool connected_;
+  HpackEncoder encoder_;
+  HpackDecoder decoder_;
+  std::map<uint32_t, Response> responses_;
+};
+
+struct Result
+{
+  Result() : goAwayError(0) {}
+  Response hello;
+  Response echo;
+  Response firstWindow;
+  Response big;
+  string upgradeHead;
+  Response upgraded;
+  Response afterUpgrade;
+  uint32_t goAwayError;
+};
+
+void runClient(EventLoop* loop, Result* result)
+{
+  {
+    // prior knowledge, two streams at once
+    Client client;
+    if (client.connected())
+    {
+      client.sendPreface();
+      client.sendRequest(1, "GET", "/hello", true);
+      client.sendRequest(3, "POST", "/echo", false);
+      client.sendFrame(0, 0x1, 3, "some data");
+      client.readResponse(1);
+      client.readResponse(3);
+      result->hello = client.response(1);
+      result->echo = client.response(3);
+    }
+  }
+
+  {
+    // the server stops at the initial window of 65535 bytes
+    Client client;
+    if (client.connected())
+    {
+      client.sendPreface();
+      client.sendRequest(1, "GET", "/big", true);
+      client.readResponse(1, 65535);
+      result->firstWindow = client.response(1);
+      client.sendWindowUpdate(0, kBigBody);
+      client.sendWindowUpdate(1, kBigBody);
+      client.readResponse(1);
+      result->big = client.response(1);
+    }
+  }
+
+  {
+    Client client;
+    if (client.connected())
+    {
+      // SETTINGS_MAX_CONCURRENT_STREAMS = 100, SETTINGS_INITIAL_WINDOW_SIZE = 10485760
+      client.send("GET /up HTTP/1.1\r\n"
+                  "Host: upgrade\r\n"
+                  "Connection: Upgrade, HTTP2-Settings\r\n"
+                  "Upgrade: h2c\r\n"
+                  "HTTP2-Settings: AAMAAABkAAQAoAAAAAIAAAAA\r\n"
+                  "\r\n");
+      client.sendPreface();
+      result->upgradeHead = client.readHead();
+      client.readResponse(1);
+      result->upgraded = client.response(1);
+      client.sendRequest(3, "GET", "/next", true);
+      client.readResponse(3);
+      result->afterUpgrade = client.response(3);
+    }
+  }
+
+  {
+    // a small block of indexed fields decodes to over
+    // SETTINGS_MAX_HEADER_LIST_SIZE = 65536
+    Client client;
+    if (client.connected())
+    {
+      client.sendPreface();
+      HpackEncoder encoder;
+      string block;
+      encoder.startBlock(&block);
+      encoder.encode("x-big", string(2000, 'a'), &block);
+      block.append(40, '\xbe');  // index 62, x-big
+      client.sendFrame(1, 0x5, 1, block);
+      Frame frame;
+      while (client.readFrame(&frame))
+      {
+        if (frame.type == 7 && frame.payload.size() >= 8)
+        {
+          const uint8_t* p = reinterpret_cast<const uint8_t*>(frame.payload.data()) + 4;
+          result->goAwayError = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+          break;
+        }
+      }
+    }
+  }
+  loop->quit();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testHttp2)
+{
+  EventLoop loop;
+  HttpServer server(&loop, InetAddress(kPort), "Http2Test");
+  server.setHttpCallback(onRequest);
+  server.enableHttp2();
+  server.start();
+
+  Result result;
+  Thread client(boost::bind(runClient, &loop, &result));
+  client.start();
+  loop.loop();
+  client.join();
+
+  BOOST_CHECK_EQUAL(result.hello.status, 200);
+  BOOST_CHECK_EQUAL(result.hello.body, "/hello localhost h2test");
+  BOOST_CHECK(result.hello.ended);
+  BOOST_CHECK_EQUAL(result.echo.status, 200);
+  BOOST_CHECK_EQUAL(result.echo.body, "some data");
+
+  BOOST_CHECK_EQUAL(result.firstWindow.body.size(), 65535);
+  BOOST_CHECK(!result.firstWindow.ended);
+  BOOST_CHECK_EQUAL(result.big.body.size(), kBigBody);
+  BOOST_CHECK(result.big.ended);
+
+  BOOST_CHECK_EQUAL(result.upgradeHead.compare(0, 12, "HTTP/1.1 101"), 0);
+  BOOST_CHECK_EQUAL(result.upgraded.status, 200);
+  BOOST_CHECK_EQUAL(result.upgraded.body, "/up upgrade ");
+  BOOST_CHECK_EQUAL(result.afterUpgrade.body, "/next localhost h2test");
+  // COMPRESSION_ERROR
+  BOOST_CHECK_EQUAL(result.goAwayError, 9u);
+}
@@ -0,0 +1,267 @@
+#include <muduo/net/http/HttpClient.h>
+#include <muduo/net/http/HttpContext.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpServer.h>
+
+//#define BOOST_TEST_MODULE HttpClientTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Runs HttpClient against a scripted server over loopback.
+
+namespace
+{
+
+// of the pid, below the ephemeral ports, so concurrent runs do not collide
+const uint16_t kPort = static_cast<uint16_t>(10000 + ::getpid() % 20000);
+const size_t kBigBody = 100 * 1000;
+
+class ScriptedServer
+{
+ public:
+  ScriptedServer(EventLoop* loop, uint16_t port)
+    : server_(loop, InetAddress(port), "ScriptedServer"),
+      connections_(0)
+  {
+    server_.setConnectionCallback(
+        boost::bind(&ScriptedServer::onConnection, this, _1));
+    server_.setMessageCallback(
+        boost::bind(&ScriptedServer::onMessage, this, _1, _2, _3));
+    server_.start();
+  }
+
+  int connections() const { return connections_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      ++connections_;
+      conn->setContext(HttpContext());
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime)
+  {
+    HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    while (context->parseRequest(buf, receiveTime) && context->gotAll())
+    {
+      respond(conn, context->request());
+      context->reset();
+    }
+  }
+
+  void respond(const TcpConnectionPtr& conn, const HttpRequest& req)
+  {
+    const string& path = req.path();
+    if (path == "/hello")
+    {
+      // no body for HEAD, but the length of GET
+      conn->send(req.method() == HttpRequest::kHead
+                 ? "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n"
+                 : "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+    }
+    else if (path == "/query")
+    {
+      string body = req.query();
+      char head[64];
+      snprintf(head, sizeof head, "HTTP/1.1 200 OK\r\ncontent-length: %zu\r\n\r\n", body.size());
+      conn->send(head + body);
+    }
+    else if (path == "/chunked")
+    {
+      conn->send("HTTP/1.1 100 Continue\r\n\r\n"
+                 "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n"
+                 "3\r\nabc\r\n4;ext=1\r\ndefg\r\n0\r\nX-Trailer: 1\r\n\r\n");
+    }
+    else if (path == "/close")
+    {
+      conn->send("HTTP/1.0 200 OK\r\n\r\nbye");
+      conn->shutdown();
+    }
+    else if (path == "/big")
+    {
+      conn->send("HTTP/1.1 200 OK\r\nContent-Length: 100000\r\n\r\n");
+      conn->send(string(kBigBody, 'x'));
+    }
+    else if (path == "/bad")
+    {
+      conn->send("HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n");
+    }
+    // "/slow" never gets a response
+  }
+
+  TcpServer server_;
+  int connections_;
+};
+
+struct Result
+{
+  Result() : status(0), error(HttpClient::kNoError), streamed(0), pieces(0) {}
+  int status;
+  HttpClient::Error error;
+  string body;
+  string header;
+  size_t streamed;
+  int pieces;
+};
+
+class Tester
+{
+ public:
+  Tester(EventLoop* loop, int expected)
+    : loop_(loop),
+      client_(new HttpClient(loop, "HttpClientTest")),
+      server_(InetAddress("127.0.0.1", kPort)),
+      expected_(expected),
+      results_(expected)
+  {
+  }
+
+  void get(int i, const string& path)
+  {
+    client_->get(server_, path, boost::bind(&Tester::onResponse, this, i, _1));
+  }
+
+  void request(int i, const HttpRequest& req, bool stream)
+  {
+    client_->request(server_, req,
+                     boost::bind(&Tester::onResponse, this, i, _1),
+                     stream ? boost::bind(&Tester::onBody, this, i, _1, _2, _3)
+                            : HttpClient::BodyCallback());
+  }
+
+  HttpClient* client() { return get_pointer(client_); }
+  const Result& result(int i) const { return results_[i]; }
+  const std::vector<int>& order() const { return order_; }
+
+ private:
+  void onResponse(int i, const HttpClient::Response& resp)
+  {
+    results_[i].status = resp.statusCode();
+    results_[i].error = resp.error();
+    results_[i].body = resp.body();
+    results_[i].header = resp.getHeader("X-Trailer") + resp.getHeader("Content-Length");
+    order_.push_back(i);
+    if (static_cast<int>(order_.size()) == expected_)
+    {
+      loop_->queueInLoop(boost::bind(&Tester::finish, this));
+    }
+  }
+
+  // HttpClient closes its connections in the loop
+  void finish()
+  {
+    client_.reset();
+    loop_->runAfter(0.1, boost::bind(&EventLoop::quit, loop_));
+  }
+
+  void onBody(int i, const HttpClient::Response& resp, const char*, size_t len)
+  {
+    results_[i].status = resp.statusCode();
+    results_[i].streamed += len;
+    ++results_[i].pieces;
+  }
+
+  EventLoop* loop_;
+  boost::scoped_ptr<HttpClient> client_;
+  InetAddress server_;
+  int expected_;
+  std::vector<Result> results_;
+  std::vector<int> order_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testPipelining)
+{
+  EventLoop loop;
+  ScriptedServer server(&loop, kPort);
+  const int kRequests = 10;
+  Tester tester(&loop, kRequests);
+  tester.client()->setMaxConnectionsPerHost(1);
+  tester.client()->setPipelineDepth(4);
+  for (int i = 0; i < kRequests; ++i)
+  {
+    tester.get(i, i % 2 ? "/hello" : "/query?i=0");
+  }
+  loop.runAfter(10, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_REQUIRE_EQUAL(tester.order().size(), kRequests);
+  for (int i = 0; i < kRequests; ++i)
+  {
+    BOOST_CHECK_EQUAL(tester.order()[i], i);
+    BOOST_CHECK_EQUAL(tester.result(i).error, HttpClient::kNoError);
+    BOOST_CHECK_EQUAL(tester.result(i).status, 200);
+    BOOST_CHECK_EQUAL(tester.result(i).body, i % 2 ? "hello" : "?i=0");
+  }
+  BOOST_CHECK_EQUAL(server.connections(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testBodies)
+{
+  EventLoop loop;
+  ScriptedServer server(&loop, kPort);
+  Tester tester(&loop, 5);
+  tester.client()->setMaxConnectionsPerHost(1);
+  tester.get(0, "/chunked");
+  HttpRequest head;
+  head.setMethod(HttpRequest::kHead);
+  head.setPath("/hello", "/hello" + 6);
+  tester.request(1, head, false);
+  tester.get(2, "/close");
+  HttpRequest big;
+  big.setMethod(HttpRequest::kGet);
+  big.setPath("/big", "/big" + 4);
+  tester.request(3, big, true);
+  tester.get(4, "/hello");
+  loop.runAfter(10, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(tester.result(0).status, 201);
+  BOOST_CHECK_EQUAL(tester.result(0).body, "abcdefg");
+  BOOST_CHECK_EQUAL(tester.result(1).status, 200);
+  BOOST_CHECK_EQUAL(tester.result(1).body, "");
+  BOOST_CHECK_EQUAL(tester.result(1).header, "5");
+  BOOST_CHECK_EQUAL(tester.result(2).error, HttpClient::kNoError);
+  BOOST_CHECK_EQUAL(tester.result(2).body, "bye");
+  BOOST_CHECK_EQUAL(tester.result(3).status, 200);
+  BOOST_CHECK_EQUAL(tester.result(3).body, "");
+  BOOST_CHECK_EQUAL(tester.result(3).streamed, kBigBody);
+  BOOST_CHECK_GT(tester.result(3).pieces, 0);
+  BOOST_CHECK_EQUAL(tester.result(4).body, "hello");
+  // a new connection after "/close"
+  BOOST_CHECK_EQUAL(server.connections(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(testErrors)
+{
+  EventLoop loop;
+  ScriptedServer server(&loop, kPort);
+  Tester tester(&loop, 3);
+  tester.client()->setTimeout(0.2);
+  tester.get(0, "/slow");
+  tester.get(1, "/bad");
+  tester.get(2, "/hello");
+  loop.runAfter(10, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(tester.result(0).error, HttpClient::kTimeout);
+  BOOST_CHECK_EQUAL(tester.result(1).error, HttpClient::kBadResponse);
+  BOOST_CHECK_EQUAL(tester.result(2).error, HttpClient::kNoError);
+  BOOST_CHECK_EQUAL(tester.result(2).body, "hello");
+}
@@ -0,0 +1,266 @@
+#include <muduo/net/http/HttpDeflater.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpServer.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpClient.h>
+
+//#define BOOST_TEST_MODULE HttpDeflaterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#include <zlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// of the pid, below the ephemeral ports, so concurrent runs do not collide
+const uint16_t kPort = static_cast<uint16_t>(10000 + ::getpid() % 20000);
+
+// decodes chunked transfer coding up to the last-chunk, returns false on
+// malformed input.
+bool dechunk(Buffer* input, string* output)
+{
+  while (true)
+  {
+    const char* crlf = input->findCRLF();
+    if (!crlf)
+    {
+      return false;
+    }
+    string size(input->peek(), crlf);
+    input->retrieveUntil(crlf + 2);
+    size_t len = strtoul(size.c_str(), NULL, 16);
+    if (input->readableBytes() < len + 2)
+    {
+      return false;
+    }
+    output->append(input->peek(), len);
+    input->retrieve(len);
+    if (string(input->peek(), 2) != "\r\n")
+    {
+      return false;
+    }
+    input->retrieve(2);
+    if (len == 0)
+    {
+      return true;
+    }
+  }
+}
+
+string inflate(const string& compressed, int windowBits)
+{
+  z_stream zs;
+  bzero(&zs, sizeof zs);
+  BOOST_REQUIRE_EQUAL(inflateInit2(&zs, windowBits), Z_OK);
+  string result;
+  char buf[4096];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zs.avail_in = static_cast<uInt>(compressed.size());
+  int error = Z_OK;
+  while (error == Z_OK)
+  {
+    zs.next_out = reinterpret_cast<Bytef*>(buf);
+    zs.avail_out = sizeof buf;
+    error = ::inflate(&zs, Z_NO_FLUSH);
+    result.append(buf, sizeof buf - zs.avail_out);
+  }
+  BOOST_CHECK_EQUAL(error, Z_STREAM_END);
+  inflateEnd(&zs);
+  return result;
+}
+
+string makeBody(size_t len)
+{
+  string body;
+  char line[64];
+  for (int i = 0; body.size() < len; ++i)
+  {
+    snprintf(line, sizeof line, "{\"id\": %d, \"value\": %d}\n", i, rand() % 100);
+    body += line;
+  }
+  body.resize(len);
+  return body;
+}
+
+void roundTrip(HttpDeflater::Coding coding, int windowBits, size_t len)
+{
+  string body = makeBody(len);
+  Buffer output;
+  {
+    HttpDeflater deflater(coding, -1, body);
+    BOOST_REQUIRE(deflater.valid());
+    int chunks = 1;
+    while (deflater.appendChunk(&output))
+    {
+      ++chunks;
+    }
+    BOOST_CHECK_EQUAL(deflater.inputBytes(), static_cast<int64_t>(len));
+    BOOST_CHECK(chunks >= 1);
+  }
+  string compressed;
+  BOOST_REQUIRE(dechunk(&output, &compressed));
+  BOOST_CHECK_EQUAL(output.readableBytes(), 0);
+  BOOST_CHECK(inflate(compressed, windowBits) == body);
+}
+
+// A body too large for the socket buffers, the client reads late, then
+// a request pipelined after it, which is answered when it is sent.
+class StreamingTest : boost::noncopyable
+{
+ public:
+  explicit StreamingTest(EventLoop* loop)
+    : loop_(loop),
+      server_(loop, InetAddress(kPort), "StreamingTest"),
+      client_(loop, InetAddress("127.0.0.1", kPort), "StreamingTest")
+  {
+    // random bytes do not compress
+    body_.resize(16 * 1000 * 1000);
+    for (size_t i = 0; i < body_.size(); ++i)
+    {
+      body_[i] = static_cast<char>(rand());
+    }
+    server_.setHttpCallback(boost::bind(&StreamingTest::onRequest, this, _1, _2));
+    server_.enableCompression(1);
+    client_.setConnectionCallback(boost::bind(&StreamingTest::onConnection, this, _1));
+    client_.setMessageCallback(boost::bind(&StreamingTest::onMessage, this, _1, _2, _3));
+  }
+
+  void run()
+  {
+    server_.start();
+    client_.connect();
+  }
+
+  const string& body() const { return body_; }
+  const string& received() const { return received_; }
+
+ private:
+  void onRequest(const HttpRequest&, HttpResponse* resp)
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("application/octet-stream");
+    resp->setBody(body_);
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->stopRead();
+      conn->send("GET /big HTTP/1.1\r\n"
+                 "Accept-Encoding: gzip\r\n"
+                 "\r\n"
+                 "GET /big HTTP/1.1\r\n"
+                 "Accept-Encoding: gzip;q=0, identity;q=0\r\n"
+                 "Connection: close\r\n"
+                 "\r\n");
+      loop_->runAfter(0.2, boost::bind(&TcpConnection::startRead, conn));
+    }
+    else
+    {
+      loop_->quit();
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr&, Buffer* buf, Timestamp)
+  {
+    received_.append(buf->peek(), buf->readableBytes());
+    buf->retrieveAll();
+  }
+
+  EventLoop* loop_;
+  HttpServer server_;
+  TcpClient client_;
+  string body_;
+  string received_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testNegotiate)
+{
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate(""), HttpDeflater::kIdentity);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip, deflate, br"), HttpDeflater::kGzip);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("deflate"), HttpDeflater::kDeflate);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("GZIP;q=0.5"), HttpDeflater::kGzip);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip;q=0, deflate"), HttpDeflater::kDeflate);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip ; q=0.000"), HttpDeflater::kIdentity);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*"), HttpDeflater::kGzip);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("identity, br"), HttpDeflater::kIdentity);
+  // q=0 of a coding wins over "*"
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*, gzip;q=0"), HttpDeflater::kDeflate);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip;q=0, *"), HttpDeflater::kDeflate);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*, gzip;q=0, deflate;q=0"), HttpDeflater::kIdentity);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*;q=0, gzip"), HttpDeflater::kGzip);
+  // identity
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip", true), HttpDeflater::kIdentity);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip, identity;q=0", true), HttpDeflater::kGzip);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*;q=0, deflate", true), HttpDeflater::kDeflate);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("identity;q=0"), HttpDeflater::kNotAcceptable);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("*;q=0"), HttpDeflater::kNotAcceptable);
+  BOOST_CHECK_EQUAL(HttpDeflater::negotiate("gzip;q=0, identity;q=0"), HttpDeflater::kNotAcceptable);
+}
+
+BOOST_AUTO_TEST_CASE(testGzip)
+{
+  roundTrip(HttpDeflater::kGzip, 15 + 16, 0);
+  roundTrip(HttpDeflater::kGzip, 15 + 16, 100);
+  roundTrip(HttpDeflater::kGzip, 15 + 16, 1000 * 1000);
+}
+
+BOOST_AUTO_TEST_CASE(testDeflate)
+{
+  roundTrip(HttpDeflater::kDeflate, 15, 1000);
+  roundTrip(HttpDeflater::kDeflate, 15, 1000 * 1000);
+}
+
+BOOST_AUTO_TEST_CASE(testReuse)
+{
+  // the second one reuses the deflate state of the first one
+  for (int i = 0; i < 10; ++i)
+  {
+    roundTrip(HttpDeflater::kGzip, 15 + 16, 10 * 1000);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testServerStreams)
+{
+  EventLoop loop;
+  StreamingTest test(&loop);
+  test.run();
+  loop.runAfter(30.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  const string& received = test.received();
+  size_t headersEnd = received.find("\r\n\r\n");
+  BOOST_REQUIRE(headersEnd != string::npos);
+  string headers(received, 0, headersEnd);
+  Buffer input;
+  input.append(received.data() + headersEnd + 4, received.size() - headersEnd - 4);
+  BOOST_CHECK(headers.find("Content-Encoding: gzip") != string::npos);
+  BOOST_CHECK(headers.find("Transfer-Encoding: chunked") != string::npos);
+
+  string compressed;
+  BOOST_REQUIRE(dechunk(&input, &compressed));
+  BOOST_CHECK(inflate(compressed, 15 + 16) == test.body());
+  // the second one, which refuses both
+  BOOST_CHECK_EQUAL(string(input.peek(), std::min<size_t>(input.readableBytes(), 28)),
+                    "HTTP/1.1 406 Not Acceptable\r");
+}
@@ -0,0 +1,53 @@
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/Buffer.h>
+
+//#define BOOST_TEST_MODULE HttpResponseTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::Timestamp;
+using muduo::net::Buffer;
+using muduo::net::HttpResponse;
+
+BOOST_AUTO_TEST_CASE(testKeepAlive)
+{
+  HttpResponse resp(false);
+  resp.setStatusCode(HttpResponse::k200Ok);
+  resp.setStatusMessage("OK");
+  resp.setContentType("text/plain");
+  resp.addHeader("Server", "Muduo");
+  resp.addHeader("Content-Type", "text/html");
+  string body("hello, world!\n");
+  resp.swapBody(&body);
+  BOOST_CHECK(body.empty());
+
+  Buffer buf;
+  // 1994-11-06 08:49:37 UTC
+  resp.appendToBuffer(&buf, Timestamp::fromUnixTime(784111777));
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(),
+                    "HTTP/1.1 200 OK\r\n"
+                    "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                    "Content-Length: 14\r\n"
+                    "Connection: Keep-Alive\r\n"
+                    "Content-Type: text/html\r\n"
+                    "Server: Muduo\r\n"
+                    "\r\n"
+                    "hello, world!\n");
+}
+
+BOOST_AUTO_TEST_CASE(testCustomStatus)
+{
+  HttpResponse resp(true);
+  resp.setStatusCode(HttpResponse::k404NotFound);
+  resp.setStatusMessage("Nothing Here");
+
+  Buffer buf;
+  resp.appendToBuffer(&buf, Timestamp::fromUnixTime(951782400));
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(),
+                    "HTTP/1.1 404 Nothing Here\r\n"
+                    "Date: Tue, 29 Feb 2000 00:00:00 GMT\r\n"
+                    "Connection: close\r\n"
+                    "\r\n");
+}
@@ -0,0 +1,184 @@
+#include <muduo/net/http/HttpRouter.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/Buffer.h>
+
+#include <boost/bind.hpp>
+
+//#define BOOST_TEST_MODULE HttpRouterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::net::Buffer;
+using muduo::net::HttpRequest;
+using muduo::net::HttpResponse;
+using muduo::net::HttpRouter;
+
+namespace
+{
+
+string g_matched;
+string g_params;
+
+void handler(const char* name,
+             const HttpRequest&,
+             const HttpRouter::Params& params,
+             HttpResponse* resp)
+{
+  g_matched = name;
+  g_params.clear();
+  for (int i = 0; i < params.size(); ++i)
+  {
+    g_params += params.name(i).as_string();
+    g_params += "=";
+    g_params += params.value(i).as_string();
+    g_params += ";";
+  }
+  resp->setStatusCode(HttpResponse::k200Ok);
+}
+
+HttpRouter::Handler named(const char* name)
+{
+  return boost::bind(handler, name, _1, _2, _3);
+}
+
+bool route(const HttpRouter& router, const char* method, const string& path)
+{
+  HttpRequest req;
+  req.setMethod(method, method + strlen(method));
+  req.setPath(path.data(), path.data() + path.size());
+  HttpResponse resp(false);
+  g_matched.clear();
+  g_params.clear();
+  return router.route(req, &resp);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testStaticRoutes)
+{
+  HttpRouter router;
+  router.add(HttpRequest::kGet, "/", named("root"));
+  router.add(HttpRequest::kGet, "/hello", named("hello"));
+  router.add(HttpRequest::kGet, "/help", named("help"));
+  router.add(HttpRequest::kGet, "/hello/world", named("world"));
+  router.add(HttpRequest::kPost, "/hello", named("post hello"));
+  router.compile();
+
+  BOOST_CHECK(route(router, "GET", "/"));
+  BOOST_CHECK_EQUAL(g_matched, "root");
+  BOOST_CHECK(route(router, "GET", "/hello"));
+  BOOST_CHECK_EQUAL(g_matched, "hello");
+  BOOST_CHECK(route(router, "GET", "/help"));
+  BOOST_CHECK_EQUAL(g_matched, "help");
+  BOOST_CHECK(route(router, "GET", "/hello/world"));
+  BOOST_CHECK_EQUAL(g_matched, "world");
+  BOOST_CHECK(route(router, "POST", "/hello"));
+  BOOST_CHECK_EQUAL(g_matched, "post hello");
+
+  BOOST_CHECK(!route(router, "GET", "/hel"));
+  BOOST_CHECK(!route(router, "GET", "/hello/"));
+  BOOST_CHECK(!route(router, "GET", "/helloo"));
+  BOOST_CHECK(!route(router, "DELETE", "/hello"));
+}
+
+BOOST_AUTO_TEST_CASE(testParamsAndWildcard)
+{
+  HttpRouter router;
+  router.add(HttpRequest::kGet, "/users/:id", named("user"));
+  router.add(HttpRequest::kGet, "/users/:id/posts/:post", named("post"));
+  router.add(HttpRequest::kGet, "/users/new", named("new user"));
+  router.add(HttpRequest::kGet, "/static/*file", named("static"));
+  router.addAny("/any/:x", named("any"));
+  router.compile();
+
+  BOOST_CHECK(route(router, "GET", "/users/42"));
+  BOOST_CHECK_EQUAL(g_matched, "user");
+  BOOST_CHECK_EQUAL(g_params, "id=42;");
+
+  BOOST_CHECK(route(router, "GET", "/users/new"));
+  BOOST_CHECK_EQUAL(g_matched, "new user");
+  BOOST_CHECK_EQUAL(g_params, "");
+
+  // backtracks from static "new" to parameter
+  BOOST_CHECK(route(router, "GET", "/users/new/posts/7"));
+  BOOST_CHECK_EQUAL(g_matched, "post");
+  BOOST_CHECK_EQUAL(g_params, "id=new;post=7;");
+
+  BOOST_CHECK(route(router, "GET", "/static/css/main.css"));
+  BOOST_CHECK_EQUAL(g_matched, "static");
+  BOOST_CHECK_EQUAL(g_params, "file=css/main.css;");
+
+  BOOST_CHECK(route(router, "GET", "/static/"));
+  BOOST_CHECK_EQUAL(g_params, "file=;");
+
+  BOOST_CHECK(route(router, "PUT", "/any/1"));
+  BOOST_CHECK_EQUAL(g_matched, "any");
+
+  BOOST_CHECK(!route(router, "GET", "/users/"));
+  BOOST_CHECK(!route(router, "GET", "/users/42/posts"));
+}
+
+BOOST_AUTO_TEST_CASE(testNotFoundAndMethodNotAllowed)
+{
+  HttpRouter router;
+  router.add(HttpRequest::kGet, "/a", named("a"));
+  router.compile();
+
+  HttpRequest req;
+  const char post[] = "POST";
+  const char path[] = "/a";
+  req.setMethod(post, post + 4);
+  req.setPath(path, path + 2);
+  HttpResponse resp(true);
+  BOOST_CHECK(!router.route(req, &resp));
+  Buffer buf;
+  resp.appendToBuffer(&buf);
+  BOOST_CHECK(buf.retrieveAllAsString().find("HTTP/1.1 405 ") == 0);
+
+  HttpRequest req2;
+  const char b[] = "/b";
+  req2.setMethod(post, post + 4);
+  req2.setPath(b, b + 2);
+  HttpResponse resp2(true);
+  BOOST_CHECK(!router.route(req2, &resp2));
+  resp2.appendToBuffer(&buf);
+  BOOST_CHECK(buf.retrieveAllAsString().find("HTTP/1.1 404 ") == 0);
+}
+
+BOOST_AUTO_TEST_CASE(testMatchByMethod)
+{
+  HttpRouter router;
+  router.add(HttpRequest::kGet, "/users/:id", named("get user"));
+  router.add(HttpRequest::kPost, "/users/new", named("create user"));
+  router.add(HttpRequest::kPut, "/files/readme", named("put readme"));
+  router.add(HttpRequest::kGet, "/files/*path", named("get file"));
+  router.compile();
+
+  // static "new" is POST only, backtracks to parameter
+  BOOST_CHECK(route(router, "GET", "/users/new"));
+  BOOST_CHECK_EQUAL(g_matched, "get user");
+  BOOST_CHECK_EQUAL(g_params, "id=new;");
+  BOOST_CHECK(route(router, "POST", "/users/new"));
+  BOOST_CHECK_EQUAL(g_matched, "create user");
+
+  // and to wildcard
+  BOOST_CHECK(route(router, "GET", "/files/readme"));
+  BOOST_CHECK_EQUAL(g_matched, "get file");
+  BOOST_CHECK_EQUAL(g_params, "path=readme;");
+  BOOST_CHECK(route(router, "PUT", "/files/readme"));
+  BOOST_CHECK_EQUAL(g_matched, "put readme");
+
+  // 405, not 404, when only another method matches
+  HttpRequest req;
+  const char del[] = "DELETE";
+  const char path[] = "/users/7";
+  req.setMethod(del, del + 6);
+  req.setPath(path, path + 8);
+  HttpResponse resp(true);
+  BOOST_CHECK(!router.route(req, &resp));
+  Buffer buf;
+  resp.appendToBuffer(&buf);
+  BOOST_CHECK(buf.retrieveAllAsString().find("HTTP/1.1 405 ") == 0);
+}
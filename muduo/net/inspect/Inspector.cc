@@ -60,12 +60,26 @@ std::vector<string> split(const string& str)
 
 extern char favicon[1743];
 
+namespace
+{
+
+void onFavicon(const HttpRequest&, const HttpRouter::Params&, HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("image/png");
+  resp->setBody(string(favicon, sizeof favicon));
+}
+
+}
+
 Inspector::Inspector(EventLoop* loop,
                      const InetAddress& httpAddr,
                      const string& name)
     : server_(loop, httpAddr, "Inspector:"+name),
       processInspector_(new ProcessInspector),
-      systemInspector_(new SystemInspector)
+      systemInspector_(new SystemInspector),
+      rebuildPending_(false)
 {
   assert(CurrentThread::isMainThread());
   assert(g_globalInspector == 0);
@@ -94,6 +108,7 @@ void Inspector::add(const string& module,
   MutexLockGuard lock(mutex_);
   modules_[module][command] = cb;
   helps_[module][command] = help;
+  scheduleRebuild();
 }
 
 void Inspector::remove(const string& module, const string& command)
@@ -104,6 +119,7 @@ void Inspector::remove(const string& module, const string& command)
   {
     it->second.erase(command);
     helps_[module].erase(command);
+    scheduleRebuild();
   }
 }
 
@@ -112,12 +128,46 @@ void Inspector::start()
   server_.start();
 }
 
-void Inspector::onRequest(const HttpRequest& req, HttpResponse* resp)
+void Inspector::scheduleRebuild()
 {
-  if (req.path() == "/")
+  mutex_.assertLocked();
+  if (!rebuildPending_)
+  {
+    rebuildPending_ = true;
+    server_.getLoop()->queueInLoop(boost::bind(&Inspector::rebuild, this));
+  }
+}
+
+// Requests are served in the loop thread only, so the router is replaced
+// there as a whole, and onRequest() needs no lock.
+void Inspector::rebuild()
+{
+  server_.getLoop()->assertInLoopThread();
+  boost::scoped_ptr<HttpRouter> router(new HttpRouter);
+  string help;
   {
-    string result;
     MutexLockGuard lock(mutex_);
+    rebuildPending_ = false;
+    for (std::map<string, CommandList>::const_iterator commListI = modules_.begin();
+         commListI != modules_.end();
+         ++commListI)
+    {
+      const CommandList& commList = commListI->second;
+      for (CommandList::const_iterator it = commList.begin();
+           it != commList.end();
+           ++it)
+      {
+        if (it->second)
+        {
+          string path = "/" + commListI->first + "/" + it->first;
+          HttpRouter::Handler handler =
+              boost::bind(&Inspector::onCommand, this, it->second, _1, _2, _3);
+          router->addAny(path, handler);
+          router->addAny(path + "/*args", handler);
+        }
+      }
+    }
+
     for (std::map<string, HelpList>::const_iterator helpListI = helps_.begin();
          helpListI != helps_.end();
          ++helpListI)
@@ -127,82 +177,57 @@ void Inspector::onRequest(const HttpRequest& req, HttpResponse* resp)
            it != list.end();
            ++it)
       {
-        result += "/";
-        result += helpListI->first;
-        result += "/";
-        result += it->first;
+        help += "/";
+        help += helpListI->first;
+        help += "/";
+        help += it->first;
         size_t len = helpListI->first.size() + it->first.size();
-        result += string(len >= 25 ? 1 : 25 - len, ' ');
-        result += it->second;
-        result += "\n";
+        help += string(len >= 25 ? 1 : 25 - len, ' ');
+        help += it->second;
+        help += "\n";
       }
     }
-    resp->setStatusCode(HttpResponse::k200Ok);
-    resp->setStatusMessage("OK");
-    resp->setContentType("text/plain");
-    resp->setBody(result);
   }
-  else
-  {
-    std::vector<string> result = split(req.path());
-    // boost::split(result, req.path(), boost::is_any_of("/"));
-    //std::copy(result.begin(), result.end(), std::ostream_iterator<string>(std::cout, ", "));
-    //std::cout << "\n";
-    bool ok = false;
-    if (result.size() == 0)
-    {
-      LOG_DEBUG << req.path();
-    }
-    else if (result.size() == 1)
-    {
-      string module = result[0];
-      if (module == "favicon.ico")
-      {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("image/png");
-        resp->setBody(string(favicon, sizeof favicon));
+  router->addAny("/", boost::bind(&Inspector::onHelp, this, _1, _2, _3));
+  router->addAny("/favicon.ico", boost::bind(&onFavicon, _1, _2, _3));
+  router->compile();
+  router_.swap(router);
+  helpText_.swap(help);
+}
 
-        ok = true;
-      }
-      else
-      {
-        LOG_ERROR << "Unimplemented " << module;
-      }
-    }
-    else
-    {
-      string module = result[0];
-      std::map<string, CommandList>::const_iterator commListI = modules_.find(module);
-      if (commListI != modules_.end())
-      {
-        string command = result[1];
-        const CommandList& commList = commListI->second;
-        CommandList::const_iterator it = commList.find(command);
-        if (it != commList.end())
-        {
-          ArgList args(result.begin()+2, result.end());
-          if (it->second)
-          {
-            resp->setStatusCode(HttpResponse::k200Ok);
-            resp->setStatusMessage("OK");
-            resp->setContentType("text/plain");
-            const Callback& cb = it->second;
-            resp->setBody(cb(req.method(), args));
-            ok = true;
-          }
-        }
-      }
+void Inspector::onRequest(const HttpRequest& req, HttpResponse* resp)
+{
+  server_.getLoop()->assertInLoopThread();
+  if (!router_ || !router_->route(req, resp))
+  {
+    LOG_DEBUG << "Not found " << req.path();
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+  }
+  //resp->setCloseConnection(true);
+}
 
-    }
+void Inspector::onHelp(const HttpRequest& req,
+                       const HttpRouter::Params& params,
+                       HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  resp->setBody(helpText_);
+}
 
-    if (!ok)
-    {
-      resp->setStatusCode(HttpResponse::k404NotFound);
-      resp->setStatusMessage("Not Found");
-    }
-    //resp->setCloseConnection(true);
-  }
+void Inspector::onCommand(const Callback& cb,
+                          const HttpRequest& req,
+                          const HttpRouter::Params& params,
+                          HttpResponse* resp)
+{
+  ArgList args = split(params.get("args").as_string());
+  string body = cb(req.method(), args);
+  resp->setStatusCode(HttpResponse::k200Ok);
+  resp->setStatusMessage("OK");
+  resp->setContentType("text/plain");
+  resp->swapBody(&body);
 }
 
 char favicon[1743] =
@@ -13,6 +13,7 @@
 
 #include <muduo/base/Mutex.h>
 #include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpRouter.h>
 #include <muduo/net/http/HttpServer.h>
 
 #include <map>
@@ -53,7 +54,16 @@ class Inspector : boost::noncopyable
   typedef std::map<string, string> HelpList;
 
   void start();
+  void scheduleRebuild();
+  void rebuild();
   void onRequest(const HttpRequest& req, HttpResponse* resp);
+  void onHelp(const HttpRequest& req,
+              const HttpRouter::Params& params,
+              HttpResponse* resp);
+  void onCommand(const Callback& cb,
+                 const HttpRequest& req,
+                 const HttpRouter::Params& params,
+                 HttpResponse* resp);
 
   HttpServer server_;
   boost::scoped_ptr<ProcessInspector> processInspector_;
@@ -62,6 +72,10 @@ class Inspector : boost::noncopyable
   MutexLock mutex_;
   std::map<string, CommandList> modules_;
   std::map<string, HelpList> helps_;
+  bool rebuildPending_;
+  // accessed in loop thread of server_ only, rebuilt after add() or remove().
+  boost::scoped_ptr<HttpRouter> router_;
+  string helpText_;
 };
 
 }
@@ -0,0 +1,50 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/inspect/LoggingInspector.h>
+#include <muduo/base/AsyncLogging.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+void LoggingInspector::registerCommands(Inspector* ins)
+{
+  ins->add("logging", "stats",
+           boost::bind(&LoggingInspector::stats, this, _1, _2),
+           "queued and written bytes, drops, write latency of the log file");
+}
+
+string LoggingInspector::stats(HttpRequest::Method, const Inspector::ArgList&)
+{
+  AsyncLogging::Stats stats = log_->stats();
+  char buf[1024];
+  snprintf(buf, sizeof buf,
+           "queued_buffers %d\n"
+           "queued_bytes %lld\n"
+           "written_bytes %lld\n"
+           "written_bytes_per_second %.0f\n"
+           "dropped_lines %lld\n"
+           "dropped_buffers %lld\n"
+           "blocked_lines %lld\n"
+           "write_microseconds %lld\n"
+           "max_write_microseconds %lld\n",
+           stats.queuedBuffers,
+           static_cast<long long>(stats.queuedBytes),
+           static_cast<long long>(stats.writtenBytes),
+           stats.writtenBytesPerSecond,
+           static_cast<long long>(stats.droppedLines),
+           static_cast<long long>(stats.droppedBuffers),
+           static_cast<long long>(stats.blockedLines),
+           static_cast<long long>(stats.writeMicroSeconds),
+           static_cast<long long>(stats.maxWriteMicroSeconds));
+  return buf;
+}
@@ -0,0 +1,45 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_INSPECT_LOGGINGINSPECTOR_H
+#define MUDUO_NET_INSPECT_LOGGINGINSPECTOR_H
+
+#include <muduo/net/inspect/Inspector.h>
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+
+class AsyncLogging;
+
+namespace net
+{
+
+// /logging/stats of an AsyncLogging, which outlives the Inspector.
+class LoggingInspector : boost::noncopyable
+{
+ public:
+  explicit LoggingInspector(AsyncLogging* log)
+    : log_(log)
+  {
+  }
+
+  void registerCommands(Inspector* ins);
+
+  string stats(HttpRequest::Method, const Inspector::ArgList&);
+
+ private:
+  AsyncLogging* log_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_INSPECT_LOGGINGINSPECTOR_H
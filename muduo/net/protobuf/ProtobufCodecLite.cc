@@ -9,14 +9,22 @@
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
 // #include <muduo/net/protobuf/BufferStream.h>
 
+#include <muduo/base/Crc32c.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/base/ThreadPool.h>
 #include <muduo/net/Endian.h>
+#include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpConnection.h>
+#include <muduo/net/ZlibStream.h>
 #include <muduo/net/protorpc/google-inl.h>
 
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/message.h>
 #include <zlib.h>
 
+#include <algorithm>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -28,6 +36,30 @@ namespace
     return 0;
   }
   int __attribute__ ((unused)) dummy = ProtobufVersionCheck();
+
+  // Compression state of a thread, so payloads do not pay for
+  // deflateInit() and inflateInit().
+  class ZlibState : boost::noncopyable
+  {
+   public:
+    ZlibState()
+      : deflater(&idle, Z_BEST_SPEED),  // one payload at a time, speed first
+        inflater(&idle)
+    {
+    }
+
+    Buffer idle;  // outlives the streams
+    ZlibOutputStream deflater;
+    ZlibInputStream inflater;
+    Buffer compressed;
+    Buffer decompressed;
+  };
+
+  typedef ThreadLocalSingleton<ZlibState> ThreadZlibState;
+
+  const char kCompressedMarker = 0;
+  // bounds the output of each inflate, deflate is at most about 1000:1
+  const int kInflateInputChunk = 4096;
 }
 
 void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
@@ -39,16 +71,53 @@ void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
   conn->send(&buf);
 }
 
+bool ProtobufCodecLite::send(const TcpConnectionPtr& conn,
+                             const MessagePtr& message)
+{
+  if (pool_)
+  {
+    return !post(&encodeQueues_, conn,
+                 boost::bind(&ProtobufCodecLite::encodeInPool, this, conn, message),
+                 static_cast<size_t>(message->ByteSize()));
+  }
+  else
+  {
+    send(conn, *message);
+    return true;
+  }
+}
+
+namespace
+{
+  void sendBuffer(const TcpConnectionPtr& conn, const boost::shared_ptr<Buffer>& buf)
+  {
+    conn->send(get_pointer(buf));
+  }
+}
+
+void ProtobufCodecLite::encodeInPool(const TcpConnectionPtr& conn,
+                                     const MessagePtr& message)
+{
+  // send() from other threads copies the frame into a string, maybe twice
+  boost::shared_ptr<Buffer> buf(new Buffer);
+  fillEmptyBuffer(get_pointer(buf), *message);
+  conn->getLoop()->queueInLoop(boost::bind(sendBuffer, conn, buf));
+}
+
 void ProtobufCodecLite::fillEmptyBuffer(muduo::net::Buffer* buf,
                                         const google::protobuf::Message& message)
 {
   assert(buf->readableBytes() == 0);
-  // FIXME: can we move serialization & checksum to other thread?
   buf->append(tag_);
 
   int byte_size = serializeToBuffer(message, buf);
+  if (compressionType_ != kNoCompression && byte_size >= compressionThreshold_
+      && compressPayload(buf, byte_size, compressionType_))
+  {
+    byte_size = static_cast<int>(buf->readableBytes() - tag_.size());
+  }
 
-  int32_t checkSum = checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+  int32_t checkSum = checksum(checksumType_, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
   assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
   int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
@@ -59,6 +128,12 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
                                   Buffer* buf,
                                   Timestamp receiveTime)
 {
+  if (pool_ && !rawCb_)
+  {
+    sliceFrames(conn, buf, receiveTime);
+    return;
+  }
+
   while (buf->readableBytes() >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
   {
     const int32_t len = buf->peekInt32();
@@ -75,7 +150,6 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
         continue;
       }
       MessagePtr message(prototype_->New());
-      // FIXME: can we move deserialization & callback to other thread?
       ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get());
       if (errorCode == kNoError)
       {
@@ -96,6 +170,222 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
   }
 }
 
+void ProtobufCodecLite::sliceFrames(const TcpConnectionPtr& conn,
+                                    Buffer* buf,
+                                    Timestamp receiveTime)
+{
+  if (failed(conn))
+  {
+    buf->retrieveAll();
+    return;
+  }
+
+  // whole frames only, they are checked and parsed in the pool
+  size_t n = 0;
+  ErrorCode errorCode = kNoError;
+  while (buf->readableBytes() - n >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
+  {
+    const int32_t len = asInt32(buf->peek() + n);
+    if (len > kMaxMessageLen || len < kMinMessageLen)
+    {
+      errorCode = kInvalidLength;
+      break;
+    }
+    else if (buf->readableBytes() - n >= implicit_cast<size_t>(kHeaderLen+len))
+    {
+      n += kHeaderLen+len;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if (n > 0 || errorCode != kNoError)
+  {
+    boost::shared_ptr<Buffer> frames(new Buffer(n == buf->readableBytes() ? 0 : n));
+    if (n == buf->readableBytes())
+    {
+      frames->swap(*buf);
+    }
+    else
+    {
+      frames->append(buf->peek(), n);
+      buf->retrieve(n);
+    }
+    if (errorCode != kNoError)
+    {
+      // the rest can not be framed, reported once
+      MutexLockGuard lock(mutex_);
+      for (ConnectionMap::iterator it = failed_.begin(); it != failed_.end(); )
+      {
+        if (it->second.expired())
+        {
+          failed_.erase(it++);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+      failed_[get_pointer(conn)] = conn;
+    }
+    // the error is reported after the frames before it
+    post(&decodeQueues_, conn,
+         boost::bind(&ProtobufCodecLite::decodeInPool, this, conn, frames, receiveTime, errorCode),
+         frames->readableBytes());
+  }
+}
+
+bool ProtobufCodecLite::failed(const TcpConnectionPtr& conn)
+{
+  MutexLockGuard lock(mutex_);
+  ConnectionMap::iterator it = failed_.find(get_pointer(conn));
+  // or another connection at the same address
+  return it != failed_.end() && it->second.lock() == conn;
+}
+
+void ProtobufCodecLite::decodeInPool(const TcpConnectionPtr& conn,
+                                     const boost::shared_ptr<Buffer>& frames,
+                                     Timestamp receiveTime,
+                                     ErrorCode trailingError)
+{
+  MessageList messages;
+  ErrorCode errorCode = kNoError;
+  while (frames->readableBytes() > 0)
+  {
+    const int32_t len = frames->peekInt32();
+    MessagePtr message(prototype_->New());
+    errorCode = parse(frames->peek()+kHeaderLen, len, message.get());
+    frames->retrieve(kHeaderLen+len);
+    if (errorCode != kNoError)
+    {
+      break;
+    }
+    messages.push_back(message);
+  }
+  if (errorCode == kNoError)
+  {
+    errorCode = trailingError;
+  }
+
+  if (!messages.empty() || errorCode != kNoError)
+  {
+    conn->getLoop()->queueInLoop(
+        boost::bind(&ProtobufCodecLite::deliver, messageCallback_, errorCallback_,
+                    conn, messages, receiveTime, errorCode));
+  }
+}
+
+void ProtobufCodecLite::pauseReading(const TcpConnectionPtr& conn)
+{
+  conn->stopRead();
+}
+
+void ProtobufCodecLite::resumeReading(const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn->startRead();
+  }
+}
+
+void ProtobufCodecLite::deliver(const ProtobufMessageCallback& messageCb,
+                                const ErrorCallback& errorCb,
+                                const TcpConnectionPtr& conn,
+                                const MessageList& messages,
+                                Timestamp receiveTime,
+                                ErrorCode errorCode)
+{
+  for (size_t i = 0; i < messages.size(); ++i)
+  {
+    messageCb(conn, messages[i], receiveTime);
+  }
+  if (errorCode != kNoError)
+  {
+    errorCb(conn, conn->inputBuffer(), receiveTime, errorCode);
+  }
+}
+
+bool ProtobufCodecLite::post(TaskQueues* queues,
+                             const TcpConnectionPtr& conn,
+                             const Task& task,
+                             size_t bytes)
+{
+  bool idle = false;
+  bool full = false;
+  {
+    MutexLockGuard lock(mutex_);
+    TaskQueue* queue = &(*queues)[get_pointer(conn)];
+    queue->conn = conn;
+    queue->tasks.push_back(std::make_pair(task, bytes));
+    queue->bytes += bytes;
+    idle = queue->tasks.size() == 1;
+    full = queue->bytes > maxQueuedBytes_;
+    if (full && !queue->stopped)
+    {
+      queue->stopped = true;
+      // under the lock, so it is queued to the loop before the
+      // resumeReading() of runQueue()
+      conn->getLoop()->runInLoop(boost::bind(&ProtobufCodecLite::pauseReading, conn));
+    }
+  }
+  if (idle)
+  {
+    // the queue holds conn, so the key stays unique while not empty
+    pool_->run(boost::bind(&ProtobufCodecLite::runQueue, this, queues, get_pointer(conn)));
+  }
+  return full;
+}
+
+void ProtobufCodecLite::runQueue(TaskQueues* queues, TcpConnection* conn)
+{
+  TaskQueues* others = queues == &encodeQueues_ ? &decodeQueues_ : &encodeQueues_;
+  // one task of a connection at a time, in order
+  Task task;
+  {
+    MutexLockGuard lock(mutex_);
+    task = (*queues)[conn].tasks.front().first;
+  }
+  while (true)
+  {
+    task();
+    bool done = false;
+    {
+      MutexLockGuard lock(mutex_);
+      TaskQueues::iterator it = queues->find(conn);
+      assert(it != queues->end());
+      TaskQueue& queue = it->second;
+      queue.bytes -= queue.tasks.front().second;
+      queue.tasks.pop_front();
+      if (queue.stopped && queue.bytes <= maxQueuedBytes_)
+      {
+        queue.stopped = false;
+        // or the other queue of conn resumes it, when it drains
+        TaskQueues::const_iterator other = others->find(conn);
+        if (other == others->end() || !other->second.stopped)
+        {
+          queue.conn->getLoop()->queueInLoop(
+              boost::bind(&ProtobufCodecLite::resumeReading, queue.conn));
+        }
+      }
+      if (queue.tasks.empty())
+      {
+        queues->erase(it);
+        done = true;
+      }
+      else
+      {
+        task = queue.tasks.front().first;
+      }
+    }
+    if (done)
+    {
+      break;
+    }
+  }
+}
+
 bool ProtobufCodecLite::parseFromBuffer(StringPiece buf, google::protobuf::Message* message)
 {
   return message->ParseFromArray(buf.data(), buf.size());
@@ -132,6 +422,7 @@ namespace
   const string kInvalidNameLenStr = "InvalidNameLen";
   const string kUnknownMessageTypeStr = "UnknownMessageType";
   const string kParseErrorStr = "ParseError";
+  const string kDecompressErrorStr = "DecompressError";
   const string kUnknownErrorStr = "UnknownError";
 }
 
@@ -151,6 +442,8 @@ const string& ProtobufCodecLite::errorCodeToString(ErrorCode errorCode)
      return kUnknownMessageTypeStr;
    case kParseError:
      return kParseErrorStr;
+   case kDecompressError:
+     return kDecompressErrorStr;
    default:
      return kUnknownErrorStr;
   }
@@ -177,36 +470,133 @@ int32_t ProtobufCodecLite::asInt32(const char* buf)
 
 int32_t ProtobufCodecLite::checksum(const void* buf, int len)
 {
-  return static_cast<int32_t>(
-      ::adler32(1, static_cast<const Bytef*>(buf), len));
+  return checksum(kAdler32, buf, len);
 }
 
 bool ProtobufCodecLite::validateChecksum(const char* buf, int len)
 {
+  return validateChecksum(kAdler32, buf, len);
+}
+
+int32_t ProtobufCodecLite::checksum(ChecksumType type, const void* buf, int len)
+{
+  switch (type)
+  {
+   case kAdler32:
+     return static_cast<int32_t>(
+         ::adler32(1, static_cast<const Bytef*>(buf), len));
+   case kCrc32c:
+     return static_cast<int32_t>(crc32c::value(buf, static_cast<size_t>(len)));
+   default:
+     return 0;
+  }
+}
+
+bool ProtobufCodecLite::validateChecksum(ChecksumType type, const char* buf, int len)
+{
+  if (type == kNoChecksum)
+  {
+    return true;
+  }
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
+bool ProtobufCodecLite::compressPayload(Buffer* buf, size_t len, CompressionType type)
+{
+  assert(len <= buf->readableBytes());
+  if (type != kZlib || len == 0)
+  {
+    return false;
+  }
+
+  ZlibState& state = ThreadZlibState::instance();
+  Buffer* output = &state.compressed;
+  output->retrieveAll();
+  uint8_t header[2 + 5];  // marker, method and a varint32
+  header[0] = kCompressedMarker;
+  header[1] = static_cast<uint8_t>(type);
+  uint8_t* end = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+      static_cast<uint32_t>(len), header + 2);
+  output->append(header, end - header);
+
+  StringPiece payload(buf->beginWrite() - len, static_cast<int>(len));
+  if (state.deflater.reset(output)
+      && state.deflater.write(payload)
+      && state.deflater.finishStream()
+      && output->readableBytes() < len)
+  {
+    buf->unwrite(len);
+    buf->append(output->peek(), output->readableBytes());
+    return true;
+  }
+  return false;
+}
+
+ProtobufCodecLite::ErrorCode ProtobufCodecLite::decompressPayload(StringPiece* payload, Buffer* output)
+{
+  if (payload->empty() || (*payload)[0] != kCompressedMarker)
+  {
+    return kNoError;
+  }
+
+  ZlibState& state = ThreadZlibState::instance();
+  if (output == NULL)
+  {
+    output = &state.decompressed;
+  }
+  output->retrieveAll();
+  if (payload->size() < 2 || static_cast<uint8_t>((*payload)[1]) != kZlib)
+  {
+    return kDecompressError;
+  }
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(payload->data()) + 2, payload->size() - 2);
+  uint32_t len = 0;
+  if (!input.ReadVarint32(&len) || len > static_cast<uint32_t>(kMaxMessageLen))
+  {
+    return kDecompressError;
+  }
+
+  StringPiece data(payload->data() + 2 + input.CurrentPosition(),
+                   payload->size() - 2 - input.CurrentPosition());
+  output->ensureWritableBytes(len);
+  bool ok = state.inflater.reset(output);
+  while (ok && !data.empty())
+  {
+    int n = std::min(data.size(), kInflateInputChunk);
+    ok = state.inflater.write(StringPiece(data.data(), n))
+        && output->readableBytes() <= len;
+    data.remove_prefix(n);
+  }
+  if (ok
+      && state.inflater.zlibErrorCode() == Z_STREAM_END
+      && output->readableBytes() == len)
+  {
+    *payload = output->toStringPiece();
+    return kNoError;
+  }
+  return kDecompressError;
+}
+
 ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
                                                       int len,
                                                       ::google::protobuf::Message* message)
 {
   ErrorCode error = kNoError;
 
-  if (validateChecksum(buf, len))
+  if (validateChecksum(checksumType_, buf, len))
   {
     if (memcmp(buf, tag_.data(), tag_.size()) == 0)
     {
       // parse from buffer
       const char* data = buf + tag_.size();
       int32_t dataLen = len - kChecksumLen - static_cast<int>(tag_.size());
-      if (parseFromBuffer(StringPiece(data, dataLen), message))
-      {
-        error = kNoError;
-      }
-      else
+      StringPiece payload(data, dataLen);
+      error = decompressPayload(&payload, NULL);
+      if (error == kNoError && !parseFromBuffer(payload, message))
       {
         error = kParseError;
       }
@@ -14,6 +14,7 @@
 #ifndef MUDUO_NET_PROTOBUF_CODEC_H
 #define MUDUO_NET_PROTOBUF_CODEC_H
 
+#include <muduo/base/Mutex.h>
 #include <muduo/base/StringPiece.h>
 #include <muduo/base/Timestamp.h>
 
@@ -22,9 +23,14 @@
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <boost/bind.hpp>
 
+#include <deque>
+#include <map>
+#include <vector>
+
 #ifndef NDEBUG
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_base_of.hpp>
@@ -40,6 +46,8 @@ class Message;
 
 namespace muduo
 {
+class ThreadPool;
+
 namespace net
 {
 
@@ -55,7 +63,14 @@ typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
 // size      4-byte  M+N+4
 // tag       M-byte  could be "RPC0", etc.
 // payload   N-byte
-// checksum  4-byte  adler32 of tag+payload
+// checksum  4-byte  adler32 of tag+payload, or see ChecksumType
+//
+// A compressed payload, see setCompression(), is
+//
+// marker    1-byte  0, which never starts a protobuf message
+// method    1-byte  CompressionType
+// length    varint  of the uncompressed payload
+// data      K-byte
 //
 // This is an internal class, you should use ProtobufCodecT instead.
 class ProtobufCodecLite : boost::noncopyable
@@ -73,8 +88,27 @@ class ProtobufCodecLite : boost::noncopyable
     kInvalidNameLen,
     kUnknownMessageType,
     kParseError,
+    kDecompressError,
+  };
+
+  // Both ends must agree, there is no negotiation on the wire.
+  enum ChecksumType
+  {
+    kAdler32,
+    kCrc32c,      // SSE4.2 if available
+    kNoChecksum,  // for loopback or otherwise trusted links, sends zero
   };
 
+  // Only the sender chooses, compressed frames are always decoded.
+  enum CompressionType
+  {
+    kNoCompression,
+    kZlib,
+  };
+
+  const static int kDefaultCompressionThreshold = 1024;
+  const static size_t kDefaultMaxQueuedBytes = 64*1024*1024;
+
   // return false to stop parsing protobuf message
   typedef boost::function<bool (const TcpConnectionPtr&,
                                 StringPiece,
@@ -99,7 +133,13 @@ class ProtobufCodecLite : boost::noncopyable
       messageCallback_(messageCb),
       rawCb_(rawCb),
       errorCallback_(errorCb),
-      kMinMessageLen(tagArg.size() + kChecksumLen)
+      kMinMessageLen(tagArg.size() + kChecksumLen),
+      checksumType_(kAdler32),
+      compressionType_(kNoCompression),
+      compressionThreshold_(kDefaultCompressionThreshold),
+      pool_(NULL),
+      maxQueuedBytes_(kDefaultMaxQueuedBytes),
+      mutex_()
   {
   }
 
@@ -107,9 +147,60 @@ class ProtobufCodecLite : boost::noncopyable
 
   const string& tag() const { return tag_; }
 
+  /// Encodes messages sent as MessagePtr, and decodes received ones, in pool
+  /// instead of the calling thread and the IO thread, which only slices and
+  /// copies frames.  Messages of one connection keep their order, and all
+  /// callbacks still run in its loop.  With a rawCb, which must see frames
+  /// in order and in the loop, received frames are decoded in the loop.
+  /// So it does nothing for RpcChannel, which takes frames with a rawCb and
+  /// sends them with appendRpcFrame(), both in the loop.
+  ///
+  /// Nothing blocks on pool.  When more than maxQueuedBytes of a connection
+  /// wait for it, either way, reading from the connection stops until they
+  /// drop below, and send() of a MessagePtr returns false, see there.
+  ///
+  /// Must be called before any message is sent or received, and pool must
+  /// be stopped before the codec is destroyed.
+  void setThreadPool(ThreadPool* pool, size_t maxQueuedBytes = kDefaultMaxQueuedBytes)
+  {
+    pool_ = pool;
+    maxQueuedBytes_ = maxQueuedBytes;
+  }
+
+  /// Default is kAdler32.
+  void setChecksumType(ChecksumType type)
+  { checksumType_ = type; }
+
+  ChecksumType checksumType() const
+  { return checksumType_; }
+
+  /// Compresses payloads of at least minBytes, when it makes them smaller.
+  /// Default is kNoCompression.  Peers older than this fail compressed
+  /// frames with kParseError.
+  void setCompression(CompressionType type, int minBytes = kDefaultCompressionThreshold)
+  {
+    compressionType_ = type;
+    compressionThreshold_ = minBytes;
+  }
+
+  CompressionType compressionType() const
+  { return compressionType_; }
+
+  int compressionThreshold() const
+  { return compressionThreshold_; }
+
   void send(const TcpConnectionPtr& conn,
             const ::google::protobuf::Message& message);
 
+  /// Encodes in the thread pool if any, after messages sent this way before,
+  /// see setThreadPool().  The message is queued anyway, but false means
+  /// more than maxQueuedBytes of conn wait to be encoded: a sender out of
+  /// the loop should hold back, eg. until the write complete callback of
+  /// conn.  In the loop, reading from conn stops meanwhile, so replies to
+  /// its requests are bounded by what has been read.
+  bool send(const TcpConnectionPtr& conn,
+            const MessagePtr& message);
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
@@ -123,21 +214,85 @@ class ProtobufCodecLite : boost::noncopyable
   ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message);
   void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
 
+  // adler32
   static int32_t checksum(const void* buf, int len);
   static bool validateChecksum(const char* buf, int len);
+  static int32_t checksum(ChecksumType type, const void* buf, int len);
+  static bool validateChecksum(ChecksumType type, const char* buf, int len);
   static int32_t asInt32(const char* buf);
+
+  // The compression state belongs to the calling thread, and is reset
+  // for every payload.
+
+  /// Replaces the last len bytes of buf, a payload, with its compressed
+  /// form if that is shorter.  Returns true if replaced.
+  static bool compressPayload(Buffer* buf, size_t len, CompressionType type);
+  /// Decompresses payload into output and points payload to it,
+  /// if compressed.  output is cleared first, NULL for a buffer of the
+  /// calling thread, which the next call reuses.
+  static ErrorCode decompressPayload(StringPiece* payload, Buffer* output);
   static void defaultErrorCallback(const TcpConnectionPtr&,
                                    Buffer*,
                                    Timestamp,
                                    ErrorCode);
 
  private:
+  typedef boost::function<void ()> Task;
+  // tasks of a connection and their bytes, the front one is running
+  struct TaskQueue
+  {
+    TaskQueue() : bytes(0), stopped(false) { }
+
+    TcpConnectionPtr conn;
+    std::deque<std::pair<Task, size_t> > tasks;
+    size_t bytes;
+    bool stopped;  // reading from conn, until bytes drop below the bound
+  };
+  typedef std::map<TcpConnection*, TaskQueue> TaskQueues;
+  typedef std::map<TcpConnection*, boost::weak_ptr<TcpConnection> > ConnectionMap;
+  typedef std::vector<MessagePtr> MessageList;
+
+  // Stops reading from conn and returns true if the queue of conn is full.
+  bool post(TaskQueues* queues,
+            const TcpConnectionPtr& conn,
+            const Task& task,
+            size_t bytes);
+  void runQueue(TaskQueues* queues, TcpConnection* conn);
+  bool failed(const TcpConnectionPtr& conn);
+
+  void sliceFrames(const TcpConnectionPtr& conn,
+                   Buffer* buf,
+                   Timestamp receiveTime);
+  void encodeInPool(const TcpConnectionPtr& conn, const MessagePtr& message);
+  void decodeInPool(const TcpConnectionPtr& conn,
+                    const boost::shared_ptr<Buffer>& frames,
+                    Timestamp receiveTime,
+                    ErrorCode trailingError);
+  // in loop, holds no codec
+  static void pauseReading(const TcpConnectionPtr& conn);
+  static void resumeReading(const TcpConnectionPtr& conn);
+  static void deliver(const ProtobufMessageCallback& messageCb,
+                      const ErrorCallback& errorCb,
+                      const TcpConnectionPtr& conn,
+                      const MessageList& messages,
+                      Timestamp receiveTime,
+                      ErrorCode errorCode);
+
   const ::google::protobuf::Message* prototype_;
   const string tag_;
   ProtobufMessageCallback messageCallback_;
   RawMessageCallback rawCb_;
   ErrorCallback errorCallback_;
   const int kMinMessageLen;
+  ChecksumType checksumType_;
+  CompressionType compressionType_;
+  int compressionThreshold_;
+  ThreadPool* pool_;
+  size_t maxQueuedBytes_;
+  MutexLock mutex_;
+  TaskQueues encodeQueues_;
+  TaskQueues decodeQueues_;
+  ConnectionMap failed_;  // sent an invalid length, input is dropped
 };
 
 template<typename MSG, const char* TAG, typename CODEC=ProtobufCodecLite>  // TAG must be a variable with external linkage, not a string literal
@@ -168,12 +323,50 @@ class ProtobufCodecLiteT
 
   const string& tag() const { return codec_.tag(); }
 
+  void setThreadPool(ThreadPool* pool,
+                     size_t maxQueuedBytes = ProtobufCodecLite::kDefaultMaxQueuedBytes)
+  {
+    codec_.setThreadPool(pool, maxQueuedBytes);
+  }
+
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    codec_.setChecksumType(type);
+  }
+
+  ProtobufCodecLite::ChecksumType checksumType() const
+  {
+    return codec_.checksumType();
+  }
+
+  void setCompression(ProtobufCodecLite::CompressionType type,
+                      int minBytes = ProtobufCodecLite::kDefaultCompressionThreshold)
+  {
+    codec_.setCompression(type, minBytes);
+  }
+
+  ProtobufCodecLite::CompressionType compressionType() const
+  {
+    return codec_.compressionType();
+  }
+
+  int compressionThreshold() const
+  {
+    return codec_.compressionThreshold();
+  }
+
   void send(const TcpConnectionPtr& conn,
             const MSG& message)
   {
     codec_.send(conn, message);
   }
 
+  bool send(const TcpConnectionPtr& conn,
+            const ConcreteMessagePtr& message)
+  {
+    return codec_.send(conn, MessagePtr(message));
+  }
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime)
@@ -9,27 +9,109 @@
 #include <muduo/net/protorpc/RpcChannel.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/protorpc/RpcController.h>
+#include <muduo/net/protorpc/RpcExecutor.h>
 #include <muduo/net/protorpc/rpc.pb.h>
 
+#include <google/protobuf/arena.h>
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
 
 #include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <algorithm>
+
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+
+// must be a power of 2
+const size_t kInitialOutstandings = 64;
+
+const int kDefaultStreamWindow = 32;
+const size_t kDefaultStreamHighWaterMark = 4*1024*1024;
+const int64_t kMaxStreamCredits = 1 << 30;
+
+// recycled arenas kept by each channel
+const size_t kMaxFreeArenas = 16;
+const size_t kEnvelopeArenaSize = 512;
+
+// messages on an arena are freed with it
+void deleteNothing(google::protobuf::Message*)
+{
+}
+
+}
+
+// A protobuf Arena with a first block of its own, which Reset() keeps, so
+// a recycled arena allocates nothing until a call outgrows the block.
+class RpcChannel::CallArena : boost::noncopyable
+{
+ public:
+  explicit CallArena(size_t blockSize)
+    : block_(new char[blockSize]),
+      arena_(block_.get(), blockSize),
+      response(NULL)
+  {
+  }
+
+  google::protobuf::Arena* arena()
+  { return &arena_; }
+
+  void reset()
+  {
+    response = NULL;
+    arena_.Reset();
+  }
+
+ private:
+  boost::scoped_array<char> block_;
+  google::protobuf::Arena arena_;
+
+ public:
+  // of a call being served, sent by arenaDoneCallback()
+  google::protobuf::Message* response;
+};
+
 RpcChannel::RpcChannel()
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
-    services_(NULL)
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRpcFrame, this, _1, _2, _3)),
+    timeout_(0.0),
+    outstandings_(kInitialOutstandings),
+    numOutstandings_(0),
+    streamWindow_(kDefaultStreamWindow),
+    streamHighWaterMark_(kDefaultStreamHighWaterMark),
+    watchingWriteComplete_(false),
+    services_(NULL),
+    streamHandlers_(NULL),
+    executor_(NULL),
+    arenaBlockSize_(0),
+    envelopeArena_(new CallArena(kEnvelopeArenaSize))
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
 }
 
 RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRpcFrame, this, _1, _2, _3)),
     conn_(conn),
-    services_(NULL)
+    timeout_(0.0),
+    outstandings_(kInitialOutstandings),
+    numOutstandings_(0),
+    streamWindow_(kDefaultStreamWindow),
+    streamHighWaterMark_(kDefaultStreamHighWaterMark),
+    watchingWriteComplete_(false),
+    services_(NULL),
+    streamHandlers_(NULL),
+    executor_(NULL),
+    arenaBlockSize_(0),
+    envelopeArena_(new CallArena(kEnvelopeArenaSize))
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
 }
@@ -37,11 +119,34 @@ RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
 RpcChannel::~RpcChannel()
 {
   LOG_INFO << "RpcChannel::dtor - " << this;
-  for (std::map<int64_t, OutstandingCall>::iterator it = outstandings_.begin(); it != outstandings_.end(); ++it)
+  for (size_t i = 0; i < outstandings_.size(); ++i)
   {
-    OutstandingCall out = it->second;
-    delete out.response;
-    delete out.done;
+    OutstandingCall& out = outstandings_[i];
+    if (out.id != 0)
+    {
+      if (out.hasDeadline && conn_)
+      {
+        conn_->getLoop()->cancel(out.timer);
+      }
+      if (out.response->GetArena() == NULL)
+      {
+        delete out.response;
+      }
+      delete out.done;
+    }
+  }
+
+  // lets handlers still holding them know
+  StreamMap streams(clientStreams_);
+  streams.insert(serverStreams_.begin(), serverStreams_.end());
+  for (StreamMap::iterator it = streams.begin(); it != streams.end(); ++it)
+  {
+    finishStream(it->second, CANCELED);
+  }
+
+  for (size_t i = 0; i < freeArenas_.size(); ++i)
+  {
+    delete freeArenas_[i];
   }
 }
 
@@ -62,14 +167,218 @@ void RpcChannel::CallMethod(const ::google::protobuf::MethodDescriptor* method,
   message.set_id(id);
   message.set_service(method->service()->full_name());
   message.set_method(method->name());
-  message.set_request(request->SerializeAsString()); // FIXME: error check
 
-  OutstandingCall out = { response, done };
+  // closures queued to the loop may outlive the channel
+  boost::weak_ptr<RpcChannel> wkChannel(shared_from_this());
+  double timeout = timeout_;
+  RpcController* muduoController = dynamic_cast<RpcController*>(controller);
+  if (muduoController)
+  {
+    if (muduoController->timeout() >= 0)
+    {
+      timeout = muduoController->timeout();
+    }
+    muduoController->startCall(wkChannel, id);
+  }
+
+  OutstandingCall out;
+  out.id = id;
+  out.response = response;
+  out.done = done;
+  out.controller = muduoController;
+  EventLoop* loop = conn_->getLoop();
+  if (loop->isInLoopThread())
+  {
+    startCall(out, timeout);
+  }
+  else
+  {
+    // queued before the request is sent, so the response always finds it.
+    loop->queueInLoop(boost::bind(&RpcChannel::startCallInLoop, wkChannel, out, timeout));
+  }
+  sendFrame(message, RpcMessage::kRequestFieldNumber, request);
+}
+
+void RpcChannel::sendFrame(const RpcMessage& message,
+                           int payloadField,
+                           const ::google::protobuf::Message* payload)
+{
+  if (conn_->getLoop()->isInLoopThread())
+  {
+    appendRpcFrame(conn_->outputBuffer(), message, payloadField, payload,
+                   codec_.checksumType(), codec_.compressionType(),
+                   codec_.compressionThreshold());
+    conn_->flushOutputBuffer();
+  }
+  else
+  {
+    Buffer buf;
+    appendRpcFrame(&buf, message, payloadField, payload,
+                   codec_.checksumType(), codec_.compressionType(),
+                   codec_.compressionThreshold());
+    conn_->send(&buf);
+  }
+}
+
+void RpcChannel::cancel(int64_t id)
+{
+  if (conn_)
+  {
+    conn_->getLoop()->runInLoop(boost::bind(&RpcChannel::cancelInLoop,
+                                            boost::weak_ptr<RpcChannel>(shared_from_this()),
+                                            id));
+  }
+}
+
+void RpcChannel::startCall(const OutstandingCall& out, double timeout)
+{
+  OutstandingCall call(out);
+  if (timeout > 0)
+  {
+    call.timer = conn_->getLoop()->runAfter(
+        timeout, boost::bind(&RpcChannel::timeoutInLoop,
+                             boost::weak_ptr<RpcChannel>(shared_from_this()),
+                             call.id));
+    call.hasDeadline = true;
+  }
+  insertCall(call);
+}
+
+void RpcChannel::startCallInLoop(const boost::weak_ptr<RpcChannel>& wkChannel,
+                                 const OutstandingCall& out,
+                                 double timeout)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  if (channel)
+  {
+    channel->startCall(out, timeout);
+  }
+  else
+  {
+    // as the destructor does to outstanding calls
+    if (out.response->GetArena() == NULL)
+    {
+      delete out.response;
+    }
+    delete out.done;
+  }
+}
+
+void RpcChannel::cancelInLoop(const boost::weak_ptr<RpcChannel>& wkChannel, int64_t id)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  OutstandingCall* slot = channel ? channel->findCall(id) : NULL;
+  if (slot)
   {
-  MutexLockGuard lock(mutex_);
-  outstandings_[id] = out;
+    channel->completeCall(slot, CANCELED, StringPiece());
+  }
+}
+
+void RpcChannel::timeoutInLoop(const boost::weak_ptr<RpcChannel>& wkChannel, int64_t id)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  OutstandingCall* slot = channel ? channel->findCall(id) : NULL;
+  if (slot)
+  {
+    LOG_WARN << "RpcChannel::timeoutInLoop - call " << id << " timed out";
+    channel->completeCall(slot, TIMEOUT, StringPiece());
+  }
+}
+
+void RpcChannel::completeCall(OutstandingCall* slot, int error, StringPiece response)
+{
+  OutstandingCall out = *slot;
+  eraseCall(slot);
+  if (out.hasDeadline && error != TIMEOUT)
+  {
+    conn_->getLoop()->cancel(out.timer);
+  }
+
+  // a response on an arena of the caller is freed with it
+  boost::scoped_ptr<google::protobuf::Message> d(
+      out.response->GetArena() == NULL ? out.response : NULL);
+  if (response.data() != NULL
+      && !out.response->ParseFromArray(response.data(), response.size())
+      && error == NO_ERROR)
+  {
+    error = INVALID_RESPONSE;
+  }
+  if (out.controller)
+  {
+    out.controller->finishCall(static_cast<ErrorCode>(error));
+  }
+  if (out.done)
+  {
+    out.done->Run();
+  }
+}
+
+RpcChannel::OutstandingCall* RpcChannel::findCall(int64_t id)
+{
+  size_t mask = outstandings_.size() - 1;
+  size_t i = static_cast<size_t>(id) & mask;
+  while (outstandings_[i].id != 0)
+  {
+    if (outstandings_[i].id == id)
+    {
+      return &outstandings_[i];
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+void RpcChannel::insertCall(const OutstandingCall& out)
+{
+  if ((numOutstandings_ + 1) * 2 > outstandings_.size())
+  {
+    // keeps the load factor under 1/2, probes stay short.
+    std::vector<OutstandingCall> old(outstandings_.size() * 2);
+    old.swap(outstandings_);
+    numOutstandings_ = 0;
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+      if (old[i].id != 0)
+      {
+        insertCall(old[i]);
+      }
+    }
+  }
+
+  size_t mask = outstandings_.size() - 1;
+  size_t i = static_cast<size_t>(out.id) & mask;
+  while (outstandings_[i].id != 0)
+  {
+    i = (i + 1) & mask;
+  }
+  outstandings_[i] = out;
+  ++numOutstandings_;
+}
+
+void RpcChannel::eraseCall(OutstandingCall* slot)
+{
+  // backward shift deletion, no tombstones
+  size_t mask = outstandings_.size() - 1;
+  size_t i = static_cast<size_t>(slot - &outstandings_[0]);
+  size_t j = i;
+  while (true)
+  {
+    outstandings_[i].id = 0;
+    size_t home = 0;
+    do
+    {
+      j = (j + 1) & mask;
+      if (outstandings_[j].id == 0)
+      {
+        --numOutstandings_;
+        return;
+      }
+      home = static_cast<size_t>(outstandings_[j].id) & mask;
+      // slot j stays if its home is cyclically in (i, j]
+    } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+    outstandings_[i] = outstandings_[j];
+    i = j;
   }
-  codec_.send(conn_, message);
 }
 
 void RpcChannel::onMessage(const TcpConnectionPtr& conn,
@@ -79,41 +388,97 @@ void RpcChannel::onMessage(const TcpConnectionPtr& conn,
   codec_.onMessage(conn, buf, receiveTime);
 }
 
+void RpcChannel::onDisconnected(const TcpConnectionPtr& conn)
+{
+  conn->getLoop()->assertInLoopThread();
+  if (conn != conn_)
+  {
+    return;
+  }
+  // close callbacks may close other streams
+  StreamMap streams(clientStreams_);
+  streams.insert(serverStreams_.begin(), serverStreams_.end());
+  for (StreamMap::iterator it = streams.begin(); it != streams.end(); ++it)
+  {
+    if (!it->second->done())
+    {
+      finishStream(it->second, UNAVAILABLE);
+    }
+  }
+}
+
+bool RpcChannel::onRpcFrame(const TcpConnectionPtr& conn,
+                            StringPiece frame,
+                            Timestamp)
+{
+  assert(conn == conn_);
+  // strings of the envelope, service and method names, go on the arena too
+  RpcMessage* message
+    = google::protobuf::Arena::CreateMessage<RpcMessage>(envelopeArena_->arena());
+  StringPiece payload;
+  bool taken = parseRpcFrame(frame, message, &payload, codec_.checksumType())
+               == ProtobufCodecLite::kNoError;
+  if (taken)
+  {
+    handleMessage(*message, payload);
+  }
+  envelopeArena_->reset();
+  return !taken;
+}
+
 void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
                               const RpcMessagePtr& messagePtr,
                               Timestamp receiveTime)
 {
   assert(conn == conn_);
+  const RpcMessage& message = *messagePtr;
+  if (message.type() == REQUEST)
+  {
+    handleMessage(message, message.request());
+  }
+  else if (message.has_response())
+  {
+    handleMessage(message, message.response());
+  }
+  else
+  {
+    handleMessage(message, StringPiece());
+  }
+}
+
+void RpcChannel::handleMessage(const RpcMessage& message, StringPiece payload)
+{
   //printf("%s\n", message.DebugString().c_str());
-  RpcMessage& message = *messagePtr;
+  if (message.has_credits() && handleStreamFrame(message, payload))
+  {
+    return;
+  }
+
   if (message.type() == RESPONSE)
   {
     int64_t id = message.id();
-    assert(message.has_response() || message.has_error());
-
-    OutstandingCall out = { NULL, NULL };
-
+    StreamMap::iterator stream = clientStreams_.find(id);
+    if (stream != clientStreams_.end())
     {
-      MutexLockGuard lock(mutex_);
-      std::map<int64_t, OutstandingCall>::iterator it = outstandings_.find(id);
-      if (it != outstandings_.end())
+      // a unary reply, or an error of a server without streams
+      RpcStreamPtr s(stream->second);
+      if (payload.data() != NULL && !message.has_error())
       {
-        out = it->second;
-        outstandings_.erase(it);
+        readStream(s, payload);
       }
+      if (!s->done())
+      {
+        finishStream(s, message.has_error() ? message.error() : NO_ERROR);
+      }
+      return;
     }
+    assert(payload.data() != NULL || message.has_error());
 
-    if (out.response)
+    // gone if it has timed out or been canceled
+    OutstandingCall* slot = findCall(id);
+    if (slot)
     {
-      boost::scoped_ptr<google::protobuf::Message> d(out.response);
-      if (message.has_response())
-      {
-        out.response->ParseFromString(message.response());
-      }
-      if (out.done)
-      {
-        out.done->Run();
-      }
+      completeCall(slot, message.has_error() ? message.error() : NO_ERROR, payload);
     }
   }
   else if (message.type() == REQUEST)
@@ -132,20 +497,7 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
           = desc->FindMethodByName(message.method());
         if (method)
         {
-          boost::scoped_ptr<google::protobuf::Message> request(service->GetRequestPrototype(method).New());
-          if (request->ParseFromString(message.request()))
-          {
-            google::protobuf::Message* response = service->GetResponsePrototype(method).New();
-            // response is deleted in doneCallback
-            int64_t id = message.id();
-            service->CallMethod(method, NULL, get_pointer(request), response,
-                                NewCallback(this, &RpcChannel::doneCallback, response, id));
-            error = NO_ERROR;
-          }
-          else
-          {
-            error = INVALID_REQUEST;
-          }
+          error = serveCall(service, method, message.id(), payload);
         }
         else
         {
@@ -167,7 +519,7 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
       response.set_type(RESPONSE);
       response.set_id(message.id());
       response.set_error(error);
-      codec_.send(conn_, response);
+      sendFrame(response, 0, NULL);
     }
   }
   else if (message.type() == ERROR)
@@ -181,7 +533,482 @@ void RpcChannel::doneCallback(::google::protobuf::Message* response, int64_t id)
   RpcMessage message;
   message.set_type(RESPONSE);
   message.set_id(id);
-  message.set_response(response->SerializeAsString()); // FIXME: error check
-  codec_.send(conn_, message);
+  sendFrame(message, RpcMessage::kResponseFieldNumber, response);
+}
+
+// Runs in any thread, once, like the closures of NewCallback(), and sends
+// the response in the loop of the connection if the channel is still
+// there.  executor is NULL for a call not run by it.
+class RpcChannel::CallDone : public google::protobuf::Closure
+{
+ public:
+  CallDone(const boost::weak_ptr<RpcChannel>& wkChannel,
+           EventLoop* loop,
+           RpcExecutor* executor,
+           const google::protobuf::MethodDescriptor* method,
+           google::protobuf::Message* response,
+           CallArena* arena,
+           int64_t id)
+    : wkChannel_(wkChannel),
+      loop_(loop),
+      executor_(executor),
+      method_(method),
+      response_(response),
+      arena_(arena),
+      id_(id)
+  {
+  }
+
+  void Run()
+  {
+    if (executor_)
+    {
+      executor_->finish(method_);
+    }
+    // sends in the loop of the connection, straight into its output buffer
+    loop_->runInLoop(boost::bind(&RpcChannel::doneInLoop,
+                                 wkChannel_, response_, arena_, id_));
+    delete this;
+  }
+
+ private:
+  boost::weak_ptr<RpcChannel> wkChannel_;
+  EventLoop* loop_;
+  RpcExecutor* executor_;
+  const google::protobuf::MethodDescriptor* method_;
+  google::protobuf::Message* response_;
+  CallArena* arena_;
+  int64_t id_;
+};
+
+ErrorCode RpcChannel::serveCall(google::protobuf::Service* service,
+                                const google::protobuf::MethodDescriptor* method,
+                                int64_t id,
+                                StringPiece payload)
+{
+  // request and response live on arena until the response is sent
+  CallArena* arena = takeArena();
+  google::protobuf::Arena* a = arena ? arena->arena() : NULL;
+  google::protobuf::Message* request = service->GetRequestPrototype(method).New(a);
+  MessagePtr requestPtr;
+  if (arena)
+  {
+    requestPtr.reset(request, deleteNothing);
+  }
+  else
+  {
+    requestPtr.reset(request);
+  }
+
+  ErrorCode error = NO_ERROR;
+  if (!request->ParseFromArray(payload.data(), payload.size()))
+  {
+    error = INVALID_REQUEST;
+  }
+  else if (executor_ && !executor_->isInline(method))
+  {
+    if (!submitCall(service, method, requestPtr, arena, id))
+    {
+      error = SERVER_BUSY;
+    }
+  }
+  else
+  {
+    google::protobuf::Message* response = service->GetResponsePrototype(method).New(a);
+    google::protobuf::Closure* done = NULL;
+    if (arena)
+    {
+      // done may run in any thread, after the channel is gone
+      arena->response = response;
+      done = new CallDone(shared_from_this(), conn_->getLoop(), NULL,
+                          method, response, arena, id);
+    }
+    else
+    {
+      // response is deleted in doneCallback
+      done = NewCallback(this, &RpcChannel::doneCallback, response, id);
+    }
+    service->CallMethod(method, NULL, request, response, done);
+  }
+
+  if (error != NO_ERROR)
+  {
+    recycleArena(arena);
+  }
+  return error;
+}
+
+void RpcChannel::arenaDoneCallback(CallArena* arena, int64_t id)
+{
+  // recycled arenas are kept in the loop
+  conn_->getLoop()->assertInLoopThread();
+  RpcMessage message;
+  message.set_type(RESPONSE);
+  message.set_id(id);
+  sendFrame(message, RpcMessage::kResponseFieldNumber, arena->response);
+  recycleArena(arena);
+}
+
+RpcChannel::CallArena* RpcChannel::takeArena()
+{
+  if (arenaBlockSize_ == 0)
+  {
+    return NULL;
+  }
+  if (freeArenas_.empty())
+  {
+    return new CallArena(arenaBlockSize_);
+  }
+  CallArena* arena = freeArenas_.back();
+  freeArenas_.pop_back();
+  return arena;
+}
+
+void RpcChannel::recycleArena(CallArena* arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+  if (freeArenas_.size() < kMaxFreeArenas)
+  {
+    arena->reset();
+    freeArenas_.push_back(arena);
+  }
+  else
+  {
+    delete arena;
+  }
+}
+
+bool RpcChannel::submitCall(google::protobuf::Service* service,
+                            const google::protobuf::MethodDescriptor* method,
+                            const MessagePtr& request,
+                            CallArena* arena,
+                            int64_t id)
+{
+  boost::weak_ptr<RpcChannel> wkChannel(shared_from_this());
+  return executor_->submit(method, boost::bind(&RpcChannel::callInPool,
+                                               wkChannel,
+                                               conn_->getLoop(),
+                                               executor_,
+                                               service,
+                                               method,
+                                               request,
+                                               arena,
+                                               id));
+}
+
+void RpcChannel::callInPool(const boost::weak_ptr<RpcChannel>& wkChannel,
+                            EventLoop* loop,
+                            RpcExecutor* executor,
+                            google::protobuf::Service* service,
+                            const google::protobuf::MethodDescriptor* method,
+                            const MessagePtr& request,
+                            CallArena* arena,
+                            int64_t id)
+{
+  if (wkChannel.expired())
+  {
+    // the connection has gone while the call waited, nobody takes the reply
+    executor->finish(method);
+    delete arena;
+    return;
+  }
+  google::protobuf::Message* response
+    = service->GetResponsePrototype(method).New(arena ? arena->arena() : NULL);
+  if (arena)
+  {
+    arena->response = response;
+  }
+  service->CallMethod(method, NULL, get_pointer(request), response,
+                      new CallDone(wkChannel, loop, executor, method, response, arena, id));
+}
+
+void RpcChannel::doneInLoop(const boost::weak_ptr<RpcChannel>& wkChannel,
+                            google::protobuf::Message* response,
+                            CallArena* arena,
+                            int64_t id)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  if (channel && arena)
+  {
+    channel->arenaDoneCallback(arena, id);
+  }
+  else if (channel)
+  {
+    channel->doneCallback(response, id);
+  }
+  else if (arena)
+  {
+    delete arena;
+  }
+  else
+  {
+    delete response;
+  }
+}
+
+
+RpcStreamPtr RpcChannel::openStream(const ::google::protobuf::MethodDescriptor* method,
+                                    const ::google::protobuf::Message* request,
+                                    const RpcStream::MessageCallback& messageCb,
+                                    const RpcStream::CloseCallback& closeCb)
+{
+  conn_->getLoop()->assertInLoopThread();
+  int64_t id = id_.incrementAndGet();
+  RpcStreamPtr stream(new RpcStream(this, id, true, method, streamWindow_));
+  stream->setMessageCallback(messageCb);
+  stream->setCloseCallback(closeCb);
+  // writable when the server gives credits
+  stream->blocked_ = true;
+  watchWriteComplete();
+  clientStreams_[id] = stream;
+
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(id);
+  message.set_service(method->service()->full_name());
+  message.set_method(method->name());
+  message.set_credits(streamWindow_);
+  sendFrame(message, RpcMessage::kRequestFieldNumber, request);
+  return stream;
+}
+
+bool RpcChannel::congested() const
+{
+  return !conn_->connected()
+      || conn_->outputBuffer()->readableBytes() >= streamHighWaterMark_;
+}
+
+void RpcChannel::sendStreamFrame(const RpcStream& stream,
+                                 const ::google::protobuf::Message* payload,
+                                 int credits,
+                                 bool end,
+                                 ErrorCode error)
+{
+  RpcMessage message;
+  message.set_type(stream.client_ ? REQUEST : RESPONSE);
+  message.set_id(stream.id_);
+  message.set_credits(credits);
+  if (end)
+  {
+    message.set_end(true);
+  }
+  if (error != NO_ERROR)
+  {
+    message.set_error(error);
+  }
+  sendFrame(message,
+            stream.client_ ? RpcMessage::kRequestFieldNumber : RpcMessage::kResponseFieldNumber,
+            payload);
 }
 
+bool RpcChannel::handleStreamFrame(const RpcMessage& message, StringPiece payload)
+{
+  const bool fromClient = message.type() == REQUEST;
+  StreamMap& streams = fromClient ? serverStreams_ : clientStreams_;
+  StreamMap::iterator it = streams.find(message.id());
+  if (it == streams.end())
+  {
+    if (fromClient && message.has_method())
+    {
+      return acceptStream(message, payload);
+    }
+    // done on this side already
+    return true;
+  }
+
+  RpcStreamPtr stream(it->second);
+  if (message.has_error() && message.error() != NO_ERROR)
+  {
+    finishStream(stream, message.error());
+    return true;
+  }
+  stream->sendCredits_ = static_cast<int>(std::min<int64_t>(
+      stream->sendCredits_ + static_cast<int64_t>(message.credits()), kMaxStreamCredits));
+  if (payload.data() != NULL)
+  {
+    readStream(stream, payload);
+  }
+  if (!stream->done() && message.end())
+  {
+    stream->remoteClosed_ = true;
+    if (stream->messageCallback_)
+    {
+      RpcStream::MessageCallback cb(stream->messageCallback_);
+      cb(stream, MessagePtr());
+    }
+    if (!stream->done() && stream->localClosed_)
+    {
+      finishStream(stream, NO_ERROR);
+    }
+  }
+  if (!stream->done() && stream->blocked_ && stream->writable())
+  {
+    notifyWritable(stream);
+  }
+  return true;
+}
+
+bool RpcChannel::acceptStream(const RpcMessage& message, StringPiece payload)
+{
+  std::string name = message.service() + "." + message.method();
+  std::map<std::string, RpcStreamHandler>::const_iterator it;
+  if (!streamHandlers_
+      || (it = streamHandlers_->find(name)) == streamHandlers_->end())
+  {
+    return false;
+  }
+  const google::protobuf::MethodDescriptor* method =
+      google::protobuf::DescriptorPool::generated_pool()->FindMethodByName(name);
+  assert(method != NULL);
+
+  RpcStreamPtr stream(new RpcStream(this, message.id(), false, method, streamWindow_));
+  stream->sendCredits_ = static_cast<int>(std::min<int64_t>(message.credits(), kMaxStreamCredits));
+  watchWriteComplete();
+  serverStreams_[stream->id_] = stream;
+
+  MessagePtr request;
+  if (payload.data() != NULL)
+  {
+    request.reset(google::protobuf::MessageFactory::generated_factory()
+                  ->GetPrototype(method->input_type())->New());
+    if (!request->ParseFromArray(payload.data(), payload.size()))
+    {
+      closeStream(stream, INVALID_REQUEST);
+      return true;
+    }
+  }
+  // the client may write as well
+  sendStreamFrame(*stream, NULL, streamWindow_, false, NO_ERROR);
+  it->second(stream, request);
+  return true;
+}
+
+void RpcChannel::readStream(const RpcStreamPtr& stream, StringPiece payload)
+{
+  if (stream->remoteClosed_ || stream->recvCredits_ <= 0)
+  {
+    LOG_ERROR << "RpcChannel::readStream - stream " << stream->id_
+              << " is over its credits";
+    closeStream(stream, WRONG_PROTO);
+    return;
+  }
+  --stream->recvCredits_;
+  MessagePtr message(stream->prototype_->New());
+  if (!message->ParseFromArray(payload.data(), payload.size()))
+  {
+    closeStream(stream, stream->client_ ? INVALID_RESPONSE : INVALID_REQUEST);
+    return;
+  }
+  if (stream->messageCallback_)
+  {
+    // which may close the stream, and clear the callback
+    RpcStream::MessageCallback cb(stream->messageCallback_);
+    cb(stream, message);
+  }
+
+  // gives credits back in batches
+  if (!stream->done() && ++stream->consumed_ * 2 >= stream->window_)
+  {
+    stream->recvCredits_ += stream->consumed_;
+    sendStreamFrame(*stream, NULL, stream->consumed_, false, NO_ERROR);
+    stream->consumed_ = 0;
+  }
+}
+
+void RpcChannel::closeStream(const RpcStreamPtr& stream, ErrorCode error)
+{
+  if (error != NO_ERROR)
+  {
+    sendStreamFrame(*stream, NULL, 0, true, error);
+    finishStream(stream, error);
+  }
+  else if (!stream->localClosed_)
+  {
+    stream->localClosed_ = true;
+    sendStreamFrame(*stream, NULL, 0, true, NO_ERROR);
+    if (stream->remoteClosed_)
+    {
+      finishStream(stream, NO_ERROR);
+    }
+  }
+}
+
+void RpcChannel::finishStream(const RpcStreamPtr& stream, ErrorCode error)
+{
+  (stream->client_ ? clientStreams_ : serverStreams_).erase(stream->id_);
+  stream->channel_ = NULL;
+  stream->localClosed_ = true;
+  stream->remoteClosed_ = true;
+  stream->blocked_ = false;
+
+  // callbacks often hold the stream
+  RpcStream::CloseCallback closeCb;
+  closeCb.swap(stream->closeCallback_);
+  stream->messageCallback_ = RpcStream::MessageCallback();
+  stream->writableCallback_ = RpcStream::WritableCallback();
+  if (closeCb)
+  {
+    closeCb(stream, error);
+  }
+}
+
+void RpcChannel::notifyWritable(const RpcStreamPtr& stream)
+{
+  stream->blocked_ = false;
+  if (stream->writableCallback_)
+  {
+    RpcStream::WritableCallback cb(stream->writableCallback_);
+    cb(stream);
+  }
+}
+
+void RpcChannel::watchWriteComplete()
+{
+  if (!watchingWriteComplete_)
+  {
+    // shared_from_this() throws boost::bad_weak_ptr if the channel is
+    // not held by an RpcChannelPtr, as it must be.
+    // credits are small frames, which Nagle's algorithm would hold
+    // for a delayed ACK
+    conn_->setTcpNoDelay(true);
+    // the callback may be queued after the channel is gone
+    conn_->setWriteCompleteCallback(
+        boost::bind(&RpcChannel::onWriteComplete,
+                    boost::weak_ptr<RpcChannel>(shared_from_this()), _1));
+    watchingWriteComplete_ = true;
+  }
+}
+
+void RpcChannel::onWriteComplete(const boost::weak_ptr<RpcChannel>& wkChannel,
+                                 const TcpConnectionPtr& conn)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  if (!channel || channel->conn_ != conn)
+  {
+    return;
+  }
+
+  std::vector<RpcStreamPtr> ready;
+  const StreamMap* maps[] = { &channel->clientStreams_, &channel->serverStreams_ };
+  for (size_t i = 0; i < sizeof maps / sizeof maps[0]; ++i)
+  {
+    for (StreamMap::const_iterator it = maps[i]->begin(); it != maps[i]->end(); ++it)
+    {
+      if (it->second->blocked_ && it->second->writable())
+      {
+        ready.push_back(it->second);
+      }
+    }
+  }
+  // callbacks may write, close or open streams
+  for (size_t i = 0; i < ready.size(); ++i)
+  {
+    if (ready[i]->blocked_ && ready[i]->writable())
+    {
+      channel->notifyWritable(ready[i]);
+    }
+  }
+}
@@ -12,14 +12,19 @@
 #define MUDUO_NET_PROTORPC_RPCCHANNEL_H
 
 #include <muduo/base/Atomic.h>
-#include <muduo/base/Mutex.h>
+#include <muduo/net/TimerId.h>
 #include <muduo/net/protorpc/RpcCodec.h>
+#include <muduo/net/protorpc/RpcStream.h>
 
 #include <google/protobuf/service.h>
 
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <map>
+#include <vector>
 
 // Service and RpcChannel classes are incorporated from
 // google/protobuf/service.h
@@ -81,6 +86,10 @@ namespace muduo
 namespace net
 {
 
+class EventLoop;
+class RpcController;
+class RpcExecutor;
+
 // Abstract interface for an RPC channel.  An RpcChannel represents a
 // communication line to a Service which can be used to call that Service's
 // methods.  The Service may be running on another machine.  Normally, you
@@ -90,7 +99,13 @@ namespace net
 //   RpcChannel* channel = new MyRpcChannel("remotehost.example.com:1234");
 //   MyService* service = new MyService::Stub(channel);
 //   service->MyMethod(request, &response, callback);
-class RpcChannel : public ::google::protobuf::RpcChannel
+//
+// The channel must be held by an RpcChannelPtr, closures it queues to the
+// loop of the connection, eg. of calls from other threads and of their
+// deadlines, hold it by weak_ptr.  Streaming calls take the write complete
+// callback of the connection too, see RpcStream.
+class RpcChannel : public ::google::protobuf::RpcChannel,
+                   public boost::enable_shared_from_this<RpcChannel>
 {
  public:
   RpcChannel();
@@ -102,6 +117,7 @@ class RpcChannel : public ::google::protobuf::RpcChannel
   void setConnection(const TcpConnectionPtr& conn)
   {
     conn_ = conn;
+    watchingWriteComplete_ = false;
   }
 
   void setServices(const std::map<std::string, ::google::protobuf::Service*>* services)
@@ -109,11 +125,78 @@ class RpcChannel : public ::google::protobuf::RpcChannel
     services_ = services;
   }
 
+  /// Keyed by the full name of methods, calls of them open streams.
+  /// Other methods are served as unary calls by services.
+  void setStreamHandlers(const std::map<std::string, RpcStreamHandler>* handlers)
+  {
+    streamHandlers_ = handlers;
+  }
+
+  /// Runs calls of services in the worker threads of executor, which
+  /// outlives the channel, instead of the loop of the connection.
+  /// Needs the channel held by an RpcChannelPtr.
+  void setExecutor(RpcExecutor* executor)
+  {
+    executor_ = executor;
+  }
+
+  /// Serves each call with its request and response on a protobuf Arena,
+  /// whose first block is this many bytes, recycled when the response has
+  /// been sent.  The messages must not be kept after done runs.
+  /// 0 for messages on the heap, the default.  Needs the channel held by
+  /// an RpcChannelPtr, done may run after the channel is gone.
+  void setArenaBlockSize(size_t bytes)
+  {
+    arenaBlockSize_ = bytes;
+  }
+
+  /// Credits of each stream, the messages the peer may send ahead,
+  /// default is 32.
+  void setStreamWindow(int messages)
+  {
+    assert(messages > 0);
+    streamWindow_ = messages;
+  }
+
+  /// Streams are not writable while the output buffer of the connection
+  /// holds this many bytes, default is 4MiB.
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    streamHighWaterMark_ = bytes;
+  }
+
+  /// Calls without a response in this many seconds complete with TIMEOUT,
+  /// unless their muduo::net::RpcController sets its own.
+  /// 0 for no deadline, which is the default.
+  void setTimeout(double seconds)
+  {
+    timeout_ = seconds;
+  }
+
+  /// Must be the same as the peer's, default is adler32.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    codec_.setChecksumType(type);
+  }
+
+  /// Compresses frames of at least minBytes sent from now on, the peer
+  /// must be new enough to decompress them, see ProtobufCodecLite.
+  void setCompression(ProtobufCodecLite::CompressionType type,
+                      int minBytes = ProtobufCodecLite::kDefaultCompressionThreshold)
+  {
+    codec_.setCompression(type, minBytes);
+  }
+
   // Call the given method of the remote service.  The signature of this
   // procedure looks the same as Service::CallMethod(), but the requirements
   // are less strict in one important way:  the request and response objects
   // need not be of any specific class as long as their descriptors are
   // method->input_type() and method->output_type().
+  //
+  // Thread safe.  If controller is a muduo::net::RpcController, it tells
+  // why the call failed when done runs, and can cancel it.  The channel
+  // deletes response after done runs, unless it is on an Arena, which
+  // frees it instead.
   void CallMethod(const ::google::protobuf::MethodDescriptor* method,
                   ::google::protobuf::RpcController* controller,
                   const ::google::protobuf::Message* request,
@@ -124,27 +207,150 @@ class RpcChannel : public ::google::protobuf::RpcChannel
                  Buffer* buf,
                  Timestamp receiveTime);
 
+  /// Fails the streams open on conn with UNAVAILABLE, their close
+  /// callbacks run.  Call it when conn is down, in its loop.
+  void onDisconnected(const TcpConnectionPtr& conn);
+
+  /// Thread safe, completes an outstanding call with CANCELED.
+  void cancel(int64_t id);
+
+  /// Opens a stream to method, with request if not NULL.  Messages read
+  /// are of method->output_type().  In the loop of the connection.
+  ///
+  /// A server that serves method as a unary call replies once, which
+  /// comes as the only message before the stream closes.  The stream
+  /// fails with UNAVAILABLE when onDisconnected() is called.
+  RpcStreamPtr openStream(const ::google::protobuf::MethodDescriptor* method,
+                          const ::google::protobuf::Message* request,
+                          const RpcStream::MessageCallback& messageCb,
+                          const RpcStream::CloseCallback& closeCb);
+
  private:
+  friend class RpcStream;
+  typedef std::map<int64_t, RpcStreamPtr> StreamMap;
+
+  // parses the payload in place, see appendRpcFrame()
+  bool onRpcFrame(const TcpConnectionPtr& conn,
+                  StringPiece frame,
+                  Timestamp receiveTime);
+
+  // frames onRpcFrame() did not take, the codec reports their errors
   void onRpcMessage(const TcpConnectionPtr& conn,
                     const RpcMessagePtr& messagePtr,
                     Timestamp receiveTime);
 
+  void handleMessage(const RpcMessage& message, StringPiece payload);
+
+  // straight into the output buffer of conn_ if in its loop
+  void sendFrame(const RpcMessage& message,
+                 int payloadField,
+                 const ::google::protobuf::Message* payload);
+
   void doneCallback(::google::protobuf::Message* response, int64_t id);
 
+  class CallArena;
+  class CallDone;
+  ErrorCode serveCall(::google::protobuf::Service* service,
+                      const ::google::protobuf::MethodDescriptor* method,
+                      int64_t id,
+                      StringPiece payload);
+  void arenaDoneCallback(CallArena* arena, int64_t id);
+  // NULL without arenas, in the loop of conn_
+  CallArena* takeArena();
+  void recycleArena(CallArena* arena);
+
+  // calls in the worker threads of executor_
+  bool submitCall(::google::protobuf::Service* service,
+                  const ::google::protobuf::MethodDescriptor* method,
+                  const MessagePtr& request,
+                  CallArena* arena,
+                  int64_t id);
+  static void callInPool(const boost::weak_ptr<RpcChannel>& wkChannel,
+                         EventLoop* loop,
+                         RpcExecutor* executor,
+                         ::google::protobuf::Service* service,
+                         const ::google::protobuf::MethodDescriptor* method,
+                         const MessagePtr& request,
+                         CallArena* arena,
+                         int64_t id);
+  static void doneInLoop(const boost::weak_ptr<RpcChannel>& wkChannel,
+                         ::google::protobuf::Message* response,
+                         CallArena* arena,
+                         int64_t id);
+
   struct OutstandingCall
   {
+    OutstandingCall()
+      : id(0),
+        response(NULL),
+        done(NULL),
+        controller(NULL),
+        hasDeadline(false)
+    {
+    }
+
+    int64_t id;  // 0 for an empty slot
     ::google::protobuf::Message* response;
     ::google::protobuf::Closure* done;
+    RpcController* controller;
+    TimerId timer;
+    bool hasDeadline;
   };
 
+  // in the loop of conn_
+  void startCall(const OutstandingCall& out, double timeout);
+  static void startCallInLoop(const boost::weak_ptr<RpcChannel>& wkChannel,
+                              const OutstandingCall& out,
+                              double timeout);
+  static void cancelInLoop(const boost::weak_ptr<RpcChannel>& wkChannel, int64_t id);
+  static void timeoutInLoop(const boost::weak_ptr<RpcChannel>& wkChannel, int64_t id);
+  // error is an ErrorCode, response is NULL unless it comes from the peer
+  void completeCall(OutstandingCall* slot, int error, StringPiece response);
+
+  // streams, in the loop of conn_
+  bool congested() const;
+  void sendStreamFrame(const RpcStream& stream,
+                       const ::google::protobuf::Message* payload,
+                       int credits,
+                       bool end,
+                       ErrorCode error);
+  // false if method has no stream handler
+  bool handleStreamFrame(const RpcMessage& message, StringPiece payload);
+  bool acceptStream(const RpcMessage& message, StringPiece payload);
+  void readStream(const RpcStreamPtr& stream, StringPiece payload);
+  void closeStream(const RpcStreamPtr& stream, ErrorCode error);
+  void finishStream(const RpcStreamPtr& stream, ErrorCode error);
+  void notifyWritable(const RpcStreamPtr& stream);
+  void watchWriteComplete();
+  static void onWriteComplete(const boost::weak_ptr<RpcChannel>& wkChannel,
+                              const TcpConnectionPtr& conn);
+
+  // open addressing table, linear probing from id & mask
+  OutstandingCall* findCall(int64_t id);
+  void insertCall(const OutstandingCall& out);
+  void eraseCall(OutstandingCall* slot);
+
   RpcCodec codec_;
   TcpConnectionPtr conn_;
   AtomicInt64 id_;
+  double timeout_;
 
-  MutexLock mutex_;
-  std::map<int64_t, OutstandingCall> outstandings_;
+  // Only touched in the loop of conn_, so needs no lock.
+  std::vector<OutstandingCall> outstandings_;
+  size_t numOutstandings_;
+  StreamMap clientStreams_;  // opened here
+  StreamMap serverStreams_;  // opened by the peer
+  int streamWindow_;
+  size_t streamHighWaterMark_;
+  bool watchingWriteComplete_;
 
   const std::map<std::string, ::google::protobuf::Service*>* services_;
+  const std::map<std::string, RpcStreamHandler>* streamHandlers_;
+  RpcExecutor* executor_;
+  size_t arenaBlockSize_;
+  std::vector<CallArena*> freeArenas_;  // in the loop of conn_
+  // of RpcMessage read by onRpcFrame(), reset after each
+  boost::scoped_ptr<CallArena> envelopeArena_;
 };
 typedef boost::shared_ptr<RpcChannel> RpcChannelPtr;
 
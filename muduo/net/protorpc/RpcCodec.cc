@@ -12,9 +12,13 @@
 #include <muduo/net/Endian.h>
 #include <muduo/net/TcpConnection.h>
 
+#include <muduo/net/protobuf/BufferStream.h>
 #include <muduo/net/protorpc/rpc.pb.h>
 #include <muduo/net/protorpc/google-inl.h>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
 #include <boost/bind.hpp>
 
 using namespace muduo;
@@ -37,3 +41,151 @@ namespace net
 const char rpctag [] = "RPC0";
 }
 }
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace
+{
+  const int kTagLen = sizeof(rpctag) - 1;
+
+  bool isPayloadField(int field)
+  {
+    return field == RpcMessage::kRequestFieldNumber
+        || field == RpcMessage::kResponseFieldNumber;
+  }
+}
+
+void muduo::net::appendRpcFrame(Buffer* buf,
+                                const RpcMessage& message,
+                                int payloadField,
+                                const google::protobuf::Message* payload,
+                                ProtobufCodecLite::ChecksumType checksumType,
+                                ProtobufCodecLite::CompressionType compression,
+                                int compressionThreshold)
+{
+  assert(payload == NULL || isPayloadField(payloadField));
+  GOOGLE_DCHECK(message.IsInitialized()) << InitializationErrorMessage("serialize", message);
+  const int headerSize = message.ByteSize();
+  int payloadSize = 0;
+  int fieldSize = 0;
+  uint32_t key = WireFormatLite::MakeTag(payloadField, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  if (payload)
+  {
+    payloadSize = payload->ByteSize();
+    fieldSize = static_cast<int>(CodedOutputStream::VarintSize32(key)
+                                 + CodedOutputStream::VarintSize32(payloadSize))
+              + payloadSize;
+  }
+  const int len = kTagLen + headerSize + fieldSize + ProtobufCodecLite::kChecksumLen;
+
+  // the whole frame at once, so BufferOutputStream returns a single block
+  buf->ensureWritableBytes(ProtobufCodecLite::kHeaderLen + len);
+  buf->appendInt32(len);
+  const size_t start = buf->readableBytes();
+  buf->append(rpctag, kTagLen);
+  {
+    BufferOutputStream os(buf);
+    CodedOutputStream output(&os);
+    message.SerializeWithCachedSizes(&output);
+    if (payload)
+    {
+      output.WriteTag(key);
+      output.WriteVarint32(payloadSize);
+      payload->SerializeWithCachedSizes(&output);
+    }
+  }  // backs up the unused bytes
+  assert(buf->readableBytes() - start == static_cast<size_t>(kTagLen + headerSize + fieldSize));
+
+  const size_t bodyLen = headerSize + fieldSize;
+  if (compression != ProtobufCodecLite::kNoCompression
+      && static_cast<int>(bodyLen) >= compressionThreshold
+      && ProtobufCodecLite::compressPayload(buf, bodyLen, compression))
+  {
+    // patches the size
+    const size_t frameLen = buf->readableBytes() - start + ProtobufCodecLite::kChecksumLen;
+    int32_t be32 = sockets::hostToNetwork32(static_cast<int32_t>(frameLen));
+    char* frame = buf->beginWrite() - (buf->readableBytes() - start);
+    memcpy(frame - ProtobufCodecLite::kHeaderLen, &be32, sizeof be32);
+  }
+
+  int32_t checkSum = ProtobufCodecLite::checksum(checksumType,
+                                                 buf->peek() + start,
+                                                 static_cast<int>(buf->readableBytes() - start));
+  buf->appendInt32(checkSum);
+}
+
+ProtobufCodecLite::ErrorCode muduo::net::parseRpcFrame(StringPiece frame,
+                                                       RpcMessage* message,
+                                                       StringPiece* payload,
+                                                       ProtobufCodecLite::ChecksumType checksumType,
+                                                       Buffer* inflated)
+{
+  const char* buf = frame.data() + ProtobufCodecLite::kHeaderLen;
+  const int len = frame.size() - ProtobufCodecLite::kHeaderLen;
+  if (!ProtobufCodecLite::validateChecksum(checksumType, buf, len))
+  {
+    return ProtobufCodecLite::kCheckSumError;
+  }
+  if (memcmp(buf, rpctag, kTagLen) != 0)
+  {
+    return ProtobufCodecLite::kUnknownMessageType;
+  }
+
+  StringPiece body(buf + kTagLen, len - kTagLen - ProtobufCodecLite::kChecksumLen);
+  ProtobufCodecLite::ErrorCode error = ProtobufCodecLite::decompressPayload(&body, inflated);
+  if (error != ProtobufCodecLite::kNoError)
+  {
+    return error;
+  }
+
+  // finds the payload field, without copying it
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+  const int dataLen = body.size();
+  int fieldBegin = dataLen;
+  int fieldEnd = dataLen;
+  *payload = StringPiece();
+  CodedInputStream input(data, dataLen);
+  while (true)
+  {
+    const int pos = input.CurrentPosition();
+    uint32_t tag = input.ReadTag();
+    if (tag == 0)
+    {
+      break;
+    }
+    if (isPayloadField(WireFormatLite::GetTagFieldNumber(tag))
+        && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+    {
+      uint32_t size = 0;
+      if (!input.ReadVarint32(&size) || !input.Skip(static_cast<int>(size)))
+      {
+        return ProtobufCodecLite::kParseError;
+      }
+      // the last one wins, as in a nested message
+      fieldBegin = pos;
+      fieldEnd = input.CurrentPosition();
+      *payload = StringPiece(reinterpret_cast<const char*>(data) + fieldEnd - size,
+                             static_cast<int>(size));
+    }
+    else if (!WireFormatLite::SkipField(&input, tag))
+    {
+      return ProtobufCodecLite::kParseError;
+    }
+  }
+  if (!input.ConsumedEntireMessage())
+  {
+    return ProtobufCodecLite::kParseError;
+  }
+
+  // the header, which is the fields before and after payload
+  bool ok = message->ParsePartialFromArray(data, fieldBegin);
+  if (ok && fieldEnd < dataLen)
+  {
+    CodedInputStream rest(data + fieldEnd, dataLen - fieldEnd);
+    ok = message->MergePartialFromCodedStream(&rest) && rest.ConsumedEntireMessage();
+  }
+  return ok && message->IsInitialized() ? ProtobufCodecLite::kNoError
+                                        : ProtobufCodecLite::kParseError;
+}
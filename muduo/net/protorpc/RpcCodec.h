@@ -38,11 +38,44 @@ extern const char rpctag[];// = "RPC0";
 // size      4-byte  N+8
 // "RPC0"    4-byte
 // payload   N-byte
-// checksum  4-byte  adler32 of "RPC0"+payload
+// checksum  4-byte  adler32 of "RPC0"+payload, or see setChecksumType()
 //
 
 typedef ProtobufCodecLiteT<RpcMessage, rpctag> RpcCodec;
 
+// The request or response of a call is framed side by side with the
+// RpcMessage header, as its last field, so payload is serialized only once:
+//
+// "RPC0"    4-byte
+// header    M-byte  RpcMessage without request or response
+// payload   N-byte  key and length of field 5 or 6, then user message
+//
+// These are the same bytes as the nested RpcMessage, either side may be
+// an older peer.  When compressed, header and payload are compressed
+// together, see ProtobufCodecLite.
+
+/// Appends a frame of message to buf, with payload as field payloadField,
+/// eg. RpcMessage::kRequestFieldNumber, serialized in place.
+/// payload can be NULL.
+void appendRpcFrame(Buffer* buf,
+                    const RpcMessage& message,
+                    int payloadField,
+                    const ::google::protobuf::Message* payload,
+                    ProtobufCodecLite::ChecksumType checksumType = ProtobufCodecLite::kAdler32,
+                    ProtobufCodecLite::CompressionType compression = ProtobufCodecLite::kNoCompression,
+                    int compressionThreshold = ProtobufCodecLite::kDefaultCompressionThreshold);
+
+/// Parses frame, which starts with the size, as passed to
+/// RpcCodec::RawMessageCallback.  The request or response field is left
+/// in payload, which points into frame, or is NULL if absent.
+/// A compressed frame is decompressed into inflated first, and payload
+/// points there, see ProtobufCodecLite::decompressPayload().
+ProtobufCodecLite::ErrorCode parseRpcFrame(StringPiece frame,
+                                           RpcMessage* message,
+                                           StringPiece* payload,
+                                           ProtobufCodecLite::ChecksumType checksumType = ProtobufCodecLite::kAdler32,
+                                           Buffer* inflated = NULL);
+
 }
 }
 
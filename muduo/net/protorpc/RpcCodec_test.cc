@@ -5,6 +5,7 @@
 #include <muduo/net/Buffer.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -77,5 +78,155 @@ int main()
   assert(g_msgptr->DebugString() == message.DebugString());
   }
 
+  {
+  Buffer buf;
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  codec.setChecksumType(ProtobufCodecLite::kCrc32c);
+  codec.fillEmptyBuffer(&buf, message);
+  assert(buf.toStringPiece() != expected);
+  codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_msgptr);
+  assert(g_msgptr->DebugString() == message.DebugString());
+  g_msgptr.reset();
+  }
+
+  {
+  // payload framed side by side, same bytes as the nested message
+  RpcMessage payload;
+  payload.set_type(RESPONSE);
+  payload.set_id(9);
+  payload.set_service(std::string(300, 's'));
+  message.set_service("service");
+  message.set_method("method");
+  RpcMessage nested(message);
+  nested.set_request(payload.SerializeAsString());
+  Buffer buf, expectedBuf;
+  RpcCodec codec(rpcMessageCallback);
+  codec.fillEmptyBuffer(&expectedBuf, nested);
+  codec.fillEmptyBuffer(&buf, message);
+  appendRpcFrame(&buf, message, RpcMessage::kRequestFieldNumber, &payload);
+  int32_t firstLen = ProtobufCodecLite::kHeaderLen + buf.peekInt32();
+  buf.retrieve(firstLen);
+  assert(buf.toStringPiece() == expectedBuf.toStringPiece());
+
+  RpcMessage header;
+  StringPiece piece;
+  assert(parseRpcFrame(buf.toStringPiece(), &header, &piece) == ProtobufCodecLite::kNoError);
+  assert(header.DebugString() == message.DebugString());
+  assert(piece == payload.SerializeAsString());
+
+  // payload of an older peer, before the error field
+  RpcMessage response;
+  response.set_type(RESPONSE);
+  response.set_id(10);
+  response.set_response("");
+  response.set_error(INVALID_REQUEST);
+  Buffer oldBuf;
+  codec.fillEmptyBuffer(&oldBuf, response);
+  assert(parseRpcFrame(oldBuf.toStringPiece(), &header, &piece) == ProtobufCodecLite::kNoError);
+  assert(header.id() == 10 && header.error() == INVALID_REQUEST && !header.has_response());
+  assert(piece.data() != NULL && piece.empty());
+
+  // no payload
+  Buffer buf3;
+  appendRpcFrame(&buf3, message, 0, NULL);
+  assert(parseRpcFrame(buf3.toStringPiece(), &header, &piece) == ProtobufCodecLite::kNoError);
+  assert(header.DebugString() == message.DebugString());
+  assert(piece.data() == NULL);
+
+  const_cast<char*>(buf3.peek())[buf3.readableBytes()-1] ^= 1;
+  assert(parseRpcFrame(buf3.toStringPiece(), &header, &piece) == ProtobufCodecLite::kCheckSumError);
+
+  // other checksums
+  Buffer crcBuf, noneBuf;
+  appendRpcFrame(&crcBuf, message, RpcMessage::kRequestFieldNumber, &payload, ProtobufCodecLite::kCrc32c);
+  appendRpcFrame(&noneBuf, message, RpcMessage::kRequestFieldNumber, &payload, ProtobufCodecLite::kNoChecksum);
+  assert(parseRpcFrame(crcBuf.toStringPiece(), &header, &piece, ProtobufCodecLite::kCrc32c) == ProtobufCodecLite::kNoError);
+  assert(piece == payload.SerializeAsString());
+  assert(parseRpcFrame(crcBuf.toStringPiece(), &header, &piece) == ProtobufCodecLite::kCheckSumError);
+  assert(ProtobufCodecLite::asInt32(noneBuf.peek() + noneBuf.readableBytes() - 4) == 0);
+  assert(parseRpcFrame(noneBuf.toStringPiece(), &header, &piece, ProtobufCodecLite::kNoChecksum) == ProtobufCodecLite::kNoError);
+  assert(parseRpcFrame(crcBuf.toStringPiece(), &header, &piece, ProtobufCodecLite::kNoChecksum) == ProtobufCodecLite::kNoError);
+
+  // compressed, after another frame in the same buffer
+  Buffer zbuf;
+  appendRpcFrame(&zbuf, message, 0, NULL);
+  const size_t firstFrame = zbuf.readableBytes();
+  appendRpcFrame(&zbuf, message, RpcMessage::kRequestFieldNumber, &payload,
+                 ProtobufCodecLite::kAdler32, ProtobufCodecLite::kZlib, 100);
+  zbuf.retrieve(firstFrame);
+  assert(zbuf.readableBytes() == static_cast<size_t>(ProtobufCodecLite::kHeaderLen + zbuf.peekInt32()));
+  assert(zbuf.readableBytes() < buf.readableBytes());
+  assert(zbuf.peek()[ProtobufCodecLite::kHeaderLen + 4] == 0);
+  Buffer inflated;
+  assert(parseRpcFrame(zbuf.toStringPiece(), &header, &piece, ProtobufCodecLite::kAdler32, &inflated) == ProtobufCodecLite::kNoError);
+  assert(header.DebugString() == message.DebugString());
+  assert(piece == payload.SerializeAsString());
+  assert(piece.data() >= inflated.peek() && piece.end() <= inflated.beginWrite());
+
+  // the codec decodes it too
+  ProtobufCodecLite liteCodec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  liteCodec.onMessage(TcpConnectionPtr(), &zbuf, Timestamp::now());
+  assert(g_msgptr);
+  assert(g_msgptr->DebugString() == nested.DebugString());
+  g_msgptr.reset();
+
+  // below the threshold
+  Buffer smallBuf;
+  appendRpcFrame(&smallBuf, message, RpcMessage::kRequestFieldNumber, &payload,
+                 ProtobufCodecLite::kAdler32, ProtobufCodecLite::kZlib, 100000);
+  assert(smallBuf.toStringPiece() == buf.toStringPiece());
+
+  // corrupted, beyond the checksum
+  Buffer badBuf;
+  appendRpcFrame(&badBuf, message, RpcMessage::kRequestFieldNumber, &payload,
+                 ProtobufCodecLite::kNoChecksum, ProtobufCodecLite::kZlib, 100);
+  const_cast<char*>(badBuf.peek())[badBuf.readableBytes() - 8] ^= 1;
+  assert(parseRpcFrame(badBuf.toStringPiece(), &header, &piece, ProtobufCodecLite::kNoChecksum) == ProtobufCodecLite::kDecompressError);
+
+  // a frame of a stream
+  RpcMessage streamFrame;
+  streamFrame.set_type(RESPONSE);
+  streamFrame.set_id(11);
+  streamFrame.set_credits(16);
+  streamFrame.set_end(true);
+  Buffer streamBuf;
+  appendRpcFrame(&streamBuf, streamFrame, RpcMessage::kResponseFieldNumber, &payload);
+  assert(parseRpcFrame(streamBuf.toStringPiece(), &header, &piece) == ProtobufCodecLite::kNoError);
+  assert(header.credits() == 16 && header.end() && !header.has_error());
+  assert(piece == payload.SerializeAsString());
+  }
+
+  {
+  // compressed by ProtobufCodecLite, only if smaller
+  RpcMessage big;
+  big.set_type(REQUEST);
+  big.set_id(3);
+  big.set_request(std::string(10000, 'x'));
+  Buffer buf, plainBuf;
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  codec.fillEmptyBuffer(&plainBuf, big);
+  codec.setCompression(ProtobufCodecLite::kZlib);
+  codec.fillEmptyBuffer(&buf, big);
+  assert(buf.readableBytes() < 200);
+  codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_msgptr);
+  assert(g_msgptr->DebugString() == big.DebugString());
+  g_msgptr.reset();
+
+  std::string noise;
+  for (int i = 0; i < 10000; ++i)
+  {
+    noise.push_back(static_cast<char>(rand()));
+  }
+  big.set_request(noise);
+  buf.retrieveAll();
+  plainBuf.retrieveAll();
+  codec.fillEmptyBuffer(&buf, big);
+  codec.setCompression(ProtobufCodecLite::kNoCompression);
+  codec.fillEmptyBuffer(&plainBuf, big);
+  assert(buf.toStringPiece() == plainBuf.toStringPiece());
+  }
+
   google::protobuf::ShutdownProtobufLibrary();
 }
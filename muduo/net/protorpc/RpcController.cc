@@ -0,0 +1,98 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcController.h>
+
+#include <muduo/net/protorpc/RpcChannel.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcController::RpcController()
+  : timeout_(-1.0),
+    errorCode_(NO_ERROR),
+    id_(0)
+{
+}
+
+RpcController::~RpcController()
+{
+}
+
+void RpcController::Reset()
+{
+  timeout_ = -1.0;
+  errorCode_ = NO_ERROR;
+  errorText_.clear();
+  MutexLockGuard lock(mutex_);
+  channel_.reset();
+  id_ = 0;
+}
+
+bool RpcController::Failed() const
+{
+  return errorCode_ != NO_ERROR;
+}
+
+std::string RpcController::ErrorText() const
+{
+  return errorText_;
+}
+
+void RpcController::StartCancel()
+{
+  RpcChannelPtr channel;
+  int64_t id = 0;
+  {
+    MutexLockGuard lock(mutex_);
+    channel = channel_.lock();
+    id = id_;
+  }
+  if (channel)
+  {
+    channel->cancel(id);
+  }
+}
+
+void RpcController::SetFailed(const std::string& reason)
+{
+  errorText_ = reason;
+}
+
+bool RpcController::IsCanceled() const
+{
+  return false;
+}
+
+void RpcController::NotifyOnCancel(::google::protobuf::Closure* callback)
+{
+  // never canceled on the server side
+}
+
+void RpcController::startCall(const boost::weak_ptr<RpcChannel>& channel, int64_t id)
+{
+  errorCode_ = NO_ERROR;
+  errorText_.clear();
+  MutexLockGuard lock(mutex_);
+  channel_ = channel;
+  id_ = id;
+}
+
+void RpcController::finishCall(ErrorCode error)
+{
+  {
+    MutexLockGuard lock(mutex_);
+    channel_.reset();
+    id_ = 0;
+  }
+  if (error != NO_ERROR)
+  {
+    errorCode_ = error;
+    errorText_ = ErrorCode_Name(error);
+  }
+}
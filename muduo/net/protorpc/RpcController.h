@@ -0,0 +1,81 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+#define MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <google/protobuf/service.h>
+
+#include <boost/weak_ptr.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+class RpcChannel;
+
+/// Client side controller of one call at a time.
+///
+/// Carries the deadline of the call, and tells why it failed when done
+/// runs.  Must outlive the call it is passed to.
+class RpcController : public ::google::protobuf::RpcController
+{
+ public:
+  RpcController();
+  virtual ~RpcController();
+
+  // client side
+  virtual void Reset();
+  virtual bool Failed() const;
+  virtual std::string ErrorText() const;
+  /// Thread safe, the call completes with CANCELED soon if it is still
+  /// outstanding.
+  virtual void StartCancel();
+
+  // server side, not supported
+  virtual void SetFailed(const std::string& reason);
+  virtual bool IsCanceled() const;
+  virtual void NotifyOnCancel(::google::protobuf::Closure* callback);
+
+  /// Overrides the channel's timeout for the next call, 0 for no deadline.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  /// Negative if not set.
+  double timeout() const
+  { return timeout_; }
+
+  ErrorCode errorCode() const
+  { return errorCode_; }
+
+ private:
+  friend class RpcChannel;
+
+  void startCall(const boost::weak_ptr<RpcChannel>& channel, int64_t id);
+  void finishCall(ErrorCode error);
+
+  double timeout_;
+  ErrorCode errorCode_;
+  std::string errorText_;
+  // of the outstanding call, StartCancel() reads them in any thread,
+  // finishCall() clears them in the loop of the channel.
+  MutexLock mutex_;
+  boost::weak_ptr<RpcChannel> channel_;
+  int64_t id_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCCONTROLLER_H
@@ -0,0 +1,131 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcExecutor.h>
+
+#include <muduo/base/Logging.h>
+
+#include <google/protobuf/descriptor.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int RpcExecutor::kDefaultMaxQueue;
+
+RpcExecutor::RpcExecutor(const string& name)
+  : numThreads_(0),
+    pool_(name)
+{
+  defaultLimit_.maxQueue = kDefaultMaxQueue;
+}
+
+RpcExecutor::~RpcExecutor()
+{
+  if (started())
+  {
+    stop();
+  }
+}
+
+void RpcExecutor::setDefaultLimit(int maxConcurrency, int maxQueue)
+{
+  assert(!started());
+  assert(maxConcurrency > 0 && maxQueue >= 0);
+  defaultLimit_.maxConcurrency = maxConcurrency;
+  defaultLimit_.maxQueue = maxQueue;
+}
+
+void RpcExecutor::setMethodLimit(const ::google::protobuf::MethodDescriptor* method,
+                                 int maxConcurrency,
+                                 int maxQueue)
+{
+  assert(!started());
+  assert(maxConcurrency > 0 && maxQueue >= 0);
+  Limit& limit = limits_[method];
+  limit.maxConcurrency = maxConcurrency;
+  limit.maxQueue = maxQueue;
+}
+
+void RpcExecutor::setInline(const ::google::protobuf::MethodDescriptor* method)
+{
+  assert(!started());
+  inlineMethods_.insert(method);
+}
+
+void RpcExecutor::start(int numThreads)
+{
+  assert(!started());
+  assert(numThreads > 0);
+  numThreads_ = numThreads;
+  if (defaultLimit_.maxConcurrency == 0)
+  {
+    defaultLimit_.maxConcurrency = numThreads;
+  }
+  pool_.start(numThreads);
+}
+
+void RpcExecutor::stop()
+{
+  pool_.stop();
+}
+
+RpcExecutor::Limit* RpcExecutor::findLimit(const ::google::protobuf::MethodDescriptor* method)
+{
+  mutex_.assertLocked();
+  LimitMap::iterator it = limits_.find(method);
+  if (it == limits_.end())
+  {
+    it = limits_.insert(LimitMap::value_type(method, defaultLimit_)).first;
+  }
+  return &it->second;
+}
+
+bool RpcExecutor::submit(const ::google::protobuf::MethodDescriptor* method,
+                         const Task& task)
+{
+  assert(started());
+  {
+    MutexLockGuard lock(mutex_);
+    Limit* limit = findLimit(method);
+    if (limit->running >= limit->maxConcurrency)
+    {
+      if (limit->waiting.size() >= static_cast<size_t>(limit->maxQueue))
+      {
+        LOG_WARN << "RpcExecutor::submit - " << method->full_name()
+                 << " rejected, " << limit->running << " running, "
+                 << limit->waiting.size() << " waiting";
+        return false;
+      }
+      limit->waiting.push_back(task);
+      return true;
+    }
+    ++limit->running;
+  }
+  // the queue of pool_ is unbounded, so this never blocks
+  pool_.run(task);
+  return true;
+}
+
+void RpcExecutor::finish(const ::google::protobuf::MethodDescriptor* method)
+{
+  Task next;
+  {
+    MutexLockGuard lock(mutex_);
+    Limit* limit = findLimit(method);
+    assert(limit->running > 0);
+    if (limit->waiting.empty())
+    {
+      --limit->running;
+      return;
+    }
+    // keeps the slot for the next call
+    next.swap(limit->waiting.front());
+    limit->waiting.pop_front();
+  }
+  pool_.run(next);
+}
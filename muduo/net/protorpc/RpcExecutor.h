@@ -0,0 +1,113 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCEXECUTOR_H
+#define MUDUO_NET_PROTORPC_RPCEXECUTOR_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadPool.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <map>
+#include <set>
+
+namespace google
+{
+namespace protobuf
+{
+class MethodDescriptor;
+}
+}
+
+namespace muduo
+{
+namespace net
+{
+
+/// Runs calls of methods in worker threads, so a slow method does not
+/// hold up the loop of its connection, see RpcServer::setWorkerThreadNum().
+///
+/// Each method has its own limits: at most maxConcurrency calls run at a
+/// time, at most maxQueue more wait for them, and the rest are rejected.
+/// A call takes its slot until its done closure runs, so an asynchronous
+/// method that returns early still counts until it replies.
+///
+/// Limits are set before start(), then submit() and finish() are thread
+/// safe.
+class RpcExecutor : boost::noncopyable
+{
+ public:
+  typedef boost::function<void ()> Task;
+
+  static const int kDefaultMaxQueue = 1024;
+
+  explicit RpcExecutor(const string& name = string("RpcExecutor"));
+  ~RpcExecutor();
+
+  /// Of methods without their own, the default is as many calls as
+  /// worker threads, and kDefaultMaxQueue waiting.
+  void setDefaultLimit(int maxConcurrency, int maxQueue);
+  void setMethodLimit(const ::google::protobuf::MethodDescriptor* method,
+                      int maxConcurrency,
+                      int maxQueue);
+  /// Cheap methods run in the loop of the connection, without limits.
+  void setInline(const ::google::protobuf::MethodDescriptor* method);
+
+  void start(int numThreads);
+  void stop();
+
+  bool started() const
+  { return numThreads_ > 0; }
+
+  bool isInline(const ::google::protobuf::MethodDescriptor* method) const
+  { return inlineMethods_.count(method) > 0; }
+
+  /// Runs task in a worker thread, now or once a call of method
+  /// finishes.  Returns false if the queue of method is full.
+  bool submit(const ::google::protobuf::MethodDescriptor* method, const Task& task);
+
+  /// A call of method has run its done closure.
+  void finish(const ::google::protobuf::MethodDescriptor* method);
+
+ private:
+  struct Limit
+  {
+    Limit()
+      : maxConcurrency(0),
+        maxQueue(0),
+        running(0)
+    {
+    }
+
+    int maxConcurrency;
+    int maxQueue;
+    int running;
+    std::deque<Task> waiting;
+  };
+
+  typedef std::map<const ::google::protobuf::MethodDescriptor*, Limit> LimitMap;
+
+  Limit* findLimit(const ::google::protobuf::MethodDescriptor* method);
+
+  int numThreads_;
+  Limit defaultLimit_;
+  std::set<const ::google::protobuf::MethodDescriptor*> inlineMethods_;
+  MutexLock mutex_;
+  LimitMap limits_;  // @GuardedBy mutex_, methods without their own are added
+  ThreadPool pool_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCEXECUTOR_H
@@ -21,7 +21,15 @@ using namespace muduo::net;
 
 RpcServer::RpcServer(EventLoop* loop,
                      const InetAddress& listenAddr)
-  : server_(loop, listenAddr, "RpcServer")
+  : server_(loop, listenAddr, "RpcServer"),
+    checksumType_(ProtobufCodecLite::kAdler32),
+    compressionType_(ProtobufCodecLite::kNoCompression),
+    compressionThreshold_(ProtobufCodecLite::kDefaultCompressionThreshold),
+    streamWindow_(0),
+    streamHighWaterMark_(0),
+    workerThreads_(0),
+    arenaBlockSize_(0),
+    executor_("RpcServerWorker")
 {
   server_.setConnectionCallback(
       boost::bind(&RpcServer::onConnection, this, _1));
@@ -35,8 +43,18 @@ void RpcServer::registerService(google::protobuf::Service* service)
   services_[desc->full_name()] = service;
 }
 
+void RpcServer::registerStreamHandler(const google::protobuf::MethodDescriptor* method,
+                                      const RpcStreamHandler& handler)
+{
+  streamHandlers_[method->full_name()] = handler;
+}
+
 void RpcServer::start()
 {
+  if (workerThreads_ > 0)
+  {
+    executor_.start(workerThreads_);
+  }
   server_.start();
 }
 
@@ -49,14 +67,34 @@ void RpcServer::onConnection(const TcpConnectionPtr& conn)
   {
     RpcChannelPtr channel(new RpcChannel(conn));
     channel->setServices(&services_);
+    channel->setChecksumType(checksumType_);
+    channel->setCompression(compressionType_, compressionThreshold_);
+    channel->setStreamHandlers(&streamHandlers_);
+    channel->setArenaBlockSize(arenaBlockSize_);
+    if (executor_.started())
+    {
+      channel->setExecutor(&executor_);
+    }
+    if (streamWindow_ > 0)
+    {
+      channel->setStreamWindow(streamWindow_);
+    }
+    if (streamHighWaterMark_ > 0)
+    {
+      channel->setStreamHighWaterMark(streamHighWaterMark_);
+    }
     conn->setMessageCallback(
         boost::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
     conn->setContext(channel);
   }
   else
   {
+    RpcChannelPtr channel(boost::any_cast<const RpcChannelPtr&>(conn->getContext()));
+    if (channel)
+    {
+      channel->onDisconnected(conn);
+    }
     conn->setContext(RpcChannelPtr());
-    // FIXME:
   }
 }
 
@@ -12,10 +12,14 @@
 #define MUDUO_NET_PROTORPC_RPCSERVER_H
 
 #include <muduo/net/TcpServer.h>
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+#include <muduo/net/protorpc/RpcExecutor.h>
+#include <muduo/net/protorpc/RpcStream.h>
 
 namespace google {
 namespace protobuf {
 
+class MethodDescriptor;
 class Service;
 
 }  // namespace protobuf
@@ -37,7 +41,74 @@ class RpcServer
     server_.setThreadNum(numThreads);
   }
 
+  /// Of every connection, see RpcChannel::setChecksumType().
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    checksumType_ = type;
+  }
+
+  /// Of every connection, see RpcChannel::setCompression().
+  void setCompression(ProtobufCodecLite::CompressionType type,
+                      int minBytes = ProtobufCodecLite::kDefaultCompressionThreshold)
+  {
+    compressionType_ = type;
+    compressionThreshold_ = minBytes;
+  }
+
+  /// Of every connection, see RpcChannel::setStreamWindow().
+  void setStreamWindow(int messages)
+  {
+    streamWindow_ = messages;
+  }
+
+  /// Of every connection, see RpcChannel::setStreamHighWaterMark().
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    streamHighWaterMark_ = bytes;
+  }
+
+  /// Calls of services run in numThreads worker threads, instead of the
+  /// loops of connections, which only read requests and send responses.
+  /// 0 for none, the default.  Before start().
+  void setWorkerThreadNum(int numThreads)
+  {
+    workerThreads_ = numThreads;
+  }
+
+  /// At most maxConcurrency calls of method run in the worker threads at
+  /// a time, and maxQueue more wait, others fail with SERVER_BUSY.
+  /// Before start(), see RpcExecutor.
+  void setMethodLimit(const ::google::protobuf::MethodDescriptor* method,
+                      int maxConcurrency,
+                      int maxQueue)
+  {
+    executor_.setMethodLimit(method, maxConcurrency, maxQueue);
+  }
+
+  /// Of methods without their own limit.
+  void setDefaultMethodLimit(int maxConcurrency, int maxQueue)
+  {
+    executor_.setDefaultLimit(maxConcurrency, maxQueue);
+  }
+
+  /// A cheap method runs in the loop of its connection, even with worker
+  /// threads.  Before start().
+  void setInlineMethod(const ::google::protobuf::MethodDescriptor* method)
+  {
+    executor_.setInline(method);
+  }
+
+  /// Of every connection, see RpcChannel::setArenaBlockSize().
+  void setArenaBlockSize(size_t bytes)
+  {
+    arenaBlockSize_ = bytes;
+  }
+
   void registerService(::google::protobuf::Service*);
+  /// Calls of method open an RpcStream, which handler takes in the loop
+  /// of the connection.  Before start().
+  void registerStreamHandler(const ::google::protobuf::MethodDescriptor* method,
+                             const RpcStreamHandler& handler);
   void start();
 
  private:
@@ -49,6 +120,16 @@ class RpcServer
 
   TcpServer server_;
   std::map<std::string, ::google::protobuf::Service*> services_;
+  std::map<std::string, RpcStreamHandler> streamHandlers_;
+  ProtobufCodecLite::ChecksumType checksumType_;
+  ProtobufCodecLite::CompressionType compressionType_;
+  int compressionThreshold_;
+  int streamWindow_;
+  size_t streamHighWaterMark_;
+  int workerThreads_;
+  size_t arenaBlockSize_;
+  // stops before server_, so no call is left running
+  RpcExecutor executor_;
 };
 
 }
@@ -0,0 +1,75 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcStream.h>
+
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcStream::RpcStream(RpcChannel* channel,
+                     int64_t id,
+                     bool client,
+                     const ::google::protobuf::MethodDescriptor* method,
+                     int window)
+  : channel_(channel),
+    id_(id),
+    client_(client),
+    method_(method),
+    prototype_(::google::protobuf::MessageFactory::generated_factory()->GetPrototype(
+        client ? method->output_type() : method->input_type())),
+    window_(window),
+    sendCredits_(0),
+    recvCredits_(window),
+    consumed_(0),
+    localClosed_(false),
+    remoteClosed_(false),
+    blocked_(false)
+{
+  assert(prototype_ != NULL);
+}
+
+RpcStream::~RpcStream()
+{
+}
+
+bool RpcStream::writable() const
+{
+  return channel_ != NULL
+      && !localClosed_
+      && sendCredits_ > 0
+      && !channel_->congested();
+}
+
+bool RpcStream::write(const ::google::protobuf::Message& message)
+{
+  if (!writable())
+  {
+    blocked_ = channel_ != NULL && !localClosed_;
+    return false;
+  }
+  --sendCredits_;
+  channel_->sendStreamFrame(*this, &message, 0, false, NO_ERROR);
+  if (!writable())
+  {
+    blocked_ = true;
+  }
+  return true;
+}
+
+void RpcStream::close(ErrorCode error)
+{
+  if (channel_ != NULL)
+  {
+    channel_->closeStream(shared_from_this(), error);
+  }
+}
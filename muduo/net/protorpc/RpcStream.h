@@ -0,0 +1,140 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCSTREAM_H
+#define MUDUO_NET_PROTORPC_RPCSTREAM_H
+
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace google
+{
+namespace protobuf
+{
+class MethodDescriptor;
+}
+}
+
+namespace muduo
+{
+namespace net
+{
+
+class RpcChannel;
+class RpcStream;
+typedef boost::shared_ptr<RpcStream> RpcStreamPtr;
+
+/// Takes a stream opened by the client, request is NULL if it sent none.
+typedef boost::function<void (const RpcStreamPtr& stream,
+                              const MessagePtr& request)> RpcStreamHandler;
+
+/// One streaming call, many messages each way on an RpcChannel.
+///
+/// The client opens it with RpcChannel::openStream(), and may send a
+/// request with it, the server takes it in the handler given to
+/// RpcServer::registerStreamHandler().  Then each side writes messages
+/// of its output type, ie. method->output_type() for the server, and
+/// closes its side.  A server-streaming call is the server writing many
+/// responses, a client-streaming call is the client writing many
+/// requests, and the server writing one response after they end.
+///
+/// Flow control: a side writes only as many messages as the other side
+/// has given credits for, which it gives back as its message callback
+/// returns, and only while the output buffer of the connection is below
+/// the high-water mark of the channel.  So both sides hold a bounded
+/// number of messages, whatever the size of the whole result.
+///
+/// Not thread safe, all member functions and callbacks are in the loop
+/// of the connection.
+class RpcStream : boost::noncopyable,
+                  public boost::enable_shared_from_this<RpcStream>
+{
+ public:
+  /// message is NULL when the other side has closed.
+  typedef boost::function<void (const RpcStreamPtr&,
+                                const MessagePtr&)> MessageCallback;
+  /// Runs once, when both sides have closed, or either failed.
+  typedef boost::function<void (const RpcStreamPtr&,
+                                ErrorCode)> CloseCallback;
+  /// Runs when writable() turns true after a write() failed, or left it
+  /// false.
+  typedef boost::function<void (const RpcStreamPtr&)> WritableCallback;
+
+  ~RpcStream();
+
+  int64_t id() const
+  { return id_; }
+
+  const ::google::protobuf::MethodDescriptor* method() const
+  { return method_; }
+
+  void setMessageCallback(const MessageCallback& cb)
+  { messageCallback_ = cb; }
+
+  void setCloseCallback(const CloseCallback& cb)
+  { closeCallback_ = cb; }
+
+  void setWritableCallback(const WritableCallback& cb)
+  { writableCallback_ = cb; }
+
+  /// Whether write() sends now.
+  bool writable() const;
+
+  /// Sends message if writable(), returns false otherwise, and the
+  /// WritableCallback tells when to try again.
+  bool write(const ::google::protobuf::Message& message);
+
+  /// No more writes from this side, the stream closes when the other
+  /// side closes too.  An error other than NO_ERROR fails both sides,
+  /// the client can cancel the call with CANCELED.
+  void close(ErrorCode error = NO_ERROR);
+
+  /// Whether close() was called, or the stream is done.
+  bool writeClosed() const
+  { return localClosed_; }
+
+  bool done() const
+  { return channel_ == NULL; }
+
+ private:
+  friend class RpcChannel;
+
+  RpcStream(RpcChannel* channel,
+            int64_t id,
+            bool client,
+            const ::google::protobuf::MethodDescriptor* method,
+            int window);
+
+  RpcChannel* channel_;  // NULL when done
+  const int64_t id_;
+  const bool client_;
+  const ::google::protobuf::MethodDescriptor* method_;
+  const ::google::protobuf::Message* prototype_;  // of messages read
+  const int window_;
+  int sendCredits_;  // messages the peer takes
+  int recvCredits_;  // messages the peer may send
+  int consumed_;     // messages read, not given back as credits yet
+  bool localClosed_;
+  bool remoteClosed_;
+  bool blocked_;  // writable() was false, the WritableCallback is due
+  MessageCallback messageCallback_;
+  CloseCallback closeCallback_;
+  WritableCallback writableCallback_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCSTREAM_H
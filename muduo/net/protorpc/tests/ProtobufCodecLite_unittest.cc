@@ -0,0 +1,234 @@
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+
+//#define BOOST_TEST_MODULE ProtobufCodecLiteTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// ProtobufCodecLite with a ThreadPool, a server and a client in one loop,
+// over loopback.
+
+namespace
+{
+
+// of the pid, below the ephemeral ports, so concurrent runs do not collide
+const uint16_t kPort = static_cast<uint16_t>(10000 + ::getpid() % 20000);
+const int kMessages = 2000;
+const char kTag[] = "RPC0";
+
+// The server echoes every message, decoded and encoded in the pool with
+// little room for each connection, so reading from it stops and its
+// sends report it is behind, without blocking the loop.  The client sees the echoes with a raw callback, which
+// must run in the loop, and checks their order.
+class EchoTest : boost::noncopyable
+{
+ public:
+  explicit EchoTest(EventLoop* loop)
+    : loop_(loop),
+      server_(loop, InetAddress(kPort), "EchoTest"),
+      client_(loop, InetAddress("127.0.0.1", kPort), "EchoTest"),
+      serverCodec_(&RpcMessage::default_instance(), kTag,
+                   boost::bind(&EchoTest::onServerMessage, this, _1, _2, _3)),
+      clientCodec_(&RpcMessage::default_instance(), kTag,
+                   boost::bind(&EchoTest::onClientMessage, this, _1, _2, _3),
+                   boost::bind(&EchoTest::onRawMessage, this, _1, _2, _3)),
+      pool_("EchoTest"),
+      received_(0),
+      rawInLoop_(0),
+      outOfOrder_(0),
+      behind_(0)
+  {
+    pool_.start(2);
+    serverCodec_.setThreadPool(&pool_, 1024);
+    clientCodec_.setThreadPool(&pool_);
+    server_.setMessageCallback(
+        boost::bind(&ProtobufCodecLite::onMessage, &serverCodec_, _1, _2, _3));
+    client_.setConnectionCallback(
+        boost::bind(&EchoTest::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&ProtobufCodecLite::onMessage, &clientCodec_, _1, _2, _3));
+  }
+
+  ~EchoTest()
+  {
+    pool_.stop();
+  }
+
+  void run()
+  {
+    server_.start();
+    client_.connect();
+  }
+
+  int received() const { return received_; }
+  int rawInLoop() const { return rawInLoop_; }
+  int outOfOrder() const { return outOfOrder_; }
+  int behind() const { return behind_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      for (int i = 0; i < kMessages; ++i)
+      {
+        boost::shared_ptr<RpcMessage> message(new RpcMessage);
+        message->set_type(REQUEST);
+        message->set_id(i);
+        message->set_request(std::string(i % 997, 'x'));
+        clientCodec_.send(conn, message);
+      }
+    }
+  }
+
+  void onServerMessage(const TcpConnectionPtr& conn, const MessagePtr& message, Timestamp)
+  {
+    if (!serverCodec_.send(conn, message))
+    {
+      ++behind_;
+    }
+  }
+
+  bool onRawMessage(const TcpConnectionPtr&, StringPiece, Timestamp)
+  {
+    if (loop_->isInLoopThread())
+    {
+      ++rawInLoop_;
+    }
+    return true;
+  }
+
+  void onClientMessage(const TcpConnectionPtr&, const MessagePtr& message, Timestamp)
+  {
+    boost::shared_ptr<RpcMessage> echo = down_pointer_cast<RpcMessage>(message);
+    if (echo->id() != static_cast<uint64_t>(received_)
+        || echo->request().size() != static_cast<size_t>(received_ % 997))
+    {
+      ++outOfOrder_;
+    }
+    if (++received_ == kMessages)
+    {
+      loop_->quit();
+    }
+  }
+
+  EventLoop* loop_;
+  TcpServer server_;
+  TcpClient client_;
+  ProtobufCodecLite serverCodec_;
+  ProtobufCodecLite clientCodec_;
+  ThreadPool pool_;
+  int received_;
+  int rawInLoop_;
+  int outOfOrder_;
+  int behind_;
+};
+
+// The client sends an invalid length, then more bytes, which must not be
+// reported again.
+class InvalidLengthTest : boost::noncopyable
+{
+ public:
+  explicit InvalidLengthTest(EventLoop* loop)
+    : loop_(loop),
+      server_(loop, InetAddress(kPort), "InvalidLengthTest"),
+      client_(loop, InetAddress("127.0.0.1", kPort), "InvalidLengthTest"),
+      codec_(&RpcMessage::default_instance(), kTag,
+             ProtobufCodecLite::ProtobufMessageCallback(),
+             ProtobufCodecLite::RawMessageCallback(),
+             boost::bind(&InvalidLengthTest::onError, this, _1, _2, _3, _4)),
+      pool_("InvalidLengthTest"),
+      errors_(0)
+  {
+    pool_.start(1);
+    codec_.setThreadPool(&pool_);
+    server_.setMessageCallback(
+        boost::bind(&ProtobufCodecLite::onMessage, &codec_, _1, _2, _3));
+    client_.setConnectionCallback(
+        boost::bind(&InvalidLengthTest::onConnection, this, _1));
+  }
+
+  ~InvalidLengthTest()
+  {
+    pool_.stop();
+  }
+
+  void run()
+  {
+    server_.start();
+    client_.connect();
+  }
+
+  int errors() const { return errors_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      sendGarbage(conn);
+      loop_->runAfter(0.1, boost::bind(&InvalidLengthTest::sendGarbage, conn));
+      loop_->runAfter(0.3, boost::bind(&EventLoop::quit, loop_));
+    }
+  }
+
+  static void sendGarbage(const TcpConnectionPtr& conn)
+  {
+    Buffer buf;
+    buf.appendInt32(-1);
+    buf.append(std::string(100, 'x'));
+    conn->send(&buf);
+  }
+
+  void onError(const TcpConnectionPtr&, Buffer*, Timestamp, ProtobufCodecLite::ErrorCode)
+  {
+    ++errors_;
+  }
+
+  EventLoop* loop_;
+  TcpServer server_;
+  TcpClient client_;
+  ProtobufCodecLite codec_;
+  ThreadPool pool_;
+  int errors_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testThreadPoolKeepsOrder)
+{
+  EventLoop loop;
+  EchoTest test(&loop);
+  test.run();
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.received(), kMessages);
+  BOOST_CHECK_EQUAL(test.rawInLoop(), kMessages);
+  BOOST_CHECK_EQUAL(test.outOfOrder(), 0);
+  BOOST_CHECK_GT(test.behind(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testInvalidLengthReportedOnce)
+{
+  EventLoop loop;
+  InvalidLengthTest test(&loop);
+  test.run();
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.errors(), 1);
+}
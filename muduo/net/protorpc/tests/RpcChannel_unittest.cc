@@ -0,0 +1,623 @@
+#include <muduo/net/protorpc/rpctest.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Thread.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcController.h>
+#include <muduo/net/protorpc/RpcExecutor.h>
+#include <muduo/net/protorpc/RpcServer.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+//#define BOOST_TEST_MODULE RpcChannelTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// A server and a client of RpcChannel in one loop, over loopback.
+
+namespace
+{
+
+// of the pid, below the ephemeral ports, so concurrent runs do not collide
+const uint16_t kPort = static_cast<uint16_t>(10000 + ::getpid() % 20000);
+const int kWindow = 4;
+const int kMessages = 100;
+const int kCalls = 4;
+
+// Echo replies at once, Hold keeps done for the test to run.
+class EchoServiceImpl : public rpctest::EchoService
+{
+ public:
+  EchoServiceImpl()
+    : held(NULL)
+  {
+  }
+
+  virtual void Echo(::google::protobuf::RpcController*,
+                    const rpctest::EchoRequest* request,
+                    rpctest::EchoResponse* response,
+                    ::google::protobuf::Closure* done)
+  {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+
+  virtual void Hold(::google::protobuf::RpcController*,
+                    const rpctest::EchoRequest* request,
+                    rpctest::EchoResponse* response,
+                    ::google::protobuf::Closure* done)
+  {
+    response->set_payload(request->payload());
+    held = done;
+    if (heldCallback)
+    {
+      heldCallback();
+    }
+  }
+
+  ::google::protobuf::Closure* held;
+  boost::function<void ()> heldCallback;
+};
+
+class Client : boost::noncopyable
+{
+ public:
+  typedef boost::function<void ()> Callback;
+
+  explicit Client(EventLoop* loop)
+    : client_(loop, InetAddress("127.0.0.1", kPort), "RpcChannelTest"),
+      channel_(new RpcChannel),
+      stub_(get_pointer(channel_))
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Client::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+  }
+
+  void connect(const Callback& connectedCb, const Callback& disconnectedCb)
+  {
+    connectedCallback_ = connectedCb;
+    disconnectedCallback_ = disconnectedCb;
+    client_.connect();
+  }
+
+  void disconnect()
+  {
+    client_.disconnect();
+  }
+
+  rpctest::EchoService::Stub& stub()
+  { return stub_; }
+
+  RpcChannel* channel()
+  { return get_pointer(channel_); }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      channel_->setConnection(conn);
+      connectedCallback_();
+    }
+    else
+    {
+      channel_->onDisconnected(conn);
+      if (disconnectedCallback_)
+      {
+        disconnectedCallback_();
+      }
+    }
+  }
+
+  TcpClient client_;
+  RpcChannelPtr channel_;
+  rpctest::EchoService::Stub stub_;
+  Callback connectedCallback_;
+  Callback disconnectedCallback_;
+};
+
+void runInThread(::google::protobuf::Closure* done)
+{
+  Thread thread(boost::bind(&::google::protobuf::Closure::Run, done));
+  thread.start();
+  thread.join();
+}
+
+// The server replies to Hold on a recycled arena, from another thread,
+// while connected, then again after the connection and its channel are
+// gone, which must only free the arena.
+class ArenaDoneTest : boost::noncopyable
+{
+ public:
+  ArenaDoneTest(EventLoop* loop, EchoServiceImpl* service)
+    : loop_(loop),
+      service_(service),
+      client_(loop),
+      held_(0),
+      secondReplied_(false)
+  {
+  }
+
+  void run()
+  {
+    client_.connect(boost::bind(&ArenaDoneTest::holdFirst, this),
+                    boost::bind(&ArenaDoneTest::replySecond, this));
+  }
+
+  std::string firstPayload() const { return firstPayload_; }
+  bool secondReplied() const { return secondReplied_; }
+
+ private:
+  void call(const char* payload, void (ArenaDoneTest::*replied)(rpctest::EchoResponse*))
+  {
+    rpctest::EchoRequest request;
+    request.set_payload(payload);
+    rpctest::EchoResponse* response = new rpctest::EchoResponse;
+    client_.stub().Hold(NULL, &request, response, NewCallback(this, replied, response));
+  }
+
+  void holdFirst()
+  {
+    service_->heldCallback = boost::bind(&ArenaDoneTest::onHeld, this);
+    call("first", &ArenaDoneTest::firstReplied);
+  }
+
+  // in Hold, the next step runs after it
+  void onHeld()
+  {
+    if (++held_ == 1)
+    {
+      loop_->queueInLoop(boost::bind(&ArenaDoneTest::replyFirst, this));
+    }
+    else
+    {
+      loop_->queueInLoop(boost::bind(&Client::disconnect, &client_));
+    }
+  }
+
+  void replyFirst()
+  {
+    runInThread(service_->held);
+  }
+
+  void firstReplied(rpctest::EchoResponse* response)
+  {
+    firstPayload_ = response->payload();
+    call("second", &ArenaDoneTest::secondReplied);
+  }
+
+  // the channel of the server is gone before the client sees the close
+  void replySecond()
+  {
+    runInThread(service_->held);
+    loop_->queueInLoop(boost::bind(&EventLoop::quit, loop_));
+  }
+
+  void secondReplied(rpctest::EchoResponse*)
+  {
+    secondReplied_ = true;
+  }
+
+  EventLoop* loop_;
+  EchoServiceImpl* service_;
+  Client client_;
+  int held_;
+  std::string firstPayload_;
+  bool secondReplied_;
+};
+
+// Cancels a call held by the server from another thread, then lets the
+// next one time out.
+class CancelTest : boost::noncopyable
+{
+ public:
+  CancelTest(EventLoop* loop, EchoServiceImpl* service)
+    : loop_(loop),
+      service_(service),
+      client_(loop),
+      held_(0),
+      canceledError_(NO_ERROR),
+      timedOutError_(NO_ERROR)
+  {
+  }
+
+  void run()
+  {
+    client_.connect(boost::bind(&CancelTest::holdToCancel, this),
+                    Client::Callback());
+  }
+
+  ErrorCode canceledError() const { return canceledError_; }
+  ErrorCode timedOutError() const { return timedOutError_; }
+
+ private:
+  void call(void (CancelTest::*replied)(rpctest::EchoResponse*))
+  {
+    rpctest::EchoRequest request;
+    request.set_payload("held");
+    rpctest::EchoResponse* response = new rpctest::EchoResponse;
+    client_.stub().Hold(&controller_, &request, response, NewCallback(this, replied, response));
+  }
+
+  void holdToCancel()
+  {
+    service_->heldCallback = boost::bind(&CancelTest::onHeld, this);
+    call(&CancelTest::canceled);
+  }
+
+  void onHeld()
+  {
+    if (++held_ == 1)
+    {
+      loop_->queueInLoop(boost::bind(&CancelTest::cancelInThread, this));
+    }
+  }
+
+  void cancelInThread()
+  {
+    Thread thread(boost::bind(&RpcController::StartCancel, &controller_));
+    thread.start();
+    thread.join();
+  }
+
+  void canceled(rpctest::EchoResponse*)
+  {
+    canceledError_ = controller_.errorCode();
+    // the late response is dropped
+    service_->held->Run();
+    controller_.Reset();
+    controller_.setTimeout(0.05);
+    call(&CancelTest::timedOut);
+  }
+
+  void timedOut(rpctest::EchoResponse*)
+  {
+    timedOutError_ = controller_.errorCode();
+    service_->held->Run();
+    loop_->quit();
+  }
+
+  EventLoop* loop_;
+  EchoServiceImpl* service_;
+  Client client_;
+  RpcController controller_;
+  int held_;
+  ErrorCode canceledError_;
+  ErrorCode timedOutError_;
+};
+
+// Hold takes one call at a time in the workers, and queues one more.  Of
+// three calls at once, the third fails with SERVER_BUSY, and a call after
+// the first two are done is served again.
+class BusyTest : boost::noncopyable
+{
+ public:
+  BusyTest(EventLoop* loop, EchoServiceImpl* service)
+    : loop_(loop),
+      service_(service),
+      client_(loop),
+      held_(0),
+      replied_(0)
+  {
+    for (int i = 0; i < kCalls; ++i)
+    {
+      errors_[i] = UNAVAILABLE;
+    }
+  }
+
+  void run()
+  {
+    client_.connect(boost::bind(&BusyTest::saturate, this),
+                    Client::Callback());
+  }
+
+  ErrorCode error(int i) const { return errors_[i]; }
+  int replied() const { return replied_; }
+
+ private:
+  void call(int i)
+  {
+    rpctest::EchoRequest request;
+    request.set_payload("held");
+    rpctest::EchoResponse* response = new rpctest::EchoResponse;
+    client_.stub().Hold(&controllers_[i], &request, response,
+                        NewCallback(this, &BusyTest::replied, i, response));
+  }
+
+  void saturate()
+  {
+    service_->heldCallback = boost::bind(&BusyTest::onHeld, this);
+    call(0);
+    call(1);
+    call(2);
+  }
+
+  // in a worker thread
+  void onHeld()
+  {
+    loop_->queueInLoop(boost::bind(&BusyTest::release, this));
+  }
+
+  void release()
+  {
+    service_->held->Run();
+    if (++held_ == 2)
+    {
+      // the first two are done
+      call(3);
+    }
+  }
+
+  // the channel deletes the response after this
+  void replied(int i, rpctest::EchoResponse*)
+  {
+    errors_[i] = controllers_[i].errorCode();
+    if (++replied_ == kCalls)
+    {
+      loop_->quit();
+    }
+  }
+
+  EventLoop* loop_;
+  EchoServiceImpl* service_;
+  Client client_;
+  RpcController controllers_[kCalls];
+  ErrorCode errors_[kCalls];
+  int held_;
+  int replied_;
+};
+
+// The server writes kMessages on a stream, as fast as credits of the
+// client let it, then holds a second stream open, which both sides must
+// see fail when the client disconnects.
+class StreamTest : boost::noncopyable
+{
+ public:
+  explicit StreamTest(EventLoop* loop)
+    : loop_(loop),
+      client_(loop),
+      written_(0),
+      received_(0),
+      maxAhead_(0),
+      firstBurst_(-1),
+      blocked_(0),
+      exportError_(UNAVAILABLE),
+      serverHoldError_(NO_ERROR),
+      clientHoldError_(NO_ERROR)
+  {
+    client_.channel()->setStreamWindow(kWindow);
+  }
+
+  void run()
+  {
+    client_.connect(boost::bind(&StreamTest::startExport, this),
+                    boost::bind(&EventLoop::quit, loop_));
+  }
+
+  // the server side
+  void onExport(const RpcStreamPtr& stream, const MessagePtr& request)
+  {
+    boost::shared_ptr<rpctest::EchoRequest> echo
+        = down_pointer_cast<rpctest::EchoRequest>(request);
+    if (echo && echo->payload() == "hold")
+    {
+      stream->setCloseCallback(boost::bind(&StreamTest::serverHoldClosed, this, _1, _2));
+      heldStream_ = stream;
+      loop_->queueInLoop(boost::bind(&Client::disconnect, &client_));
+      return;
+    }
+    stream->setWritableCallback(boost::bind(&StreamTest::writeAll, this, _1));
+    writeAll(stream);
+  }
+
+  int received() const { return received_; }
+  int maxAhead() const { return maxAhead_; }
+  int firstBurst() const { return firstBurst_; }
+  int blocked() const { return blocked_; }
+  ErrorCode exportError() const { return exportError_; }
+  ErrorCode serverHoldError() const { return serverHoldError_; }
+  ErrorCode clientHoldError() const { return clientHoldError_; }
+
+ private:
+  RpcStreamPtr open(const char* payload,
+                    void (StreamTest::*closed)(const RpcStreamPtr&, ErrorCode))
+  {
+    rpctest::EchoRequest request;
+    request.set_payload(payload);
+    RpcStreamPtr s = client_.channel()->openStream(
+        rpctest::EchoService::descriptor()->FindMethodByName("Export"),
+        &request,
+        boost::bind(&StreamTest::onMessage, this, _1, _2),
+        boost::bind(closed, this, _1, _2));
+    s->close();
+    return s;
+  }
+
+  void startExport()
+  {
+    open("export", &StreamTest::exportClosed);
+  }
+
+  void writeAll(const RpcStreamPtr& s)
+  {
+    rpctest::EchoResponse response;
+    while (written_ < kMessages && s->writable())
+    {
+      response.set_payload("x");
+      BOOST_CHECK(s->write(response));
+      ++written_;
+      maxAhead_ = std::max(maxAhead_, written_ - received_);
+    }
+    if (written_ < kMessages)
+    {
+      if (firstBurst_ < 0)
+      {
+        firstBurst_ = written_;
+      }
+      ++blocked_;
+      BOOST_CHECK(!s->write(response));
+    }
+    else if (!s->writeClosed())
+    {
+      s->close();
+    }
+  }
+
+  void onMessage(const RpcStreamPtr&, const MessagePtr& message)
+  {
+    if (message)
+    {
+      ++received_;
+    }
+  }
+
+  void exportClosed(const RpcStreamPtr&, ErrorCode error)
+  {
+    exportError_ = error;
+    open("hold", &StreamTest::clientHoldClosed);
+  }
+
+  void serverHoldClosed(const RpcStreamPtr&, ErrorCode error)
+  {
+    serverHoldError_ = error;
+    heldStream_.reset();
+  }
+
+  void clientHoldClosed(const RpcStreamPtr&, ErrorCode error)
+  {
+    clientHoldError_ = error;
+  }
+
+  EventLoop* loop_;
+  Client client_;
+  int written_;
+  int received_;
+  int maxAhead_;    // messages written, not read yet
+  int firstBurst_;  // written before the first block
+  int blocked_;
+  ErrorCode exportError_;
+  ErrorCode serverHoldError_;
+  ErrorCode clientHoldError_;
+  RpcStreamPtr heldStream_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testArenaDoneInAnyThread)
+{
+  EventLoop loop;
+  EchoServiceImpl service;
+  RpcServer server(&loop, InetAddress(kPort));
+  server.registerService(&service);
+  server.setArenaBlockSize(1024);
+  server.start();
+
+  ArenaDoneTest test(&loop, &service);
+  test.run();
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.firstPayload(), "first");
+  BOOST_CHECK(!test.secondReplied());
+}
+
+BOOST_AUTO_TEST_CASE(testCancelAndTimeout)
+{
+  EventLoop loop;
+  EchoServiceImpl service;
+  RpcServer server(&loop, InetAddress(kPort));
+  server.registerService(&service);
+  server.start();
+
+  CancelTest test(&loop, &service);
+  test.run();
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.canceledError(), CANCELED);
+  BOOST_CHECK_EQUAL(test.timedOutError(), TIMEOUT);
+}
+
+BOOST_AUTO_TEST_CASE(testExecutorLimit)
+{
+  const google::protobuf::MethodDescriptor* hold =
+      rpctest::EchoService::descriptor()->FindMethodByName("Hold");
+  RpcExecutor executor;
+  executor.setMethodLimit(hold, 1, 1);
+  executor.start(2);
+
+  // a call keeps its slot until finish()
+  CountDownLatch ran(3);
+  RpcExecutor::Task task(boost::bind(&CountDownLatch::countDown, &ran));
+  BOOST_CHECK(executor.submit(hold, task));
+  BOOST_CHECK(executor.submit(hold, task));
+  BOOST_CHECK(!executor.submit(hold, task));
+  // the second runs, then none
+  executor.finish(hold);
+  executor.finish(hold);
+  BOOST_CHECK(executor.submit(hold, task));
+  ran.wait();
+  executor.finish(hold);
+  executor.stop();
+}
+
+BOOST_AUTO_TEST_CASE(testMethodLimit)
+{
+  EventLoop loop;
+  EchoServiceImpl service;
+  RpcServer server(&loop, InetAddress(kPort));
+  server.registerService(&service);
+  server.setWorkerThreadNum(2);
+  server.setMethodLimit(rpctest::EchoService::descriptor()->FindMethodByName("Hold"), 1, 1);
+  server.start();
+
+  BusyTest test(&loop, &service);
+  test.run();
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.replied(), kCalls);
+  BOOST_CHECK_EQUAL(test.error(0), NO_ERROR);
+  BOOST_CHECK_EQUAL(test.error(1), NO_ERROR);
+  BOOST_CHECK_EQUAL(test.error(2), SERVER_BUSY);
+  BOOST_CHECK_EQUAL(test.error(3), NO_ERROR);
+}
+
+BOOST_AUTO_TEST_CASE(testStreamCreditsAndDisconnect)
+{
+  EventLoop loop;
+  EchoServiceImpl service;
+  RpcServer server(&loop, InetAddress(kPort));
+  StreamTest test(&loop);
+  server.registerService(&service);
+  server.registerStreamHandler(
+      rpctest::EchoService::descriptor()->FindMethodByName("Export"),
+      boost::bind(&StreamTest::onExport, &test, _1, _2));
+  server.start();
+
+  test.run();
+  loop.runAfter(10.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(test.exportError(), NO_ERROR);
+  BOOST_CHECK_EQUAL(test.received(), kMessages);
+  // never more than the window ahead of the reader, and blocked on it
+  BOOST_CHECK_EQUAL(test.firstBurst(), kWindow);
+  BOOST_CHECK_EQUAL(test.maxAhead(), kWindow);
+  BOOST_CHECK_GT(test.blocked(), 1);
+  BOOST_CHECK_EQUAL(test.serverHoldError(), UNAVAILABLE);
+  BOOST_CHECK_EQUAL(test.clientHoldError(), UNAVAILABLE);
+}
@@ -6,6 +6,8 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+
 #include <stdio.h>
 
 BOOST_AUTO_TEST_CASE(testZlibOutputStream)
@@ -89,3 +91,67 @@ BOOST_AUTO_TEST_CASE(testZlibOutputStream5)
   printf("total %zd\n", output.readableBytes());
   BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_STREAM_END);
 }
+
+BOOST_AUTO_TEST_CASE(testZlibInputStream)
+{
+  muduo::net::Buffer compressed;
+  muduo::string input;
+  for (int i = 0; i < 100000; ++i)
+  {
+    input += "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_-"[rand() % 64];
+  }
+  {
+    muduo::net::ZlibOutputStream stream(&compressed);
+    BOOST_CHECK(stream.write(input));
+  }
+
+  muduo::net::Buffer output;
+  muduo::net::ZlibInputStream stream(&output);
+  // a few bytes at a time
+  muduo::string data = compressed.retrieveAllAsString();
+  for (size_t i = 0; i < data.size(); i += 7)
+  {
+    BOOST_CHECK(stream.write(muduo::StringPiece(data.data() + i,
+                                                static_cast<int>(std::min<size_t>(7, data.size() - i)))));
+  }
+  BOOST_CHECK_EQUAL(stream.zlibErrorCode(), Z_STREAM_END);
+  BOOST_CHECK(stream.finish());
+  BOOST_CHECK(output.retrieveAllAsString() == input);
+}
+
+BOOST_AUTO_TEST_CASE(testZlibInputStreamTruncated)
+{
+  muduo::net::Buffer compressed;
+  {
+    muduo::net::ZlibOutputStream stream(&compressed);
+    BOOST_CHECK(stream.write("01234567890123456789012345678901234567890123456789"));
+  }
+  compressed.unwrite(1);
+  muduo::net::Buffer output;
+  muduo::net::ZlibInputStream stream(&output);
+  BOOST_CHECK(stream.write(&compressed));
+  BOOST_CHECK(!stream.finish());
+}
+
+BOOST_AUTO_TEST_CASE(testZlibStreamReset)
+{
+  muduo::net::Buffer idle;
+  muduo::net::ZlibOutputStream deflater(&idle, Z_BEST_SPEED);
+  muduo::net::ZlibInputStream inflater(&idle);
+  for (int i = 0; i < 3; ++i)
+  {
+    muduo::string input(1000 * (i+1), static_cast<char>('a' + i));
+    muduo::net::Buffer compressed;
+    BOOST_CHECK(deflater.reset(&compressed));
+    BOOST_CHECK(deflater.write(input));
+    BOOST_CHECK(deflater.finishStream());
+    BOOST_CHECK_EQUAL(deflater.inputBytes(), static_cast<int64_t>(input.size()));
+    BOOST_CHECK_EQUAL(deflater.outputBytes(), static_cast<int64_t>(compressed.readableBytes()));
+
+    muduo::net::Buffer output;
+    BOOST_CHECK(inflater.reset(&output));
+    BOOST_CHECK(inflater.write(&compressed));
+    BOOST_CHECK_EQUAL(inflater.zlibErrorCode(), Z_STREAM_END);
+    BOOST_CHECK(output.retrieveAllAsString() == input);
+  }
+}